@@ -19,6 +19,9 @@ int main( int argc, char **argv )
   std::cout << " Ws =          " << Ws << std::endl;
   std::cout << " Ws.Ws = " << inner(Ws,Ws) << std::endl << std::endl;
   std::cout << " Ws.Ws = " << simplify(inner(Ws,Ws)) << std::endl << std::endl;
+  Symath::SymRelations unitW;
+  unitW.add( S("w1")*S("w1") + S("w2")*S("w2") + S("w3")*S("w3"), S(1) );
+  std::cout << " Ws*As, |w| = 1: " << reduce(simplify(Ws*As), unitW) << std::endl << std::endl;
 
   /// Conformal zero vector
   GOsym N0 = GOsym::conformal(S("0"),S("0"),S("0"));
@@ -168,6 +171,15 @@ int main( int argc, char **argv )
   std::cout << " C^D V A^B = "  << meet( CwD, AwB, 3 ) << std::endl;
   std::cout << " C^D V A^B = "  << simplify( meet( CwDs, AwBs, 3 ) ) << std::endl;
   std::cout << std::endl;
+
+  /// C++ source for the meet, one output per basis element
+  std::vector<std::string> abcd;
+  abcd.push_back("a1"); abcd.push_back("a2"); abcd.push_back("a3");
+  abcd.push_back("b1"); abcd.push_back("b2"); abcd.push_back("b3");
+  abcd.push_back("c1"); abcd.push_back("c2"); abcd.push_back("c3");
+  abcd.push_back("d1"); abcd.push_back("d2"); abcd.push_back("d3");
+  emitCpp( std::cout, "meetLines", simplify( meet( AwBs, CwDs, 3 ) ), abcd );
+  std::cout << std::endl;
   
   /// More maths
   std::cout << " C - C = " << Cs - Cs << std::endl;
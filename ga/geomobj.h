@@ -5,7 +5,10 @@
 #ifndef __GEOMETRIC_OBJECT_H
 #define __GEOMETRIC_OBJECT_H
 
+#include <atomic>
 #include <map>
+#include <thread>
+#include <vector>
 #include "vec.h"
 
 //-----------------------------------------------------------------
@@ -849,25 +852,96 @@ template< class T, class B >
 /// Symbolic Geometric Object
 typedef GO<Symath::Sym> GOsym;
 
-/// SIMPLIFY ( symbolic geometric object )
+/// SIMPLIFY ( symbolic geometric object, thread count )
+///   coefficients are independent, they are put in normal form on
+///   [threads] threads (0: one per core).  The result does not depend on
+///   the thread count.
 inline
-GOsym simplify( const GOsym &g )
+GOsym simplify( const GOsym &g, unsigned threads = 0 )
 {
   typedef GOsym GOS;
   typedef GOS::EMapCIter  EMapIter;
 
+  std::vector<EMapIter> items;
+  for ( EMapIter emi = g._coefs.begin(); emi != g._coefs.end(); ++emi )
+    items.push_back( emi );
+  std::vector<Symath::Sym> normal( items.size() );
+
+  if ( threads == 0 ) threads = std::thread::hardware_concurrency();
+  if ( threads > items.size() ) threads = unsigned( items.size() );
+
+  // coefficients vary a lot in cost, threads pull the next one when done
+  std::atomic<size_t> next( 0 );
+  struct Worker {
+    const std::vector<EMapIter> &items;
+    std::vector<Symath::Sym>    &normal;
+    std::atomic<size_t>         &next;
+    void operator()() const
+    {
+      for ( size_t i = next++; i < items.size(); i = next++ )
+	normal[i] = (*items[i]).second.normalForm();
+    }
+  } work = { items, normal, next };
+
+  if ( threads <= 1 )
+    work();
+  else
+    {
+      std::vector<std::thread> pool;
+      for ( unsigned t = 1; t < threads; ++t )
+	pool.push_back( std::thread( work ) );
+      work();
+      for ( size_t t = 0; t < pool.size(); ++t )
+	pool[t].join();
+    }
+
   GOS ret;
+  for ( size_t i = 0; i < items.size(); ++i )
+    if (!( normal[i] == Symath::Sym::zero() ) )
+      ret._coefs[(*items[i]).first] = normal[i];
+
+  return ret;
+}
+
+/// REDUCE ( symbolic geometric object, side relations )
+///   every coefficient modulo |relations| (symreduce.h), zeros dropped
+inline
+GOsym reduce( const GOsym &g, Symath::SymRelations &relations )
+{
+  typedef GOsym::EMapCIter  EMapIter;
 
+  GOsym ret;
   for ( EMapIter emi = g._coefs.begin(); emi != g._coefs.end(); ++emi )
     {
-      Symath::Sym sca = (*emi).second.normalForm();
-      if (!( sca == Symath::Sym::zero() ) )
-	  ret._coefs[(*emi).first] = sca;
+      const Symath::Sym r = relations.reduce( (*emi).second );
+      if (!( r == Symath::Sym::zero() ) )
+	ret._coefs[(*emi).first] = r;
     }
-
   return ret;
 }
 
+/// EMIT C++ ( stream, function name, symbolic geometric object, variables )
+///   writes  inline void name( const double var0, ..., double *out )
+///   out[i] is the coefficient of the i-th basis element of [g] in map
+///   order, each output line is commented with its basis element.
+inline
+std::ostream &emitCpp( std::ostream &os, const std::string &name,
+		       const GOsym &g, const std::vector<std::string> &variables )
+{
+  typedef GOsym::EMapCIter  EMapIter;
+
+  std::vector<Symath::Sym> coefs;
+  std::vector<std::string> labels;
+  for ( EMapIter emi = g._coefs.begin(); emi != g._coefs.end(); ++emi )
+    {
+      std::ostringstream label;
+      label << (*emi).first;
+      coefs.push_back( (*emi).second );
+      labels.push_back( label.str() );
+    }
+
+  return Symath::emitCpp( os, name, coefs, variables, labels );
+}
 
 #endif
 
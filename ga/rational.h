@@ -0,0 +1,633 @@
+/// Arbitrary precision rationals for symbolic numeric leaves.
+///   Rational keeps a pair of 64 bit integers while it can, and promotes
+///   itself to a BigInt numerator/denominator pair when an operation would
+///   overflow.  Always gcd-normalized with a positive denominator.
+
+#ifndef __SYMBOLIC_RATIONAL_H
+#define __SYMBOLIC_RATIONAL_H
+
+#include <cassert>
+#include <cstdlib>
+#include <iostream>
+#include <limits>
+#include <sstream>
+#include <string>
+#include <vector>
+#include "smartptr.h"
+
+namespace Symath {
+
+   /// folds |v| into the running hash |seed|, order sensitive
+   inline size_t hashCombine( size_t seed, size_t v )
+   {
+      return seed ^ (v + size_t(0x9e3779b97f4a7c15ULL) + (seed << 6) + (seed >> 2));
+   }
+
+   ///----------------------------------------------------------
+   //
+   /// signed magnitude integer, base 2^32 limbs, little endian.
+   ///  no leading zero limbs, zero is an empty magnitude (never negative)
+   //
+   class BigInt {
+     public:
+      typedef unsigned int       limb_type;
+      typedef unsigned long long wide_type;
+      typedef std::vector< limb_type > limb_vec;
+
+      BigInt() : _neg(false) {}
+
+      BigInt( long long v ) : _neg(v < 0)
+      {
+	 // negate in unsigned so LLONG_MIN survives
+	 wide_type mag = _neg ? ~wide_type(v) + 1ULL : wide_type(v);
+	 while ( mag )
+	 {
+	    _mag.push_back( limb_type(mag & 0xffffffffULL) );
+	    mag >>= 32;
+	 }
+      }
+
+      /// from a magnitude as returned by limbs()
+      BigInt( const limb_vec &magnitude, bool negative ) : _mag(magnitude), _neg(negative)
+      {
+	 fixZero();
+      }
+
+      bool isZero() const     { return _mag.empty(); }
+      bool isNegative() const { return _neg; }
+      int  sign() const       { return isZero() ? 0 : (_neg ? -1 : 1); }
+
+      /// true if the value can be held by a long long (excluding LLONG_MIN, so negation is safe)
+      bool fitsLongLong() const
+      {
+	 if ( _mag.size() > 2 ) return false;
+	 return magnitude64() <= wide_type(std::numeric_limits<long long>::max());
+      }
+      long long toLongLong() const
+      {
+	 assert( fitsLongLong() );
+	 long long v = (long long)magnitude64();
+	 return _neg ? -v : v;
+      }
+      double toDouble() const
+      {
+	 double d = 0.0;
+	 for ( int i = int(_mag.size()) - 1; i >= 0; --i )
+	    d = d * 4294967296.0 + double(_mag[i]);
+	 return _neg ? -d : d;
+      }
+
+      //-----------------------------------------------------------------------------
+      BigInt operator-() const
+      {
+	 BigInt r(*this);
+	 r._neg = !r._neg && !r.isZero();
+	 return r;
+      }
+      BigInt abs() const { return _neg ? -(*this) : *this; }
+
+      BigInt operator+( const BigInt &b ) const
+      {
+	 BigInt r;
+	 if ( _neg == b._neg )
+	 {
+	    addMag( _mag, b._mag, &r._mag );
+	    r._neg = _neg;
+	 }
+	 else if ( cmpMag( _mag, b._mag ) >= 0 )
+	 {
+	    subMag( _mag, b._mag, &r._mag );
+	    r._neg = _neg;
+	 }
+	 else
+	 {
+	    subMag( b._mag, _mag, &r._mag );
+	    r._neg = b._neg;
+	 }
+	 r.fixZero();
+	 return r;
+      }
+      BigInt operator-( const BigInt &b ) const { return *this + (-b); }
+
+      BigInt operator*( const BigInt &b ) const
+      {
+	 BigInt r;
+	 mulMag( _mag, b._mag, &r._mag );
+	 r._neg = _neg != b._neg;
+	 r.fixZero();
+	 return r;
+      }
+
+      /// truncating division, remainder takes the sign of the dividend (like C++ ints)
+      static void divMod( const BigInt &a, const BigInt &b, BigInt *q, BigInt *r )
+      {
+	 assert( !b.isZero() );
+	 limb_vec qm, rm;
+	 divModMag( a._mag, b._mag, &qm, &rm );
+	 if ( q ) { q->_mag = qm; q->_neg = a._neg != b._neg; q->fixZero(); }
+	 if ( r ) { r->_mag = rm; r->_neg = a._neg; r->fixZero(); }
+      }
+      BigInt operator/( const BigInt &b ) const { BigInt q; divMod( *this, b, &q, 0 ); return q; }
+      BigInt operator%( const BigInt &b ) const { BigInt r; divMod( *this, b, 0, &r ); return r; }
+
+      /// greatest common divisor, always non-negative
+      static BigInt gcd( BigInt a, BigInt b )
+      {
+	 a._neg = false;
+	 b._neg = false;
+	 while ( !b.isZero() )
+	 {
+	    BigInt t = a % b;
+	    a = b;
+	    b = t;
+	 }
+	 return a;
+      }
+
+      //-----------------------------------------------------------------------------
+      static int compare( const BigInt &a, const BigInt &b )
+      {
+	 if ( a._neg != b._neg ) return a._neg ? -1 : 1;
+	 const int c = cmpMag( a._mag, b._mag );
+	 return a._neg ? -c : c;
+      }
+      bool operator==( const BigInt &b ) const { return _neg == b._neg && _mag == b._mag; }
+      bool operator!=( const BigInt &b ) const { return !(*this == b); }
+      bool operator<( const BigInt &b ) const  { return compare( *this, b ) < 0; }
+
+      size_t hash() const
+      {
+	 size_t h = _neg ? 1 : 0;
+	 for ( size_t i = 0; i < _mag.size(); ++i ) h = hashCombine( h, _mag[i] );
+	 return h;
+      }
+
+      //-----------------------------------------------------------------------------
+      std::string toString() const
+      {
+	 if ( isZero() ) return "0";
+	 std::string digits;
+	 limb_vec mag(_mag);
+	 while ( !mag.empty() )
+	 {
+	    // peel off 9 decimal digits at a time
+	    wide_type rem = 0;
+	    for ( int i = int(mag.size()) - 1; i >= 0; --i )
+	    {
+	       const wide_type cur = (rem << 32) | mag[i];
+	       mag[i] = limb_type(cur / 1000000000ULL);
+	       rem = cur % 1000000000ULL;
+	    }
+	    trim( &mag );
+	    for ( int d = 0; d < 9 && (rem || !mag.empty()); ++d )
+	    {
+	       digits.push_back( char('0' + rem % 10) );
+	       rem /= 10;
+	    }
+	 }
+	 if ( _neg ) digits.push_back('-');
+	 return std::string( digits.rbegin(), digits.rend() );
+      }
+
+      const limb_vec &limbs() const { return _mag; }
+
+     protected:
+      limb_vec _mag;   /// magnitude
+      bool     _neg;   /// sign
+
+      wide_type magnitude64() const
+      {
+	 wide_type m = 0;
+	 if ( _mag.size() > 0 ) m |= _mag[0];
+	 if ( _mag.size() > 1 ) m |= wide_type(_mag[1]) << 32;
+	 return m;
+      }
+
+      void fixZero() { trim( &_mag ); if ( _mag.empty() ) _neg = false; }
+
+      //-----------------------------------------------------------------------------
+      /// magnitude helpers
+      static void trim( limb_vec *m )
+      {
+	 while ( !m->empty() && m->back() == 0 ) m->pop_back();
+      }
+
+      static int cmpMag( const limb_vec &a, const limb_vec &b )
+      {
+	 if ( a.size() != b.size() ) return a.size() < b.size() ? -1 : 1;
+	 for ( int i = int(a.size()) - 1; i >= 0; --i )
+	    if ( a[i] != b[i] ) return a[i] < b[i] ? -1 : 1;
+	 return 0;
+      }
+
+      static void addMag( const limb_vec &a, const limb_vec &b, limb_vec *r )
+      {
+	 const limb_vec &lng = a.size() >= b.size() ? a : b;
+	 const limb_vec &sht = a.size() >= b.size() ? b : a;
+	 limb_vec sum( lng.size() + 1, 0 );
+	 wide_type carry = 0;
+	 for ( size_t i = 0; i < lng.size(); ++i )
+	 {
+	    const wide_type s = wide_type(lng[i]) + (i < sht.size() ? sht[i] : 0) + carry;
+	    sum[i] = limb_type(s);
+	    carry = s >> 32;
+	 }
+	 sum[lng.size()] = limb_type(carry);
+	 trim( &sum );
+	 r->swap( sum );
+      }
+
+      /// |a| - |b|, requires |a| >= |b|
+      static void subMag( const limb_vec &a, const limb_vec &b, limb_vec *r )
+      {
+	 limb_vec diff( a.size(), 0 );
+	 long long borrow = 0;
+	 for ( size_t i = 0; i < a.size(); ++i )
+	 {
+	    const long long t = (long long)a[i] - (i < b.size() ? (long long)b[i] : 0) - borrow;
+	    diff[i] = limb_type(t);
+	    borrow = t < 0 ? 1 : 0;
+	 }
+	 trim( &diff );
+	 r->swap( diff );
+      }
+
+      static void mulMag( const limb_vec &a, const limb_vec &b, limb_vec *r )
+      {
+	 if ( a.empty() || b.empty() ) { r->clear(); return; }
+	 limb_vec prod( a.size() + b.size(), 0 );
+	 for ( size_t i = 0; i < a.size(); ++i )
+	 {
+	    wide_type carry = 0;
+	    for ( size_t j = 0; j < b.size(); ++j )
+	    {
+	       const wide_type t = wide_type(a[i]) * b[j] + prod[i + j] + carry;
+	       prod[i + j] = limb_type(t);
+	       carry = t >> 32;
+	    }
+	    prod[i + b.size()] = limb_type(carry);
+	 }
+	 trim( &prod );
+	 r->swap( prod );
+      }
+
+      static int leadingZeros( limb_type x )
+      {
+	 int n = 0;
+	 while ( !(x & 0x80000000U) ) { x <<= 1; ++n; }
+	 return n;
+      }
+
+      /// long division, Knuth vol 2, algorithm D
+      static void divModMag( const limb_vec &u, const limb_vec &v, limb_vec *q, limb_vec *r )
+      {
+	 assert( !v.empty() );
+	 if ( cmpMag( u, v ) < 0 )
+	 {
+	    q->clear();
+	    *r = u;
+	    return;
+	 }
+	 if ( v.size() == 1 )  // short division
+	 {
+	    wide_type rem = 0;
+	    q->assign( u.size(), 0 );
+	    for ( int i = int(u.size()) - 1; i >= 0; --i )
+	    {
+	       const wide_type cur = (rem << 32) | u[i];
+	       (*q)[i] = limb_type(cur / v[0]);
+	       rem = cur % v[0];
+	    }
+	    trim( q );
+	    r->clear();
+	    if ( rem ) r->push_back( limb_type(rem) );
+	    return;
+	 }
+
+	 const int n = int(v.size());
+	 const int m = int(u.size()) - n;
+	 const int s = leadingZeros( v.back() );
+
+	 // normalize so the top bit of the divisor is set
+	 limb_vec vn( n ), un( u.size() + 1 );
+	 for ( int i = n - 1; i > 0; --i )
+	    vn[i] = s ? (v[i] << s) | (v[i-1] >> (32 - s)) : v[i];
+	 vn[0] = v[0] << s;
+	 un[u.size()] = s ? u.back() >> (32 - s) : 0;
+	 for ( int i = int(u.size()) - 1; i > 0; --i )
+	    un[i] = s ? (u[i] << s) | (u[i-1] >> (32 - s)) : u[i];
+	 un[0] = u[0] << s;
+
+	 const wide_type base = 1ULL << 32;
+	 q->assign( m + 1, 0 );
+	 for ( int j = m; j >= 0; --j )
+	 {
+	    const wide_type num = (wide_type(un[j+n]) << 32) | un[j+n-1];
+	    wide_type qhat = num / vn[n-1];
+	    wide_type rhat = num % vn[n-1];
+	    while ( qhat >= base || qhat * vn[n-2] > ((rhat << 32) | un[j+n-2]) )
+	    {
+	       --qhat;
+	       rhat += vn[n-1];
+	       if ( rhat >= base ) break;
+	    }
+	    // multiply and subtract
+	    long long borrow = 0;
+	    wide_type carry = 0;
+	    for ( int i = 0; i < n; ++i )
+	    {
+	       const wide_type p = qhat * vn[i] + carry;
+	       carry = p >> 32;
+	       const long long t = (long long)un[i+j] - borrow - (long long)(p & 0xffffffffULL);
+	       un[i+j] = limb_type(t);
+	       borrow = t < 0 ? 1 : 0;
+	    }
+	    const long long t = (long long)un[j+n] - borrow - (long long)carry;
+	    un[j+n] = limb_type(t);
+	    if ( t < 0 )  // subtracted too much, add back
+	    {
+	       --qhat;
+	       wide_type c = 0;
+	       for ( int i = 0; i < n; ++i )
+	       {
+		  const wide_type sm = wide_type(un[i+j]) + vn[i] + c;
+		  un[i+j] = limb_type(sm);
+		  c = sm >> 32;
+	       }
+	       un[j+n] = limb_type(un[j+n] + c);
+	    }
+	    (*q)[j] = limb_type(qhat);
+	 }
+	 trim( q );
+
+	 // un-normalize the remainder
+	 r->assign( n, 0 );
+	 for ( int i = 0; i < n; ++i )
+	    (*r)[i] = s ? (un[i] >> s) | (un[i+1] << (32 - s)) : un[i];
+	 trim( r );
+      }
+   };
+
+   inline std::ostream &operator<<( std::ostream &os, const BigInt &b )
+   {
+      return os << b.toString();
+   }
+
+   ///----------------------------------------------------------
+   //
+   /// Rational number: small (long long) fast path, BigInt when it overflows.
+   ///   The BigInt pair lives on the heap and is shared between copies,
+   ///   so small values never allocate and big values copy cheaply.
+   ///   A value that fits in the small form is always stored small,
+   ///   so equality can compare representations directly.
+   //
+   class Rational {
+     public:
+      /// heap storage for the overflowed case, immutable once built
+      class BigRational : public gutz::Counted {
+	public:
+	 BigRational( const BigInt &n, const BigInt &d ) : num(n), den(d) {}
+	 BigInt num;
+	 BigInt den;
+      };
+      typedef gutz::SmartPtr< BigRational > BigRationalSP;
+
+      Rational() : _num(0), _den(1), _big(0) {}
+
+      Rational( long long numerator, long long denominator = 1 )
+	: _num(numerator), _den(denominator), _big(0)
+      {
+	 if ( denominator == 0 )
+	 {
+	    std::cerr << "Rational with zero denominator (" << numerator << "/0)" << std::endl;
+	    assert( denominator != 0 );
+	 }
+	 if ( _num == LLMIN() || _den == LLMIN() )
+	    setBig( BigInt(numerator), BigInt(denominator) );
+	 else
+	    normalizeSmall();
+      }
+
+      Rational( const BigInt &numerator, const BigInt &denominator = BigInt(1) )
+	: _num(0), _den(1), _big(0)
+      {
+	 assert( !denominator.isZero() );
+	 setBig( numerator, denominator );
+      }
+
+      //-----------------------------------------------------------------------------
+      bool isBig() const      { return !_big.isNull(); }
+      bool isZero() const     { return !_big && _num == 0; }
+      bool isOne() const      { return !_big && _num == 1 && _den == 1; }
+      bool isNegOne() const   { return !_big && _num == -1 && _den == 1; }
+      bool isInteger() const  { return _big ? _big->den == BigInt(1) : _den == 1; }
+      int  sign() const       { return _big ? _big->num.sign() : (_num > 0) - (_num < 0); }
+
+      BigInt numerator() const   { return _big ? _big->num : BigInt(_num); }
+      BigInt denominator() const { return _big ? _big->den : BigInt(_den); }
+
+      /// small form accessors, only valid when !isBig()
+      long long smallNumerator() const   { assert( !_big ); return _num; }
+      long long smallDenominator() const { assert( !_big ); return _den; }
+
+      double toDouble() const
+      {
+	 if ( !_big ) return double(_num) / double(_den);
+	 return _big->num.toDouble() / _big->den.toDouble();
+      }
+
+      //-----------------------------------------------------------------------------
+      Rational operator-() const
+      {
+	 if ( _big ) return Rational( -_big->num, _big->den );
+	 Rational r(*this);
+	 r._num = -r._num;  // never LLONG_MIN, so this is safe
+	 return r;
+      }
+
+      Rational operator+( const Rational &r ) const
+      {
+	 if ( !_big && !r._big )
+	 {
+	    // a/b + c/d = (a*(d/g) + c*(b/g)) / (b*(d/g))
+	    const long long g = gcd( _den, r._den );
+	    const long long bg = _den / g, dg = r._den / g;
+	    long long ad, cb, n, d;
+	    if ( !mulOverflow( _num, dg, &ad ) && !mulOverflow( r._num, bg, &cb ) &&
+		 !addOverflow( ad, cb, &n ) && !mulOverflow( _den, dg, &d ) )
+	       return Rational( n, d );
+	 }
+	 return Rational( numerator() * r.denominator() + r.numerator() * denominator(),
+			  denominator() * r.denominator() );
+      }
+
+      Rational operator-( const Rational &r ) const { return *this + (-r); }
+
+      Rational operator*( const Rational &r ) const
+      {
+	 if ( !_big && !r._big )
+	 {
+	    // cross cancel first so the products stay small
+	    const long long g1 = gcd( _num, r._den ), g2 = gcd( r._num, _den );
+	    long long n, d;
+	    if ( !mulOverflow( _num / g1, r._num / g2, &n ) &&
+		 !mulOverflow( _den / g2, r._den / g1, &d ) )
+	       return Rational( n, d );
+	 }
+	 return Rational( numerator() * r.numerator(), denominator() * r.denominator() );
+      }
+
+      Rational operator/( const Rational &r ) const
+      {
+	 return *this * r.inverse();
+      }
+
+      /// 1/this, this must not be zero
+      Rational inverse() const
+      {
+	 assert( !isZero() );
+	 if ( _big ) return Rational( _big->den, _big->num );
+	 return Rational( _den, _num );
+      }
+
+      //-----------------------------------------------------------------------------
+      bool operator==( const Rational &r ) const
+      {
+	 if ( !_big && !r._big ) return _num == r._num && _den == r._den;
+	 if ( _big && r._big ) return _big->num == r._big->num && _big->den == r._big->den;
+	 return false;  // normalized, a big value never equals a small one
+      }
+      bool operator!=( const Rational &r ) const { return !(*this == r); }
+
+      /// equal values hash the same, a value is small or big but never both
+      size_t hash() const
+      {
+	 if ( _big ) return hashCombine( _big->num.hash(), _big->den.hash() );
+	 return hashCombine( hashCombine( 0, size_t(_num) ), size_t(_den) );
+      }
+
+      bool operator<( const Rational &r ) const
+      {
+	 if ( !_big && !r._big )
+	 {
+	    long long ad, cb;
+	    if ( !mulOverflow( _num, r._den, &ad ) && !mulOverflow( r._num, _den, &cb ) )
+	       return ad < cb;
+	 }
+	 return numerator() * r.denominator() < r.numerator() * denominator();
+      }
+
+      //-----------------------------------------------------------------------------
+      /// prints n or n/d
+      std::ostream &print( std::ostream &os ) const
+      {
+	 if ( !_big )
+	 {
+	    os << _num;
+	    if ( _den != 1 ) os << "/" << _den;
+	    return os;
+	 }
+	 os << _big->num;
+	 if ( !(_big->den == BigInt(1)) ) os << "/" << _big->den;
+	 return os;
+      }
+
+      std::string toString() const
+      {
+	 std::stringstream ss;
+	 print( ss );
+	 return ss.str();
+      }
+
+     protected:
+      long long      _num;   /// small numerator   (valid when _big is null)
+      long long      _den;   /// small denominator (valid when _big is null), > 0
+      BigRationalSP  _big;   /// overflowed value, null while small
+
+      static long long LLMIN() { return std::numeric_limits<long long>::min(); }
+
+      static long long gcd( long long a, long long b )
+      {
+	 if ( a < 0 ) a = -a;
+	 if ( b < 0 ) b = -b;
+	 while ( b )
+	 {
+	    const long long t = a % b;
+	    a = b;
+	    b = t;
+	 }
+	 return a ? a : 1;
+      }
+
+      /// checked arithmetic, true on overflow. LLONG_MIN counts as overflow
+      /// so small values can always be negated.
+      static bool mulOverflow( long long a, long long b, long long *r )
+      {
+#if defined(__GNUC__) || defined(__clang__)
+	 if ( __builtin_mul_overflow( a, b, r ) ) return true;
+#else
+	 const long long mx = std::numeric_limits<long long>::max();
+	 if ( a && b && ( a > 0 ? ( b > 0 ? a > mx / b : b < LLMIN() / a )
+			        : ( b > 0 ? a < LLMIN() / b : b < mx / a ) ) )
+	    return true;
+	 *r = a * b;
+#endif
+	 return *r == LLMIN();
+      }
+      static bool addOverflow( long long a, long long b, long long *r )
+      {
+#if defined(__GNUC__) || defined(__clang__)
+	 if ( __builtin_add_overflow( a, b, r ) ) return true;
+#else
+	 const long long mx = std::numeric_limits<long long>::max();
+	 if ( (b > 0 && a > mx - b) || (b < 0 && a < LLMIN() - b) ) return true;
+	 *r = a + b;
+#endif
+	 return *r == LLMIN();
+      }
+
+      void normalizeSmall()
+      {
+	 if ( _den < 0 )
+	 {
+	    _num = -_num;
+	    _den = -_den;
+	 }
+	 const long long g = gcd( _num, _den );
+	 _num /= g;
+	 _den /= g;
+      }
+
+      /// normalize a big pair, demote to the small form if it fits
+      void setBig( BigInt n, BigInt d )
+      {
+	 if ( d.isNegative() )
+	 {
+	    n = -n;
+	    d = -d;
+	 }
+	 const BigInt g = BigInt::gcd( n, d );
+	 if ( !(g == BigInt(1)) && !g.isZero() )
+	 {
+	    n = n / g;
+	    d = d / g;
+	 }
+	 if ( n.fitsLongLong() && d.fitsLongLong() )
+	 {
+	    _num = n.toLongLong();
+	    _den = d.toLongLong();
+	    _big = 0;
+	    return;
+	 }
+	 _big = new BigRational( n, d );
+      }
+   };
+
+   inline std::ostream &operator<<( std::ostream &os, const Rational &r )
+   {
+      return r.print( os );
+   }
+
+}  /// end namespace Symath
+
+#endif
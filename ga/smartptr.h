@@ -17,6 +17,8 @@
 // if GL::Buffer is used without gutz smart pointers.
 #define GUTZ_SMARTPTR
 
+#include <atomic>
+#include <cstdlib>
 #include <new>
 
 /// define this to be 0 and smart-pointers behave the same as before
@@ -47,13 +49,15 @@ namespace gutz {
   /// TODO: add stack-heap check using operator new and a
   ///  a static pointer map.
    
-  /// new attempt to distinguish stact from heap, NOT THREAD SAFE YET, but
-  /// the only concequence of this is you may accidentially query a heap var,
-  /// and have it report itself as a stack, then make an extra copy, not so bad
-  static void* last_heap_addr;
+  /// new attempt to distinguish stact from heap, one per thread so
+  /// threads allocating at the same time can't confuse each other.
+  static thread_local void* last_heap_addr;
    
   class Counted {
   public:
+    /// reference counts are atomic, so SmartPtr s to the same object can be
+    /// copied and released from different threads.  The object itself is
+    /// only as thread safe as its own const members.
 
     virtual ~Counted()                     {}
 
@@ -72,6 +76,11 @@ namespace gutz {
       last_heap_addr = storage;
       return storage;
     }   
+    /// storage came from malloc, so it goes back with free
+    void operator delete(void *storage)
+    {
+      free(storage);
+    }
    
 
    
@@ -87,23 +96,28 @@ namespace gutz {
     ///   documentation for gutz::SmartPtr
     virtual void _incCount()               
     {
-      _count += _count != COUNT_IS_POINTLESS ? 1 : 0; 
+      if ( _count.load( std::memory_order_relaxed ) != COUNT_IS_POINTLESS )
+	_count.fetch_add( 1, std::memory_order_relaxed );
     }
     /// gutz::Counted interface, decrement reference count by one.
     ///   Not generaly used by subclasses, mostly for 
     ///   collaboration with gutz::SmartPtr.  Sometimes
     ///   you need to call this though, see the 
     ///   documentation for gutz::SmartPtr
-    virtual void _decCount()               
+    ///   Returns the count after the decrement (same as _getCount()),
+    ///   only one thread ever sees it drop to 0.
+    virtual int  _decCount()               
     {
-      _count -= _count != COUNT_IS_POINTLESS ? 1 : 0; 
+      if ( _count.load( std::memory_order_relaxed ) == COUNT_IS_POINTLESS ) return STACK_VAR_ERROR_COUNT;
+      return _count.fetch_sub( 1, std::memory_order_acq_rel ) - 1;
     }
     /// gutz::Counted interface, get the current reference count.
     ///   Not generaly used by subclasses, mostly for 
     ///   collaboration with gutz::SmartPtr.  
     virtual int  _getCount() const         
     {
-      return _count != COUNT_IS_POINTLESS ? _count : STACK_VAR_ERROR_COUNT;
+      const int count = _count.load( std::memory_order_acquire );
+      return count != COUNT_IS_POINTLESS ? count : (int)STACK_VAR_ERROR_COUNT;
     }
 
     /// protected constructor since this class does nothing by itself
@@ -118,7 +132,7 @@ namespace gutz {
 
   private:
     /// Counted: reference count, if _getCount() == 0 then delete
-    int _count;  
+    std::atomic<int> _count;  
   };
 
 
@@ -366,9 +380,8 @@ namespace gutz {
       /// delete the old reference
       if(oldref!=0 && !_pucky){
 	/// just a dec most of the time...
-	oldref->_decCount();
-	/// but if we hold the last reference, nuke it
-	if((oldref->_getCount() <= 0))
+	/// but if we held the last reference, nuke it
+	if((oldref->_decCount() <= 0))
 	  {
             delete oldref;
 	  }
@@ -469,9 +482,8 @@ namespace gutz {
       /// deleting the old guy
       if(oldref!=0){
 	/// just a dec most of the time
-	oldref->_decCount();
-	/// but if we are the last reference, nuke it
-	if(oldref->_getCount() <= 0)
+	/// but if we were the last reference, nuke it
+	if(oldref->_decCount() <= 0)
 	  {
             delete oldref;
 	  }
@@ -1,13 +1,54 @@
 /// symbolic math sanity 
+///   symain bench [threads]   times Sym::expand() on 1, 2, 4, ... threads up
+///                            to |threads| (default one per core) instead
 
+#include <chrono>
+#include <cstdlib>
+#include <fstream>
+#include <thread>
 #include "symath.h"
+#include "symbinary.h"
 
 typedef Symath::Sym S;
 using namespace Symath;
 using namespace std;
 
+/// expand a product of eight 6-term sums (1.7M monomials to collect) on a
+/// growing number of threads, speedup against one thread
+static int benchExpand( unsigned most )
+{
+  if ( most == 0 ) most = std::thread::hardware_concurrency();
+  if ( most == 0 ) most = 1;
+  S a("a"), b("b"), c("c"), d("d"), e("e");
+  S p = S::one();
+  for ( int i = 1; i <= 8; ++i ) p = p * (a + b + c + d + e + S(i));
+
+  S reference;
+  double serial = 0;
+  cout << " expand() of " << p.treeSize() << " nodes, " << most << " threads at most" << endl;
+  for ( unsigned threads = 1; ; threads = std::min( 2 * threads, most ) )
+  {
+    const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    const S x = p.expand( threads );
+    const double seconds = std::chrono::duration<double>( std::chrono::steady_clock::now() - start ).count();
+    if ( threads == 1 )
+    {
+      reference = x;
+      serial = seconds;
+    }
+    cout << "  " << threads << " threads " << seconds << " s, speedup " << serial / seconds
+	 << (x == reference ? "" : "  DIFFERENT RESULT") << endl;
+    if ( !(x == reference) ) return 1;
+    if ( threads == most ) break;
+  }
+  return 0;
+}
+
 int main( int argc, char** argv )
 {
+  if ( argc > 1 && std::string( argv[1] ) == "bench" )
+    return benchExpand( argc > 2 ? unsigned( atoi( argv[2] ) ) : 0 );
+
   S one = S::one();
   S zero = S::zero();
   std::cout << " one " << one << " = " << S(one) << " = " << S(1) << " = " 
@@ -36,6 +77,7 @@ int main( int argc, char** argv )
   S b1 = b / d1.normalForm();
   S b2 = b / d1.normalForm();
   cout << " b/d1 == b/d1 ? " << (b1 == b2) << endl;
+  cout << " d1.expand() == d1.normalForm() ? " << (d1.expand() == d1.normalForm()) << endl;
   
   cout << endl;
   S w1("w1");
@@ -77,6 +119,20 @@ int main( int argc, char** argv )
    cout << " sortedized e = " << e.sortedForm() << endl;
    cout << " normalized e = " << e.normalForm() << endl;
 
+   std::vector<std::string> abcd;
+   abcd.push_back("a"); abcd.push_back("b"); abcd.push_back("c"); abcd.push_back("d");
+   Program eprog = e.normalForm().compile(abcd);
+   double e_at[4] = { 1, 2, 3, 4 }, e_val = 0;
+   eprog.evaluate(e_at, &e_val);
+   cout << " compiled e(1,2,3,4) = " << e_val << " (43), " << eprog.size() << " instructions" << endl;
+   e.normalForm().emitCpp(cout, "evalE", abcd);
+   (pow(a + b, S(5)) * c).emitCpp(cout, "powE", abcd);
+   std::vector<std::string> tout;  // user names like the temporaries, fine
+   tout.push_back("t0"); tout.push_back("out");
+   (pow(S("t0") + S("out"), S(3))).emitCpp(cout, "tempE", tout);
+   tout.push_back("a.b"); tout.push_back("a_b");  // both a_b, #error
+   (S("a.b") * S("a_b")).emitCpp(cout, "clashE", tout);
+
    cout << endl;
 
    S g = (a + (b - c*c) - c * (b - c) + (-b) + (c * b - a)) + S::one();
@@ -134,6 +190,61 @@ int main( int argc, char** argv )
    cout << " sum = " << sum << endl << endl;
    
    cout << " sin:  " << sin(-(a-b)) * c + d << endl;
+   cout << " parse(\"(a + 2)*(b - c) - Sin(a*b)^2\") = " << Symath::parse("(a + 2)*(b - c) - Sin(a*b)^2") << endl;
+   {
+      char line[48];
+      Symath::SymWriter( line, sizeof(line) ).compact().maxDepth( 2 ).write( (a + S(2))*(b - c) - sin(a*b) );
+      cout << " compact, depth 2: " << line << endl;
+   }
+   {
+      std::vector<S> saved( 1, (a*a*b + sin(a*b)) * (a*a*b + sin(a*b)) ), loaded;
+      Symath::saveBinary( "/tmp/symain.symb", saved );
+      const bool ok = Symath::loadBinary( "/tmp/symain.symb", &loaded );
+      cout << " binary round trip: " << (ok && loaded.size() == 1 && loaded[0] == saved[0]) << endl;
+   }
+   {
+      // a long sum should come out smaller than its text and in about the same time
+      S::SymPVec terms;
+      for ( int i = 0; i < 20000; ++i )
+	 terms.push_back( (S( i % 100 + 1, 7 )*a*b*c + a*S( i )).copyMaybe() );
+      std::vector<S> saved( 1, S::sum( terms ) ), loaded;
+      std::chrono::steady_clock::time_point t0 = std::chrono::steady_clock::now();
+      const std::string text = saved[0].toString();
+      std::chrono::steady_clock::time_point t1 = std::chrono::steady_clock::now();
+      Symath::saveBinary( "/tmp/symain.symb", saved );
+      std::chrono::steady_clock::time_point t2 = std::chrono::steady_clock::now();
+      const bool ok = Symath::loadBinary( "/tmp/symain.symb", &loaded );
+      std::ifstream in( "/tmp/symain.symb", std::ios::binary | std::ios::ate );
+      cout << " binary round trip, long sum: " << (ok && loaded.size() == 1 && loaded[0] == saved[0])
+	   << ", smaller than text: " << (size_t(in.tellg()) < text.size())
+	   << ", within 4x toString time: " << (t2 - t1 <= 4*(t1 - t0)) << endl;
+   }
+   {
+      Symath::SymRelations rel;
+      rel.add( a*b, S(-1) );
+      cout << " (a*b + c)*(a*b - c) with a*b = -1: " << rel.reduce( (a*b + c)*(a*b - c) ) << endl;
+   }
+   {
+      S m = ((a + b)*(a - c) + c*c).normalForm();
+      cout << " " << m << " with c = a + b: " << m.substitute( "c", a + b ) << endl;
+   }
+   cout << " d/da (a*a*b + sin(a*b)) = " << (a*a*b + sin(a*b)).diff("a").normalForm() << endl;
+
+   S big = S::one();
+   for (int i = 0; i < 6; ++i) big = big * S(1000003) / S(7);
+   cout << " big rationals (1000003/7)^6 = " << big << endl;
+   cout << "   * (a + 7/1000003) = " << (big * (a + S(7, 1000003))).normalForm() << endl;
+
+   S deep = S::zero();  // as deep as it is long
+   for (int i = 0; i < 20000; ++i) deep += a*b - b;
+   cout << " 20000 term sum = " << deep.normalForm() << endl;
+
+   std::string squares;
+   {
+      Symath::SymArena arena;  // nodes of this derivation are freed together
+      squares = ((a + b)*(a - b)*(a + b)).normalForm().toString();
+   }
+   cout << " arena (a + b)*(a - b)*(a + b) = " << squares << endl;
 
    return 0;
 }
@@ -5,13 +5,18 @@
 
 #include <algorithm>
 #include <cassert>
+#include <deque>
 #include <iostream>
 #include <map>
 #include <list>
+#include <atomic>
 #include <string>
 #include <sstream>
 #include <limits>
+#include <vector>
 #include "smartptr.h"  // TODO: maybe we should move away from smartptr?
+#include "rational.h"
+#include "sympool.h"
 
 namespace Symath {
    /// Operators:
@@ -33,12 +38,15 @@ namespace Symath {
    const std::string CPR(")");
    const std::string NUM("#");
 
+   class Program;  // compiled expressions, see symprogram.h
+
    ///----------------------------------------------------------
    //
    /// symbolic value type
    /// names instead of numbers, capable of some simplifications
    //  implements a communitive-field algebra
-   // TODO functions n-ary
+   //  Sums and products built with operators are binary trees, canonical forms
+   //  (sortedForm, normalForm) use n-ary PLUS/TIMES nodes with sorted operands.
 
    class Sym : public gutz::Counted {
      public:
@@ -51,6 +59,7 @@ namespace Symath {
       typedef gutz::SmartPtr< Sym >         SymSP;
       typedef std::list< SymSP >            SymPVec;
       typedef SymPVec::iterator             SymPVecIter;
+      typedef std::vector< SymSP >          SymArgs;   ///< n-ary operands
       
       //-----------------------------------------------------------------------------
       /// Key constants, you should use these!
@@ -68,12 +77,17 @@ namespace Symath {
       std::string   _value;
       SymSP         _left;     /// left hand side
       SymSP         _right;    /// right hand side
-      int           _numerator;  /// a integral value
-      int           _denominator;  /// a integral value 
+      SymArgs       _args;     /// operands of an n-ary PLUS or TIMES, sorted, left & right are 0
+      Rational      _rational; /// numeric value, only meaningful for "#" leaves
+      size_t        _hash;     /// structural hash, set once by shape()
+      size_t        _size;     /// nodes in the tree, shared subtrees counted every time
+      unsigned long long _mentions; /// variableBit() of every variable below, see mayContain()
 
       /// Twin of this symbol, allows us to have unique symbols in an expression,
-      /// helps minimize copies while expressions are being built.
-      mutable SymSP         _doppleganger;   
+      /// helps minimize copies while expressions are being built.  Holds one
+      /// reference; set once by copyMaybe() (see there), else only written by
+      /// construction, assignment and destruction.
+      mutable std::atomic<Sym*> _doppleganger;   
       mutable bool          _is_doppleganger;  // was object created on heap?
   
      public:
@@ -81,45 +95,52 @@ namespace Symath {
       /// default constructor, undefined symbol defaults to "1" (multiplicitive identity)
      Sym() 
 	: _value("#"), _op(), _left(0), _right(0),
-	 _numerator(1), _denominator(1),
+	 _rational(1),
 	 _doppleganger(0), _is_doppleganger(false)
-      {}
+      {
+	 shape();
+      }
 
       //-----------------------------------------------------------------------------
       /// rational constructor, #a/#b
       Sym( int numerator, int denominator = 1 ) 
 	: _value("#"), _op(), _left(), _right(),
-	_numerator(numerator), _denominator(denominator),
+	_rational(numerator, denominator),
 	_doppleganger(0), _is_doppleganger(false) 
       {
-	 if (_denominator < 0)
-	 {
-	    _numerator = -_numerator;
-	    _denominator = -_denominator;
-	 }
+	 shape();
+      }
+
+      //-----------------------------------------------------------------------------
+      /// rational constructor, arbitrary precision
+      explicit Sym( const Rational &r ) 
+	: _op(), _value("#"), _left(), _right(),
+	_rational(r),
+	_doppleganger(0), _is_doppleganger(false) 
+      {
+	 shape();
       }
            
       //-----------------------------------------------------------------------------
       /// Create a variable : Sym a1("a1");  
      explicit Sym( const std::string& symbol ) 
 	 : _value(symbol), _op(), _left(0), _right(0),
-	 _numerator(-0), _denominator(-0),
+	 _rational(),
 	 _doppleganger(0), _is_doppleganger(false)
       {
 	// For some bizzare reason, the compiler will choose this constructor rather than
 	// the integer version when you call Sym(0) or Sym(1) from a templated class... WTF?
 	if (symbol == "0") {
 	  _value = "#";
-	  _numerator = 0;
-	  _denominator = 1;
+	  _rational = Rational(0);
 	}
 	if (symbol == "1") {
 	  _value = "#";
-	  _numerator = 1;
-	  _denominator = 1;
+	  _rational = Rational(1);
 	}
 	assert(symbol != "-1");
 	assert(!symbol.empty());
+	shape();
       }
       
       //-----------------------------------------------------------------------------
@@ -130,26 +151,73 @@ namespace Symath {
 	  SymSP                 left,              ///< left operand (0 if not relevant)
 	  SymSP                 right = SymSP(0) ) ///< right operand (0 if not relevant) 
 	: _value(), _op(op), _left(left), _right(right),
-	 _numerator(-0), _denominator(-0),
+	 _rational(),
 	 _doppleganger(0), _is_doppleganger(false)
       {
 	 assert(!op.empty());
+	 shape();
+      }
+
+      //-----------------------------------------------------------------------------
+      /// n-ary PLUS or TIMES node, use sum() and product() to build these
+     Sym( const std::string & op,                  ///< PLUS or TIMES
+	  const SymArgs       & args )             ///< two or more sorted operands
+	: _op(op), _value(), _left(0), _right(0), _args(args),
+	 _rational(),
+	 _doppleganger(0), _is_doppleganger(false)
+      {
+	 assert(op == PLUS || op == TIMES);
+	 assert(args.size() > 1);
+	 shape();
       }
       
       //-----------------------------------------------------------------------------
       /// copy constructor, shallow copy
      Sym( const Sym &s ) 
-	: _value(s._value), _op(s._op), _left(s._left), _right(s._right),
-	 _numerator(s._numerator), _denominator(s._denominator),
-	 _doppleganger(s._doppleganger), _is_doppleganger(false)
+	: _value(s._value), _op(s._op), _left(s._left), _right(s._right), _args(s._args),
+	 _rational(s._rational), _hash(s._hash), _size(s._size), _mentions(s._mentions),
+	 _doppleganger(0), _is_doppleganger(false)
       {
-	 if ( s._is_doppleganger )
-	    _doppleganger = s.copyMaybe();
+	 setTwin( s._is_doppleganger ? const_cast<Sym*>(&s) : s.twin() );
       }
       
       //-----------------------------------------------------------------------------
-      /// destructor
-      virtual ~Sym() {}
+      /// nodes come from the thread's NodePool, see sympool.h
+      void *operator new( size_t size )
+      {
+	 void *storage = NodePool<Sym>::allocate( size );
+	 gutz::last_heap_addr = storage;  // so Counted knows we are on the heap
+	 return storage;
+      }
+      void operator delete( void *storage, size_t size )
+      {
+	 NodePool<Sym>::release( storage, size );
+      }
+
+      //-----------------------------------------------------------------------------
+      /// destructor, long chains (100k term sums) are released one node at a
+      /// time so deleting them can't overflow the stack
+      virtual ~Sym() 
+      {
+	 releaseTwin( _doppleganger.exchange( 0, std::memory_order_acq_rel ) );
+	 if ( !onlyOwner( _left ) && !onlyOwner( _right ) && _args.empty() ) return;
+	 std::vector<SymSP> doomed;
+	 doomed.swap( _args );
+	 doomed.push_back( _left );  _left = 0;
+	 doomed.push_back( _right ); _right = 0;
+	 while ( !doomed.empty() )
+	 {
+	    SymSP sym = doomed.back();
+	    doomed.pop_back();
+	    if ( onlyOwner( sym ) )  // detach the children before |sym| goes away
+	    {
+	       doomed.insert( doomed.end(), sym->_args.begin(), sym->_args.end() );
+	       sym->_args.clear();
+	       doomed.push_back( sym->_left );  sym->_left = 0;
+	       doomed.push_back( sym->_right ); sym->_right = 0;
+	    }
+	 }
+      }
            
       /// Only copy this symbol once. Save the copy with the symbol so it can be reused.
       /// mark the copy a copy so that it can always return itself.
@@ -159,12 +227,22 @@ namespace Symath {
 	 {  // we are the doppleganger/copy use us.
 	    return SymSP(const_cast<Sym*>(this));
 	 }
-	 if (!_doppleganger)  // we may or may-not have been created on the stack.
+	 // stack symbols may be shared read-only between threads: the first
+	 // copy published wins, a thread that loses the race drops its own
+	 Sym *twin = this->twin();
+	 if (!twin)  // we may or may-not have been created on the stack.
 	 {  // make a shallow copy of this expression on the heap to share with others.
-	    _doppleganger = new Sym( *this );
-	    _doppleganger->_is_doppleganger = true;
-	 }
-	 return _doppleganger;
+	    Sym *copy = new Sym( *this );
+	    copy->setTwin( 0 );
+	    copy->_is_doppleganger = true;
+	    copy->_incCount();  // the reference _doppleganger holds
+	    if ( _doppleganger.compare_exchange_strong( twin, copy, std::memory_order_acq_rel,
+							 std::memory_order_acquire ) )
+	       twin = copy;
+	    else
+	       releaseTwin( copy );  // |twin| is the winner's
+	 }
+	 return SymSP( twin );
       }
       
       //-----------------------------------------------------------------------------
@@ -183,16 +261,45 @@ namespace Symath {
 	_op = s._op;
 	_left = s._left;
 	_right = s._right;
-	_doppleganger = s._doppleganger;
-	_numerator = s._numerator;
-	_denominator = s._denominator;
-	if ( s._is_doppleganger )
-	  _doppleganger = s.copyMaybe();
+	_args = s._args;
+	setTwin( s._is_doppleganger ? const_cast<Sym*>(&s) : s.twin() );
+	_rational = s._rational;
+	_hash = s._hash;
+	_size = s._size;
+	_mentions = s._mentions;
 	return *this;
       }
       
       /// get symbol expression string
       const std::string &getValue() const { return _value; }
+      /// get operator and operands, operands are 0 if not present
+      const std::string &getOp() const { return _op; }
+      const Sym *getLeft() const { return _left; }
+      const Sym *getRight() const { return _right; }
+      /// operands of an n-ary node, empty for binary nodes
+      const SymArgs &getArgs() const { return _args; }
+      bool isNary() const { return !_args.empty(); }
+      /// number of operands, n-ary or binary
+      size_t arity() const 
+      {
+	 return isNary() ? _args.size() : (_left ? 1 : 0) + (_right ? 1 : 0);
+      }
+      /// i-th operand, for binary nodes left comes before right
+      const Sym *operand( size_t i ) const 
+      {
+	 if ( isNary() ) return _args[i];
+	 return i == 0 && _left ? _left : _right;
+      }
+      /// cached structural hash, equal expressions (==) hash the same
+      size_t hash() const { return _hash; }
+      /// cached node count, a subtree shared n times counts n times
+      size_t treeSize() const { return _size; }
+      /// false if |variable| is certainly not in this expression, a one word
+      ///  filter (64 buckets of names) kept up to date at construction
+      bool mayContain( const std::string &variable ) const 
+      { 
+	 return (_mentions & variableBit( variable )) != 0; 
+      }
 
       //-----------------------------------------------------------------------------
       
@@ -203,26 +310,20 @@ namespace Symath {
       // It's tricky to tell the difference between minus and negate, these help
       bool isNegateOp() const { return (this->_op == "-" && _left && !_right); }
       bool isMinusOp() const { return (this->_op == "-" && _left && _right); }
-      bool isZero() const { return isRationalValue() && getNumerator() == 0; }
-      bool isOne() const { return isRationalValue() && getNumerator() == getDenominator(); }
-      bool isNegOne() const { return isRationalValue() && getNumerator() == -getDenominator(); }
+      bool isZero() const { return isRational() ? _rational.isZero() : (isNegateOp() && _left->isZero()); }
+      bool isOne() const { return isRational() ? _rational.isOne() : (isNegateOp() && _left->isNegOne()); }
+      bool isNegOne() const { return isRational() ? _rational.isNegOne() : (isNegateOp() && _left->isOne()); }
       bool isVariable() const { return isLeaf() && _op.empty() && !numberCheck(getValue()); }
       bool isRational() const { return numberCheck(getValue()); }
       bool isRationalValue() const { return isRational() || (isNegateOp() && _left->isRationalValue()); }
-      bool isLeaf() const { return _right == 0 && _left == 0; }
+      bool isLeaf() const { return _right == 0 && _left == 0 && _args.empty(); }
 
-      /// Accessors for rational numbers
-      int getNumerator() const { 
-	 if ( this->isNegateOp() && _left->isRationalValue() )
-	    return -_left->getNumerator();   // note the numerator will get the negate
-	 if ( this->isRational() ) return _numerator;
-	 return 1;
-      }
-      int getDenominator() const {
+      /// Accessor for rational numbers, folds negates into the value
+      Rational getRational() const { 
 	 if ( this->isNegateOp() && _left->isRationalValue() )
-	    return _left->getDenominator();  // no negate, we gave it to numerator.
-	 if ( this->isRational() ) return _denominator;
-	 return 1;
+	    return -_left->getRational();
+	 if ( this->isRational() ) return _rational;
+	 return Rational(1);
       }
 
 
@@ -238,7 +339,7 @@ namespace Symath {
          
 	 if ( this->isRationalValue() )
 	 {
-	    return Sym(-getNumerator(), getDenominator());
+	    return Sym(-getRational());
 	 }
 
 	 /// --A -> A double negative
@@ -273,7 +374,7 @@ namespace Symath {
 	 if ( this->isRationalValue() && s.isRationalValue() )
 	 {
 	   //std::cout << "detected rational: " << this->toString() << "," << s.toString()  << std::endl;
-	    return Sym( this->getNumerator() * s.getNumerator(), this->getDenominator() * s.getDenominator() );
+	    return Sym( this->getRational() * s.getRational() );
 	 }
 	 // 1 * x
 	 if ( this->isOne() )
@@ -343,11 +444,7 @@ namespace Symath {
 	 /// numbers a/b - c/d = (ad - cb)/(bd)
 	 if ( this->isRationalValue() && s.isRationalValue() )
 	 {
-	    int ldenom = this->getDenominator();
-	    int rdenom = s.getDenominator(); 
-	    if ( ldenom != rdenom )
-	       return Sym( this->getNumerator() * rdenom  -  ldenom * s.getNumerator(), ldenom * rdenom );
-	    return Sym( this->getNumerator() - s.getNumerator(), ldenom );
+	    return Sym( this->getRational() - s.getRational() );
 	 }
 
 	 /// a--b = a+b
@@ -395,7 +492,7 @@ namespace Symath {
 
 	 if ( s.isRationalValue() )
 	 {
-	    return *this * Sym(s.getDenominator(), s.getNumerator());
+	    return *this * Sym(s.getRational().inverse());
 	 }
 	 
 	 // -a/-b  = a/b
@@ -446,11 +543,7 @@ namespace Symath {
 	 // a/b + c/d = (ad + cb)/(bd)
 	 if ( this->isRationalValue() && s.isRationalValue() )
 	 {
-	    int ldenom = this->getDenominator();
-	    int rdenom = s.getDenominator(); 
-	    if ( ldenom != rdenom )
-	       return Sym( this->getNumerator() * rdenom  +  ldenom * s.getNumerator(), ldenom * rdenom );
-	    return Sym( this->getNumerator() + s.getNumerator(), ldenom );
+	    return Sym( this->getRational() + s.getRational() );
 	 }
    
 	 // neg right, check for cancellation
@@ -481,107 +574,164 @@ namespace Symath {
       }
 
       //-----------------------------------------------------------------------------
-      // important for generating the "normalForm"
+      /// numbers < variables < operators, numbers by value.  Generic code
+      ///  (GO printing) uses this as "less than", sorting uses order().
       bool operator<( const Sym &s ) const
       {
-	 if ( this->isRationalValue() && s.isRationalValue() ) 
-	 {
-	    return this->getNumerator() * s.getDenominator() < 
-	       s.getNumerator() * this->getDenominator();
-	 }
-	 if ( this->isRationalValue() ) return true;
-	 if ( s.isRationalValue() ) return false;
-
-	 // ignore negates for comparison, unless we have -a vs a
-	 // -a < a, but a < -b 
-	 if ( this->isNegateOp() )
-	 {
-	    if ( s.isNegateOp() )
-	       return *(this->_left) < *(s._left);
+	 return compare( *this, s ) < 0;
+      }
 
-	    // -a < a
-	    if ( *(this->_left) == s ) 
-	       return true;
+      //-----------------------------------------------------------------------------
+      /// canonical total order behind SymPComp, so behind sum(), product() and
+      ///  the normalForm, negative if a < b.  Leaves (numbers, variables) come
+      ///  first in compare() order, which is as cheap and keeps a*b*c readable.
+      ///  Operators follow by cached hash, compare() only when hashes collide,
+      ///  so sorting a long term list is mostly integer compares.  Terms of a
+      ///  sum come out in hash order.
+      static int order( const Sym &a, const Sym &b )
+      {
+	 const bool la = a.isLeaf(), lb = b.isLeaf();
+	 if ( la != lb ) return la ? -1 : 1;
+	 if ( !la && a._hash != b._hash ) return a._hash < b._hash ? -1 : 1;
+	 return compare( a, b );
+      }
 
-	    return *(this->_left) < s;
-	 }
-	 if ( s.isNegateOp() )
+      //-----------------------------------------------------------------------------
+      /// deep three way compare behind operator<, negative if a < b: numbers <
+      ///  variables < operators, -a just before a.  The tie-breaker of order().
+      ///  Walks both trees with an explicit stack, operands compared left to right.
+      static int compare( const Sym &a, const Sym &b )
+      {
+	 if ( &a == &b ) return 0;
+	 std::vector<CompareItem> todo( 1, CompareItem( &a, &b ) );
+	 while ( !todo.empty() )
 	 {
-	    // a > -a
-	    if ( *this == *(s._left) ) 
-	       return false;
-
-	    return *this < *(s._left);
-	 }
+	    const CompareItem item = todo.back();
+	    todo.pop_back();
+	    if ( !item.a ) return item.tie;  // everything since the tie-breaker was equal
+	    if ( item.a == item.b ) continue;  // shared subtree
+	    const Sym &x = *item.a, &y = *item.b;
 
-	 // both leafs, compare values
-	 if ( this->isLeaf() && s.isLeaf() )
-	    return this->getValue() < s.getValue();
-
-	 // just left is leaf, a < a*a
-	 if ( isLeaf() ) return true;
-	 // just right is leaf a*a > a
-	 if ( s.isLeaf() ) return false;
+	    if ( x.isRationalValue() && y.isRationalValue() ) 
+	    {
+	       const Rational rx = x.getRational(), ry = y.getRational();
+	       if ( rx < ry ) return -1;
+	       if ( ry < rx ) return 1;
+	       continue;
+	    }
+	    if ( x.isRationalValue() ) return -1;
+	    if ( y.isRationalValue() ) return 1;
 
-	 // non-operators < operators (not sure what the conditions are to get here...)
-	 if ( _op != NOP && s._op == NOP ) return false;
-	 if ( _op == NOP && s._op != NOP ) return true;
+	    // ignore negates for comparison, unless we have -a vs a
+	    // -a < a, but a < -b 
+	    if ( x.isNegateOp() )
+	    {
+	       if ( y.isNegateOp() )
+	       {
+		  todo.push_back( CompareItem( x._left, y._left ) );
+		  continue;
+	       }
+	       todo.push_back( CompareItem( -1 ) );  // -a < a
+	       todo.push_back( CompareItem( x._left, &y ) );
+	       continue;
+	    }
+	    if ( y.isNegateOp() )
+	    {
+	       todo.push_back( CompareItem( 1 ) );   // a > -a
+	       todo.push_back( CompareItem( &x, y._left ) );
+	       continue;
+	    }
 
-	 // two operators
-	 if ( _op != NOP && s._op != NOP )
-	 {
-	    if ( _op < s._op ) return true;
-	    if ( s._op < _op ) return false;
-	
-	    // operators must be the same, compare operands
-	    if ( _left && s._left ) 
+	    // both leafs, compare values
+	    if ( x.isLeaf() && y.isLeaf() )
 	    {
-	       if ( *_left < *s._left ) return true;
-	       if ( *s._left < *_left ) return false;
+	       const int c = x.getValue().compare( y.getValue() );
+	       if ( c ) return c < 0 ? -1 : 1;
+	       continue;
 	    }
-	    if ( _right && s._right ) 
+	    // just left is leaf, a < a*a
+	    if ( x.isLeaf() ) return -1;
+	    // just right is leaf a*a > a
+	    if ( y.isLeaf() ) return 1;
+
+	    // non-operators < operators (not sure what the conditions are to get here...)
+	    if ( x._op != NOP && y._op == NOP ) return 1;
+	    if ( x._op == NOP && y._op != NOP ) return -1;
+
+	    // two operators
+	    if ( x._op != NOP && y._op != NOP )
 	    {
-	       if ( *_right < *s._right ) return true;
-	       if ( *s._right < *_right ) return false;
+	       if ( x._op < y._op ) return -1;
+	       if ( y._op < x._op ) return 1;
+	
+	       // operators must be the same, fewer operands first (a*b < a*a*b),
+	       // then compare operands in order
+	       const size_t nx = x.arity(), ny = y.arity();
+	       if ( nx != ny ) return nx < ny ? -1 : 1;
+	       for ( size_t i = nx; i-- > 0; )
+		  todo.push_back( CompareItem( x.operand( i ), y.operand( i ) ) );
+	       continue;
 	    }
-	    // everything the same!
-	    return false;  // a*a !< a*a
+	    // both are non-ops
+	    const int c = x.getValue().compare( y.getValue() );
+	    if ( c ) return c < 0 ? -1 : 1;
 	 }
-	 // both are non-ops
-	 return getValue() < s.getValue();
+	 return 0;  // everything the same!
       }
 
       //-----------------------------------------------------------------------------
       // tests if the two expressions are EXACTLY the same, not equivalent 
       bool operator==( const Sym &s ) const 
       {
-	 if ( this->isLeaf() ) // must be a variable or number
+	 if ( _hash != s._hash || _size != s._size ) return false;
+	 // follow left operands directly, right operands wait on a stack
+	 std::vector< std::pair<const Sym*, const Sym*> > rest;
+	 const Sym *a = this, *b = &s;
+	 for (;;)
 	 {
-	    if ( !s.isLeaf() ) return false;
-	    // Numbers?
-	    if ( this->isRationalValue() && s.isRationalValue() )
-	       return this->getNumerator() * s.getDenominator() == s.getNumerator() * this->getDenominator();
-	    if ( this->isRationalValue() || s.isRationalValue() ) return false;
-	    // Variable.
-	    return getValue() == s.getValue();
-	 }
-
-	 // Must be an operator
-	 if ( _op != s._op ) return false;
-    
-	 if ( _left && s._left )
-	 {
-	    if (!(*_left == *s._left)) return false;
-	 }
-	 else if (_left || s._left) return false;
+	    if ( a->_hash != b->_hash ) return false;
+	    if ( a == b ) {}  // shared subtree
+	    else if ( a->isLeaf() ) // must be a variable or number
+	    {
+	       if ( !b->isLeaf() ) return false;
+	       // Numbers?
+	       if ( a->isRationalValue() && b->isRationalValue() )
+	       {
+		  if ( !(a->getRational() == b->getRational()) ) return false;
+	       }
+	       else if ( a->isRationalValue() || b->isRationalValue() ) return false;
+	       // Variable.
+	       else if ( a->getValue() != b->getValue() ) return false;
+	    }
+	    else 
+	    {
+	       // Must be an operator
+	       if ( a->_op != b->_op ) return false;
+	       if ( a->isNary() || b->isNary() )  // same operands, in order
+	       {
+		  const size_t n = a->arity();
+		  if ( n != b->arity() ) return false;
+		  for ( size_t i = n; i-- > 1; )
+		     rest.push_back( std::make_pair( a->operand( i ), b->operand( i ) ) );
+		  a = a->operand( 0 );
+		  b = b->operand( 0 );
+		  continue;
+	       }
+	       if ( (!a->_left) != (!b->_left) || (!a->_right) != (!b->_right) ) return false;
 
-	 if ( _right && s._right )
-	 {
-	    if (!(*_right == *s._right)) return false; 
+	       if ( a->_right ) rest.push_back( std::make_pair( a->_right.getPtr(), b->_right.getPtr() ) );
+	       if ( a->_left ) 
+	       {
+		  a = a->_left;
+		  b = b->_left;
+		  continue;
+	       }
+	    }
+	    if ( rest.empty() ) return true;
+	    a = rest.back().first;
+	    b = rest.back().second;
+	    rest.pop_back();
 	 }
-	 else if ( _right || s._right) return false;
-
-	 return true; 
       }
       //-----------------------------------------------------------------------------
       bool operator==( const std::string &s ) const 
@@ -594,162 +744,316 @@ namespace Symath {
       // push negation down and to the left
       // push division down and to the right
       // (a/(-e) + b) * (c + d) = -(a)c/e + bc + -(a)d/e + bd (sum of products only)
+      //  Runs on an explicit stack, sums are as deep as they are long.  Each
+      //  frame is one level of the old recursion; a rule that ends in 
+      //  "(...).distribute()" just swaps the frame's expression (tail call).
       Sym distribute() const {
-
-	 if ( isRational() ) return *this;  // effectively a leaf, could be #1/#2
-	 if ( isRationalValue() ) // we have one or more negates in front of a number
+	 enum { ENTER, NEG_DONE, TIMES_LEFT, TIMES_RIGHT, DIV_LEFT, DIV_RIGHT,
+		BOTH_LEFT, BOTH_RIGHT, LEFT_ONLY, RIGHT_ONLY };
+	 std::deque<Frame> stack( 1, Frame( this ) );
+	 Sym ret;
+	 while ( !stack.empty() )
 	 {
-	    return Sym( this->getNumerator(), this->getDenominator() );
-	 }
-
-	 if ( isNegateOp() ) // push negates down to leaves of product expressions -(a*b) --> (-a) * b
-	 {
-	    if ( _left->_op == TIMES ) // -(a * b) --> (-a) * b
-	    {
-	       return ((-*(_left->_left)) * *(_left->_right)).distribute();
-	    }
-	    if ( _left->_op == PLUS ) // -(a + b) --> (-a) + (-b)
-	    {
-	       return ((-*(_left->_left)) + (-*(_left->_right))).distribute();
-	    }
-	    if ( _left->_op == DIV )  // -(a / b ) --> (-a) / b
-	    {
-	       return ((-*(_left->_left)) / (*(_left->_right))).distribute();
-	    }
-	    if ( _left->isMinusOp() )  // -(a - b) --> (-a) + b
+	    Frame &f = stack.back();
+	    const Sym &s = *f.node;
+	    switch ( f.stage )
 	    {
-	       return ((-*(_left->_left)) + (*(_left->_right))).distribute();
-	    }
-	    if ( _left->isNegateOp() )  // -(-a) --> a
-	    {
-	       return _left->_left->distribute();
-	    }
-	    if (!_left->isLeaf())
-	    {
-	       std::cerr << " **** WTF **** ";
-	    }
-	    return - _left->distribute();
-	 }
+	       case ENTER:
+	       {
+		  if ( s.isRational() ) break;  // effectively a leaf, could be #1/#2
+		  if ( s.isRationalValue() ) // we have one or more negates in front of a number
+		  {
+		     const Sym r( s.getRational() );
+		     stack.pop_back();
+		     ret = r;
+		     continue;
+		  }
+		  if ( s.isNary() )  // the rules below are written for binary trees
+		  {
+		     f.become( s.binaryForm() );
+		     continue;
+		  }
+
+		  if ( s.isNegateOp() ) // push negates down to leaves of product expressions -(a*b) --> (-a) * b
+		  {
+		     const Sym &l = *s._left;
+		     if ( l.isNary() )
+		     {
+			f.become( -l.binaryForm() );
+			continue;
+		     }
+		     if ( l._op == TIMES ) // -(a * b) --> (-a) * b
+		     {
+			f.become( (-*(l._left)) * *(l._right) );
+			continue;
+		     }
+		     if ( l._op == PLUS ) // -(a + b) --> (-a) + (-b)
+		     {
+			f.become( (-*(l._left)) + (-*(l._right)) );
+			continue;
+		     }
+		     if ( l._op == DIV )  // -(a / b ) --> (-a) / b
+		     {
+			f.become( (-*(l._left)) / (*(l._right)) );
+			continue;
+		     }
+		     if ( l.isMinusOp() )  // -(a - b) --> (-a) + b
+		     {
+			f.become( (-*(l._left)) + (*(l._right)) );
+			continue;
+		     }
+		     if ( l.isNegateOp() )  // -(-a) --> a
+		     {
+			f.node = l._left;   // still owned by |s|
+			continue;
+		     }
+		     if (!l.isLeaf() && l._op != SIN && l._op != COS && l._op != POW)  // -Sin(a) is fine
+		     {
+			std::cerr << " **** WTF **** ";
+		     }
+		     f.stage = NEG_DONE;
+		     stack.push_back( Frame( s._left ) );
+		     continue;
+		  }
+
+		  if ( s._op == TIMES )  // l*r
+		     f.stage = TIMES_LEFT;
+		  else if ( s._op == DIV ) // l/r
+		     f.stage = DIV_LEFT;
+		  else if ( s._left && s._right )
+		     f.stage = BOTH_LEFT;
+		  else if ( s._left )
+		     f.stage = LEFT_ONLY;
+		  else if ( s._right )
+		  {
+		     f.stage = RIGHT_ONLY;
+		     stack.push_back( Frame( s._right ) );
+		     continue;
+		  }
+		  else break;
+		  stack.push_back( Frame( s._left ) );
+		  continue;
+	       }
 
-	 if ( _op == TIMES )  // l*r
-	 {
-	    Sym left = _left->distribute();
-	
-	    if ( left._op == PLUS )  // (a + b) * c  --> (a*c) + (b*c)
-	       return ((*left._left * *_right) + (*left._right * *_right)).distribute();
-	
-	    if ( left.isMinusOp() )  // (a - b) * c  --> (a*c) - (b*c)
-	       return ((*left._left * *_right) - (*left._right * *_right)).distribute();
-
-	    Sym right = _right->distribute();
-
-	    if ( right.isRational() )  // Move rational to the left.
-	       return right * left;
-	    
-	    // (a / b) * (c / d) --> (a*c) / (b * d)
-	    if ( left._op == DIV && right._op == DIV ) 
-	       return ((*left._left * *right._left) / (*left._right * *right._right)).distribute();
-
-	    // (a / b) * c --> c * (a / b)
-	    if ( left._op == DIV ) 
-	       return (right * left).distribute();
-
-	    // a * (b + c)  --> (a*b) + (a*c)
-	    if ( right._op == PLUS ) 
-	       return ((left * *right._left) + (left * *right._right)).distribute();
-
-	    // a * (b - c)  --> (a*b) - (a*c)
-	    if ( right.isMinusOp() ) 
-	       return ((left * *right._left) - (left * *right._right)).distribute();
-
-	    if ( left._op == TIMES )
-	    { 
-	       // (a * (b / c))*d --> (a*b*d)/c  // looks like this could be a*(b/c) --> (a*b)/c
-	       if (left._right->_op == DIV) 
-		  return ((*left._left * *left._right->_left * right) / *left._right->_right).distribute();
-	    }
+	       case NEG_DONE:
+	       {
+		  const Sym r( -ret );
+		  stack.pop_back();
+		  ret = r;
+		  continue;
+	       }
 
-	    // We tried, did left, did right, but no luck, done.
-	    return left * right;
-	 }
-    
-	 if ( _op == DIV ) // l/r
-	 {
-	    Sym left = _left->distribute();
+	       case TIMES_LEFT:
+	       {
+		  const Sym &left = ret;
 	
-	    if ( left._op == PLUS )  // (a + b) / c  --> (a/c) + (b/c)
-	       return ((*left._left / *_right) + (*left._right / *_right)).distribute();
-
-	    if ( left.isMinusOp() )  // (a - b) / c  --> (a/c) - (b/c)
-	       return ((*left._left / *_right) - (*left._right / *_right)).distribute();
+		  if ( left._op == PLUS )  // (a + b) * c  --> (a*c) + (b*c)
+		  {
+		     f.become( (*left._left * *s._right) + (*left._right * *s._right) );
+		     continue;
+		  }
+		  if ( left.isMinusOp() )  // (a - b) * c  --> (a*c) - (b*c)
+		  {
+		     f.become( (*left._left * *s._right) - (*left._right * *s._right) );
+		     continue;
+		  }
+		  f.left = left.copyMaybe();
+		  f.stage = TIMES_RIGHT;
+		  stack.push_back( Frame( s._right ) );
+		  continue;
+	       }
 
-	    if ( left._op == DIV ) // (a / b) / c --> a / (b * c)
-	       return (*left._left / (*left._right * *_right)).distribute();
+	       case TIMES_RIGHT:
+	       {
+		  const Sym &left = *f.left, &right = ret;
+
+		  if ( right.isRational() )  // Move rational to the left.
+		  {
+		     const Sym r( right * left );
+		     stack.pop_back();
+		     ret = r;
+		     continue;
+		  }
+		  // (a / b) * (c / d) --> (a*c) / (b * d)
+		  if ( left._op == DIV && right._op == DIV ) 
+		     f.become( (*left._left * *right._left) / (*left._right * *right._right) );
+		  // (a / b) * c --> c * (a / b)
+		  else if ( left._op == DIV ) 
+		     f.become( right * left );
+		  // a * (b + c)  --> (a*b) + (a*c)
+		  else if ( right._op == PLUS ) 
+		     f.become( (left * *right._left) + (left * *right._right) );
+		  // a * (b - c)  --> (a*b) - (a*c)
+		  else if ( right.isMinusOp() ) 
+		     f.become( (left * *right._left) - (left * *right._right) );
+		  // (a * (b / c))*d --> (a*b*d)/c  // looks like this could be a*(b/c) --> (a*b)/c
+		  else if ( left._op == TIMES && left._right->_op == DIV )
+		     f.become( (*left._left * *left._right->_left * right) / *left._right->_right );
+		  else
+		  {
+		     // We tried, did left, did right, but no luck, done.
+		     const Sym r( left * right );
+		     stack.pop_back();
+		     ret = r;
+		  }
+		  continue;
+	       }
 
-	    if ( left._op == TIMES )
-	    {
-	       if (left._right->_op == DIV) // (a*(b/c))/d --> (a*b)/(d*c)
-		  return ((*left._left * *left._right->_left) / (*_right * *left._right->_right)).distribute();
-	    }
+	       case DIV_LEFT:
+	       {
+		  const Sym &left = ret;
 	
-	    Sym right = _right->distribute();
+		  if ( left._op == PLUS )  // (a + b) / c  --> (a/c) + (b/c)
+		     f.become( (*left._left / *s._right) + (*left._right / *s._right) );
+		  else if ( left.isMinusOp() )  // (a - b) / c  --> (a/c) - (b/c)
+		     f.become( (*left._left / *s._right) - (*left._right / *s._right) );
+		  else if ( left._op == DIV ) // (a / b) / c --> a / (b * c)
+		     f.become( *left._left / (*left._right * *s._right) );
+		  else if ( left._op == TIMES && left._right->_op == DIV ) // (a*(b/c))/d --> (a*b)/(d*c)
+		     f.become( (*left._left * *left._right->_left) / (*s._right * *left._right->_right) );
+		  else
+		  {
+		     f.left = left.copyMaybe();
+		     f.stage = DIV_RIGHT;
+		     stack.push_back( Frame( s._right ) );
+		  }
+		  continue;
+	       }
 
-	    if (right.isRational())
-	       return (one()/right) * left;
-	    
-	    if ( right._op == DIV ) //  a / (b / c) --> (a*c)/b
-	       return (( left * *right._right ) / *right._left).distribute();
-	
-	    // a / b --> a * (1/b) (unless they are rationals)
-	    if ( ! (left.isOne() || left.isNegOne())  )  
-	       return (left * ( one() / right)).distribute();
+	       case DIV_RIGHT:
+	       {
+		  const Sym &left = *f.left, &right = ret;
+
+		  if (right.isRational())
+		  {
+		     const Sym r( (one()/right) * left );
+		     stack.pop_back();
+		     ret = r;
+		  }
+		  else if ( right._op == DIV ) //  a / (b / c) --> (a*c)/b
+		     f.become( ( left * *right._right ) / *right._left );
+		  // a / b --> a * (1/b) (unless they are rationals)
+		  else if ( ! (left.isOne() || left.isNegOne())  )  
+		     f.become( left * ( one() / right ) );
+		  else
+		  {
+		     const Sym r( left / right );
+		     stack.pop_back();
+		     ret = r;
+		  }
+		  continue;
+	       }
 
-	    return left / right;
-	 }
+	       case BOTH_LEFT:
+		  f.left = ret.copyMaybe();
+		  f.stage = BOTH_RIGHT;
+		  stack.push_back( Frame( s._right ) );
+		  continue;
+
+	       case BOTH_RIGHT:
+	       {
+		  const Sym r( s._op, f.left, ret.copyMaybe() );
+		  stack.pop_back();
+		  ret = r;
+		  continue;
+	       }
 
-	 if ( _left && _right )
-	    return Sym(_op, 
-		       _left->distribute().copyMaybe(), _right->distribute().copyMaybe());
-	 if ( _left )
-	    return Sym(_op, _left->distribute().copyMaybe());
-	 if ( _right )
-	    return Sym(_op, NULL, _right->distribute().copyMaybe());
+	       case LEFT_ONLY:
+	       {
+		  const Sym r( s._op, ret.copyMaybe() );
+		  stack.pop_back();
+		  ret = r;
+		  continue;
+	       }
 
-	 return *this;
+	       case RIGHT_ONLY:
+	       {
+		  const Sym r( s._op, NULL, ret.copyMaybe() );
+		  stack.pop_back();
+		  ret = r;
+		  continue;
+	       }
+	    }
+	    // leaf, nothing to do
+	    const Sym r( s );
+	    stack.pop_back();
+	    ret = r;
+	 }
+	 return ret;
       }
 
       /// convert subtractions to negations, push all negates down to non-PLUS nodes.
       /// -(a + (b*a - c)) -> (-a) + ((-b)*a + c)
       Sym makeAdditive() const 
       {
-	 if ( isLeaf() )
-	    return *this;
-
-	 // a - b = a + (-b)
-	 if ( isMinusOp() )
-	 {
-	    return _left->makeAdditive() + (-*_right).makeAdditive();
-	 }
-
-	 // -(e)
-	 if ( isNegateOp() ) 
+	 enum { ENTER, SUM_LEFT, SUM_RIGHT, NEG_MINUS };
+	 std::deque<Frame> stack( 1, Frame( this ) );
+	 Sym ret;
+	 while ( !stack.empty() )
 	 {
-	    // -(a+b) -> (-a) + (-b)
-	    if ( _left->_op == PLUS )
-	    {
-	       return ((-*_left->_left).makeAdditive() + (-*_left->_right).makeAdditive());
-	    }
-	    // -(a-b) -> (-a) + b
-	    if ( _left->isMinusOp() )
+	    Frame &f = stack.back();
+	    const Sym &s = *f.node;
+	    switch ( f.stage )
 	    {
-	       return ((-*_left->_left).makeAdditive() + *_left->_right).makeAdditive();
+	       case ENTER:
+		  // a - b = a + (-b)
+		  if ( s.isMinusOp() )
+		  {
+		     f.right = (-*s._right).copyMaybe();
+		     f.stage = SUM_LEFT;
+		     stack.push_back( Frame( s._left ) );
+		     continue;
+		  }
+		  // -(e)
+		  if ( s.isNegateOp() ) 
+		  {
+		     const Sym &l = *s._left;
+		     if ( l.isNary() && l._op == PLUS )
+		     {
+			f.become( -l.binaryForm() );
+			continue;
+		     }
+		     // -(a+b) -> (-a) + (-b)
+		     if ( l._op == PLUS )
+		     {
+			f.right = (-*l._right).copyMaybe();
+			f.stage = SUM_LEFT;
+			stack.push_back( Frame( -*l._left ) );
+			continue;
+		     }
+		     // -(a-b) -> (-a) + b
+		     if ( l.isMinusOp() )
+		     {
+			f.stage = NEG_MINUS;
+			stack.push_back( Frame( -*l._left ) );
+			continue;
+		     }
+		  }
+		  break;
+
+	       case SUM_LEFT:
+		  f.left = ret.copyMaybe();
+		  f.stage = SUM_RIGHT;
+		  stack.push_back( Frame( f.right ) );
+		  continue;
+
+	       case SUM_RIGHT:
+	       {
+		  const Sym r( *f.left + ret );
+		  stack.pop_back();
+		  ret = r;
+		  continue;
+	       }
+
+	       case NEG_MINUS:
+		  f.become( ret + *s._left->_right );
+		  continue;
 	    }
+	    const Sym r( s );
+	    stack.pop_back();
+	    ret = r;
 	 }
-
-	 return *this;
-	 // return Sym(_op,
-	 //	    _left ? _left->makeAdditive().copyMaybe() : NULL,
-	 //	    _right ? _right->makeAdditive().copyMaybe() : NULL);
+	 return ret;
       }
 
       //-----------------------------------------------------------------------------
@@ -757,28 +1061,38 @@ namespace Symath {
       // works best if you call distribute before gathering subexpressions
       void getAdditiveSubexps(SymPVec* spv) const
       {
-	 // a-b -> a + (-b) 
-	 if ( isMinusOp() ) 
+	 std::vector<const Sym*> todo( 1, this );
+	 SymPVec made;  // keeps negated operands alive while they are traversed
+	 while ( !todo.empty() )
 	 {
-	    _left->getAdditiveSubexps(spv);
-	    // negate right, then traverse
-	    (-*_right).getAdditiveSubexps(spv);
-	    return;
-	 }
-	 // -(a+b) -> (-a) + (-b)
-	 if ( isNegateOp() && (_left->_op == PLUS || _left->isMinusOp()) ) 
-	 {
-	    // we are a negate op, see if it helps to "makeAdditive"
-	    this->makeAdditive().getAdditiveSubexps(spv);
-	    return;
-	 }
-	 if ( _op != PLUS )  // non sum node, add this subexpression
-	 {
-	    spv->push_back( this->copyMaybe() );
-	    return;
+	    const Sym &s = *todo.back();
+	    todo.pop_back();
+	    // a-b -> a + (-b) 
+	    if ( s.isMinusOp() ) 
+	    {
+	       // negate right, then traverse
+	       made.push_back( (-*s._right).copyMaybe() );
+	       todo.push_back( made.back() );
+	       todo.push_back( s._left );
+	       continue;
+	    }
+	    // -(a+b) -> (-a) + (-b)
+	    if ( s.isNegateOp() && (s._left->_op == PLUS || s._left->isMinusOp()) ) 
+	    {
+	       // we are a negate op, see if it helps to "makeAdditive"
+	       made.push_back( s.makeAdditive().copyMaybe() );
+	       todo.push_back( made.back() );
+	       continue;
+	    }
+	    if ( s._op != PLUS )  // non sum node, add this subexpression
+	    {
+	       spv->push_back( s.copyMaybe() );
+	       continue;
+	    }
+	    for ( size_t i = s._args.size(); i-- > 0; ) todo.push_back( s._args[i] );
+	    if ( s._right ) todo.push_back( s._right );
+	    if ( s._left  ) todo.push_back( s._left );
 	 }
-	 if ( _left  ) _left->getAdditiveSubexps( spv );
-	 if ( _right ) _right->getAdditiveSubexps( spv );
       }
 
       // returns true if there was a negation.
@@ -786,30 +1100,76 @@ namespace Symath {
       bool getMultiplicitiveSubexps(SymPVec *spv) const
       {
 	 bool flip_sign = false;
-	 if ( isNegateOp() ) 
+	 std::vector<const Sym*> todo( 1, this );
+	 while ( !todo.empty() )
 	 {
-	    flip_sign = !flip_sign;
-	    if (_left->getMultiplicitiveSubexps( spv ))
+	    const Sym &s = *todo.back();
+	    todo.pop_back();
+	    if ( s.isNegateOp() ) 
+	    {
 	       flip_sign = !flip_sign;
-	    return flip_sign;
+	       todo.push_back( s._left );
+	       continue;
+	    }
+	    if ( s._op != TIMES )
+	    {
+	       spv->push_back( s.copyMaybe() );
+	       continue;
+	    }
+	    for ( size_t i = s._args.size(); i-- > 0; ) todo.push_back( s._args[i] );
+	    if ( s._right ) todo.push_back( s._right );
+	    if ( s._left  ) todo.push_back( s._left );
 	 }
-	 if ( _op != TIMES )
+	 return flip_sign;
+      }
+
+      // numeric coefficient of a product, the other factors go in spv
+      Rational getCoefficient(SymPVec *spv) const
+      {
+	 SymPVec factors;
+	 Rational c( getMultiplicitiveSubexps( &factors ) ? -1 : 1 );
+	 for ( SymPVecIter f = factors.begin(); f != factors.end(); ++f )
 	 {
-	    spv->push_back( this->copyMaybe() );
-	    return flip_sign;
+	    if ( (*f)->isRationalValue() ) c = c * (*f)->getRational();
+	    else spv->push_back( *f );
+	 }
+	 return c;
+      }
+
+      //-----------------------------------------------------------------------------
+      // post-order walk, operands before operators, explicit stack so deep
+      // sums are fine.  visitor->enter(s) on reaching s returns false when
+      // s is already handled, otherwise its operands are walked and then
+      // visitor->leave(s) is called.
+      template <class Visitor>
+      static void walk(const Sym &root, Visitor *visitor)
+      {
+	 std::vector< std::pair<const Sym*, bool> > stack( 1, std::make_pair( &root, false ) );
+	 while ( !stack.empty() )
+	 {
+	    const Sym *s = stack.back().first;
+	    if ( stack.back().second )
+	    {
+	       stack.pop_back();
+	       visitor->leave( *s );
+	       continue;
+	    }
+	    if ( !visitor->enter( *s ) )
+	    {
+	       stack.pop_back();
+	       continue;
+	    }
+	    stack.back().second = true;
+	    for ( size_t i = s->_args.size(); i-- > 0; )
+	       stack.push_back( std::make_pair( (const Sym*)s->_args[i].getPtr(), false ) );
+	    if ( s->_right ) stack.push_back( std::make_pair( (const Sym*)s->_right.getPtr(), false ) );
+	    if ( s->_left  ) stack.push_back( std::make_pair( (const Sym*)s->_left.getPtr(), false ) );
 	 }
-	 if ( _left ) 
-	    if (_left->getMultiplicitiveSubexps( spv ))
-	       flip_sign = !flip_sign;
-	 if ( _right ) 
-	    if (_right->getMultiplicitiveSubexps( spv ))
-	       flip_sign = !flip_sign;
-	 return flip_sign;
       }
 
       struct SymPComp {
 	 bool operator() (const SymSP& a, const SymSP& b) {
-	    return (*a) < (*b);
+	    return order( *a, *b ) < 0;
 	 }
       } sym_ptr_comp;
 
@@ -817,7 +1177,8 @@ namespace Symath {
       // Returns an expression that is the sum of multiplies, with all 
       // expressions sorted.  If two different but equivalent expressions
       // are placed in normal form, we should be able to detect equivalence
-      // a*(a-b)+(a+b)(a+b)+c --> c + -a*b + a*a + a*a + a*b + a*b + b*b
+      // a*(a-b)+(a+b)(a+b)+c --> c + -a*b + b*b + a*b + a*b + a*a + a*a  (terms in order())
+      //  The result is an n-ary sum of n-ary products, see sum() and product().
       Sym sortedForm(bool distrib = true) const {
 	 if ( isLeaf() )
 	    return *this;
@@ -843,35 +1204,87 @@ namespace Symath {
 		  // recurse, sorted these sub expressions first
 		  (*miter) = (*miter)->sortedForm(false).copyMaybe();
 	       }
-	       // sort * subexps
-	       multexps.sort(sym_ptr_comp);
-
-	       // rebuild multiplicitive expression tree from sortedd subexps
-	       Sym mexp(one());
-	       if ( neg )	    // don't forget to return the negative we stripped off
-		  mexp = -mexp; // keep negates as close to leaves as possible
-	       for (SymPVecIter miter = multexps.begin(), mend = multexps.end(); miter != mend; ++miter)
-	       {
-		  mexp = mexp * *(*miter);
-	       }
-	       // replace expression in list
-	       (*aiter) = mexp.copyMaybe();
-	    }
-	    else // only one expression, do not recurse, put the negative back tho
-	    {
-	       if (neg)
-		  (*multexps.begin()) = (-*(*multexps.begin())).copyMaybe();
+	       if ( neg )  // don't forget to return the negative we stripped off
+		  multexps.push_back( Sym(-1).copyMaybe() );
+	       // replace expression in list with the sorted product
+	       (*aiter) = product(multexps).copyMaybe();
 	    }
+	    // only one expression, do not recurse, the term keeps its negative
 	 }
-	 // sort additive subexpressions
-	 addexps.sort(sym_ptr_comp);
-	 // rebuild entire expression
-	 Sym aexp(zero());
-	 for (SymPVecIter aiter = addexps.begin(), aend = addexps.end(); aiter != aend; ++aiter)
+	 // sort additive subexpressions into one sum
+	 return sum(addexps);
+      }
+
+      //-----------------------------------------------------------------------------
+      /// n-ary sum of |terms|.  Nested sums are flattened, rational terms are
+      /// folded into one leading constant and the other terms are sorted.
+      static Sym sum( const SymPVec &terms )
+      {
+	 SymPVec flat;
+	 for ( SymPVec::const_iterator t = terms.begin(); t != terms.end(); ++t )
+	    (*t)->getAdditiveSubexps( &flat );
+
+	 Rational constant( 0 );
+	 SymArgs args;
+	 args.reserve( flat.size() + 1 );
+	 args.push_back( SymSP(0) );  // room for the constant
+	 for ( SymPVecIter t = flat.begin(); t != flat.end(); ++t )
+	 {
+	    if ( (*t)->isRationalValue() ) constant = constant + (*t)->getRational();
+	    else args.push_back( *t );
+	 }
+	 std::stable_sort( args.begin() + 1, args.end(), SymPComp() );
+
+	 if ( constant.isZero() ) args.erase( args.begin() );  // 0 + x
+	 else args[0] = Sym( constant ).copyMaybe();
+	 if ( args.empty() ) return zero();
+	 if ( args.size() == 1 ) return *args[0];
+	 return Sym( PLUS, args );
+      }
+
+      //-----------------------------------------------------------------------------
+      /// n-ary product of |factors|.  Nested products are flattened, rationals
+      /// and negates are folded into one leading scale and the other factors
+      /// are sorted.  A scale of -1 negates the first factor, -1*a*b --> -a*b
+      static Sym product( const SymPVec &factors )
+      {
+	 SymPVec flat;
+	 bool neg = false;
+	 for ( SymPVec::const_iterator f = factors.begin(); f != factors.end(); ++f )
+	    if ( (*f)->getMultiplicitiveSubexps( &flat ) ) neg = !neg;
+
+	 Rational scale( neg ? -1 : 1 );
+	 SymArgs args;
+	 args.reserve( flat.size() + 1 );
+	 args.push_back( SymSP(0) );  // room for the scale
+	 for ( SymPVecIter f = flat.begin(); f != flat.end(); ++f )
+	 {
+	    if ( (*f)->isRationalValue() ) scale = scale * (*f)->getRational();
+	    else args.push_back( *f );
+	 }
+	 if ( scale.isZero() ) return zero();  // 0 * x = 0
+	 if ( args.size() == 1 ) return Sym( scale );
+	 std::stable_sort( args.begin() + 1, args.end(), SymPComp() );
+
+	 if ( scale.isOne() || scale.isNegOne() ) 
 	 {
-	    aexp = aexp + *(*aiter);
+	    args.erase( args.begin() );
+	    if ( scale.isNegOne() ) args[0] = (-*args[0]).copyMaybe();
 	 }
-	 return aexp;
+	 else args[0] = Sym( scale ).copyMaybe();
+	 if ( args.size() == 1 ) return *args[0];
+	 return Sym( TIMES, args );
+      }
+
+      //-----------------------------------------------------------------------------
+      /// the same expression with n-ary operands folded into a left-leaning binary tree
+      Sym binaryForm() const
+      {
+	 if ( !isNary() ) return *this;
+	 Sym tree( _op, _args[0], _args[1] );
+	 for ( size_t i = 2; i < _args.size(); ++i )
+	    tree = Sym( _op, tree.copyMaybe(), _args[i] );
+	 return tree;
       }
 
       // +/- rational scale factor applied to an expression ex: 2*a*3/-2 --> -3
@@ -879,6 +1292,13 @@ namespace Symath {
 	 if ( this->isRational() ) return *this;
 	 if ( this->isNegateOp() ) return -(this->_left->GetMultiple());
 	 if (!(_op == TIMES || _op == DIV)) return one();
+	 if ( _op == TIMES && isNary() )
+	 {
+	    Sym multiple( one() );
+	    for ( size_t i = 0; i < _args.size(); ++i )
+	       multiple = multiple * _args[i]->GetMultiple();
+	    return multiple;
+	 }
 	 if ( _op == TIMES )
 	 {
 	    return _left->GetMultiple() * _right->GetMultiple();
@@ -896,242 +1316,334 @@ namespace Symath {
       //  (a + b) * (b + a) --> a*a + 2*a*b + b*b
       // the == compare operator should return true when any pair if equivalent expressions
       // are both in normal form.  ie   -a * (b - a) + 3*a*b - b*-b --> a*a + 2ab + b*b
+      //  Explicit stack like distribute(), a frame per level of the old recursion.
       Sym normalForm(bool sorted_form = true) const
       {
-	 Sym std_form = sorted_form ? this->sortedForm() : (*this);
-	 // no additive subexpressions to cancel at this level, recurse on subexpressions.
-	 if ( ! (std_form._op == PLUS || std_form.isMinusOp()) )
-	 {
-	   if (std_form._left || std_form._right) {  // carefull to never copy leaf nodes.
-	     if (std_form._op == TIMES) {
-	       return std_form._left->normalForm() * std_form._right->normalForm();
-	     }
-	     //std::cout << "creating symbol for " << this->toString() << ",";
-	     return Sym(std_form._op, 
-			std_form._left ? std_form._left->normalForm().copyMaybe() : NULL,
-			std_form._right ? std_form._right->normalForm().copyMaybe() : NULL);
-	   }
-	   return *this;
-	 }
-
-	 SymPVec subexps;
-    
-	 /// grab all sub expression connected by addition (commute trivially)    
-	 std_form.getAdditiveSubexps( &subexps );
-       
-	 if ( subexps.size() <= 1 ) std::cerr << "badness in cancel" << std::endl;
-  
-	 /// double loop, summs up the multiplicity of repeated subexpressions, eliminates those that sum to 0
-	 SymPVecIter spviA = subexps.begin();
-	 while ( spviA != subexps.end() ) 
+	 enum { ENTER, OP_LEFT, OP_RIGHT, FACTOR, SUM_TERM };
+	 std::deque<Frame> stack( 1, Frame( this ) );
+	 stack.back().sorted = sorted_form;
+	 Sym ret;
+	 while ( !stack.empty() )
 	 {
-	    if ( !(*spviA) ) std::cerr << " BOOM " << std::endl;
-	    Sym& left_exp = **spviA;
-	    if ( left_exp.isZero() )  // already zero, remove
+	    Frame &f = stack.back();
+	    switch ( f.stage )
 	    {
-	       subexps.erase(spviA++);
-	       continue;
-	    }
-       
-	    Sym left_multiple = left_exp.GetMultiple();
-	    assert(left_multiple.isRational());
-	    Sym left = (left_exp / left_multiple).sortedForm();
-
-	    Sym new_multiple = left_multiple; 
-
-	    SymPVecIter spviB = spviA;
-	    //std::cout << " doing " << left_exp.toString() << ", " << left_multiple.toString() << " base: "  << left.toString()
-	    //	      << std::endl;;
-	    ++spviB;
-	    while ( spviB != subexps.end() ) // check against every other remaining expression
-	    {
-	       if ( !(*spviB) ) std::cerr << " BOMB " << std::endl;
-	       Sym& right_exp = **spviB;
-	       Sym right_multiple = right_exp.GetMultiple();
-	       assert(right_multiple.isRational());
-	       /// is 0, remove
-	       if ( right_exp.isZero() || right_multiple.isZero() )
+	       case ENTER:
 	       {
-		  subexps.erase(spviB++);
+		  f.left = f.sorted ? f.node->sortedForm().copyMaybe() : SymSP(0);
+		  const Sym &std_form = f.sorted ? *f.left : *f.node;
+		  // no additive subexpressions to cancel at this level, recurse on subexpressions.
+		  if ( ! (std_form._op == PLUS || std_form.isMinusOp()) )
+		  {
+		     if ( f.sorted )   // std_form is our node now, keep it alive
+		     {
+			f.keep = f.left;
+			f.node = f.keep;
+		     }
+		     if (std_form.isLeaf()) break;  // a leaf is its own normal form
+		     if (std_form._op == TIMES)  // normalize the factors, then a sorted product
+		     {
+			if ( std_form.isNary() ) f.terms.assign( std_form._args.begin(), std_form._args.end() );
+			else
+			{
+			   f.terms.push_back( std_form._left );
+			   f.terms.push_back( std_form._right );
+			}
+			f.next = f.terms.begin();
+			f.stage = FACTOR;
+			stack.push_back( Frame( *f.next ) );
+		     }
+		     else if ( std_form._left ) 
+		     {
+			f.stage = OP_LEFT;
+			stack.push_back( Frame( std_form._left ) );
+		     }
+		     else
+		     {
+			f.stage = OP_RIGHT;
+			f.left = 0;
+			stack.push_back( Frame( std_form._right ) );
+		     }
+		     continue;
+		  }
+
+		  /// grab all sub expression connected by addition (commute trivially)    
+		  std_form.getAdditiveSubexps( &f.terms );
+		  if ( f.terms.size() <= 1 ) std::cerr << "badness in cancel" << std::endl;
+		  combineLikeTerms( &f.terms );
+
+		  // Assemble new expression.
+		  f.next = f.terms.begin();
+		  f.stage = SUM_TERM;
+		  if ( f.next == f.terms.end() ) break;
+		  // recurse on sub-expressions, no need to sorted again.
+		  stack.push_back( Frame( *f.next ) );
+		  stack.back().sorted = false;
 		  continue;
 	       }
-	       Sym right = (right_exp / right_multiple).sortedForm();
-	       //std::cout << right.toString() << " ";
-	       if ( left == right ) // A match!
+
+	       case OP_LEFT:
+		  f.left = ret.copyMaybe();
+		  if ( f.node->_right )
+		  {
+		     f.stage = OP_RIGHT;
+		     stack.push_back( Frame( f.node->_right ) );
+		     continue;
+		  }
+		  else
+		  {
+		     const Sym r( f.node->_op, f.left );
+		     stack.pop_back();
+		     ret = r;
+		     continue;
+		  }
+
+	       case OP_RIGHT:
 	       {
-		  //std::cout << "== ";
-		  // sum their multiples:  3a + (1/3)a == 10/3a
-		  new_multiple = new_multiple + right_multiple;
-		  // delete duplicate expression
-		  subexps.erase(spviB++);
+		  const Sym r( f.node->_op, f.left, ret.copyMaybe() );
+		  stack.pop_back();
+		  ret = r;
 		  continue;
 	       }
-	       ++spviB;
-	    } /// end while B
-	    //std::cout << std::endl;
-	    // build the new summed expression. Don't introduce products with 0, 1 or -1
-	    if ( new_multiple.isZero() ) 
-	    {  // we can remove left, there are none
-	       subexps.erase(spviA++);
-	       continue;
-	    } 
-	    else if ( new_multiple == Sym(-1) )
-	       *spviA = (-left).copyMaybe();  // have to copy since we are assigning ourself.
-	    else if ( new_multiple == Sym(1) )
-	       *spviA = left.copyMaybe();
-	    else if ( !(new_multiple == left_multiple) )
-	    {
-	       *spviA = (new_multiple * left).copyMaybe();
-	    }
-	    ++spviA;
-	 } /// end while A
 
-	 // Assemble new expression.
-	 Sym sym(zero());
-	 for (SymPVecIter iter = subexps.begin(), end = subexps.end(); iter != end; ++iter)
-	 {
-	    // recurse on sub-expressions, no need to sorted again.
-	    Sym canceled = (*iter)->normalForm(false);
-	    sym = sym + canceled;
+	       case FACTOR:
+	       case SUM_TERM:
+		  f.done.push_back( ret.copyMaybe() );
+		  if ( ++f.next != f.terms.end() )
+		  {
+		     // sum terms are sorted already, factors are not
+		     const bool sorted = f.stage == FACTOR;
+		     stack.push_back( Frame( *f.next ) );
+		     stack.back().sorted = sorted;
+		     continue;
+		  }
+		  break;
+	    }
+	    // done: leaves come back in sorted form
+	    const Sym r( f.stage == SUM_TERM ? sum( f.done ) : 
+			 f.stage == FACTOR   ? product( f.done ) : *f.node );
+	    stack.pop_back();
+	    ret = r;
 	 }
-
-	 return sym;
-      }
-      
-      //-----------------------------------------------------------------------------
-      /// Print as a tree
-      // helper, gets the right indent for any given value/operator name length
-      inline std::string getIndent(int indent) const 
-      {
-	 return std::string(indent, ' ');
+	 return ret;
       }
 
-      std::ostream& printTree(std::ostream &os, int indent = 0) const
+      /// sums up the multiplicity of repeated subexpressions, eliminates those that sum to 0
+      ///  3a + b + (1/3)a  -->  (10/3)a + b
+      ///  Each term's key (the term without its number, sorted) is made once
+      ///  and looked up in a map in order(), hash first, so n terms cost
+      ///  n log n compares.  Merged terms stay where the first one was.
+      static void combineLikeTerms( SymPVec *subexps )
       {
-	 /// negate node, or unitary func I want negs printed in-line  -*  or - A * B
-	 if ( this->_op != NOP && 
-	      ((this->_left && !this->_right) || (this->_right && !this->_left))  )
+	 typedef std::map<SymSP, size_t, bool (*)( const SymSP&, const SymSP& )> Keys;
+	 Keys keys( termBefore );
+	 struct Like {
+	    SymSP term;      ///< first term with this key, as it was
+	    SymSP key;
+	    Sym   first;     ///< its multiple
+	    Sym   multiple;  ///< sum of the multiples
+	 };
+	 std::vector<Like> like;
+	 for ( SymPVecIter t = subexps->begin(); t != subexps->end(); ++t )
 	 {
-	    Sym* sym = _left ? _left : _right;
-	    std::string str(getIndent(indent) + _op + " ");
-	    if ( sym->_op != NOP ) // operator
+	    if ( !(*t) ) std::cerr << " BOOM " << std::endl;
+	    if ( (*t)->isZero() ) continue;
+	    const Sym multiple = (*t)->GetMultiple();
+	    assert(multiple.isRational());
+	    if ( multiple.isZero() ) continue;
+	    const SymSP key = (**t / multiple).sortedForm().copyMaybe();
+	    Keys::iterator it = keys.find( key );
+	    if ( it != keys.end() )
 	    {
-	       str += sym->_op;
-	    }
-	    else if ( sym->isRational() )
-	    {
-	       std::stringstream ss;
-	       ss << _numerator;
-	       if (_denominator != 1)
-		  ss << "/" << _denominator;
-	       str += ss.str();
-	    }
-	    else if ( !sym->getValue().empty() )
-	    {
-	       str += sym->getValue();
+	       like[it->second].multiple = like[it->second].multiple + multiple;
+	       continue;
 	    }
-	    else  // one I guess? 
-	    {
-	       str += std::string("<?>");
+	    keys.insert( std::make_pair( key, like.size() ) );
+	    like.push_back( Like() );
+	    like.back().term = *t;
+	    like.back().key = key;
+	    like.back().first = multiple;
+	    like.back().multiple = multiple;
+	 }
+
+	 // build the new summed expressions. Don't introduce products with 0, 1 or -1
+	 subexps->clear();
+	 for ( size_t k = 0; k < like.size(); ++k )
+	 {
+	    const Like &l = like[k];
+	    if ( l.multiple.isZero() ) continue;
+	    if ( l.multiple == Sym(1) ) subexps->push_back( l.key );
+	    else if ( l.multiple == Sym(-1) || !(l.multiple == l.first) )
+	    {  // scale * key as one product, the way sortedForm() builds them
+	       SymPVec scaled;
+	       scaled.push_back( l.multiple.copyMaybe() );
+	       scaled.push_back( l.key );
+	       subexps->push_back( product( scaled ).copyMaybe() );
 	    }
+	    else subexps->push_back( l.term );
+	 }
+      }
+      
+      //-----------------------------------------------------------------------------
+      /// Print as a tree, one node per line (symwriter.h)
+      std::ostream& printTree( std::ostream &os, int indent = 0 ) const;
 
-	    if (sym->_left) sym->_left->printTree(os, str.length() + 1);
-	    os << str << "\n";
-	    if (sym->_right) sym->_right->printTree(os, str.length() + 1);
-	    return os;
-	 } /// END IF NEG NODE
+      /// infix text, see SymWriter in symwriter.h for buffers and options
+      std::string toString() const;
+      std::ostream& printInfix( std::ostream &os, const std::string &last_op = NOP ) const;
 
+      //-----------------------------------------------------------------------------
+      /// Compile to register bytecode for fast numeric evaluation (symprogram.h)
+      ///  |variables| gives the input order, other variables evaluate to NaN.
+      Program compile( const std::vector<std::string> &variables ) const;
 
-	 std::string str(getIndent(indent));
-	 if ( _op != NOP ) // operator
-	 {
-	    str += _op;
-	 }
-	 else if ( isRational() )
+      //-----------------------------------------------------------------------------
+      /// derivative with respect to |variable|, not simplified (symdiff.h)
+      Sym diff( const std::string &variable ) const;
+
+      //-----------------------------------------------------------------------------
+      /// normalForm() for big products of sums, the product is multiplied out
+      ///  in chunks on |threads| threads (0: one per core) and like terms are
+      ///  collected in hash tables (symexpand.h)
+      Sym expand( unsigned threads = 0 ) const;
+
+      //-----------------------------------------------------------------------------
+      /// |variable| replaced by |value|, for an expression in normalForm():
+      ///  only the terms that mention |variable| are normalized again and
+      ///  merged back, the result is the normalForm() of the substitution
+      ///  (symsubstitute.h)
+      Sym substitute( const std::string &variable, const Sym &value ) const;
+
+      /// |variable| replaced by |value|, no simplification.  Subtrees
+      ///  without |variable| are shared, not copied.
+      Sym replace( const std::string &variable, const Sym &value ) const;
+
+      //-----------------------------------------------------------------------------
+      /// Emit a standalone C++ function   inline double |name|( variables... )
+      ///  that evaluates this expression (symcodegen.h)
+      std::ostream &emitCpp( std::ostream &os,
+			     const std::string &name,
+			     const std::vector<std::string> &variables ) const;
+
+      //-----------------------------------------------------------------------------
+      /// standard ostream << printer
+      std::ostream &operator<<( std::ostream &os ) const
+      {
+	 return printInfix(os, TIMES);
+      }
+
+     protected:
+      //-----------------------------------------------------------------------------
+      /// Explicit stack helpers.  Expressions built by repeated += are as deep as
+      /// they are long, so the traversals above keep their own stacks.
+
+      /// one level of distribute(), makeAdditive() or normalForm(), frames live
+      /// in a std::deque so they never move (|next| points into |terms|)
+      struct Frame {
+	 explicit Frame( const Sym *n ) : node(n), stage(0), sorted(true) {}
+	 explicit Frame( const SymSP &n ) : node(n), keep(n), stage(0), sorted(true) {}
+	 explicit Frame( const Sym &built ) 
+	    : keep(built.copyMaybe()), stage(0), sorted(true) { node = keep; }
+
+	 /// tail call, continue with a new expression
+	 void become( const Sym &built ) 
 	 {
-	    std::stringstream ss;
-	    ss << _numerator;
-	    if (_denominator != 1)
-	       ss << "/" << _denominator;
-	    str += ss.str();
-	 }
-	 else if ( !_value.empty() )  // not operator, must be value_type
+	    SymSP n = built.copyMaybe();
+	    keep = n;
+	    node = n;
+	    stage = 0;
+	 }
+
+	 const Sym  *node;    ///< expression at this level
+	 SymSP       keep;    ///< owns |node| if it was built along the way
+	 int         stage;   ///< what the frame is waiting for
+	 bool        sorted;  ///< normalForm(sorted_form)
+	 SymSP       left;    ///< finished left operand, or partial result
+	 SymSP       right;   ///< right operand still to do
+	 SymPVec     terms;   ///< normalForm() sum terms or factors
+	 SymPVecIter next;    ///< the one being normalized
+	 SymPVec     done;    ///< normalized so far
+      };
+
+      /// pair of operands for compare(), or a tie-breaker if |a| is NULL
+      struct CompareItem {
+	 CompareItem( const Sym *x, const Sym *y ) : a(x), b(y), tie(0) {}
+	 explicit CompareItem( int t ) : a(0), b(0), tie(t) {}
+	 const Sym *a, *b;
+	 int tie;
+      };
+
+      /// set _hash, _size and _mentions from the operands' cached values,
+      ///  once, at construction (symbols are immutable after that)
+      void shape()
+      {
+	 size_t h = isRational() ? _rational.hash() : hashString( _op.empty() ? _value : _op );
+	 size_t n = 1;
+	 unsigned long long m = isVariable() ? variableBit( _value ) : 0;
+	 for ( size_t i = 0; i < _args.size(); ++i )
 	 {
-	    str += _value;
+	    h = hashCombine( h, _args[i]->_hash );
+	    n = addSize( n, _args[i]->_size );
+	    m |= _args[i]->_mentions;
 	 }
-	 else // WTF?
+	 if ( !isNary() )  // -a and Sin(a) differ by side as well as op
 	 {
-	    str += "<?>";
-	 }
+	    h = hashCombine( h, _left ? _left->_hash : 1 );
+	    h = hashCombine( h, _right ? _right->_hash : 2 );
+	    if ( _left )  { n = addSize( n, _left->_size );  m |= _left->_mentions; }
+	    if ( _right ) { n = addSize( n, _right->_size ); m |= _right->_mentions; }
+	 }
+	 _hash = h;
+	 _size = n;
+	 _mentions = m;
+      }
 
-	 // print right tree.
-	 if ( _left )
-	 {
-	    _left->printTree( os, str.length() + 1 );
-	 }
-    
-	 os << str << "\n";
+      static unsigned long long variableBit( const std::string &variable )
+      {
+	 return 1ULL << (hashString( variable ) % 64);
+      }
 
-	 if ( _right  )
-	 {
-	    _right->printTree( os, str.length() + 1 );
-	 }
+      /// order() for map keys, see substitute()
+      static bool termBefore( const SymSP &a, const SymSP &b );
 
-	 return os;
-      }
-      
-      std::string toString() const 
+      /// FNV-1a, not std::hash: hash order is the canonical order, it
+      ///  must not change between builds
+      static size_t hashString( const std::string &s )
       {
-	 std::stringstream ss;
-	 printInfix(ss);
-	 return ss.str();
+	 unsigned long long h = 14695981039346656037ULL;
+	 for ( size_t i = 0; i < s.size(); ++i ) h = (h ^ (unsigned char)s[i]) * 1099511628211ULL;
+	 return size_t( h );
       }
-  
-      std::ostream& printInfix( std::ostream &os, const std::string &last_op = NOP ) const
+
+      /// saturating, a deep DAG can count more nodes than fit
+      static size_t addSize( size_t a, size_t b )
       {
-	 bool parens = true;
-	 if ( last_op == NOP || last_op == PLUS || last_op == MINUS || isLeaf() ) parens = false; 
-	 if ( _op == TIMES || _op == DIV ) parens = false;
-	 if ( isNegateOp() ) parens = false;
-	 if ( last_op == DIV && _op != NOP ) parens = true;
-
-	 // treat negate as -1 * x so we don't confuse neg and minus when we recurse
-	 std::string this_op = isNegateOp() ? TIMES : _op;
-
-	 if ( isNegateOp() ) os << NEG;
-	 if ( parens ) os << OPR;
-	 if ( _left )  _left->printInfix( os, _op != DIV ? this_op : TIMES );
-    
-	 if ( _op != NOP && !isNegateOp() )
-	 {
-	    if (_op == PLUS || isMinusOp()) os << " ";
-	    os << _op;
-	    if (_op == PLUS || isMinusOp()) os << " ";
-	 }
-	 else if ( this->isRational() && !isNegateOp() )
-	 {
-	    os << _numerator;
-	    if (_denominator != 1)
-	       os << "/" << _denominator;
-	 }
-	 else if ( !isNegateOp() && !getValue().empty())  os << getValue();
-	 else if ( !isNegateOp() && getValue().empty() ) os << "?<" << _op << "|" << _numerator << "/" << _denominator << ">";
+	 return a + b < a ? std::numeric_limits<size_t>::max() : a + b;
+      }
 
-	 if ( _right ) _right->printInfix( os, this_op );
-	 if ( parens ) os << CPR;
+      /// true if |s| holds the last reference to its symbol
+      static bool onlyOwner( const SymSP &s ) { return s && s->_getCount() == 1; }
 
-	 return os;
+      /// the doppleganger if there is one yet, lock free
+      Sym *twin() const { return _doppleganger.load( std::memory_order_acquire ); }
+
+      /// point _doppleganger at |t| (or nothing), for symbols no other thread
+      ///  can see yet or is reading
+      void setTwin( Sym *t ) const
+      {
+	 if ( t ) t->_incCount();
+	 releaseTwin( _doppleganger.exchange( t, std::memory_order_acq_rel ) );
       }
-      
-      
-      //-----------------------------------------------------------------------------
-      /// standard ostream << printer
-      std::ostream &operator<<( std::ostream &os ) const
+
+      /// drop the reference a _doppleganger held
+      static void releaseTwin( Sym *t )
       {
-	 return printInfix(os, TIMES);
+	 if ( t && t->_decCount() <= 0 ) delete t;
       }
-      
    };
+
+   /// scoped node pool for one derivation, see sympool.h
+   typedef NodeArena< Sym > SymArena;
       
 }  /// end namespace Symath
 
@@ -1160,6 +1672,23 @@ Symath::Sym cos(const Symath::Sym& s)
 		       s.copyMaybe());
 }
 
+Symath::Sym pow(const Symath::Sym& s1, const Symath::Sym& s2) 
+{
+   return Symath::Sym( Symath::POW,
+		       s1.copyMaybe(),
+		       s2.copyMaybe());
+}
+
 // TODO(djmk): the rest of cmath...
 
+#include "symwriter.h"
+#include "symprogram.h"
+#include "symcodegen.h"
+#include "symexpand.h"
+#include "symdiff.h"
+#include "symparse.h"
+// symbinary.h (binary checkpoints) is opt-in, include it where it is used
+#include "symreduce.h"
+#include "symsubstitute.h"
+
 #endif
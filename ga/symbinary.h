@@ -0,0 +1,520 @@
+/// Binary checkpoints of Sym expressions.
+///   A file holds a DAG: every distinct subexpression is written once,
+///   children before parents, however many expressions share it, and
+///   equal subtrees are one node whether or not they shared memory.
+///   Names and operators go in a string table that nodes refer to by
+///   index.  Everything after the header is a varint, operands are
+///   written as the distance back to their node, so most records are a
+///   few bytes.  Loading maps the file and builds the nodes straight from
+///   it, the result compares == to what was saved.  Without POSIX mmap the
+///   file is read into memory instead.  Not included by symath.h, include
+///   it here.
+///
+/// \code
+///   std::vector<Sym> results;  ...
+///   Symath::saveBinary( "step3.symb", results );
+///   std::vector<Sym> again;
+///   if ( !Symath::loadBinary( "step3.symb", &again ) ) ...
+/// \endcode
+///
+///   Layout: magic "SYMB" and version, 32 bit little endian, then unsigned
+///   varints (7 bits a byte, low bits first, high bit set on all but the
+///   last byte):
+///     strings  count, then the length and characters of each
+///     nodes    count, then each node as kind + 4 * op string and
+///                VARIABLE  name string
+///                NUMBER    negative + 2 * numerator limbs, denominator
+///                          limbs, then the limbs (base 2^32, low first)
+///                OPERATOR  left, right as n - id, 0 if none
+///                NARY      operand count, operands as n - id
+///              where n is the node's own id
+///     roots    count, then the node id of each saved expression
+
+#ifndef __SYMBOLIC_BINARY_H
+#define __SYMBOLIC_BINARY_H
+
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <string>
+#include <algorithm>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+#include "symath.h"
+
+#if defined(__unix__) || defined(__APPLE__)
+#  include <unistd.h>
+#endif
+#if defined(_POSIX_MAPPED_FILES) && _POSIX_MAPPED_FILES > 0
+#  define SYMBINARY_MMAP 1
+#  include <fcntl.h>
+#  include <sys/mman.h>
+#  include <sys/stat.h>
+#endif
+
+namespace Symath {
+
+   ///----------------------------------------------------------
+   //
+   /// builds the tables for a set of expressions and writes them
+   //
+   class SymBinaryWriter {
+     public:
+      typedef unsigned int u32;
+      enum { MAGIC = 0x424d5953, VERSION = 2 };  ///< "SYMB"
+      /// node kinds, see the layout at the top of the file
+      enum Kind { VARIABLE, NUMBER, OPERATOR, NARY };
+
+      SymBinaryWriter() : _by_hash( 1024, 0 ), _hashed(0), _count(0) {}
+
+      /// add an expression, returns its root index
+      u32 add( const Sym &s )
+      {
+	 _roots.push_back( node( s ) );
+	 return u32( _roots.size() - 1 );
+      }
+
+      std::ostream &write( std::ostream &os ) const
+      {
+	 std::string out;
+	 out.reserve( 16 + _names.size() * 4 + _nodes.size() + _roots.size() * 4 );
+	 word( &out, MAGIC );
+	 word( &out, VERSION );
+	 varint( &out, _names.size() );
+	 for ( size_t i = 0; i < _names.size(); ++i )
+	 {
+	    varint( &out, _names[i]->size() );
+	    out += *_names[i];
+	 }
+	 varint( &out, _count );
+	 out += _nodes;
+	 varint( &out, _roots.size() );
+	 for ( size_t i = 0; i < _roots.size(); ++i ) varint( &out, _roots[i] );
+	 return os.write( out.data(), std::streamsize( out.size() ) );
+      }
+
+      /// unsigned LEB128
+      static void varint( std::string *out, unsigned long long v )
+      {
+	 for ( ; v >= 0x80; v >>= 7 ) *out += char( (v & 0x7f) | 0x80 );
+	 *out += char( v );
+      }
+
+     protected:
+      friend class Sym;  // walk()
+
+      /// a written interior node: its operands' ids live in _shapes
+      struct Shape {
+	 size_t hash;   ///< Sym::hash() of the node
+	 u32    op, first, count;
+      };
+      struct RationalHash {
+	 size_t operator()( const Rational &r ) const { return r.hash(); }
+      };
+
+      /// Open addressing, linear probing, a power of two slots at most half
+      /// full.  Growing a std::unordered_map to a million nodes cost more
+      /// than writing them, these grow by one pass over a vector.
+      struct AddressIds {
+	 std::vector< std::pair<const Sym*, u32> > slots;
+	 size_t used;
+
+	 AddressIds() : slots( 1024, std::pair<const Sym*, u32>( 0, 0 ) ), used(0) {}
+
+	 static size_t start( const Sym *s, size_t mask )
+	 {
+	    const unsigned long long h = (unsigned long long)( size_t( s ) >> 3 ) * 0x9e3779b97f4a7c15ULL;
+	    return size_t( h ^ (h >> 32) ) & mask;
+	 }
+
+	 const u32 *find( const Sym *s ) const
+	 {
+	    const size_t mask = slots.size() - 1;
+	    for ( size_t i = start( s, mask ); slots[i].first; i = (i + 1) & mask )
+	       if ( slots[i].first == s ) return &slots[i].second;
+	    return 0;
+	 }
+
+	 /// |s| must not be in the table yet
+	 void insert( const Sym *s, u32 id )
+	 {
+	    if ( 2 * (used + 1) > slots.size() )
+	    {
+	       std::vector< std::pair<const Sym*, u32> > old( 2 * slots.size(), std::pair<const Sym*, u32>( 0, 0 ) );
+	       old.swap( slots );
+	       used = 0;
+	       for ( size_t i = 0; i < old.size(); ++i )
+		  if ( old[i].first ) insert( old[i].first, old[i].second );
+	    }
+	    const size_t mask = slots.size() - 1;
+	    size_t i = start( s, mask );
+	    while ( slots[i].first ) i = (i + 1) & mask;
+	    slots[i] = std::make_pair( s, id );
+	    ++used;
+	 }
+      };
+
+      AddressIds                          _ids;       ///< nodes already written, by address
+      std::vector<u32>                    _by_hash;   ///< interior node id + 1 by Shape::hash, 0 empty
+      size_t                              _hashed;    ///< used slots of _by_hash
+      std::unordered_map<Rational, u32, RationalHash> _numbers;
+      std::unordered_map<u32, u32>        _variables; ///< node of each name
+      std::unordered_map<std::string, u32> _strings;
+      std::vector<const std::string*>     _names;     ///< keys of _strings, by id
+      std::vector<Shape>                  _shape;     ///< by node id, interior nodes only
+      std::vector<u32>                    _shapes;    ///< operand ids
+      std::string                         _nodes;     ///< the node records so far
+      u32                                 _count;     ///< nodes written
+      std::vector<u32>                    _roots;
+      std::vector<u32>                    _done, _operands;  ///< node() scratch
+
+      static void word( std::string *out, u32 w )
+      {
+	 for ( int j = 0; j < 4; ++j ) *out += char( (w >> (8 * j)) & 0xff );
+      }
+
+      u32 string( const std::string &s )
+      {
+	 std::pair<std::unordered_map<std::string, u32>::iterator, bool> it =
+	    _strings.insert( std::make_pair( s, u32( _names.size() ) ) );
+	 if ( it.second ) _names.push_back( &it.first->first );
+	 return it.first->second;
+      }
+
+      /// start the record of the next node
+      u32 record( u32 kind, u32 op )
+      {
+	 varint( &_nodes, kind + 4ULL * op );
+	 _shape.push_back( Shape() );
+	 return _count++;
+      }
+
+      u32 variable( const std::string &name )
+      {
+	 const u32 s = string( name );
+	 std::unordered_map<u32, u32>::const_iterator it = _variables.find( s );
+	 if ( it != _variables.end() ) return it->second;
+	 const u32 id = record( VARIABLE, 0 );
+	 varint( &_nodes, s );
+	 return _variables[s] = id;
+      }
+
+      u32 number( const Rational &r )
+      {
+	 std::unordered_map<Rational, u32, RationalHash>::const_iterator it = _numbers.find( r );
+	 if ( it != _numbers.end() ) return it->second;
+	 const u32 id = record( NUMBER, 0 );
+	 const BigInt num = r.numerator(), den = r.denominator();
+	 varint( &_nodes, (num.isNegative() ? 1 : 0) + 2ULL * num.limbs().size() );
+	 varint( &_nodes, den.limbs().size() );
+	 for ( size_t i = 0; i < num.limbs().size(); ++i ) varint( &_nodes, num.limbs()[i] );
+	 for ( size_t i = 0; i < den.limbs().size(); ++i ) varint( &_nodes, den.limbs()[i] );
+	 _numbers.insert( std::make_pair( r, id ) );
+	 return id;
+      }
+
+      /// id of the interior node |s| whose operands are |ids|, an equal
+      /// node written before is reused.  Left and right of a binary node
+      /// are ids + 1, 0 when missing.
+      u32 interior( const Sym &s, u32 kind, const std::vector<u32> &ids )
+      {
+	 const u32 op = string( s.getOp() );
+	 const size_t hash = s.hash();
+	 size_t mask = _by_hash.size() - 1, i = hashSlot( hash, mask );
+	 for ( ; _by_hash[i]; i = (i + 1) & mask )
+	 {
+	    const Shape &shape = _shape[_by_hash[i] - 1];
+	    if ( shape.hash == hash && shape.op == op && shape.count == ids.size() &&
+		 std::equal( ids.begin(), ids.end(), _shapes.begin() + shape.first ) )
+	       return _by_hash[i] - 1;
+	 }
+	 const u32 id = record( kind, op );
+	 _by_hash[i] = id + 1;
+	 if ( 2 * ++_hashed > _by_hash.size() ) growByHash();
+	 Shape &shape = _shape[id];
+	 shape.hash = hash;
+	 shape.op = op;
+	 shape.first = u32( _shapes.size() );
+	 shape.count = u32( ids.size() );
+	 _shapes.insert( _shapes.end(), ids.begin(), ids.end() );
+	 if ( kind == NARY ) varint( &_nodes, ids.size() );
+	 for ( size_t i = 0; i < ids.size(); ++i )
+	 {
+	    if ( kind == NARY ) varint( &_nodes, id - ids[i] );
+	    else varint( &_nodes, ids[i] ? id + 1 - ids[i] : 0 );
+	 }
+	 return id;
+      }
+
+      static size_t hashSlot( size_t hash, size_t mask )
+      {
+	 return size_t( hash ^ (hash >> 29) ) & mask;
+      }
+
+      void growByHash()
+      {
+	 std::vector<u32> old( 2 * _by_hash.size(), 0 );
+	 old.swap( _by_hash );
+	 const size_t mask = _by_hash.size() - 1;
+	 for ( size_t j = 0; j < old.size(); ++j )
+	 {
+	    if ( !old[j] ) continue;
+	    size_t i = hashSlot( _shape[old[j] - 1].hash, mask );
+	    while ( _by_hash[i] ) i = (i + 1) & mask;
+	    _by_hash[i] = old[j];
+	 }
+      }
+
+      /// id of |s|, writing it and any new operands first
+      u32 node( const Sym &root )
+      {
+	 Sym::walk( root, this );
+	 const u32 id = _done.back();
+	 _done.pop_back();
+	 return id;
+      }
+
+      /// Sym::walk() visitor, leave() finds its operands' ids last on _done
+      bool enter( const Sym &s )
+      {
+	 if ( s.isRational() )  // found by value, cheaper than by address
+	 {
+	    _done.push_back( number( s.getRational() ) );
+	    return false;
+	 }
+	 const u32 *known = _ids.find( &s );
+	 if ( known ) _done.push_back( *known );
+	 else if ( s.isLeaf() )
+	 {
+	    _done.push_back( variable( s.getValue() ) );
+	    _ids.insert( &s, _done.back() );
+	 }
+	 return !known && !s.isLeaf();
+      }
+
+      void leave( const Sym &s )
+      {
+	 u32 id;
+	 if ( s.isNary() )
+	 {
+	    _operands.assign( _done.end() - s.getArgs().size(), _done.end() );
+	    _done.resize( _done.size() - _operands.size() );
+	    id = interior( s, NARY, _operands );
+	 }
+	 else
+	 {
+	    // left before right, missing ones are 0
+	    _operands.assign( 2, 0 );
+	    if ( s.getRight() ) { _operands[1] = _done.back() + 1; _done.pop_back(); }
+	    if ( s.getLeft() )  { _operands[0] = _done.back() + 1; _done.pop_back(); }
+	    id = interior( s, OPERATOR, _operands );
+	 }
+	 _ids.insert( &s, id );
+	 _done.push_back( id );
+      }
+   };
+
+   ///----------------------------------------------------------
+   //
+   /// builds expressions from a buffer written by SymBinaryWriter, every
+   /// count and index is checked, a bad or truncated buffer is reported
+   /// not trusted
+   //
+   class SymBinaryReader {
+     public:
+      typedef SymBinaryWriter::u32 u32;
+
+      bool read( const char *data, size_t size, std::vector<Sym> *roots )
+      {
+	 _at = reinterpret_cast<const unsigned char*>( data );
+	 _end = _at + size;
+	 if ( size < 8 ) return error( "truncated header" );
+	 if ( word() != SymBinaryWriter::MAGIC ) return error( "not a Sym binary file" );
+	 if ( word() != SymBinaryWriter::VERSION ) return error( "unknown version" );
+
+	 // every entry takes a byte at least, larger counts are corrupt
+	 unsigned long long strings = 0;
+	 if ( !varint( &strings ) || strings > left() ) return error( "bad string count" );
+	 std::vector<std::string> names( strings );
+	 for ( size_t i = 0; i < strings; ++i )
+	 {
+	    unsigned long long length = 0;
+	    if ( !varint( &length ) || length > left() ) return error( "bad string" );
+	    names[i].assign( reinterpret_cast<const char*>( _at ), size_t( length ) );
+	    _at += length;
+	 }
+
+	 unsigned long long nodes = 0;
+	 if ( !varint( &nodes ) || nodes > left() ) return error( "bad node count" );
+	 std::vector<Sym::SymSP> made( nodes );
+	 for ( u32 n = 0; n < nodes; ++n )
+	 {
+	    unsigned long long tag = 0;
+	    if ( !varint( &tag ) ) return error( "truncated node" );
+	    const unsigned long long op = tag / 4;
+	    switch ( tag % 4 )
+	    {
+	       case SymBinaryWriter::VARIABLE:
+	       {
+		  unsigned long long name = 0;
+		  if ( !varint( &name ) || name >= strings || names[name].empty() ) return error( "bad variable name" );
+		  made[n] = Sym( names[name] ).copyMaybe();
+		  break;
+	       }
+	       case SymBinaryWriter::NUMBER:
+	       {
+		  unsigned long long head = 0, dl = 0;
+		  if ( !varint( &head ) || !varint( &dl ) || head / 2 + dl > left() ) return error( "bad number" );
+		  BigInt::limb_vec num( head / 2 ), den( dl );
+		  if ( !limbs( &num ) || !limbs( &den ) ) return error( "bad number limbs" );
+		  const BigInt d( den, false );
+		  if ( d.isZero() ) return error( "zero denominator" );
+		  made[n] = Sym( Rational( BigInt( num, head % 2 != 0 ), d ) ).copyMaybe();
+		  break;
+	       }
+	       case SymBinaryWriter::OPERATOR:
+	       {
+		  // operands come first, so a distance past the start is corrupt
+		  unsigned long long a = 0, b = 0;
+		  if ( op >= strings || names[op].empty() || !varint( &a ) || !varint( &b ) ||
+		       a > n || b > n || (!a && !b) )
+		     return error( "bad operator node" );
+		  made[n] = Sym( names[op], a ? made[n - a] : Sym::SymSP(0), b ? made[n - b] : Sym::SymSP(0) ).copyMaybe();
+		  break;
+	       }
+	       case SymBinaryWriter::NARY:
+	       {
+		  unsigned long long count = 0;
+		  if ( op >= strings || (names[op] != PLUS && names[op] != TIMES) || !varint( &count ) ||
+		       count < 2 || count > left() )
+		     return error( "bad n-ary node" );
+		  Sym::SymArgs operands( count );
+		  for ( size_t i = 0; i < count; ++i )
+		  {
+		     unsigned long long back = 0;
+		     if ( !varint( &back ) || back == 0 || back > n ) return error( "bad n-ary operand" );
+		     operands[i] = made[n - back];
+		  }
+		  made[n] = Sym( names[op], operands ).copyMaybe();
+		  break;
+	       }
+	    }
+	 }
+
+	 unsigned long long nroots = 0;
+	 if ( !varint( &nroots ) || nroots > left() ) return error( "bad root count" );
+	 for ( size_t i = 0; i < nroots; ++i )
+	 {
+	    unsigned long long id = 0;
+	    if ( !varint( &id ) || id >= nodes ) return error( "bad root" );
+	    roots->push_back( *made[id] );
+	 }
+	 if ( _at != _end ) return error( "bytes left after the roots" );
+	 return true;
+      }
+
+     protected:
+      const unsigned char *_at;   ///< next byte
+      const unsigned char *_end;
+
+      size_t left() const { return size_t( _end - _at ); }
+
+      u32 word()
+      {
+	 const unsigned char *p = _at;
+	 _at += 4;
+	 return u32( p[0] ) | (u32( p[1] ) << 8) | (u32( p[2] ) << 16) | (u32( p[3] ) << 24);
+      }
+
+      /// false if the buffer ends inside it or it doesn't fit in 64 bits
+      bool varint( unsigned long long *v )
+      {
+	 *v = 0;
+	 for ( int shift = 0; shift < 64 && _at != _end; shift += 7 )
+	 {
+	    const unsigned char b = *_at++;
+	    *v |= (unsigned long long)( b & 0x7f ) << shift;
+	    if ( !(b & 0x80) ) return true;
+	 }
+	 return false;
+      }
+
+      bool limbs( BigInt::limb_vec *mag )
+      {
+	 for ( size_t i = 0; i < mag->size(); ++i )
+	 {
+	    unsigned long long l = 0;
+	    if ( !varint( &l ) || l > 0xffffffffULL ) return false;
+	    (*mag)[i] = BigInt::limb_type( l );
+	 }
+	 return true;
+      }
+
+      bool error( const char *what ) const
+      {
+	 std::cerr << "SymBinaryReader: " << what << std::endl;
+	 return false;
+      }
+   };
+
+   //-----------------------------------------------------------------------------
+   /// write |exprs| as one binary DAG
+   inline bool saveBinary( const std::string &path, const std::vector<Sym> &exprs )
+   {
+      SymBinaryWriter w;
+      for ( size_t i = 0; i < exprs.size(); ++i ) w.add( exprs[i] );
+      std::ofstream os( path.c_str(), std::ios::binary );
+      if ( !os || !w.write( os ) )
+      {
+	 std::cerr << "saveBinary(): can't write " << path << std::endl;
+	 return false;
+      }
+      return true;
+   }
+
+   //-----------------------------------------------------------------------------
+   /// map |path| and append its expressions to |exprs|
+   inline bool loadBinary( const std::string &path, std::vector<Sym> *exprs )
+   {
+#ifdef SYMBINARY_MMAP
+      const int fd = ::open( path.c_str(), O_RDONLY );
+      struct stat st;
+      if ( fd < 0 || ::fstat( fd, &st ) != 0 )
+      {
+	 std::cerr << "loadBinary(): can't open " << path << std::endl;
+	 if ( fd >= 0 ) ::close( fd );
+	 return false;
+      }
+      const size_t size = size_t( st.st_size );
+      void *map = size ? ::mmap( 0, size, PROT_READ, MAP_PRIVATE, fd, 0 ) : MAP_FAILED;
+      ::close( fd );
+      if ( map == MAP_FAILED )
+      {
+	 std::cerr << "loadBinary(): can't map " << path << std::endl;
+	 return false;
+      }
+      const bool ok = SymBinaryReader().read( static_cast<const char*>( map ), size, exprs );
+      ::munmap( map, size );
+      return ok;
+#else
+      // no mmap, read the whole file
+      std::ifstream is( path.c_str(), std::ios::binary );
+      if ( !is )
+      {
+	 std::cerr << "loadBinary(): can't open " << path << std::endl;
+	 return false;
+      }
+      std::vector<char> bytes( (std::istreambuf_iterator<char>( is )), std::istreambuf_iterator<char>() );
+      if ( bytes.empty() )
+      {
+	 std::cerr << "loadBinary(): can't read " << path << std::endl;
+	 return false;
+      }
+      return SymBinaryReader().read( &bytes[0], bytes.size(), exprs );
+#endif
+   }
+
+}  /// end namespace Symath
+
+#endif
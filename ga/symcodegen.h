@@ -0,0 +1,285 @@
+/// C++ source emission for symbolic expressions.
+///   Expressions are lowered with SymLowering (symprogram.h), so the emitted
+///   code gets the same common subexpression elimination and integer powers
+///   expanded into multiplies by squaring.  Values read more than once are
+///   hoisted into const temporaries, everything else is inlined.  Generated
+///   names start with an underscore (_t0, _t1, ..., _out); variables whose
+///   identifiers collide with them or with each other are an error.
+///
+///   Example, write a kernel for all coefficients of a symbolic multivector:
+/// \code
+///   std::ofstream out("kernels.h");
+///   emitCpp(out, "conformalInner", simplify(inner(Ws, Ys)), vars);
+/// \endcode
+
+#ifndef __SYMBOLIC_CODEGEN_H
+#define __SYMBOLIC_CODEGEN_H
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <iostream>
+#include <limits>
+#include <string>
+#include <vector>
+#include "symath.h"
+
+namespace Symath {
+
+   ///----------------------------------------------------------
+   //
+   /// Writes SSA code from a SymLowering as C++ statements.
+   //
+   class CppEmitter {
+     public:
+      enum { MAX_INLINE_DEPTH = 12 };  ///< deeper inline expressions get a temporary
+
+      CppEmitter( const SymLowering &ssa, const std::vector<std::string> &variables )
+	: _ssa(ssa), _temps(0)
+      {
+	 for ( size_t i = 0; i < variables.size(); ++i )
+	 {
+	    const std::string id = identifier( variables[i] );
+	    if ( _error.empty() && reserved( id ) )
+	       _error = "variable \"" + variables[i] + "\" is the generated name " + id;
+	    for ( size_t j = 0; j < i && _error.empty(); ++j )
+	       if ( _names[j] == id )
+		  _error = "variables \"" + variables[j] + "\" and \"" + variables[i] + "\" are both " + id;
+	    _names.push_back( id );
+	 }
+      }
+
+      /// why the variables can't be emitted, empty if they can
+      const std::string &error() const { return _error; }
+
+      /// parameter list: const double a, const double b ...
+      std::string parameters() const
+      {
+	 std::string params;
+	 for ( size_t i = 0; i < _names.size(); ++i )
+	 {
+	    if ( i ) params += ", ";
+	    params += "const double " + _names[i];
+	 }
+	 return params;
+      }
+
+      /// writes the hoisted temporaries, fills |outputs| with the inline
+      /// expression of each output
+      void body( std::ostream &os, const std::string &indent, std::vector<std::string> *outputs )
+      {
+	 const std::vector<Instr> &code = _ssa.code();
+	 const std::vector<bool> live = _ssa.liveValues();
+	 const std::vector<int> uses = _ssa.useCounts();
+	 _text.assign( code.size(), std::string() );
+	 _prec.assign( code.size(), ATOM );
+	 _depth.assign( code.size(), 0 );
+	 _negated.assign( code.size(), -1 );
+
+	 // SSA order is already topological, no recursion needed
+	 for ( size_t v = 0; v < code.size(); ++v )
+	 {
+	    if ( !live[v] ) continue;
+	    build( int(v) );
+	    const bool pinned = code[v].op == Instr::CONST || code[v].op == Instr::VAR;
+	    if ( !pinned && (uses[v] > 1 || _depth[v] > MAX_INLINE_DEPTH) )
+	    {
+	       std::string t = temp();
+	       os << indent << "const double " << t << " = " << _text[v] << ";\n";
+	       _text[v] = t;
+	       _prec[v] = ATOM;
+	       _depth[v] = 0;
+	       _negated[v] = -1;
+	    }
+	 }
+	 outputs->clear();
+	 for ( size_t o = 0; o < _ssa.outputs().size(); ++o )
+	    outputs->push_back( _text[_ssa.outputs()[o]] );
+      }
+
+      /// valid C++ identifier from a variable name
+      static std::string identifier( const std::string &name )
+      {
+	 std::string id;
+	 for ( size_t i = 0; i < name.size(); ++i )
+	 {
+	    const char c = name[i];
+	    const bool ok = (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') ||
+			    (c >= '0' && c <= '9') || c == '_';
+	    id += ok ? c : '_';
+	 }
+	 if ( id.empty() || (id[0] >= '0' && id[0] <= '9') ) id = "_" + id;
+	 return id;
+      }
+
+      /// true for the names the emitter makes up: _out, _t<n>
+      static bool reserved( const std::string &id )
+      {
+	 if ( id == "_out" ) return true;
+	 if ( id.size() < 3 || id.compare( 0, 2, "_t" ) != 0 ) return false;
+	 return id.find_first_not_of( "0123456789", 2 ) == std::string::npos;
+      }
+
+      /// double literal that round trips, always has a '.' or exponent so
+      /// C++ never does integer division on it
+      static std::string literal( double c )
+      {
+	 if ( c != c ) return "std::numeric_limits<double>::quiet_NaN()";
+	 if ( c == std::numeric_limits<double>::infinity() ) return "std::numeric_limits<double>::infinity()";
+	 if ( c == -std::numeric_limits<double>::infinity() ) return "-std::numeric_limits<double>::infinity()";
+	 char buf[64];
+	 std::snprintf( buf, sizeof(buf), "%.17g", c );
+	 std::string s( buf );
+	 if ( s.find_first_of( ".e" ) == std::string::npos ) s += ".0";
+	 return s;
+      }
+
+     protected:
+      /// operator precedence of an inline expression
+      enum { SUM = 1, PRODUCT = 2, UNARY = 3, ATOM = 4 };
+
+      const SymLowering         &_ssa;
+      std::vector<std::string>   _names;
+      std::vector<std::string>   _text;
+      std::vector<int>           _prec;
+      std::vector<int>           _depth;
+      std::vector<int>           _negated;  ///< operand of an inline negation, or -1
+      int                        _temps;
+      std::string                _error;
+
+      std::string temp()
+      {
+	 char buf[32];
+	 std::snprintf( buf, sizeof(buf), "_t%d", _temps++ );
+	 return buf;
+      }
+
+      /// operand text, parenthesized if it binds weaker than |need|
+      std::string operand( int v, int need ) const
+      {
+	 return _prec[v] < need ? "(" + _text[v] + ")" : _text[v];
+      }
+
+      void build( int v )
+      {
+	 const Instr &ins = _ssa.code()[v];
+	 const int a = ins.a, b = ins.b;
+	 switch ( ins.op )
+	 {
+	    case Instr::CONST:
+	    {
+	       const double c = _ssa.constants()[a];
+	       _text[v] = literal( c );
+	       _prec[v] = c < 0 ? UNARY : ATOM;
+	       return;
+	    }
+	    case Instr::VAR:
+	       _text[v] = _names[a];
+	       return;
+	    // right operands are parenthesized at equal precedence, C++ then
+	    // rounds in the same order as the bytecode
+	    case Instr::ADD:
+	    {
+	       // commuting is exact, keep a folded sum on the left
+	       const int l = _prec[b] == SUM && _prec[a] != SUM ? b : a;
+	       const int r = l == a ? b : a;
+	       // x + -y  ==  x - y  exactly
+	       if ( _negated[r] >= 0 )
+		  set( v, operand( l, SUM ) + " - " + operand( _negated[r], PRODUCT ), SUM, a, b );
+	       else
+		  set( v, operand( l, SUM ) + " + " + operand( r, PRODUCT ), SUM, a, b );
+	       return;
+	    }
+	    case Instr::SUB:
+	       set( v, operand( a, SUM ) + " - " + operand( b, PRODUCT ), SUM, a, b );
+	       return;
+	    case Instr::MUL:
+	       if ( _prec[b] == PRODUCT && _prec[a] != PRODUCT )
+		  set( v, operand( b, PRODUCT ) + "*" + operand( a, UNARY ), PRODUCT, a, b );
+	       else
+		  set( v, operand( a, PRODUCT ) + "*" + operand( b, UNARY ), PRODUCT, a, b );
+	       return;
+	    case Instr::DIV:
+	       set( v, operand( a, PRODUCT ) + "/" + operand( b, UNARY ), PRODUCT, a, b );
+	       return;
+	    case Instr::NEG:
+	       set( v, "-" + operand( a, UNARY ), UNARY, a, a );
+	       _negated[v] = a;
+	       return;
+	    case Instr::POW:
+	       set( v, "std::pow(" + _text[a] + ", " + _text[b] + ")", ATOM, a, b );
+	       return;
+	    case Instr::SIN:
+	       set( v, "std::sin(" + _text[a] + ")", ATOM, a, a );
+	       return;
+	    case Instr::COS:
+	       set( v, "std::cos(" + _text[a] + ")", ATOM, a, a );
+	       return;
+	 }
+      }
+
+      void set( int v, const std::string &text, int prec, int a, int b )
+      {
+	 _text[v] = text;
+	 _prec[v] = prec;
+	 _depth[v] = 1 + std::max( _depth[a], _depth[b] );
+      }
+   };
+
+   //-----------------------------------------------------------------------------
+   /// a name collision goes to std::cerr and into the source as #error, so
+   /// the kernel can't be compiled by accident
+   inline void reportCollision( std::ostream &os, const CppEmitter &emit )
+   {
+      if ( emit.error().empty() ) return;
+      std::cerr << "emitCpp(): " << emit.error() << std::endl;
+      os << "#error emitCpp(): " << emit.error() << "\n";
+   }
+
+   //-----------------------------------------------------------------------------
+   /// Emit   inline void |name|( const double var0, ..., double *_out )
+   ///   _out[i] receives exprs[i].  |labels|, if given, are written as a
+   ///   comment next to each output.
+   inline std::ostream &emitCpp( std::ostream &os,
+				 const std::string &name,
+				 const std::vector<Sym> &exprs,
+				 const std::vector<std::string> &variables,
+				 const std::vector<std::string> &labels = std::vector<std::string>() )
+   {
+      SymLowering ssa( variables );
+      for ( size_t i = 0; i < exprs.size(); ++i ) ssa.addOutput( exprs[i] );
+      CppEmitter emit( ssa, variables );
+      reportCollision( os, emit );
+
+      std::string params = emit.parameters();
+      os << "inline void " << CppEmitter::identifier( name ) << "( "
+	 << params << (params.empty() ? "" : ", ") << "double *_out )\n{\n";
+      std::vector<std::string> outputs;
+      emit.body( os, "   ", &outputs );
+      for ( size_t o = 0; o < outputs.size(); ++o )
+      {
+	 os << "   _out[" << o << "] = " << outputs[o] << ";";
+	 if ( o < labels.size() ) os << "  // " << labels[o];
+	 os << "\n";
+      }
+      return os << "}\n";
+   }
+
+   inline std::ostream &Sym::emitCpp( std::ostream &os,
+				      const std::string &name,
+				      const std::vector<std::string> &variables ) const
+   {
+      SymLowering ssa( variables );
+      ssa.addOutput( *this );
+      CppEmitter emit( ssa, variables );
+      reportCollision( os, emit );
+
+      os << "inline double " << CppEmitter::identifier( name ) << "( " << emit.parameters() << " )\n{\n";
+      std::vector<std::string> outputs;
+      emit.body( os, "   ", &outputs );
+      return os << "   return " << outputs[0] << ";\n}\n";
+   }
+
+}  /// end namespace Symath
+
+#endif
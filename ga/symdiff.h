@@ -0,0 +1,143 @@
+/// Symbolic differentiation.
+///   Derivatives are memoized by node, so a subtree that appears several
+///   times (or in several expressions) is differentiated once, and the
+///   derivative nodes are shared the same way.  compile() and emitCpp()
+///   then see that sharing as common subexpressions.
+///
+///   Example, Jacobian of two constraints, compiled for evaluation:
+/// \code
+///   std::vector<Sym> f;  f.push_back( x*x + y*y - r*r );  f.push_back( x*y - c );
+///   std::vector<std::string> v;  v.push_back("x");  v.push_back("y");
+///   std::vector<Sym> J = jacobian( f, v );   // row major, f.size() x v.size()
+///   Program p = compile( J, allVariables );
+/// \endcode
+
+#ifndef __SYMBOLIC_DIFF_H
+#define __SYMBOLIC_DIFF_H
+
+#include <map>
+#include <string>
+#include <utility>
+#include <vector>
+#include "symath.h"
+
+namespace Symath {
+
+   ///----------------------------------------------------------
+   //
+   /// d/d|variable| of expressions, keeps its memo between calls so
+   ///  expressions that share subtrees share the work.
+   //  Memo keys are node addresses, the expressions must outlive us.
+   //
+   class SymDifferentiator {
+     public:
+      typedef Sym::SymSP SymSP;
+
+      explicit SymDifferentiator( const std::string &variable )
+	: _variable(variable), _zero( Sym::zero().copyMaybe() ), _one( Sym::one().copyMaybe() )
+      {}
+
+      /// derivative of |s|, not simplified
+      Sym derivative( const Sym &s )
+      {
+	 Sym::walk( s, this );
+	 return *_memo[&s];
+      }
+
+     protected:
+      friend class Sym;  // walk()
+
+      std::string                  _variable;
+      std::map<const Sym*, SymSP>  _memo;
+      SymSP                        _zero, _one;
+
+      const Sym &d( const Sym *s ) { return *_memo[s]; }
+
+      /// Sym::walk() visitor, shared subtrees are done once
+      bool enter( const Sym &s ) const { return !_memo.count( &s ); }
+      void leave( const Sym &s ) { _memo[&s] = node( s ); }
+
+      /// derivative of |s|, operands are done
+      SymSP node( const Sym &s )
+      {
+	 if ( s.isRationalValue() ) return _zero;
+	 if ( s.isLeaf() ) return s.getValue() == _variable ? _one : _zero;
+
+	 const Sym *l = s.getLeft();
+	 const Sym *r = s.getRight();
+	 const std::string &op = s.getOp();
+
+	 if ( s.isNary() && op == PLUS )
+	 {
+	    const Sym::SymArgs &args = s.getArgs();
+	    Sym sum = d( args[0] );
+	    for ( size_t i = 1; i < args.size(); ++i ) sum = sum + d( args[i] );
+	    return sum.copyMaybe();
+	 }
+	 if ( s.isNary() && op == TIMES )
+	 {
+	    // product rule with prefix/suffix products, O(n) nodes
+	    const Sym::SymArgs &args = s.getArgs();
+	    const size_t n = args.size();
+	    std::vector<SymSP> suffix( n + 1, _one );
+	    for ( size_t i = n; i-- > 1; ) suffix[i] = ((*args[i]) * (*suffix[i + 1])).copyMaybe();
+	    Sym prefix = Sym::one(), sum = Sym::zero();
+	    for ( size_t i = 0; i < n; ++i )
+	    {
+	       sum = sum + prefix * d( args[i] ) * (*suffix[i + 1]);
+	       prefix = prefix * (*args[i]);
+	    }
+	    return sum.copyMaybe();
+	 }
+	 if ( s.isNegateOp() ) return (-d( l )).copyMaybe();
+	 if ( s.isMinusOp() )  return (d( l ) - d( r )).copyMaybe();
+	 if ( op == PLUS )     return (d( l ) + d( r )).copyMaybe();
+	 if ( op == TIMES )    return (d( l ) * (*r) + (*l) * d( r )).copyMaybe();
+	 if ( op == DIV )      // (l/r)' = (l'r - lr')/(r*r)
+	    return ((d( l ) * (*r) - (*l) * d( r )) / ((*r) * (*r))).copyMaybe();
+	 if ( op == SIN )      return (::cos( *r ) * d( r )).copyMaybe();
+	 if ( op == COS )      return (-::sin( *r ) * d( r )).copyMaybe();
+	 if ( op == POW )
+	 {
+	    if ( !d( r ).isZero() )
+	    {
+	       std::cerr << "SymDifferentiator: no log() for variable exponent in " << s.toString() << std::endl;
+	       assert( d( r ).isZero() );
+	       return Sym( "NaN" ).copyMaybe();
+	    }
+	    // (l^r)' = r * l^(r-1) * l'
+	    const Sym rm1 = r->isRationalValue() ? Sym( r->getRational() - Rational( 1 ) ) : (*r) - Sym::one();
+	    const Sym power = rm1.isZero() ? Sym::one() : rm1.isOne() ? *l : ::pow( *l, rm1 );
+	    return ((*r) * power * d( l )).copyMaybe();
+	 }
+	 std::cerr << "SymDifferentiator: unknown operator " << op << std::endl;
+	 assert( 0 );
+	 return Sym( "NaN" ).copyMaybe();
+      }
+   };
+
+   //-----------------------------------------------------------------------------
+   /// Jacobian of |exprs| with respect to |variables|, row major:
+   ///  J[i*variables.size() + j] = d exprs[i] / d variables[j]
+   ///  One memo per variable is shared by all the expressions.
+   inline std::vector<Sym> jacobian( const std::vector<Sym> &exprs,
+				     const std::vector<std::string> &variables )
+   {
+      std::vector<Sym> J( exprs.size() * variables.size() );
+      for ( size_t j = 0; j < variables.size(); ++j )
+      {
+	 SymDifferentiator dj( variables[j] );
+	 for ( size_t i = 0; i < exprs.size(); ++i )
+	    J[i * variables.size() + j] = dj.derivative( exprs[i] );
+      }
+      return J;
+   }
+
+   inline Sym Sym::diff( const std::string &variable ) const
+   {
+      return SymDifferentiator( variable ).derivative( *this );
+   }
+
+}  /// end namespace Symath
+
+#endif
@@ -0,0 +1,274 @@
+/// Parallel expansion of large products of sums.
+///   Sym::expand() gives the same sum of products as normalForm(), but
+///   instead of distributing one binary product at a time it lists the
+///   terms of every factor once, walks the cartesian product of those term
+///   lists in chunks on a pool of threads, and collects like terms in
+///   per-thread hash tables keyed by the sorted factor ids of a monomial.
+///
+///   Example, ((a+2)*(b+3)*(b+4)) from symain.cpp:
+/// \code
+///   Sym d1 = ((a + S(2)) * (b + S(3)) * (b + S(4))).expand();
+///   // 24 + 14*b + 12*a + 2*b*b + a*b*b + 7*a*b
+/// \endcode
+
+#ifndef __SYMBOLIC_EXPAND_H
+#define __SYMBOLIC_EXPAND_H
+
+#include <algorithm>
+#include <atomic>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+#include "symath.h"
+
+namespace Symath {
+
+   ///----------------------------------------------------------
+   //
+   /// Expands a sum of products of sums into canonical form, see top of file
+   //
+   class ProductExpander {
+     public:
+      enum { CHUNK = 4096 };  ///< cartesian product indices per work item
+
+      /// |threads| 0: one per core
+      explicit ProductExpander( unsigned threads = 0 )
+	: _threads( threads ? threads : std::thread::hardware_concurrency() )
+      {
+	 if ( _threads == 0 ) _threads = 1;
+      }
+
+      Sym expand( const Sym &s )
+      {
+	 gather( s );
+	 return collect();
+      }
+
+     protected:
+      typedef Sym::SymSP    SymSP;
+      typedef Sym::SymPVec  SymPVec;
+      typedef std::vector<int> Atoms;  ///< sorted atom ids, the factors of a monomial
+
+      /// rational coefficient times a product of atoms
+      struct Monomial {
+	 Rational coef;
+	 Atoms    atoms;
+      };
+      typedef std::vector<Monomial> Terms;
+
+      /// one top level product: a scale and the term list of each factor
+      struct Product {
+	 Rational            scale;
+	 std::vector<Terms*> factors;
+	 size_t              count;  ///< size of the cartesian product
+      };
+
+      struct AtomsHash {
+	 size_t operator()( const Atoms &a ) const
+	 {
+	    size_t h = 14695981039346656037ULL;
+	    for ( size_t i = 0; i < a.size(); ++i ) h = (h ^ size_t(a[i])) * 1099511628211ULL;
+	    return h;
+	 }
+      };
+      typedef std::unordered_map<Atoms, Rational, AtomsHash> Collected;
+
+      /// a range of one product's cartesian indices
+      struct Chunk {
+	 size_t product;
+	 size_t begin, end;
+      };
+
+      unsigned             _threads;
+      std::vector<SymSP>   _atoms;     ///< distinct non-numeric factors, by id
+      std::vector<Terms>   _lists;     ///< term lists of factors, Product points in here
+      std::vector<Product> _products;
+      std::vector<Chunk>   _chunks;
+
+      /// split |s| into products of factor term lists
+      void gather( const Sym &s )
+      {
+	 SymPVec top;
+	 s.getAdditiveSubexps( &top );
+
+	 // normalize each factor once, its terms are what we multiply out
+	 std::vector< std::vector<SymPVec> > factor_terms( top.size() );
+	 std::vector<Rational> scales( top.size(), Rational( 1 ) );
+	 SymPVec atoms;
+	 size_t p = 0;
+	 for ( Sym::SymPVecIter t = top.begin(); t != top.end(); ++t, ++p )
+	 {
+	    SymPVec factors;
+	    if ( (*t)->getMultiplicitiveSubexps( &factors ) ) scales[p] = -scales[p];
+	    for ( Sym::SymPVecIter f = factors.begin(); f != factors.end(); ++f )
+	    {
+	       if ( (*f)->isRationalValue() )
+	       {
+		  scales[p] = scales[p] * (*f)->getRational();
+		  continue;
+	       }
+	       factor_terms[p].push_back( SymPVec() );
+	       SymPVec &terms = factor_terms[p].back();
+	       (*f)->normalForm().getAdditiveSubexps( &terms );
+	       for ( Sym::SymPVecIter m = terms.begin(); m != terms.end(); ++m )
+		  (*m)->getMultiplicitiveSubexps( &atoms );
+	    }
+	 }
+	 internAtoms( atoms );
+
+	 size_t lists = 0;
+	 for ( p = 0; p < factor_terms.size(); ++p ) lists += factor_terms[p].size();
+	 _lists.reserve( lists );  // Product keeps pointers into _lists
+	 for ( p = 0; p < factor_terms.size(); ++p )
+	 {
+	    Product prod;
+	    prod.scale = scales[p];
+	    prod.count = prod.scale.isZero() ? 0 : 1;
+	    for ( size_t f = 0; f < factor_terms[p].size(); ++f )
+	    {
+	       _lists.push_back( Terms() );
+	       Terms &terms = _lists.back();
+	       const SymPVec &syms = factor_terms[p][f];
+	       for ( SymPVec::const_iterator m = syms.begin(); m != syms.end(); ++m )
+		  terms.push_back( monomial( **m ) );
+	       prod.factors.push_back( &terms );
+	       prod.count *= terms.size();
+	    }
+	    _products.push_back( prod );
+	 }
+
+	 for ( p = 0; p < _products.size(); ++p )
+	    for ( size_t b = 0; b < _products[p].count; b += CHUNK )
+	    {
+	       Chunk c = { p, b, std::min( b + CHUNK, _products[p].count ) };
+	       _chunks.push_back( c );
+	    }
+      }
+
+      /// ids in Sym order, so sorting ids sorts factors the way product() does
+      void internAtoms( SymPVec &atoms )
+      {
+	 std::vector<SymSP> sorted;
+	 for ( Sym::SymPVecIter a = atoms.begin(); a != atoms.end(); ++a )
+	    if ( !(*a)->isRationalValue() ) sorted.push_back( *a );
+	 std::stable_sort( sorted.begin(), sorted.end(), Sym::SymPComp() );
+	 for ( size_t i = 0; i < sorted.size(); ++i )
+	    if ( _atoms.empty() || !(*_atoms.back() == *sorted[i]) )
+	       _atoms.push_back( sorted[i] );
+      }
+
+      int atomId( const Sym &a ) const
+      {
+	 // _atoms is sorted and unique, binary search with the same order
+	 size_t lo = 0, hi = _atoms.size();
+	 while ( lo < hi )
+	 {
+	    const size_t mid = (lo + hi) / 2;
+	    if ( Sym::order( *_atoms[mid], a ) < 0 ) lo = mid + 1;
+	    else hi = mid;
+	 }
+	 assert( lo < _atoms.size() && *_atoms[lo] == a );
+	 return int(lo);
+      }
+
+      Monomial monomial( const Sym &term ) const
+      {
+	 Monomial m;
+	 SymPVec factors;
+	 m.coef = term.getCoefficient( &factors );
+	 for ( Sym::SymPVecIter f = factors.begin(); f != factors.end(); ++f )
+	    m.atoms.push_back( atomId( **f ) );
+	 std::sort( m.atoms.begin(), m.atoms.end() );
+	 return m;
+      }
+
+      /// multiply out chunks until there are none left
+      void work( std::atomic<size_t> *next, Collected *out ) const
+      {
+	 Atoms atoms;
+	 std::vector<size_t> digit;
+	 for ( size_t c = (*next)++; c < _chunks.size(); c = (*next)++ )
+	 {
+	    const Chunk &chunk = _chunks[c];
+	    const Product &prod = _products[chunk.product];
+	    const size_t k = prod.factors.size();
+
+	    // mixed radix digits of chunk.begin, first factor varies fastest
+	    digit.assign( k, 0 );
+	    size_t rest = chunk.begin;
+	    for ( size_t f = 0; f < k; ++f )
+	    {
+	       digit[f] = rest % prod.factors[f]->size();
+	       rest /= prod.factors[f]->size();
+	    }
+	    for ( size_t i = chunk.begin; i < chunk.end; ++i )
+	    {
+	       Rational coef = prod.scale;
+	       atoms.clear();
+	       for ( size_t f = 0; f < k; ++f )
+	       {
+		  const Monomial &m = (*prod.factors[f])[digit[f]];
+		  coef = coef * m.coef;
+		  atoms.insert( atoms.end(), m.atoms.begin(), m.atoms.end() );
+	       }
+	       std::sort( atoms.begin(), atoms.end() );
+	       Collected::iterator it = out->find( atoms );
+	       if ( it == out->end() ) out->insert( std::make_pair( atoms, coef ) );
+	       else it->second = it->second + coef;
+
+	       for ( size_t f = 0; f < k && ++digit[f] == prod.factors[f]->size(); ++f )
+		  digit[f] = 0;  // carry
+	    }
+	 }
+      }
+
+      /// run the chunks on the thread pool, merge and build the sum
+      Sym collect()
+      {
+	 const unsigned threads = unsigned( std::min<size_t>( _threads, _chunks.size() ) );
+	 std::vector<Collected> tables( std::max( threads, 1u ) );
+	 std::atomic<size_t> next( 0 );
+	 if ( threads <= 1 )
+	    work( &next, &tables[0] );
+	 else
+	 {
+	    std::vector<std::thread> pool;
+	    for ( unsigned t = 1; t < threads; ++t )
+	       pool.push_back( std::thread( &ProductExpander::work, this, &next, &tables[t] ) );
+	    work( &next, &tables[0] );
+	    for ( size_t t = 0; t < pool.size(); ++t ) pool[t].join();
+	 }
+
+	 // rational addition is exact, merge order doesn't change the result
+	 Collected &all = tables[0];
+	 for ( size_t t = 1; t < tables.size(); ++t )
+	 {
+	    for ( Collected::iterator m = tables[t].begin(); m != tables[t].end(); ++m )
+	    {
+	       Collected::iterator it = all.find( m->first );
+	       if ( it == all.end() ) all.insert( *m );
+	       else it->second = it->second + m->second;
+	    }
+	    Collected().swap( tables[t] );
+	 }
+
+	 SymPVec terms;
+	 for ( Collected::const_iterator m = all.begin(); m != all.end(); ++m )
+	 {
+	    if ( m->second.isZero() ) continue;
+	    SymPVec factors( 1, Sym( m->second ).copyMaybe() );
+	    for ( size_t a = 0; a < m->first.size(); ++a ) factors.push_back( _atoms[m->first[a]] );
+	    terms.push_back( Sym::product( factors ).copyMaybe() );
+	 }
+	 return Sym::sum( terms );
+      }
+   };
+
+   inline Sym Sym::expand( unsigned threads ) const
+   {
+      return ProductExpander( threads ).expand( *this );
+   }
+
+}  /// end namespace Symath
+
+#endif
@@ -0,0 +1,299 @@
+/// Text to Sym.
+///   Operator precedence (shunting-yard) parser, no recursion and no parse
+///   tree: operands go straight onto a stack of Sym and operators are applied
+///   as soon as their precedence allows, so deep or long expressions are
+///   fine.  Input is read one character at a time, a stream holding many
+///   expressions is never loaded whole.
+///
+///   Grammar, loosest first:   a + b   a - b   |   a*b   a/b   |   -a   |   a^b
+///   (right associative)   |   Sin(a)  Cos(a)  (a)  names  numbers
+///   Numbers are exact: 12, 0.25 (== 1/4), 1/3 folds to a rational.
+///   Expressions in a stream are separated by ';' or new lines, a line
+///   that ends inside parentheses or after an operator continues.
+///
+/// \code
+///   Sym e = Symath::parse( "(a + 2)*(b + 3) - Sin(a*b)^2" );
+///   std::ifstream dump( "run.sym" );
+///   Symath::SymParser parser( dump );
+///   Sym s;
+///   while ( !parser.eof() )
+///      if ( parser.next( &s ) ) results.push_back( s );  // else skip the bad one
+/// \endcode
+
+#ifndef __SYMBOLIC_PARSE_H
+#define __SYMBOLIC_PARSE_H
+
+#include <cctype>
+#include <iostream>
+#include <map>
+#include <sstream>
+#include <string>
+#include <vector>
+#include "symath.h"
+
+namespace Symath {
+
+   ///----------------------------------------------------------
+   //
+   /// reads expressions from a stream, see top of file
+   //
+   class SymParser {
+     public:
+      explicit SymParser( std::istream &is )
+	: _is(is), _line(1), _column(0), _failed(false)
+      {}
+
+      /// parse the next expression into |s|, false at end of input or on
+      /// a syntax error (reported on std::cerr, see failed()).  After an
+      /// error the bad statement is skipped, loop on eof() to carry on.
+      bool next( Sym *s )
+      {
+	 _operands.clear();
+	 _operators.clear();
+	 bool want_operand = true;  // else we want an operator
+	 int  depth = 0;
+	 for ( ;; )
+	 {
+	    skipBlanks();
+	    const int c = _is.peek();
+	    if ( c == EOF || ((c == ';' || c == '\n') && depth == 0 && !want_operand) )
+	    {
+	       if ( c != EOF ) get();
+	       if ( want_operand )
+	       {
+		  if ( _operators.empty() ) return false;  // nothing left
+		  return error( "expression ends with an operator" );
+	       }
+	       if ( depth ) return error( "missing )" );
+	       if ( !reduce( LOWEST ) ) return false;
+	       *s = _operands.back();
+	       return true;
+	    }
+	    if ( c == ';' && depth ) return error( "missing )" );
+	    if ( c == ';' || c == '\n' )  // empty statement, or continued line
+	    {
+	       get();
+	       continue;
+	    }
+
+	    if ( want_operand )
+	    {
+	       if ( c == '(' )
+	       {
+		  get();
+		  _operators.push_back( Op( OPEN, '(' ) );
+		  ++depth;
+	       }
+	       else if ( c == '-' )
+	       {
+		  get();
+		  _operators.push_back( Op( NEGATE, 'n' ) );
+	       }
+	       else if ( c == '+' )  // unary plus
+		  get();
+	       else if ( std::isdigit( c ) || c == '.' )
+	       {
+		  if ( !number() ) return false;
+		  want_operand = false;
+	       }
+	       else if ( std::isalpha( c ) || c == '_' )
+	       {
+		  const std::string name = identifier();
+		  skipBlanks();
+		  if ( name == SIN || name == COS || name == "sin" || name == "cos" )
+		  {
+		     if ( _is.peek() != '(' ) return error( "expected ( after " + name );
+		     _operators.push_back( Op( FUNCTION, name == SIN || name == "sin" ? 's' : 'c' ) );
+		     continue;  // the ( comes next
+		  }
+		  _operands.push_back( variable( name ) );
+		  want_operand = false;
+	       }
+	       else return error( std::string( "unexpected '" ) + char(c) + "'" );
+	       continue;
+	    }
+
+	    // want an operator
+	    if ( c == ')' )
+	    {
+	       get();
+	       if ( !depth ) return error( "unbalanced )" );
+	       if ( !reduce( OPEN ) ) return false;
+	       _operators.pop_back();  // the (
+	       --depth;
+	       if ( !_operators.empty() && _operators.back().kind == FUNCTION )
+		  if ( !apply() ) return false;
+	       continue;
+	    }
+	    int kind;
+	    switch ( c )
+	    {
+	       case '+': case '-': kind = SUM; break;
+	       case '*': case '/': kind = PRODUCT; break;
+	       case '^':           kind = POWER; break;
+	       default:  return error( std::string( "expected an operator, not '" ) + char(c) + "'" );
+	    }
+	    get();
+	    // left associative operators pop equal precedence, ^ does not
+	    if ( !reduce( kind == POWER ? kind + 1 : kind ) ) return false;
+	    _operators.push_back( Op( kind, char(c) ) );
+	    want_operand = true;
+	 }
+      }
+
+      /// true once only blanks, ';' and new lines are left
+      bool eof()
+      {
+	 for ( ;; )
+	 {
+	    skipBlanks();
+	    const int c = _is.peek();
+	    if ( c != ';' && c != '\n' ) return c == EOF;
+	    get();
+	 }
+      }
+
+      bool failed() const { return _failed; }
+      int  line() const   { return _line; }
+
+     protected:
+      /// operator precedence, increasing.  ( and functions sit on the
+      /// operator stack until their ) arrives.
+      enum { LOWEST, OPEN, FUNCTION, SUM, PRODUCT, NEGATE, POWER };
+      struct Op {
+	 Op( int k, char o ) : kind(k), op(o) {}
+	 int  kind;
+	 char op;  ///< + - * / ^, n negate, s Sin, c Cos
+      };
+
+      std::istream              &_is;
+      int                        _line, _column;
+      bool                       _failed;
+      std::vector<Sym>           _operands;
+      std::vector<Op>            _operators;
+      std::map<std::string, Sym> _variables;  ///< one shared node per name
+
+      int get()
+      {
+	 const int c = _is.get();
+	 if ( c == '\n' ) { ++_line; _column = 0; }
+	 else ++_column;
+	 return c;
+      }
+
+      void skipBlanks()
+      {
+	 for ( int c = _is.peek(); c == ' ' || c == '\t' || c == '\r'; c = _is.peek() ) get();
+      }
+
+      bool error( const std::string &what )
+      {
+	 std::cerr << "SymParser: " << what << " at line " << _line << ", column " << _column << std::endl;
+	 _failed = true;
+	 // skip the rest of the statement so next() can carry on
+	 for ( int c = _is.peek(); c != EOF && c != ';' && c != '\n'; c = _is.peek() ) get();
+	 return false;
+      }
+
+      std::string identifier()
+      {
+	 std::string name;
+	 for ( int c = _is.peek(); std::isalnum( c ) || c == '_'; c = _is.peek() ) name += char( get() );
+	 return name;
+      }
+
+      Sym variable( const std::string &name )
+      {
+	 std::map<std::string, Sym>::iterator v = _variables.find( name );
+	 if ( v == _variables.end() )
+	 {
+	    // the copy is on the heap, every use shares it
+	    Sym leaf( name );
+	    v = _variables.insert( std::make_pair( name, Sym( *leaf.copyMaybe() ) ) ).first;
+	 }
+	 return v->second;
+      }
+
+      /// digits [. digits], exact
+      bool number()
+      {
+	 BigInt num( 0 ), den( 1 );
+	 long long small = 0;  // digits so far while they fit
+	 int small_digits = 0;
+	 bool any = false, point = false;
+	 for ( int c = _is.peek(); std::isdigit( c ) || (c == '.' && !point); c = _is.peek() )
+	 {
+	    get();
+	    if ( c == '.' ) { point = true; continue; }
+	    any = true;
+	    small = small * 10 + (c - '0');
+	    if ( ++small_digits == 18 )  // flush before a long long could overflow
+	    {
+	       num = num * BigInt( 1000000000000000000LL ) + BigInt( small );
+	       small = 0;
+	       small_digits = 0;
+	    }
+	    if ( point ) den = den * BigInt( 10 );
+	 }
+	 if ( !any ) return error( "expected digits" );
+	 long long scale = 1;
+	 for ( int i = 0; i < small_digits; ++i ) scale *= 10;
+	 num = num * BigInt( scale ) + BigInt( small );
+	 _operands.push_back( Sym( Rational( num, den ) ) );
+	 return true;
+      }
+
+      /// apply operators that bind at least as tight as |kind|
+      bool reduce( int kind )
+      {
+	 while ( !_operators.empty() && _operators.back().kind >= kind && _operators.back().kind > FUNCTION )
+	    if ( !apply() ) return false;
+	 return true;
+      }
+
+      /// pop one operator and its operands, push the result
+      bool apply()
+      {
+	 const Op op = _operators.back();
+	 _operators.pop_back();
+	 const size_t arity = op.kind == NEGATE || op.kind == FUNCTION ? 1 : 2;
+	 if ( _operands.size() < arity ) return error( "missing operand" );
+	 const Sym b = _operands.back();
+	 _operands.pop_back();
+	 if ( arity == 1 )
+	 {
+	    _operands.push_back( op.op == 'n' ? -b : op.op == 's' ? ::sin( b ) : ::cos( b ) );
+	    return true;
+	 }
+	 const Sym a = _operands.back();
+	 _operands.pop_back();
+	 switch ( op.op )
+	 {
+	    case '+': _operands.push_back( a + b ); break;
+	    case '-': _operands.push_back( a - b ); break;
+	    case '*': _operands.push_back( a * b ); break;
+	    case '/': _operands.push_back( a / b ); break;
+	    case '^': _operands.push_back( ::pow( a, b ) ); break;
+	 }
+	 return true;
+      }
+   };
+
+   //-----------------------------------------------------------------------------
+   /// parse one expression from |text|, reports errors on std::cerr
+   inline Sym parse( const std::string &text )
+   {
+      std::istringstream is( text );
+      SymParser parser( is );
+      Sym s;
+      if ( !parser.next( &s ) )
+      {
+	 std::cerr << "parse(): no expression in \"" << text << "\"" << std::endl;
+	 return Sym( "NaN" );
+      }
+      return s;
+   }
+
+}  /// end namespace Symath
+
+#endif
@@ -0,0 +1,336 @@
+/// Pooled storage for Sym nodes.
+///   Nodes are carved from 64k aligned chunks of equal sized slots.  Each
+///   thread allocates from its own pool, so new and delete of a node are a
+///   couple of pointer moves on a free list, no malloc.
+///
+///   A SymArena (NodeArena<Sym>) opens a nested pool for the current
+///   thread: every node allocated while it is in scope goes into the arena's
+///   chunks, and when it closes the chunks go back to the system in one go.  Nodes that are
+///   still referenced when the arena closes are not lost, their chunks are
+///   handed over to the enclosing pool instead.
+/// \code
+///   std::string result;
+///   {
+///      Symath::SymArena arena;
+///      result = bigDerivation().normalForm().toString();
+///   }  // everything the derivation allocated is released here
+/// \endcode
+///
+///   Nodes can be deleted on any thread.  A node deleted on another thread
+///   goes on its pool's remote list (under the pool's mutex), the owning
+///   thread picks those up when its own free list runs dry.  A thread's
+///   pool outlives the thread until its last node is deleted.
+///   NOTE: nodes allocated in an arena must not be deleted by other threads
+///   while the arena is closing.
+
+#ifndef __SYMBOLIC_POOL_H
+#define __SYMBOLIC_POOL_H
+
+#include <atomic>
+#include <cassert>
+#include <cstdlib>
+#include <iostream>
+#include <mutex>
+#include <new>
+#if defined(_WIN32)
+#include <malloc.h>
+#endif
+
+namespace Symath {
+
+   ///----------------------------------------------------------
+   //
+   /// free list allocator for nodes of type T, one pool per thread (and per
+   /// open arena).  Use from T::operator new/delete.
+   //
+   template< class T >
+   class NodePool {
+     public:
+      enum {
+	 CHUNK_BYTES = 1 << 16,  ///< chunks are aligned to their size
+	 SLOT_ALIGN  = 16
+      };
+
+      explicit NodePool( NodePool *parent = 0 )
+	: _parent(parent), _home( &top() ), _chunks(0), _free(0),
+	  _bump(0), _end(0), _live(0),
+	  _remote(0), _remote_count(0), _orphan(false)
+      {}
+
+      /// frees the chunks, or gives them to the parent if nodes are live
+      ~NodePool()
+      {
+	 collectRemote();
+	 if ( _live && _parent )
+	    _parent->adopt( this );
+	 else if ( _live )
+	    std::cerr << "NodePool: " << _live << " nodes still live, leaking their chunks\n";
+	 else
+	    freeChunks();
+      }
+
+      /// storage for a |size| byte node from the current thread's pool
+      static void *allocate( size_t size )
+      {
+	 if ( size != sizeof(T) )  // derived class, not our size class
+	 {
+	    void *storage = std::malloc( size );
+	    if ( !storage ) throw std::bad_alloc();
+	    return storage;
+	 }
+	 return current()->take();
+      }
+
+      /// give back storage from allocate(), |size| must match
+      static void release( void *p, size_t size )
+      {
+	 if ( !p ) return;
+	 if ( size != sizeof(T) )
+	 {
+	    std::free( p );
+	    return;
+	 }
+	 NodePool *owner = chunkOf( p )->owner;
+	 if ( owner->_home == &top() && !owner->_orphan )  // a new thread may reuse a dead one's top()
+	    owner->give( p );
+	 else
+	    owner->giveRemote( p );
+      }
+
+      /// the pool new nodes on this thread come from
+      static NodePool *current()
+      {
+	 NodePool *&cur = top();
+	 if ( !cur ) cur = threadPool().pool;
+	 return cur;
+      }
+
+      /// nodes allocated from this pool and not yet deleted
+      size_t liveNodes() const
+      {
+	 std::lock_guard<std::mutex> lock( _mutex );
+	 return _live - _remote_count;
+      }
+
+     protected:
+      template< class U > friend class NodeArena;
+
+      enum { SLOT = (sizeof(T) + SLOT_ALIGN - 1) & ~(SLOT_ALIGN - 1) };
+
+      /// chunk header, slots follow it in the same chunk
+      struct Chunk {
+	 NodePool *owner;
+	 Chunk   *next;
+      };
+      /// a free slot holds the next free slot
+      struct FreeSlot {
+	 FreeSlot *next;
+      };
+
+      NodePool  *_parent;
+      NodePool **_home;     ///< address of the owning thread's top(), unique per thread
+      Chunk     *_chunks;
+      FreeSlot  *_free;
+      char      *_bump;     ///< untouched slots of the newest chunk
+      char      *_end;
+      size_t     _live;     ///< taken and not given back on this thread
+
+      /// slots deleted on other threads, guarded by _mutex
+      mutable std::mutex  _mutex;
+      FreeSlot           *_remote;
+      size_t              _remote_count;
+      std::atomic<bool>   _orphan;  ///< thread has exited, delete ourself when empty
+
+      static size_t headerBytes()
+      {
+	 return (sizeof(Chunk) + SLOT_ALIGN - 1) & ~size_t(SLOT_ALIGN - 1);
+      }
+      static Chunk *chunkOf( void *p )
+      {
+	 return reinterpret_cast<Chunk*>( reinterpret_cast<size_t>(p) & ~size_t(CHUNK_BYTES - 1) );
+      }
+
+      void *take()
+      {
+	 ++_live;
+	 if ( !_free && _bump + SLOT > _end ) collectRemote();
+	 if ( _free )
+	 {
+	    FreeSlot *s = _free;
+	    _free = s->next;
+	    return s;
+	 }
+	 if ( _bump + SLOT > _end ) newChunk();
+	 void *p = _bump;
+	 _bump += SLOT;
+	 return p;
+      }
+
+      void give( void *p )
+      {
+	 FreeSlot *s = static_cast<FreeSlot*>( p );
+	 s->next = _free;
+	 _free = s;
+	 assert( _live > 0 );
+	 --_live;
+      }
+
+      void giveRemote( void *p )
+      {
+	 bool dead = false;
+	 {
+	    std::lock_guard<std::mutex> lock( _mutex );
+	    FreeSlot *s = static_cast<FreeSlot*>( p );
+	    s->next = _remote;
+	    _remote = s;
+	    ++_remote_count;
+	    dead = _orphan && _remote_count == _live;
+	 }
+	 if ( dead ) delete this;  // last node of an exited thread
+      }
+
+      /// move slots deleted on other threads onto our free list
+      void collectRemote()
+      {
+	 std::lock_guard<std::mutex> lock( _mutex );
+	 while ( _remote )
+	 {
+	    FreeSlot *s = _remote;
+	    _remote = s->next;
+	    s->next = _free;
+	    _free = s;
+	 }
+	 _live -= _remote_count;
+	 _remote_count = 0;
+      }
+
+      void newChunk()
+      {
+	 // aligned to its size, chunkOf() finds it by masking
+#if defined(_WIN32)
+	 void *raw = _aligned_malloc( CHUNK_BYTES, CHUNK_BYTES );
+#else
+	 void *raw = 0;
+	 if ( posix_memalign( &raw, CHUNK_BYTES, CHUNK_BYTES ) != 0 ) raw = 0;
+#endif
+	 if ( !raw ) throw std::bad_alloc();
+	 char *base = static_cast<char*>( raw );
+	 Chunk *c = reinterpret_cast<Chunk*>( base );
+	 c->owner = this;
+	 c->next = _chunks;
+	 _chunks = c;
+	 _bump = base + headerBytes();
+	 _end = base + CHUNK_BYTES;
+      }
+
+      void freeChunks()
+      {
+	 while ( _chunks )
+	 {
+	    Chunk *c = _chunks;
+	    _chunks = c->next;
+#if defined(_WIN32)
+	    _aligned_free( c );
+#else
+	    std::free( c );
+#endif
+	 }
+	 _free = 0;
+	 _bump = _end = 0;
+      }
+
+      /// take over the chunks and free slots of a closing arena
+      void adopt( NodePool *arena )
+      {
+	 // untouched slots go on the free list too
+	 for ( ; arena->_bump && arena->_bump + SLOT <= arena->_end; arena->_bump += SLOT )
+	 {
+	    FreeSlot *s = reinterpret_cast<FreeSlot*>( arena->_bump );
+	    s->next = arena->_free;
+	    arena->_free = s;
+	 }
+	 while ( arena->_chunks )
+	 {
+	    Chunk *c = arena->_chunks;
+	    arena->_chunks = c->next;
+	    c->owner = this;
+	    c->next = _chunks;
+	    _chunks = c;
+	 }
+	 while ( arena->_free )
+	 {
+	    FreeSlot *s = arena->_free;
+	    arena->_free = s->next;
+	    s->next = _free;
+	    _free = s;
+	 }
+	 _live += arena->_live;
+	 arena->_live = 0;
+      }
+
+      /// innermost open pool on this thread, 0 until first use
+      static NodePool *&top()
+      {
+	 static thread_local NodePool *t = 0;
+	 return t;
+      }
+
+      /// owns the thread's base pool, which outlives the thread while any
+      /// of its nodes are referenced
+      struct ThreadPool {
+	 NodePool *pool;
+	 ThreadPool() : pool( new NodePool ) {}
+	 ~ThreadPool()
+	 {
+	    bool dead = false;
+	    {
+	       std::lock_guard<std::mutex> lock( pool->_mutex );
+	       pool->_orphan = true;
+	       dead = pool->_remote_count == pool->_live;
+	    }
+	    if ( dead ) delete pool;
+	 }
+      };
+      static ThreadPool &threadPool()
+      {
+	 static thread_local ThreadPool p;
+	 return p;
+      }
+
+     private:
+      NodePool( const NodePool & );
+      NodePool &operator=( const NodePool & );
+   };
+
+   ///----------------------------------------------------------
+   //
+   /// scoped pool for one derivation, see top of file
+   //
+   template< class T >
+   class NodeArena {
+     public:
+      NodeArena()
+	: _pool( NodePool<T>::current() )
+      {
+	 NodePool<T>::top() = &_pool;
+      }
+      ~NodeArena()
+      {
+	 assert( NodePool<T>::top() == &_pool );  // arenas close in the order they opened
+	 NodePool<T>::top() = _pool._parent;
+      }
+
+      /// nodes allocated in this arena and not yet deleted
+      size_t liveNodes() const { return _pool.liveNodes(); }
+
+     protected:
+      NodePool<T> _pool;
+
+     private:
+      NodeArena( const NodeArena & );
+      NodeArena &operator=( const NodeArena & );
+   };
+
+}  /// end namespace Symath
+
+#endif
@@ -0,0 +1,568 @@
+/// Compiled numeric evaluation of symbolic expressions.
+///   Sym::compile() lowers an expression DAG to SSA form with value numbering
+///   (common subexpressions are computed once, repeated factors become powers
+///   by squaring, constants fold), then allocates registers for a flat
+///   bytecode Program.  Program::evaluate() interprets the bytecode over
+///   blocks of samples laid out as structure-of-arrays, one tight loop per
+///   instruction, so the per-instruction dispatch is paid once per block.
+///
+///   Example:
+/// \code
+///   Sym x("x"), y("y");
+///   std::vector<std::string> vars;  vars.push_back("x");  vars.push_back("y");
+///   Program p = (x*x*y + y).compile(vars);
+///   const double *in[2] = { xs, ys };   // xs[i], ys[i] for i < count
+///   double *out[1] = { result };
+///   p.evaluate(in, out, count);
+/// \endcode
+
+#ifndef __SYMBOLIC_PROGRAM_H
+#define __SYMBOLIC_PROGRAM_H
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <deque>
+#include <iostream>
+#include <limits>
+#include <map>
+#include <mutex>
+#include <string>
+#include <vector>
+#include "symath.h"
+
+namespace Symath {
+
+   ///----------------------------------------------------------
+   //
+   /// Variable names interned to small integer ids, ids are never reused.
+   /// Safe to use from several threads.
+   //
+   class SymbolTable {
+     public:
+      static int intern( const std::string &name )
+      {
+	 Table &t = table();
+	 std::lock_guard<std::mutex> lock( t.mutex );
+	 std::map<std::string,int>::const_iterator it = t.ids.find( name );
+	 if ( it != t.ids.end() ) return it->second;
+	 const int id = int(t.names.size());
+	 t.ids[name] = id;
+	 t.names.push_back( name );
+	 return id;
+      }
+      /// -1 if the name was never interned
+      static int find( const std::string &name )
+      {
+	 Table &t = table();
+	 std::lock_guard<std::mutex> lock( t.mutex );
+	 std::map<std::string,int>::const_iterator it = t.ids.find( name );
+	 return it != t.ids.end() ? it->second : -1;
+      }
+      static const std::string &name( int id )
+      {
+	 Table &t = table();
+	 std::lock_guard<std::mutex> lock( t.mutex );
+	 return t.names.at( id );
+      }
+
+     protected:
+      struct Table {
+	 std::map<std::string,int> ids;
+	 std::deque<std::string>   names;  // deque: references stay valid as it grows
+	 std::mutex                mutex;
+      };
+      static Table &table() { static Table t; return t; }
+   };
+
+   ///----------------------------------------------------------
+   //
+   /// One three-address instruction.  In SSA form (SymLowering) dst, a, b are
+   /// value numbers, in a Program they are registers.
+   //
+   struct Instr {
+      enum OpCode {
+	 CONST,  ///< dst = constants[a]
+	 VAR,    ///< dst = input[a]
+	 ADD,    ///< dst = a + b
+	 SUB,    ///< dst = a - b
+	 MUL,    ///< dst = a * b
+	 DIV,    ///< dst = a / b
+	 NEG,    ///< dst = -a
+	 POW,    ///< dst = pow(a, b)
+	 SIN,    ///< dst = sin(a)
+	 COS     ///< dst = cos(a)
+      };
+      int op;
+      int dst;
+      int a;
+      int b;
+
+      Instr( int o = CONST, int d = -1, int l = -1, int r = -1 ) : op(o), dst(d), a(l), b(r) {}
+
+      static const char *name( int op )
+      {
+	 static const char *names[] = { "const", "var", "+", "-", "*", "/", "neg", "pow", "sin", "cos" };
+	 return names[op];
+      }
+   };
+
+   ///----------------------------------------------------------
+   //
+   /// Lowers Sym expressions to SSA instructions with value numbering.
+   ///   Value v is defined by code()[v].  Several expressions can be lowered
+   ///   into one instance, they share every common subexpression.
+   //
+   class SymLowering {
+     public:
+      explicit SymLowering( const std::vector<std::string> &variables )
+      {
+	 for ( size_t i = 0; i < variables.size(); ++i )
+	 {
+	    const int id = SymbolTable::intern( variables[i] );
+	    _variable_ids.push_back( id );
+	    _slots[id] = int(i);
+	 }
+      }
+
+      /// lower |s| and record it as the next output
+      int addOutput( const Sym &s )
+      {
+	 const int v = lower( s );
+	 _outputs.push_back( v );
+	 return v;
+      }
+
+      /// lower an expression, returns its value number.
+      ///  iterative post-order walk, so long left-leaning sums do not recurse.
+      int lower( const Sym &expr )
+      {
+	 // keep the walked nodes alive, the memo is keyed by address
+	 Sym::SymSP root = expr.copyMaybe();
+	 _roots.push_back( root );
+
+	 Sym::walk( *root, this );
+	 return _memo[root.getPtr()];
+      }
+
+      const std::vector<Instr>  &code() const        { return _code; }
+      const std::vector<double> &constants() const   { return _constants; }
+      const std::vector<int>    &outputs() const     { return _outputs; }
+      const std::vector<int>    &variableIds() const { return _variable_ids; }
+
+      /// values the outputs depend on, everything else is dead code
+      std::vector<bool> liveValues() const
+      {
+	 std::vector<bool> live( _code.size(), false );
+	 for ( size_t i = 0; i < _outputs.size(); ++i ) live[_outputs[i]] = true;
+	 for ( int v = int(_code.size()) - 1; v >= 0; --v )
+	 {
+	    if ( !live[v] ) continue;
+	    const Instr &ins = _code[v];
+	    if ( ins.op == Instr::CONST || ins.op == Instr::VAR ) continue;
+	    if ( ins.a >= 0 ) live[ins.a] = true;
+	    if ( ins.b >= 0 ) live[ins.b] = true;
+	 }
+	 return live;
+      }
+
+      /// number of reads of each live value by live code and outputs
+      std::vector<int> useCounts() const
+      {
+	 const std::vector<bool> live = liveValues();
+	 std::vector<int> uses( _code.size(), 0 );
+	 for ( size_t i = 0; i < _outputs.size(); ++i ) ++uses[_outputs[i]];
+	 for ( size_t v = 0; v < _code.size(); ++v )
+	 {
+	    const Instr &ins = _code[v];
+	    if ( !live[v] || ins.op == Instr::CONST || ins.op == Instr::VAR ) continue;
+	    if ( ins.a >= 0 ) ++uses[ins.a];
+	    if ( ins.b >= 0 ) ++uses[ins.b];
+	 }
+	 return uses;
+      }
+
+     protected:
+      friend class Sym;  // walk()
+
+      struct Key {
+	 int op, a, b;
+	 bool operator<( const Key &k ) const
+	 {
+	    if ( op != k.op ) return op < k.op;
+	    if ( a != k.a ) return a < k.a;
+	    return b < k.b;
+	 }
+      };
+
+      std::vector<Instr>                     _code;
+      std::vector<double>                    _constants;
+      std::vector<int>                       _outputs;
+      std::vector<int>                       _variable_ids;
+      std::map<int,int>                      _slots;        // variable id -> input slot
+      std::map<Key,int>                      _values;       // value numbering
+      std::map<unsigned long long,int>       _const_values; // constant bits -> value
+      std::map<const Sym*,int>               _memo;         // node -> value
+      std::map< int, std::vector<int> >      _factors;      // product value -> its factors
+      std::vector< Sym::SymSP >              _roots;
+
+      //-----------------------------------------------------------------------------
+      bool isConst( int v ) const { return _code[v].op == Instr::CONST; }
+      double constOf( int v ) const { return _constants[_code[v].a]; }
+
+      int constant( double c )
+      {
+	 unsigned long long bits;  // key by bit pattern, NaN would break a map<double>
+	 std::memcpy( &bits, &c, sizeof(bits) );
+	 std::map<unsigned long long,int>::const_iterator it = _const_values.find( bits );
+	 if ( it != _const_values.end() ) return it->second;
+	 const int v = int(_code.size());
+	 _code.push_back( Instr( Instr::CONST, v, int(_constants.size()) ) );
+	 _constants.push_back( c );
+	 _const_values[bits] = v;
+	 return v;
+      }
+
+      /// value numbered instruction, folds constants
+      int value( int op, int a, int b = -1 )
+      {
+	 if ( isConst( a ) && (b < 0 || isConst( b )) )
+	 {
+	    const double x = constOf( a ), y = b < 0 ? 0.0 : constOf( b );
+	    switch ( op )
+	    {
+	       case Instr::ADD: return constant( x + y );
+	       case Instr::SUB: return constant( x - y );
+	       case Instr::MUL: return constant( x * y );
+	       case Instr::DIV: return constant( x / y );
+	       case Instr::NEG: return constant( -x );
+	       case Instr::POW: return constant( std::pow( x, y ) );
+	       case Instr::SIN: return constant( std::sin( x ) );
+	       case Instr::COS: return constant( std::cos( x ) );
+	    }
+	 }
+	 if ( op == Instr::NEG && _code[a].op == Instr::NEG ) return _code[a].a;  // --a
+	 if ( (op == Instr::ADD || op == Instr::MUL) && b < a ) std::swap( a, b );  // commute
+
+	 Key k = { op, a, b };
+	 std::map<Key,int>::const_iterator it = _values.find( k );
+	 if ( it != _values.end() ) return it->second;
+	 const int v = int(_code.size());
+	 _code.push_back( Instr( op, v, a, b ) );
+	 _values[k] = v;
+	 return v;
+      }
+
+      /// x^n by squaring, n > 0
+      int power( int x, long long n )
+      {
+	 int result = -1;
+	 while ( n )
+	 {
+	    if ( n & 1 ) result = result < 0 ? x : value( Instr::MUL, result, x );
+	    n >>= 1;
+	    if ( n ) x = value( Instr::MUL, x, x );
+	 }
+	 return result;
+      }
+
+      /// Sym::walk() visitor, numbers and variables are lowered on the way down
+      bool enter( const Sym &s )
+      {
+	 if ( _memo.count( &s ) ) return false;
+	 if ( !s.isRationalValue() && !s.isLeaf() ) return true;
+	 _memo[&s] = lowerLeaf( s );
+	 return false;
+      }
+      void leave( const Sym &s ) { _memo[&s] = lowerNode( s ); }
+
+      int lowerLeaf( const Sym &s )
+      {
+	 if ( s.isRationalValue() ) return constant( s.getRational().toDouble() );
+	 const int id = SymbolTable::find( s.getValue() );
+	 std::map<int,int>::const_iterator slot = _slots.find( id );
+	 if ( id < 0 || slot == _slots.end() )
+	 {
+	    std::cerr << "Sym::compile() unbound variable: " << s.getValue() << std::endl;
+	    return constant( std::numeric_limits<double>::quiet_NaN() );
+	 }
+	 const Key k = { Instr::VAR, slot->second, -1 };
+	 std::map<Key,int>::const_iterator it = _values.find( k );
+	 if ( it != _values.end() ) return it->second;
+	 const int v = int(_code.size());
+	 _code.push_back( Instr( Instr::VAR, v, slot->second ) );
+	 _values[k] = v;
+	 return v;
+      }
+
+      /// a*b: collect the factors of both sides, equal factors become powers
+      int product( int l, int r )
+      {
+	 std::vector<int> factors;
+	 appendFactors( l, &factors );
+	 appendFactors( r, &factors );
+	 std::sort( factors.begin(), factors.end() );
+
+	 double scale = 1.0;
+	 int result = -1;
+	 for ( size_t i = 0; i < factors.size(); )
+	 {
+	    size_t j = i;
+	    while ( j < factors.size() && factors[j] == factors[i] ) ++j;
+	    if ( isConst( factors[i] ) )
+	       scale *= std::pow( constOf( factors[i] ), double(j - i) );
+	    else
+	    {
+	       const int p = power( factors[i], (long long)(j - i) );
+	       result = result < 0 ? p : value( Instr::MUL, result, p );
+	    }
+	    i = j;
+	 }
+	 if ( result < 0 ) return constant( scale );
+	 if ( scale == -1.0 ) result = value( Instr::NEG, result );
+	 else if ( scale != 1.0 ) result = value( Instr::MUL, constant( scale ), result );
+	 _factors[result] = factors;
+	 return result;
+      }
+
+      void appendFactors( int v, std::vector<int> *factors ) const
+      {
+	 std::map< int, std::vector<int> >::const_iterator it = _factors.find( v );
+	 if ( it == _factors.end() ) factors->push_back( v );
+	 else factors->insert( factors->end(), it->second.begin(), it->second.end() );
+      }
+
+      int lowerNode( const Sym &s )
+      {
+	 const std::string &op = s.getOp();
+	 const int l = s.getLeft() ? _memo[s.getLeft()] : -1;
+	 const int r = s.getRight() ? _memo[s.getRight()] : -1;
+
+	 if ( s.isNary() )  // fold n-ary sums and products left to right
+	 {
+	    const Sym::SymArgs &args = s.getArgs();
+	    int v = _memo[args[0]];
+	    for ( size_t i = 1; i < args.size(); ++i )
+	       v = op == PLUS ? value( Instr::ADD, v, _memo[args[i]] ) : product( v, _memo[args[i]] );
+	    return v;
+	 }
+	 if ( s.isNegateOp() ) return value( Instr::NEG, l );
+	 if ( s.isMinusOp() )  return value( Instr::SUB, l, r );
+	 if ( op == PLUS )     return value( Instr::ADD, l, r );
+	 if ( op == TIMES )    return product( l, r );
+	 if ( op == DIV )      return value( Instr::DIV, l, r );
+	 if ( op == POW )
+	 {
+	    const Sym *e = s.getRight();
+	    if ( e->isRationalValue() && e->getRational().isInteger() && !e->getRational().isBig() )
+	    {
+	       const long long n = e->getRational().smallNumerator();
+	       if ( n == 0 ) return constant( 1.0 );
+	       const int p = power( l, n < 0 ? -n : n );
+	       return n < 0 ? value( Instr::DIV, constant( 1.0 ), p ) : p;
+	    }
+	    return value( Instr::POW, l, r );
+	 }
+	 // unary functions keep their argument on the right
+	 const int arg = r >= 0 ? r : l;
+	 if ( op == SIN ) return value( Instr::SIN, arg );
+	 if ( op == COS ) return value( Instr::COS, arg );
+
+	 std::cerr << "Sym::compile() unknown operator: " << op << std::endl;
+	 return constant( std::numeric_limits<double>::quiet_NaN() );
+      }
+   };
+
+   ///----------------------------------------------------------
+   //
+   /// Register bytecode program.  Registers hold BLOCK samples each,
+   ///   constants and inputs are pinned registers, temporaries are reused
+   ///   as soon as their last reader has run (linear scan).
+   //
+   class Program {
+     public:
+      enum { BLOCK = 64 };  ///< samples per register, tuned so registers stay in L1/L2
+
+      Program() : _registers(0) {}
+
+      /// build from lowered SSA code, dead values are dropped
+      explicit Program( const SymLowering &ssa )
+	: _registers(0)
+      {
+	 assemble( ssa );
+      }
+
+      size_t inputCount() const     { return _variable_ids.size(); }
+      size_t outputCount() const    { return _outputs.size(); }
+      size_t registerCount() const  { return size_t(_registers); }
+      size_t size() const           { return _code.size(); }
+      /// interned variable id bound to each input slot
+      const std::vector<int> &variableIds() const { return _variable_ids; }
+
+      //-----------------------------------------------------------------------------
+      /// Batch evaluation, structure-of-arrays:
+      ///   inputs[slot][i] is the value of variable |slot| for sample i,
+      ///   outputs[o][i] receives output |o| for sample i.
+      void evaluate( const double *const *inputs, double *const *outputs, size_t count ) const
+      {
+	 std::vector<double> regs( size_t(_registers) * BLOCK );
+	 std::vector<const double*> src( _registers );
+	 for ( int r = 0; r < _registers; ++r ) src[r] = &regs[size_t(r) * BLOCK];
+	 for ( size_t c = 0; c < _constants.size(); ++c )
+	    std::fill( &regs[size_t(_constants[c].first) * BLOCK],
+		       &regs[size_t(_constants[c].first) * BLOCK] + BLOCK, _constants[c].second );
+
+	 for ( size_t base = 0; base < count; base += BLOCK )
+	 {
+	    const size_t n = std::min( size_t(BLOCK), count - base );
+	    // inputs are read in place
+	    for ( size_t i = 0; i < _inputs.size(); ++i )
+	       src[_inputs[i].first] = inputs[_inputs[i].second] + base;
+
+	    for ( size_t pc = 0; pc < _code.size(); ++pc )
+	    {
+	       const Instr &ins = _code[pc];
+	       double *d = &regs[size_t(ins.dst) * BLOCK];
+	       const double *a = src[ins.a];
+	       const double *b = ins.b >= 0 ? src[ins.b] : a;
+	       switch ( ins.op )
+	       {
+		  case Instr::ADD: for ( size_t k = 0; k < n; ++k ) d[k] = a[k] + b[k]; break;
+		  case Instr::SUB: for ( size_t k = 0; k < n; ++k ) d[k] = a[k] - b[k]; break;
+		  case Instr::MUL: for ( size_t k = 0; k < n; ++k ) d[k] = a[k] * b[k]; break;
+		  case Instr::DIV: for ( size_t k = 0; k < n; ++k ) d[k] = a[k] / b[k]; break;
+		  case Instr::NEG: for ( size_t k = 0; k < n; ++k ) d[k] = -a[k]; break;
+		  case Instr::POW: for ( size_t k = 0; k < n; ++k ) d[k] = std::pow( a[k], b[k] ); break;
+		  case Instr::SIN: for ( size_t k = 0; k < n; ++k ) d[k] = std::sin( a[k] ); break;
+		  case Instr::COS: for ( size_t k = 0; k < n; ++k ) d[k] = std::cos( a[k] ); break;
+	       }
+	    }
+
+	    for ( size_t o = 0; o < _outputs.size(); ++o )
+	       std::memcpy( outputs[o] + base, src[_outputs[o]], n * sizeof(double) );
+	 }
+      }
+
+      /// evaluate a single sample, inputs[slot] -> outputs[o]
+      void evaluate( const double *inputs, double *outputs ) const
+      {
+	 std::vector<const double*> in( inputCount() );
+	 std::vector<double*> out( outputCount() );
+	 for ( size_t i = 0; i < in.size(); ++i ) in[i] = inputs + i;
+	 for ( size_t o = 0; o < out.size(); ++o ) out[o] = outputs + o;
+	 evaluate( in.empty() ? 0 : &in[0], out.empty() ? 0 : &out[0], 1 );
+      }
+
+      //-----------------------------------------------------------------------------
+      /// disassembly
+      std::ostream &print( std::ostream &os ) const
+      {
+	 for ( size_t c = 0; c < _constants.size(); ++c )
+	    os << "  r" << _constants[c].first << " = " << _constants[c].second << "\n";
+	 for ( size_t i = 0; i < _inputs.size(); ++i )
+	    os << "  r" << _inputs[i].first << " = "
+	       << SymbolTable::name( _variable_ids[_inputs[i].second] ) << "\n";
+	 for ( size_t pc = 0; pc < _code.size(); ++pc )
+	 {
+	    const Instr &ins = _code[pc];
+	    os << "  r" << ins.dst << " = ";
+	    if ( ins.b >= 0 )
+	       os << "r" << ins.a << " " << Instr::name( ins.op ) << " r" << ins.b << "\n";
+	    else
+	       os << Instr::name( ins.op ) << " r" << ins.a << "\n";
+	 }
+	 for ( size_t o = 0; o < _outputs.size(); ++o )
+	    os << "  out" << o << " = r" << _outputs[o] << "\n";
+	 return os;
+      }
+
+     protected:
+      std::vector<Instr>                  _code;       // per block code, registers
+      std::vector< std::pair<int,double> > _constants; // register, value
+      std::vector< std::pair<int,int> >   _inputs;     // register, input slot
+      std::vector<int>                    _outputs;    // register of each output
+      std::vector<int>                    _variable_ids;
+      int                                 _registers;
+
+      void assemble( const SymLowering &ssa )
+      {
+	 const std::vector<Instr> &code = ssa.code();
+	 const std::vector<bool> live = ssa.liveValues();
+	 _variable_ids = ssa.variableIds();
+
+	 // last reader of every value, outputs live to the end
+	 const int forever = std::numeric_limits<int>::max();
+	 std::vector<int> last_use( code.size(), -1 );
+	 for ( size_t v = 0; v < code.size(); ++v )
+	 {
+	    if ( !live[v] || code[v].op == Instr::CONST || code[v].op == Instr::VAR ) continue;
+	    if ( code[v].a >= 0 ) last_use[code[v].a] = int(v);
+	    if ( code[v].b >= 0 ) last_use[code[v].b] = int(v);
+	 }
+	 for ( size_t o = 0; o < ssa.outputs().size(); ++o ) last_use[ssa.outputs()[o]] = forever;
+
+	 // pinned registers first
+	 std::vector<int> reg( code.size(), -1 );
+	 std::vector<bool> pinned( code.size(), false );
+	 for ( size_t v = 0; v < code.size(); ++v )
+	 {
+	    if ( !live[v] ) continue;
+	    if ( code[v].op == Instr::CONST )
+	       _constants.push_back( std::make_pair( reg[v] = _registers++, ssa.constants()[code[v].a] ) );
+	    else if ( code[v].op == Instr::VAR )
+	       _inputs.push_back( std::make_pair( reg[v] = _registers++, code[v].a ) );
+	    else
+	       continue;
+	    pinned[v] = true;
+	 }
+
+	 // linear scan over the temporaries
+	 std::vector<int> free_regs;
+	 for ( size_t v = 0; v < code.size(); ++v )
+	 {
+	    if ( !live[v] || pinned[v] ) continue;
+	    const Instr &ins = code[v];
+	    Instr out( ins.op, -1, reg[ins.a], ins.b >= 0 ? reg[ins.b] : -1 );
+	    // operands read for the last time free up first, so dst may reuse them
+	    if ( !pinned[ins.a] && last_use[ins.a] == int(v) ) free_regs.push_back( reg[ins.a] );
+	    if ( ins.b >= 0 && ins.b != ins.a && !pinned[ins.b] && last_use[ins.b] == int(v) )
+	       free_regs.push_back( reg[ins.b] );
+	    if ( free_regs.empty() )
+	       reg[v] = _registers++;
+	    else
+	    {
+	       reg[v] = free_regs.back();
+	       free_regs.pop_back();
+	    }
+	    out.dst = reg[v];
+	    _code.push_back( out );
+	 }
+	 for ( size_t o = 0; o < ssa.outputs().size(); ++o )
+	    _outputs.push_back( reg[ssa.outputs()[o]] );
+      }
+   };
+
+   inline std::ostream &operator<<( std::ostream &os, const Program &p )
+   {
+      return p.print( os );
+   }
+
+   //-----------------------------------------------------------------------------
+   /// compile several expressions into one program, they share subexpressions.
+   inline Program compile( const std::vector<Sym> &exprs, const std::vector<std::string> &variables )
+   {
+      SymLowering ssa( variables );
+      for ( size_t i = 0; i < exprs.size(); ++i ) ssa.addOutput( exprs[i] );
+      return Program( ssa );
+   }
+
+   inline Program Sym::compile( const std::vector<std::string> &variables ) const
+   {
+      SymLowering ssa( variables );
+      ssa.addOutput( *this );
+      return Program( ssa );
+   }
+
+}  /// end namespace Symath
+
+#endif
@@ -0,0 +1,321 @@
+/// Reduction modulo polynomial side relations.
+///   Register identities that hold throughout a derivation (n0.ni = -1, a
+///   unit direction, ...) and reduce() rewrites an expression to its normal
+///   form modulo those relations: the expression is expanded, then divided
+///   by a reduced Groebner basis of the relations.  The basis is completed
+///   (Buchberger, graded reverse lexicographic order) before the first
+///   reduction after a change, so the result is canonical: two expressions
+///   that are equal given the relations reduce to the same Sym.
+///
+///   The polynomial ring's variables are whatever expand() leaves as
+///   factors: variables, Sin(a), a/b, ...  A positive integer power a^n is
+///   a to the n.  Numbers are exact rationals.
+///
+/// \code
+///   Symath::SymRelations rel;
+///   rel.add( n0*ni, S(-1) );                      // n0.ni = -1
+///   rel.add( u1*u1 + u2*u2 + u3*u3, S(1) );       // |u| = 1
+///   Sym small = rel.reduce( big );
+///   GOsym g = reduce( simplify( W*U ), rel );     // geomobj.h, every coefficient
+/// \endcode
+
+#ifndef __SYMBOLIC_REDUCE_H
+#define __SYMBOLIC_REDUCE_H
+
+#include <algorithm>
+#include <iostream>
+#include <map>
+#include <utility>
+#include <vector>
+#include "symath.h"
+
+namespace Symath {
+
+   ///----------------------------------------------------------
+   //
+   /// side relations and reduction modulo them, see top of file
+   //  reduce() may learn new variables, share one SymRelations between
+   //  threads only behind a lock.
+   //
+   class SymRelations {
+     public:
+      enum { MAX_BASIS = 2000 };  ///< Buchberger gives up past this many polynomials
+
+      SymRelations() : _complete(true), _ids( before ) {}
+
+      /// |lhs| = |rhs| from now on
+      void add( const Sym &lhs, const Sym &rhs = Sym::zero() )
+      {
+	 Poly p = poly( lhs - rhs );
+	 if ( p.empty() ) return;  // 0 = 0
+	 _basis.push_back( p );
+	 _complete = false;
+      }
+
+      /// normal form of |s| modulo the relations, expanded
+      Sym reduce( const Sym &s )
+      {
+	 complete();
+	 return sym( remainder( poly( s ) ) );
+      }
+
+      /// the reduced Groebner basis, each polynomial as   p = 0
+      std::vector<Sym> basis()
+      {
+	 complete();
+	 std::vector<Sym> b;
+	 for ( size_t i = 0; i < _basis.size(); ++i ) b.push_back( sym( _basis[i] ) );
+	 return b;
+      }
+
+     protected:
+      typedef Sym::SymSP   SymSP;
+      typedef Sym::SymPVec SymPVec;
+
+      /// exponent of each variable by id, no trailing zeros
+      typedef std::vector<int> Monomial;
+
+      /// graded reverse lexicographic, true if |a| comes before (is bigger than) |b|
+      struct Greater {
+	 bool operator()( const Monomial &a, const Monomial &b ) const
+	 {
+	    const int da = degree( a ), db = degree( b );
+	    if ( da != db ) return da > db;
+	    for ( size_t i = std::max( a.size(), b.size() ); i-- > 0; )
+	    {
+	       const int ea = i < a.size() ? a[i] : 0, eb = i < b.size() ? b[i] : 0;
+	       if ( ea != eb ) return ea < eb;
+	    }
+	    return false;
+	 }
+      };
+      /// terms by monomial, leading term first, no zero coefficients
+      typedef std::map<Monomial, Rational, Greater> Poly;
+      typedef std::map<SymSP, int, bool (*)( const SymSP&, const SymSP& )> VarIds;
+
+      std::vector<Poly>  _basis;
+      bool               _complete;  ///< _basis is a reduced Groebner basis
+      std::vector<SymSP> _vars;      ///< variable of each id
+      VarIds             _ids;
+
+      static bool before( const SymSP &a, const SymSP &b ) { return Sym::order( *a, *b ) < 0; }
+
+      //-----------------------------------------------------------------------------
+      /// monomial arithmetic
+      static int degree( const Monomial &m )
+      {
+	 int d = 0;
+	 for ( size_t i = 0; i < m.size(); ++i ) d += m[i];
+	 return d;
+      }
+
+      static void trim( Monomial *m )
+      {
+	 while ( !m->empty() && m->back() == 0 ) m->pop_back();
+      }
+
+      static Monomial times( const Monomial &a, const Monomial &b )
+      {
+	 Monomial m( std::max( a.size(), b.size() ), 0 );
+	 for ( size_t i = 0; i < a.size(); ++i ) m[i] += a[i];
+	 for ( size_t i = 0; i < b.size(); ++i ) m[i] += b[i];
+	 return m;
+      }
+
+      /// a/b, b must divide a
+      static Monomial quotient( const Monomial &a, const Monomial &b )
+      {
+	 Monomial m( a );
+	 for ( size_t i = 0; i < b.size(); ++i ) m[i] -= b[i];
+	 trim( &m );
+	 return m;
+      }
+
+      static bool divides( const Monomial &b, const Monomial &a )
+      {
+	 if ( b.size() > a.size() ) return false;
+	 for ( size_t i = 0; i < b.size(); ++i ) if ( b[i] > a[i] ) return false;
+	 return true;
+      }
+
+      static Monomial lcm( const Monomial &a, const Monomial &b )
+      {
+	 Monomial m( std::max( a.size(), b.size() ), 0 );
+	 for ( size_t i = 0; i < m.size(); ++i )
+	    m[i] = std::max( i < a.size() ? a[i] : 0, i < b.size() ? b[i] : 0 );
+	 return m;
+      }
+
+      static bool coprime( const Monomial &a, const Monomial &b )
+      {
+	 for ( size_t i = 0; i < a.size() && i < b.size(); ++i ) if ( a[i] && b[i] ) return false;
+	 return true;
+      }
+
+      //-----------------------------------------------------------------------------
+      /// |p| -= c * x^m * q
+      static void subtract( Poly *p, const Rational &c, const Monomial &m, const Poly &q )
+      {
+	 for ( Poly::const_iterator t = q.begin(); t != q.end(); ++t )
+	 {
+	    const Monomial x = times( m, t->first );
+	    Poly::iterator it = p->find( x );
+	    if ( it == p->end() ) p->insert( std::make_pair( x, -(c * t->second) ) );
+	    else if ( (it->second = it->second - c * t->second).isZero() ) p->erase( it );
+	 }
+      }
+
+      /// leading coefficient 1
+      static void monic( Poly *p )
+      {
+	 const Rational lc = p->begin()->second;
+	 if ( lc.isOne() ) return;
+	 const Rational inv = Rational( 1 ) / lc;
+	 for ( Poly::iterator t = p->begin(); t != p->end(); ++t ) t->second = t->second * inv;
+      }
+
+      /// |p| divided by |basis| (skipping |skip|), every term reduced
+      Poly remainder( Poly p, size_t skip = size_t(-1) ) const
+      {
+	 Poly r;
+	 while ( !p.empty() )
+	 {
+	    const Poly::iterator lead = p.begin();
+	    size_t g = 0;
+	    for ( ; g < _basis.size(); ++g )
+	       if ( g != skip && divides( _basis[g].begin()->first, lead->first ) ) break;
+	    if ( g == _basis.size() )  // irreducible, keep it
+	    {
+	       r.insert( r.end(), *lead );
+	       p.erase( lead );
+	       continue;
+	    }
+	    // basis polynomials are monic, the leading terms cancel exactly
+	    const Rational c = lead->second;
+	    subtract( &p, c, quotient( lead->first, _basis[g].begin()->first ), _basis[g] );
+	 }
+	 return r;
+      }
+
+      //-----------------------------------------------------------------------------
+      /// Buchberger, then minimal and reduced
+      void complete()
+      {
+	 if ( _complete ) return;
+	 _complete = true;
+	 for ( size_t i = 0; i < _basis.size(); ++i ) monic( &_basis[i] );
+
+	 std::vector< std::pair<size_t, size_t> > pairs;
+	 for ( size_t j = 1; j < _basis.size(); ++j )
+	    for ( size_t i = 0; i < j; ++i ) pairs.push_back( std::make_pair( i, j ) );
+	 while ( !pairs.empty() )
+	 {
+	    const size_t i = pairs.back().first, j = pairs.back().second;
+	    pairs.pop_back();
+	    const Monomial &li = _basis[i].begin()->first, &lj = _basis[j].begin()->first;
+	    if ( coprime( li, lj ) ) continue;  // S-polynomial reduces to 0
+
+	    // S(i, j) = (L/li) * gi - (L/lj) * gj, L = lcm
+	    const Monomial l = lcm( li, lj );
+	    Poly s;
+	    subtract( &s, Rational( -1 ), quotient( l, li ), _basis[i] );
+	    subtract( &s, Rational( 1 ), quotient( l, lj ), _basis[j] );
+	    s = remainder( s );
+	    if ( s.empty() ) continue;
+	    monic( &s );
+	    if ( _basis.size() >= MAX_BASIS )
+	    {
+	       std::cerr << "SymRelations: more than " << MAX_BASIS
+			 << " polynomials, basis left incomplete" << std::endl;
+	       break;
+	    }
+	    _basis.push_back( s );
+	    for ( size_t k = 0; k + 1 < _basis.size(); ++k )
+	       pairs.push_back( std::make_pair( k, _basis.size() - 1 ) );
+	 }
+
+	 // minimal: drop polynomials whose leading term another one divides
+	 std::vector<Poly> minimal;
+	 for ( size_t i = 0; i < _basis.size(); ++i )
+	 {
+	    bool keep = true;
+	    for ( size_t j = 0; j < _basis.size() && keep; ++j )
+	       if ( j != i && divides( _basis[j].begin()->first, _basis[i].begin()->first ) )
+		  keep = _basis[j].begin()->first == _basis[i].begin()->first && i < j;  // first of equals stays
+	    if ( keep ) minimal.push_back( _basis[i] );
+	 }
+	 _basis.swap( minimal );
+	 // reduced: no term of one is divisible by another's leading term
+	 for ( size_t i = 0; i < _basis.size(); ++i ) _basis[i] = remainder( _basis[i], i );
+      }
+
+      //-----------------------------------------------------------------------------
+      /// id of variable |v|, new ones get the next id
+      int var( const Sym &v )
+      {
+	 const SymSP key = v.copyMaybe();
+	 VarIds::const_iterator it = _ids.find( key );
+	 if ( it != _ids.end() ) return it->second;
+	 const int id = int( _vars.size() );
+	 _vars.push_back( key );
+	 _ids.insert( std::make_pair( key, id ) );
+	 return id;
+      }
+
+      /// expanded |s| as a polynomial
+      Poly poly( const Sym &s )
+      {
+	 Poly p;
+	 const Sym e = s.expand();
+	 SymPVec terms;
+	 e.getAdditiveSubexps( &terms );
+	 for ( Sym::SymPVecIter t = terms.begin(); t != terms.end(); ++t )
+	 {
+	    SymPVec factors;
+	    const Rational c = (*t)->getCoefficient( &factors );
+	    Monomial m;
+	    for ( Sym::SymPVecIter f = factors.begin(); f != factors.end(); ++f )
+	    {
+	       // a^n, n a small positive integer, is a n times
+	       const Sym *base = *f;
+	       int n = 1;
+	       const Sym *r = base->getRight();
+	       if ( base->getOp() == POW && r->isRationalValue() )
+	       {
+		  const Rational x = r->getRational();
+		  if ( !x.isBig() && x.isInteger() && x.sign() > 0 && x.smallNumerator() < (1 << 16) )
+		  {
+		     n = int( x.smallNumerator() );
+		     base = base->getLeft();
+		  }
+	       }
+	       const size_t id = size_t( var( *base ) );
+	       if ( m.size() <= id ) m.resize( id + 1, 0 );
+	       m[id] += n;
+	    }
+	    if ( c.isZero() ) continue;
+	    Poly::iterator it = p.find( m );
+	    if ( it == p.end() ) p.insert( std::make_pair( m, c ) );
+	    else if ( (it->second = it->second + c).isZero() ) p.erase( it );
+	 }
+	 return p;
+      }
+
+      /// |p| as an n-ary sum of products
+      Sym sym( const Poly &p ) const
+      {
+	 SymPVec terms;
+	 for ( Poly::const_iterator t = p.begin(); t != p.end(); ++t )
+	 {
+	    SymPVec factors( 1, Sym( t->second ).copyMaybe() );
+	    for ( size_t v = 0; v < t->first.size(); ++v )
+	       for ( int k = 0; k < t->first[v]; ++k ) factors.push_back( _vars[v] );
+	    terms.push_back( Sym::product( factors ).copyMaybe() );
+	 }
+	 return Sym::sum( terms );
+      }
+   };
+
+}  /// end namespace Symath
+
+#endif
@@ -0,0 +1,137 @@
+/// Substitution into expressions that are already in normal form.
+///   Every Sym carries a one word summary of the variables below it (see
+///   Sym::mayContain()), so a substitution walks only the subtrees that can
+///   mention the variable and shares the rest.  substitute() goes further
+///   for a normalForm() sum: terms without the variable are already
+///   normal and stay as they are, only the others are normalized again, then
+///   like terms are merged back by their non-numeric factors.  A parameter
+///   sweep over a big model costs about the terms the parameter touches.
+///
+/// \code
+///   Sym model = big.normalForm();
+///   for ( int k = 0; k < 10; ++k )
+///      results.push_back( model.substitute( "t", Sym( k ) ) );
+/// \endcode
+
+#ifndef __SYMBOLIC_SUBSTITUTE_H
+#define __SYMBOLIC_SUBSTITUTE_H
+
+#include <map>
+#include <string>
+#include <utility>
+#include <vector>
+#include "symath.h"
+
+namespace Symath {
+
+   inline Sym Sym::replace( const std::string &variable, const Sym &value ) const
+   {
+      if ( !mayContain( variable ) ) return *this;
+      const SymSP with = value.copyMaybe();
+
+      // operands before operators, explicit stack so deep sums are fine
+      std::map<const Sym*, SymSP> done;
+      std::vector< std::pair<const Sym*, bool> > stack( 1, std::make_pair( this, false ) );
+      while ( !stack.empty() )
+      {
+	 const Sym *n = stack.back().first;
+	 if ( done.count( n ) )
+	 {
+	    stack.pop_back();
+	    continue;
+	 }
+	 if ( !n->mayContain( variable ) )  // shared as is
+	 {
+	    stack.pop_back();
+	    done[n] = n->copyMaybe();
+	    continue;
+	 }
+	 if ( n->isLeaf() )
+	 {
+	    stack.pop_back();
+	    done[n] = n->_value == variable ? with : n->copyMaybe();
+	    continue;
+	 }
+	 if ( !stack.back().second )  // first visit, operands first
+	 {
+	    stack.back().second = true;
+	    for ( size_t i = n->_args.size(); i-- > 0; )
+	       if ( !done.count( n->_args[i] ) )
+		  stack.push_back( std::make_pair( (const Sym*)n->_args[i].getPtr(), false ) );
+	    if ( n->_right && !done.count( n->_right ) ) stack.push_back( std::make_pair( n->_right.getPtr(), false ) );
+	    if ( n->_left && !done.count( n->_left ) )   stack.push_back( std::make_pair( n->_left.getPtr(), false ) );
+	    continue;
+	 }
+	 stack.pop_back();
+	 if ( n->isNary() )  // operands may have become sums or numbers, re-flatten
+	 {
+	    SymPVec operands;
+	    for ( size_t i = 0; i < n->_args.size(); ++i ) operands.push_back( done[n->_args[i]] );
+	    done[n] = (n->_op == PLUS ? sum( operands ) : product( operands )).copyMaybe();
+	 }
+	 else
+	    done[n] = Sym( n->_op, n->_left ? done[n->_left] : SymSP(0),
+			   n->_right ? done[n->_right] : SymSP(0) ).copyMaybe();
+      }
+      return *done[this];
+   }
+
+   inline bool Sym::termBefore( const SymSP &a, const SymSP &b )
+   {
+      return order( *a, *b ) < 0;
+   }
+
+   inline Sym Sym::substitute( const std::string &variable, const Sym &value ) const
+   {
+      if ( !mayContain( variable ) ) return *this;
+
+      // terms that can't change stay, the others are normalized again
+      SymPVec terms, kept, changed;
+      getAdditiveSubexps( &terms );
+      for ( SymPVecIter t = terms.begin(); t != terms.end(); ++t )
+      {
+	 if ( (*t)->mayContain( variable ) )
+	    (*t)->replace( variable, value ).normalForm().getAdditiveSubexps( &changed );
+	 else kept.push_back( *t );
+      }
+
+      // merge like terms: key is the product of the non-numeric factors
+      typedef std::map<SymSP, Rational, bool (*)( const SymSP&, const SymSP& )> Collected;
+      Collected fresh( termBefore );
+      for ( SymPVecIter t = changed.begin(); t != changed.end(); ++t )
+      {
+	 SymPVec key;
+	 const Rational c = (*t)->getCoefficient( &key );
+	 const SymSP k = product( key ).copyMaybe();
+	 Collected::iterator it = fresh.find( k );
+	 if ( it == fresh.end() ) fresh.insert( std::make_pair( k, c ) );
+	 else it->second = it->second + c;
+      }
+      if ( !fresh.empty() )
+	 for ( SymPVecIter t = kept.begin(); t != kept.end(); )
+	 {
+	    SymPVec key;
+	    const Rational c = (*t)->getCoefficient( &key );
+	    Collected::iterator it = fresh.find( product( key ).copyMaybe() );
+	    if ( it == fresh.end() )
+	    {
+	       ++t;
+	       continue;
+	    }
+	    it->second = it->second + c;  // rebuilt below with the merged coefficient
+	    kept.erase( t++ );
+	 }
+
+      for ( Collected::const_iterator m = fresh.begin(); m != fresh.end(); ++m )
+      {
+	 if ( m->second.isZero() ) continue;
+	 SymPVec factors( 1, Sym( m->second ).copyMaybe() );
+	 factors.push_back( m->first );
+	 kept.push_back( product( factors ).copyMaybe() );
+      }
+      return sum( kept );
+   }
+
+}  /// end namespace Symath
+
+#endif
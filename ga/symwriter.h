@@ -0,0 +1,433 @@
+/// Streaming text output for Sym.
+///   SymWriter walks an expression once with an explicit stack and copies
+///   the text straight into a block that is flushed to an ostream or a
+///   std::string, or into a caller's char buffer.  No stringstreams and no
+///   string per node; the walk stack belongs to the thread and is reused by
+///   every writer on it.  toString(), printInfix(), printTree() and
+///   operator<< all write through here.
+///
+/// \code
+///   char line[80];
+///   Symath::SymWriter( line, sizeof(line) ).compact().maxDepth( 3 ).write( big );
+///   // "(a+b)*(...)+..." cut to 79 characters, always 0 terminated
+///   Symath::SymWriter( std::cout ).write( big );
+/// \endcode
+
+#ifndef __SYMBOLIC_WRITER_H
+#define __SYMBOLIC_WRITER_H
+
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <vector>
+#include "symath.h"
+
+namespace Symath {
+
+   ///----------------------------------------------------------
+   //
+   /// writes Sym text to a stream, a string or a fixed buffer
+   //
+   class SymWriter {
+     public:
+      enum { BLOCK = 4096 };  ///< bytes buffered before a stream or string sees them
+
+      explicit SymWriter( std::ostream &os )
+	: _os(&os), _str(0), _begin(_block), _out(_block), _end(_block + BLOCK), _terminate(false)
+      { init(); }
+
+      /// appends to |str|
+      explicit SymWriter( std::string *str )
+	: _os(0), _str(str), _begin(_block), _out(_block), _end(_block + BLOCK), _terminate(false)
+      { init(); }
+
+      /// at most |size| - 1 characters and a 0, the rest is counted in
+      ///  length() but dropped
+      SymWriter( char *buffer, size_t size )
+	: _os(0), _str(0), _begin(buffer), _out(buffer), _end(size ? buffer + size - 1 : buffer),
+	  _terminate(size > 0)
+      {
+	 init();
+	 flush();
+      }
+
+      ~SymWriter() { flush(); }
+
+      /// "a+b*c" instead of "a + b*c"
+      SymWriter &compact( bool c = true ) { _compact = c; return *this; }
+      /// subtrees more than |depth| levels down print as "...", < 0 no limit
+      SymWriter &maxDepth( int depth )    { _max_depth = depth; return *this; }
+
+      /// characters written so far, including any a buffer had no room for
+      size_t length() const   { return _length; }
+      bool   truncated() const { return !_os && !_str && _length > size_t(_end - _begin); }
+
+      //-----------------------------------------------------------------------------
+      /// infix, |last_op| is the operator |s| is an operand of (parens)
+      SymWriter &write( const Sym &s, const std::string &last_op = NOP )
+      {
+	 std::vector<Item> &todo = stack();
+	 const size_t base = todo.size();  // a nested writer keeps what's below
+	 todo.push_back( Item( &s, code( last_op ), 0 ) );
+	 while ( todo.size() > base )
+	 {
+	    const Item item = todo.back();
+	    todo.pop_back();
+	    const Sym &n = *item.sym;
+	    if ( item.what == Item::CLOSE )
+	    {
+	       put( ')' );
+	       continue;
+	    }
+	    if ( item.what == Item::MIDDLE )
+	    {
+	       middle( n );
+	       continue;
+	    }
+	    if ( _max_depth >= 0 && item.depth > _max_depth )
+	    {
+	       put( "...", 3 );
+	       continue;
+	    }
+
+	    // operators as codes, string compares were most of the time here
+	    const int last = item.last;
+	    const int op = code( n.getOp() );
+	    const bool negate = n.isNegateOp();
+	    bool parens = true;
+	    if ( last == NONE || last == SUM || last == DIFFERENCE || n.isLeaf() ) parens = false;
+	    if ( op == PRODUCT || op == QUOTIENT ) parens = false;
+	    if ( negate ) parens = false;
+	    if ( last == QUOTIENT && op != NONE ) parens = true;
+	    // so the text reads back with parse(): Sin(a*b), (a*b)^(-1/2), a/(1/2)
+	    if ( last == FUNCTION ) parens = true;
+	    if ( (last == POWER || last == QUOTIENT) && !plain( n ) ) parens = true;
+	    if ( item.subtrahend && (op == SUM || n.isMinusOp()) ) parens = true;
+
+	    // treat negate as -1 * x so we don't confuse neg and minus when we recurse
+	    const int this_op = negate ? PRODUCT : op;
+	    const int depth = item.depth + 1;
+
+	    if ( parens ) put( '(' );
+	    if ( negate ) put( NEG );
+	    if ( parens ) todo.push_back( Item( &n, Item::CLOSE ) );
+	    const Sym::SymArgs &args = n.getArgs();
+	    for ( size_t i = args.size(); i-- > 0; )  // n-ary a + b + c
+	    {
+	       todo.push_back( Item( args[i], this_op, depth ) );
+	       if ( i ) todo.push_back( Item( &n, Item::MIDDLE ) );
+	    }
+	    if ( !args.empty() ) continue;
+	    if ( n.getRight() ) todo.push_back( Item( n.getRight(), this_op, depth, n.isMinusOp() ) );
+	    todo.push_back( Item( &n, Item::MIDDLE ) );
+	    if ( n.getLeft() ) todo.push_back( Item( n.getLeft(), op != QUOTIENT ? this_op : PRODUCT, depth ) );
+	 }
+	 flush();
+	 return *this;
+      }
+
+      //-----------------------------------------------------------------------------
+      /// one node per line, left operands above their operator and right
+      ///  operands below, each level indented past its parent's label
+      SymWriter &writeTree( const Sym &s, int indent = 0 )
+      {
+	 std::vector<Item> &todo = stack();
+	 const size_t base = todo.size();
+	 todo.push_back( Item::tree( &s, indent, 0 ) );
+	 while ( todo.size() > base )
+	 {
+	    const Item item = todo.back();
+	    todo.pop_back();
+	    if ( item.what == Item::LINE )
+	    {
+	       spaces( item.indent );
+	       if ( item.sym ) label( *item.sym );
+	       else put( "...", 3 );
+	       put( '\n' );
+	       continue;
+	    }
+	    if ( _max_depth >= 0 && item.depth > _max_depth )
+	    {
+	       todo.push_back( Item::tree( 0, item.indent, item.depth, Item::LINE ) );
+	       continue;
+	    }
+
+	    // negates and functions print in-line with their operand:  - *   Sin +
+	    const Sym *n = unaryOperand( *item.sym );
+	    const int child = item.indent + int( labelLength( *item.sym ) ) + 1;
+	    const int depth = item.depth + 1;
+	    const Sym::SymArgs &args = n->getArgs();
+	    if ( n->isNary() )  // first operand above, the others below
+	    {
+	       for ( size_t i = args.size(); i-- > 1; ) todo.push_back( Item::tree( args[i], child, depth ) );
+	       todo.push_back( Item::tree( item.sym, item.indent, item.depth, Item::LINE ) );
+	       todo.push_back( Item::tree( args[0], child, depth ) );
+	       continue;
+	    }
+	    if ( n->getRight() ) todo.push_back( Item::tree( n->getRight(), child, depth ) );
+	    todo.push_back( Item::tree( item.sym, item.indent, item.depth, Item::LINE ) );
+	    if ( n->getLeft() ) todo.push_back( Item::tree( n->getLeft(), child, depth ) );
+	 }
+	 flush();
+	 return *this;
+      }
+
+      //-----------------------------------------------------------------------------
+      /// hand buffered text to the stream or string, 0 terminate a buffer
+      void flush()
+      {
+	 if ( _os ) _os->write( _begin, std::streamsize( _out - _begin ) );
+	 else if ( _str ) _str->append( _begin, _out );
+	 else
+	 {
+	    if ( _terminate ) *_out = 0;
+	    return;
+	 }
+	 _out = _begin;
+      }
+
+     protected:
+      /// a node to print, the text between operands, a ")" or a tree line
+      struct Item {
+	 enum { NODE, MIDDLE, CLOSE, LINE };
+	 Item( const Sym *s, int last_op, int d, bool sub = false )
+	   : sym(s), last(last_op), what(NODE), depth(d), indent(0), subtrahend(sub) {}
+	 Item( const Sym *s, int w )
+	   : sym(s), last(NONE), what(w), depth(0), indent(0), subtrahend(false) {}
+	 /// writeTree() subtree, or its LINE
+	 static Item tree( const Sym *s, int column, int d, int w = NODE )
+	 {
+	    Item item( s, w );
+	    item.depth = d;
+	    item.indent = column;
+	    return item;
+	 }
+	 const Sym  *sym;
+	 int         last;        ///< code() of the operator above
+	 int         what;
+	 int         depth;
+	 int         indent;      ///< writeTree() column
+	 bool        subtrahend;  ///< right operand of a minus, a - (b + c)
+      };
+
+      std::ostream *_os;
+      std::string  *_str;
+      char         *_begin, *_out, *_end;  ///< _end is where a 0 terminator goes
+      bool          _terminate;             ///< caller's buffer has room for the 0
+      size_t        _length;
+      bool          _compact;
+      int           _max_depth;
+      char          _block[BLOCK];
+
+      void init()
+      {
+	 _length = 0;
+	 _compact = false;
+	 _max_depth = -1;
+      }
+
+      /// walk stack, grows once per thread and is reused after that
+      static std::vector<Item> &stack()
+      {
+	 static thread_local std::vector<Item> todo;
+	 return todo;
+      }
+
+      //-----------------------------------------------------------------------------
+      void put( char c )
+      {
+	 ++_length;
+	 if ( _out == _end && !spill() ) return;
+	 *_out++ = c;
+      }
+
+      void put( const char *text, size_t n )
+      {
+	 _length += n;
+	 while ( n )
+	 {
+	    if ( _out == _end && !spill() ) return;
+	    const size_t room = size_t( _end - _out ), m = n < room ? n : room;
+	    std::memcpy( _out, text, m );
+	    _out += m;
+	    text += m;
+	    n -= m;
+	 }
+      }
+
+      void put( const std::string &text ) { put( text.data(), text.size() ); }
+
+      void spaces( int n )
+      {
+	 static const char blanks[] = "                                                                ";
+	 for ( ; n > 0; n -= int(sizeof(blanks) - 1) )
+	    put( blanks, n < int(sizeof(blanks) - 1) ? size_t(n) : sizeof(blanks) - 1 );
+      }
+
+      /// block full: pass it on, false for a caller's buffer (text is dropped)
+      bool spill()
+      {
+	 if ( !_os && !_str ) return false;
+	 flush();
+	 return true;
+      }
+
+      /// digits of |v| into the end of |buf|, returns the first
+      static char *digits( long long v, char *end )
+      {
+	 unsigned long long m = v < 0 ? 0ULL - (unsigned long long)v : (unsigned long long)v;
+	 char *p = end;
+	 do { *--p = char( '0' + m % 10 ); m /= 10; } while ( m );
+	 if ( v < 0 ) *--p = '-';
+	 return p;
+      }
+
+      /// n or n/d, only big values go through BigInt::toString()
+      void put( const Rational &r )
+      {
+	 if ( r.isBig() )
+	 {
+	    put( r.numerator().toString() );
+	    if ( !r.isInteger() )
+	    {
+	       put( '/' );
+	       put( r.denominator().toString() );
+	    }
+	    return;
+	 }
+	 char buf[48], *end = buf + sizeof(buf);
+	 char *p = end;
+	 if ( r.smallDenominator() != 1 )
+	 {
+	    p = digits( r.smallDenominator(), p );
+	    *--p = '/';
+	 }
+	 p = digits( r.smallNumerator(), p );
+	 put( p, size_t( end - p ) );
+      }
+
+      static size_t length( const Rational &r )
+      {
+	 if ( r.isBig() )
+	    return r.numerator().toString().size() + (r.isInteger() ? 0 : 1 + r.denominator().toString().size());
+	 char buf[48], *end = buf + sizeof(buf);
+	 char *p = end;
+	 if ( r.smallDenominator() != 1 )
+	 {
+	    p = digits( r.smallDenominator(), p );
+	    *--p = '/';
+	 }
+	 return size_t( end - digits( r.smallNumerator(), p ) );
+      }
+
+      /// operator codes for write()
+      enum { NONE, SUM, DIFFERENCE, PRODUCT, QUOTIENT, POWER, FUNCTION, OTHER };
+
+      static int code( const std::string &op )
+      {
+	 if ( op.empty() ) return NONE;
+	 if ( op.size() == 1 )
+	    switch ( op[0] )
+	    {
+	       case '+': return SUM;
+	       case '-': return DIFFERENCE;
+	       case '*': return PRODUCT;
+	       case '/': return QUOTIENT;
+	       case '^': return POWER;
+	    }
+	 if ( op == SIN || op == COS ) return FUNCTION;
+	 return OTHER;
+      }
+
+      /// a variable or a non-negative integer, needs no parens anywhere
+      static bool plain( const Sym &n )
+      {
+	 if ( n.isVariable() ) return true;
+	 if ( !n.isRational() ) return false;
+	 const Rational r = n.getRational();
+	 return r.isInteger() && r.sign() >= 0;
+      }
+
+      //-----------------------------------------------------------------------------
+      /// text between the operands, operator or value
+      void middle( const Sym &n )
+      {
+	 if ( n.isNegateOp() ) return;
+	 const std::string &op = n.getOp();
+	 if ( op != NOP )
+	 {
+	    const bool spaced = !_compact && (op == PLUS || n.isMinusOp());
+	    if ( spaced ) put( ' ' );
+	    put( op );
+	    if ( spaced ) put( ' ' );
+	 }
+	 else if ( n.isRational() ) put( n.getRational() );
+	 else if ( !n.getValue().empty() ) put( n.getValue() );
+	 else
+	 {
+	    put( "?<", 2 );
+	    put( op );
+	    put( '|' );
+	    put( n.getRational() );
+	    put( '>' );
+	 }
+      }
+
+      //-----------------------------------------------------------------------------
+      /// writeTree(): the node a negate or function label stands on
+      static const Sym *unaryOperand( const Sym &s )
+      {
+	 if ( s.getOp() != NOP && (!s.getLeft() != !s.getRight()) )
+	    return s.getLeft() ? s.getLeft() : s.getRight();
+	 return &s;
+      }
+
+      /// writeTree() line text:  op,  "- " op  for a negate,  value or number
+      void label( const Sym &s )
+      {
+	 const Sym *n = unaryOperand( s );
+	 if ( n != &s )
+	 {
+	    put( s.getOp() );
+	    put( ' ' );
+	 }
+	 if ( n->getOp() != NOP ) put( n->getOp() );
+	 else if ( n->isRational() ) put( n->getRational() );
+	 else if ( !n->getValue().empty() ) put( n->getValue() );
+	 else put( "<?>", 3 );
+      }
+
+      static size_t labelLength( const Sym &s )
+      {
+	 const Sym *n = unaryOperand( s );
+	 const size_t prefix = n != &s ? s.getOp().size() + 1 : 0;
+	 if ( n->getOp() != NOP ) return prefix + n->getOp().size();
+	 if ( n->isRational() ) return prefix + length( n->getRational() );
+	 if ( !n->getValue().empty() ) return prefix + n->getValue().size();
+	 return prefix + 3;
+      }
+   };
+
+   //-----------------------------------------------------------------------------
+   inline std::ostream &Sym::printInfix( std::ostream &os, const std::string &last_op ) const
+   {
+      SymWriter( os ).write( *this, last_op );
+      return os;
+   }
+
+   inline std::ostream &Sym::printTree( std::ostream &os, int indent ) const
+   {
+      SymWriter( os ).writeTree( *this, indent );
+      return os;
+   }
+
+   inline std::string Sym::toString() const
+   {
+      std::string s;
+      SymWriter( &s ).write( *this );
+      return s;
+   }
+
+}  /// end namespace Symath
+
+#endif
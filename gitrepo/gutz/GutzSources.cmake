@@ -262,6 +262,7 @@ SET(THREAD_GUTZ_INC
 	${TDR}/threadPolicy.h
 	${TDR}/mutexPolicy.h
 	${TDR}/conditionPolicy.h
+	${TDR}/threadPool.h
 	${TDR}/threadWorker.h
 	${TDR}/threadWorker.cpp
 )
@@ -302,11 +303,21 @@ SET(GUTZ_INCLUDE_PATH ${GUTZ_INCLUDE_PATH} ${EXCEPTIONGUTZ_PATH})
 SET(SIM_GUTZ_PATH "${GUTZ_PATH}/simGutz")
 SET(SIM_GUTZ_INC
 	include/simGutz.h
+	${SIM_GUTZ_PATH}/BarnesHut.h
+	${SIM_GUTZ_PATH}/BlockTimestep.h
+	${SIM_GUTZ_PATH}/CellList.h
+	${SIM_GUTZ_PATH}/Collision.h
+	${SIM_GUTZ_PATH}/DirectSum.h
+	${SIM_GUTZ_PATH}/DormandPrince.h
 	${SIM_GUTZ_PATH}/Field.h
+	${SIM_GUTZ_PATH}/FMM.h
 	${SIM_GUTZ_PATH}/Integrator.h
+	${SIM_GUTZ_PATH}/Leapfrog.h
 	${SIM_GUTZ_PATH}/Particle.h
+	${SIM_GUTZ_PATH}/ParticleArray.h
 	${SIM_GUTZ_PATH}/RK4.h
 	${SIM_GUTZ_PATH}/Simulation.h
+	${SIM_GUTZ_PATH}/Snapshot.h
 )
 
 SET(GUTZ_INCLUDE_FILES ${GUTZ_INCLUDE_FILES} ${SIM_GUTZ_INC})
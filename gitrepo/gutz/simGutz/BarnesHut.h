@@ -0,0 +1,391 @@
+/////////////////////////////////////////////////////////////////////////////////////////////
+//                                                                                           
+//                                          8MMNMM8                                          
+//                                     $MMMMMMMMMMMNMMNNNNN:                                 
+//                             7MMMMMMMMMMMMMNNNMNNNNNNNMNDDDDD7                             
+//                            MMMMMMMMMMMMMMNNNNNNNNNNNNNND8DD888                            
+//                          ZMMMMMMMMMMMMMMMMNNNNNNNNNNNNNNNNDDD8888:                        
+//                       8MMMMMMMMMMMMMMMMMMMNNNNNNNNNNNNNNNNDDD88888=                       
+//                     MMMMMMMMMMMMMMMMMMMMMMMNNNMNNNNNNNNNNNNNDD88888O8                     
+//                   MMMMMMMMMMMMMMMMNNNNNNNNNNNDDDDDDDDDDNNDNNNDD888888O8                   
+//                  MMMMMMMMMMMMMMMNNNNNNNNNNNNDDDDDDDDDDDDDDD888ND88888OO8                  
+//                 MMMMMMMMMMMMMMMNNNNNNNNNNNNNNDDDDDDDDDDDDDDD888OO8DDOOZZZ                 
+//                MMMMMMMMMMMMMMMNMMMMMMMMMMMMMMMMMMMMMMNDDDDDD8888OOOZZ$$$$Z                
+//               ,MMMMMMMMMMMMMMMMMNNNNNMMMMMMMMMMMMMMMDDDDDDMMMDN8OOOOZZZ++I7               
+//               MMMMMMMMMMMMMMMMMMMNNNNNNNNNNNNNNNNDDDDDDDDMMM88OMMD8OOZZZ$~I               
+//              MMMMMMMMMMMMMMMMMNND8Z7I+=~::::::::~~=?I$O88DDDDD8MMOO8M8OZZ$$$              
+//             MMMMMMMMMMMMMNDOI+:,                         ,~+78O888OMMZDMO$$$$             
+//            MMMMMMMMMMM87=,                                     ,+$8OOOMMZM8$$7            
+//           MMMMMMMMMO?:                                             :IOZO8M7MO77           
+//          MMMMMMMDI,                                                   :7ZZZM7MZ7          
+//         MMMMMMD?,                                                       ,7DZMDMZ7         
+//        :MMMMN?,                                                           ,$$$MMZ,        
+//        MMMM8~                                                               +N$MM7        
+//        MMMZ,                                                                 ~DZMM        
+//        MMD:                                           8""""8 8                1XD         
+//          #2IN                eeeee eeeee eeeeeee eeee 8    " 8               2YE          
+//            1HM               8   8 8  88 8  8  8 8    8e     8e             3ZF           
+//              0GL             8e  8 8   8 8e 8  8 8eee 88  ee 88            4AG            
+//                9FK           88  8 8   8 88 8  8 88   88   8 88           5BH             
+//                  8EJ         88ee8 8eee8 88 8  8 88ee 88eee8 88eee       6CJ              
+//                    7DI                                                7DI                 
+//                       OO?~                                        ,~78D                   
+//                         D8$+:,                             ,~?ZDN                         
+//                             ,NDO$?=::,             ,:~=?$8DM,                             
+//                                       ~7NNNNN8NNNNNZ:                                     
+//                                                                                           
+//                                                                                           
+//                                       Copyright 2011                                      
+//                      Art, Research, Technology and Science Laboratory                     
+//                                 The University of New Mexico                              
+//                                      Project Home Page                                    
+//                           <<<<http://artslab.unm.edu/domegl>>>>>                          
+//                                       Code Repository                                     
+//                           <<<https://svn.cs.unm.edu/domegl>>>>>>                          
+//                                                                                           
+/////////////////////////////////////////////////////////////////////////////////////////////
+
+#ifndef _BARNES_HUT_H
+#define _BARNES_HUT_H
+
+#include <vector>
+#include <Field.h>
+
+namespace gutz
+{
+   
+   //////////////////////////////////////////////////////////////////////////////////////////
+   /// Barnes-Hut tree code for Newtonian gravity
+   ///
+   /// Sorts the particles into an octree once per step and approximates every cell that
+   /// is far enough away by its total mass at its center of mass. A cell of edge length s
+   /// whose center of mass is d away from the particle and delta away from the cell's
+   /// center is used whole when s / (d - delta) < theta, the opening angle. Subtracting
+   /// delta keeps lopsided cells from being accepted too early. theta = 0 is the exact
+   /// direct sum, 0.5 is the usual choice, larger is faster and less accurate. The cost per
+   /// step is O(N log N) instead of P2PField's O(N^2).
+   ///
+   /// Plugs into gutz::Simulation as its NBODY_FIELD:
+   /// \code
+   /// typedef gutz::Particle<gutz::vec3f>          particle_type;
+   /// typedef gutz::BarnesHutField<particle_type>  nbody_type;
+   /// 
+   /// nbody_type nbody(0.5f);
+   /// gutz::Simulation<gutz::RK4<MyField>, nbody_type> sim(&integrator, &nbody);
+   /// \endcode
+   //////////////////////////////////////////////////////////////////////////////////////////
+   template<class PARTICLE>
+   class BarnesHutField
+   {
+   public:
+      typedef PARTICLE particle_type;
+      typedef typename PARTICLE::vec_type vec_type;
+      typedef typename vec_type::value_type value_type;
+      
+      enum { 
+         LEAF_SIZE = 8,    //< Cells with this many particles or less are not split
+         MAX_DEPTH = 32    //< Coincident particles share a leaf past this depth
+      };
+      
+      ///////////////////////////////////////////////////////////////////////////////////////
+      /// Constructor
+      ///
+      /// @param theta
+      ///   Opening angle, see above
+      ///////////////////////////////////////////////////////////////////////////////////////
+      BarnesHutField(value_type theta = static_cast<value_type>(0.5))
+      : _G       (static_cast<value_type>(6.67e-11)),
+        _theta   (theta)
+      {}
+      
+      ///////////////////////////////////////////////////////////////////////////////////////
+      /// Set the opening angle
+      ///////////////////////////////////////////////////////////////////////////////////////
+      void setTheta(value_type theta) { _theta = theta; }
+      
+      ///////////////////////////////////////////////////////////////////////////////////////
+      /// Sort the particles in [begin, end) into the tree. Call it whenever they have moved,
+      /// operator() sees the positions and masses they had at this point.
+      ///////////////////////////////////////////////////////////////////////////////////////
+      template<typename p_iterator_type>
+      void build(const p_iterator_type& begin, const p_iterator_type& end)
+      {
+         _position.clear();
+         _mass.clear();
+         _nodes.clear();
+         for(p_iterator_type i = begin; i != end; ++i)
+         {
+            _position.push_back((*i).getPosition());
+            _mass.push_back((*i).getMass());
+         }
+         make();
+      }
+      
+      ///////////////////////////////////////////////////////////////////////////////////////
+      /// Sort the particles of a ParticleArray into the tree
+      ///////////////////////////////////////////////////////////////////////////////////////
+      void build(const ParticleArray<vec_type>& particles)
+      {
+         _position.resize(particles.size());
+         _mass.assign(particles.mass(), particles.mass() + particles.size());
+         _nodes.clear();
+         for(size_t i = 0; i < particles.size(); ++i) _position[i] = particles.getPosition(i);
+         make();
+      }
+      
+      ///////////////////////////////////////////////////////////////////////////////////////
+      /// Build the tree for particles and add everyone's acceleration to their
+      /// acceleration columns
+      ///////////////////////////////////////////////////////////////////////////////////////
+      void accelerate(ParticleArray<vec_type>& particles)
+      {
+         build(particles);
+         for(size_t i = 0; i < particles.size(); ++i)
+         {
+            particles.setAcceleration(i, particles.getAcceleration(i) + accelerationAt(particles.getPosition(i)));
+         }
+      }
+      
+      ///////////////////////////////////////////////////////////////////////////////////////
+      /// Same for just the particles listed in targets, the tree holds all of them
+      ///////////////////////////////////////////////////////////////////////////////////////
+      void accelerate(ParticleArray<vec_type>& particles, const std::vector<unsigned int>& targets)
+      {
+         build(particles);
+         for(size_t t = 0; t < targets.size(); ++t)
+         {
+            const size_t i = targets[t];
+            particles.setAcceleration(i, particles.getAcceleration(i) + accelerationAt(particles.getPosition(i)));
+         }
+      }
+      
+      ///////////////////////////////////////////////////////////////////////////////////////
+      /// Acceleration of p0 due to the particles given to build(). Particles at p0's
+      /// position, p0 itself among them, are skipped like P2PField does.
+      ///
+      /// @return
+      ///       The acceleration vector. Units: m/s^2
+      ///////////////////////////////////////////////////////////////////////////////////////
+      vec_type operator()(const particle_type& p0) const
+      {
+         return accelerationAt(p0.getPosition());
+      }
+      
+      ///////////////////////////////////////////////////////////////////////////////////////
+      /// Acceleration of the i'th particle given to build(). Units: m/s^2
+      ///////////////////////////////////////////////////////////////////////////////////////
+      vec_type acceleration(size_t i) const
+      {
+         return accelerationAt(_position[_where[i]]);
+      }
+      
+      ///////////////////////////////////////////////////////////////////////////////////////
+      /// Acceleration of a test mass at position x. Units: m/s^2
+      ///////////////////////////////////////////////////////////////////////////////////////
+      vec_type accelerationAt(const vec_type& x) const
+      {
+         vec_type acceleration(static_cast<value_type>(0));
+         if(_nodes.empty()) return acceleration;
+         
+         unsigned int stack[MAX_DEPTH * CHILDREN + 1];
+         int top = 0;
+         stack[top++] = 0;
+         while(top > 0)
+         {
+            const Node& node = _nodes[stack[--top]];
+            if(node.children == 0)
+            {
+               for(unsigned int i = node.begin; i < node.end; ++i)
+               {
+                  accumulate(acceleration, _position[i] - x, _mass[i]);
+               }
+               continue;
+            }
+            
+            const vec_type toCenter = node.center - x;
+            const value_type reach = node.edge + _theta * node.offset;
+            if(reach * reach < _theta * _theta * toCenter.norm2())
+            {
+               accumulate(acceleration, toCenter, node.mass);
+               continue;
+            }
+            
+            for(unsigned int c = 0; c < node.children; ++c) stack[top++] = node.firstChild + c;
+         }
+         
+         return acceleration * _G;
+      }
+      
+      ///////////////////////////////////////////////////////////////////////////////////////
+      /// Number of cells in the tree, for the curious
+      ///////////////////////////////////////////////////////////////////////////////////////
+      const size_t size(void) const { return _nodes.size(); }
+      
+   private:
+      static const int dimension = vec_type::size;
+      enum { CHILDREN = 1 << dimension };
+      
+      struct Node
+      {
+         Node() : center(static_cast<value_type>(0)), mass(0), edge(0), offset(0), begin(0), end(0), firstChild(0), children(0) {}
+         
+         vec_type     center;      //< Center of mass
+         value_type   mass;        //< Total mass
+         value_type   edge;        //< Edge length of the cell
+         value_type   offset;      //< Distance from the cell center to the center of mass
+         unsigned int begin;       //< First particle, in tree order
+         unsigned int end;         //< One past the last particle
+         unsigned int firstChild;  //< Children are stored next to each other
+         unsigned int children;    //< Number of non-empty children, 0 for a leaf
+      };
+      
+      ///////////////////////////////////////////////////////////////////////////////////////
+      /// Build the tree over _position and _mass
+      ///////////////////////////////////////////////////////////////////////////////////////
+      void make(void)
+      {
+         if(_position.empty()) return;
+         
+         // Bounding cube
+         vec_type lo(_position[0]), hi(_position[0]);
+         for(size_t i = 1; i < _position.size(); ++i)
+         {
+            for(int d = 0; d < dimension; ++d)
+            {
+               if(_position[i][d] < lo[d]) lo[d] = _position[i][d];
+               if(_position[i][d] > hi[d]) hi[d] = _position[i][d];
+            }
+         }
+         value_type edge = static_cast<value_type>(0);
+         for(int d = 0; d < dimension; ++d)
+         {
+            if(hi[d] - lo[d] > edge) edge = hi[d] - lo[d];
+         }
+         
+         std::vector<unsigned int> order(_position.size());
+         for(size_t i = 0; i < order.size(); ++i) order[i] = static_cast<unsigned int>(i);
+         _scratch.resize(order.size());
+         
+         _nodes.push_back(Node());
+         split(0, order, 0, static_cast<unsigned int>(order.size()), (lo + hi) * static_cast<value_type>(0.5), edge, 0);
+         
+         // Store the particles in tree order so leaves are contiguous
+         std::vector<vec_type>   position(order.size());
+         std::vector<value_type> mass(order.size());
+         _where.resize(order.size());
+         for(size_t i = 0; i < order.size(); ++i)
+         {
+            position[i]     = _position[order[i]];
+            mass[i]         = _mass[order[i]];
+            _where[order[i]] = static_cast<unsigned int>(i);
+         }
+         _position.swap(position);
+         _mass.swap(mass);
+      }
+      
+      ///////////////////////////////////////////////////////////////////////////////////////
+      /// m / r^2 along d, d pointing from the target to the source. Skips r = 0.
+      ///////////////////////////////////////////////////////////////////////////////////////
+      static void accumulate(vec_type& acceleration, const vec_type& d, value_type m)
+      {
+         const value_type r2 = d.norm2();
+         if(r2 <= static_cast<value_type>(0)) return;
+         const value_type r = static_cast<value_type>(sqrt(r2));
+         acceleration += d * (m / (r2 * r));
+      }
+      
+      ///////////////////////////////////////////////////////////////////////////////////////
+      /// Fill in node n for particles order[begin, end) inside the cube at center with the
+      /// given edge, then split it into octants if it holds too many.
+      ///////////////////////////////////////////////////////////////////////////////////////
+      void split(unsigned int n, std::vector<unsigned int>& order, unsigned int begin, unsigned int end,
+                 const vec_type& center, value_type edge, int depth)
+      {
+         Node node;
+         node.begin = begin;
+         node.end   = end;
+         node.edge  = edge;
+         vec_type moment(static_cast<value_type>(0));
+         for(unsigned int i = begin; i < end; ++i)
+         {
+            moment    += _position[order[i]] * _mass[order[i]];
+            node.mass += _mass[order[i]];
+         }
+         node.center = node.mass > static_cast<value_type>(0) ? moment / node.mass : center;
+         node.offset = (node.center - center).norm();
+         
+         if(end - begin <= LEAF_SIZE || depth >= MAX_DEPTH)
+         {
+            _nodes[n] = node;
+            return;
+         }
+         
+         // Counting sort of the range by octant
+         unsigned int count[CHILDREN + 1] = { 0 };
+         for(unsigned int i = begin; i < end; ++i) ++count[octant(_position[order[i]], center) + 1];
+         for(int c = 0; c < CHILDREN; ++c) count[c + 1] += count[c];
+         unsigned int fill[CHILDREN];
+         for(int c = 0; c < CHILDREN; ++c) fill[c] = begin + count[c];
+         for(unsigned int i = begin; i < end; ++i) _scratch[fill[octant(_position[order[i]], center)]++] = order[i];
+         for(unsigned int i = begin; i < end; ++i) order[i] = _scratch[i];
+         
+         node.firstChild = static_cast<unsigned int>(_nodes.size());
+         for(int c = 0; c < CHILDREN; ++c)
+         {
+            if(count[c + 1] > count[c]) ++node.children;
+         }
+         _nodes[n] = node;
+         _nodes.resize(_nodes.size() + node.children);
+         
+         const value_type half = edge * static_cast<value_type>(0.5);
+         unsigned int child = node.firstChild;
+         for(int c = 0; c < CHILDREN; ++c)
+         {
+            if(count[c + 1] == count[c]) continue;
+            vec_type childCenter(center);
+            for(int d = 0; d < dimension; ++d)
+            {
+               childCenter[d] += (c & (1 << d)) ? half * static_cast<value_type>(0.5) : -half * static_cast<value_type>(0.5);
+            }
+            split(child++, order, begin + count[c], begin + count[c + 1], childCenter, half, depth + 1);
+         }
+      }
+      
+      static int octant(const vec_type& x, const vec_type& center)
+      {
+         int c = 0;
+         for(int d = 0; d < dimension; ++d)
+         {
+            if(x[d] >= center[d]) c |= 1 << d;
+         }
+         return c;
+      }
+      
+      /// Gravitational constant, m^3 / (kg s^2)
+      value_type                _G;
+      value_type                _theta;     //< Opening angle
+      std::vector<Node>         _nodes;     //< The root is node 0
+      std::vector<vec_type>     _position;  //< Particles in tree order
+      std::vector<value_type>   _mass;
+      std::vector<unsigned int> _where;     //< Tree order of the i'th particle given to build()
+      std::vector<unsigned int> _scratch;
+   };
+   
+   //////////////////////////////////////////////////////////////////////////////////////////
+   /// The tree is built once per step by prepare(), then each particle walks it instead of
+   /// visiting every other particle.
+   //////////////////////////////////////////////////////////////////////////////////////////
+   template<class PARTICLE>
+   struct IsPrebuiltField< BarnesHutField<PARTICLE> >
+   {
+      enum { value = true };
+   };
+   
+   template<class PARTICLE>
+   struct IsBulkField< BarnesHutField<PARTICLE> >
+   {
+      enum { value = true };
+   };
+}
+
+#endif
@@ -0,0 +1,213 @@
+/////////////////////////////////////////////////////////////////////////////////////////////
+//                                                                                           
+//                                          8MMNMM8                                          
+//                                     $MMMMMMMMMMMNMMNNNNN:                                 
+//                             7MMMMMMMMMMMMMNNNMNNNNNNNMNDDDDD7                             
+//                            MMMMMMMMMMMMMMNNNNNNNNNNNNNND8DD888                            
+//                          ZMMMMMMMMMMMMMMMMNNNNNNNNNNNNNNNNDDD8888:                        
+//                       8MMMMMMMMMMMMMMMMMMMNNNNNNNNNNNNNNNNDDD88888=                       
+//                     MMMMMMMMMMMMMMMMMMMMMMMNNNMNNNNNNNNNNNNNDD88888O8                     
+//                   MMMMMMMMMMMMMMMMNNNNNNNNNNNDDDDDDDDDDNNDNNNDD888888O8                   
+//                  MMMMMMMMMMMMMMMNNNNNNNNNNNNDDDDDDDDDDDDDDD888ND88888OO8                  
+//                 MMMMMMMMMMMMMMMNNNNNNNNNNNNNNDDDDDDDDDDDDDDD888OO8DDOOZZZ                 
+//                MMMMMMMMMMMMMMMNMMMMMMMMMMMMMMMMMMMMMMNDDDDDD8888OOOZZ$$$$Z                
+//               ,MMMMMMMMMMMMMMMMMNNNNNMMMMMMMMMMMMMMMDDDDDDMMMDN8OOOOZZZ++I7               
+//               MMMMMMMMMMMMMMMMMMMNNNNNNNNNNNNNNNNDDDDDDDDMMM88OMMD8OOZZZ$~I               
+//              MMMMMMMMMMMMMMMMMNND8Z7I+=~::::::::~~=?I$O88DDDDD8MMOO8M8OZZ$$$              
+//             MMMMMMMMMMMMMNDOI+:,                         ,~+78O888OMMZDMO$$$$             
+//            MMMMMMMMMMM87=,                                     ,+$8OOOMMZM8$$7            
+//           MMMMMMMMMO?:                                             :IOZO8M7MO77           
+//          MMMMMMMDI,                                                   :7ZZZM7MZ7          
+//         MMMMMMD?,                                                       ,7DZMDMZ7         
+//        :MMMMN?,                                                           ,$$$MMZ,        
+//        MMMM8~                                                               +N$MM7        
+//        MMMZ,                                                                 ~DZMM        
+//        MMD:                                           8""""8 8                1XD         
+//          #2IN                eeeee eeeee eeeeeee eeee 8    " 8               2YE          
+//            1HM               8   8 8  88 8  8  8 8    8e     8e             3ZF           
+//              0GL             8e  8 8   8 8e 8  8 8eee 88  ee 88            4AG            
+//                9FK           88  8 8   8 88 8  8 88   88   8 88           5BH             
+//                  8EJ         88ee8 8eee8 88 8  8 88ee 88eee8 88eee       6CJ              
+//                    7DI                                                7DI                 
+//                       OO?~                                        ,~78D                   
+//                         D8$+:,                             ,~?ZDN                         
+//                             ,NDO$?=::,             ,:~=?$8DM,                             
+//                                       ~7NNNNN8NNNNNZ:                                     
+//                                                                                           
+//                                                                                           
+//                                       Copyright 2011                                      
+//                      Art, Research, Technology and Science Laboratory                     
+//                                 The University of New Mexico                              
+//                                      Project Home Page                                    
+//                           <<<<http://artslab.unm.edu/domegl>>>>>                          
+//                                       Code Repository                                     
+//                           <<<https://svn.cs.unm.edu/domegl>>>>>>                          
+//                                                                                           
+/////////////////////////////////////////////////////////////////////////////////////////////
+
+#ifndef _BLOCK_TIMESTEP_H
+#define _BLOCK_TIMESTEP_H
+
+#include <vector>
+#include <math.h>
+#include <vec.h>
+#include <ParticleArray.h>
+#include <Field.h>
+
+namespace gutz
+{
+   
+   //////////////////////////////////////////////////////////////////////////////////////////
+   /// Leapfrog with a time step for every particle
+   ///
+   /// A close encounter needs small steps, but only for the particles in it. Each particle
+   /// gets its own step dt / 2^level, level between 0 and maxLevel, from
+   ///
+   ///    step <= eta * sqrt(length / |a|)
+   ///
+   /// length a scale of the problem (the softening length, a typical separation). The
+   /// power of two levels nest, so the particles on a level are all due at once and the
+   /// ones on coarser levels are due at a subset of the same times. At each of those times
+   /// every particle drifts to it, and the field is evaluated for the particles that are
+   /// due only, through the targets form of ForEachParticle; the others keep coasting on
+   /// their last kick. A particle changes level when its step ends, going coarser only
+   /// where the coarser grid lines up.
+   ///
+   /// The force evaluations that go away depend on the field. A per particle field or
+   /// P2PField and BarnesHutField evaluate just the particles that are due; FMMField and
+   /// DirectSumField compute everyone and keep the ones that are due.
+   ///
+   /// Only works on a ParticleArray. The acceleration columns are left holding the last
+   /// accelerations, level() the levels.
+   ///
+   /// \code
+   /// gutz::BlockTimestep<gutz::BarnesHutField<particle_type> > integrator(&tree, 0.02f, 1.0f);
+   /// integrator(particles, t, 1.0f / 60.0f);
+   /// \endcode
+   //////////////////////////////////////////////////////////////////////////////////////////
+   template <class FIELD>
+   class BlockTimestep
+   {
+   public:
+      typedef FIELD field_type;
+      typedef typename FIELD::particle_type      particle_type;
+      typedef typename particle_type::value_type value_type;
+      typedef typename particle_type::vec_type   vec_type;
+      
+      ///////////////////////////////////////////////////////////////////////////////////////
+      /// Constructor
+      ///
+      /// @param eta       accuracy, smaller is more accurate
+      /// @param length    length scale of the step criterion, meters
+      /// @param maxLevel  finest step is dt / 2^maxLevel, at most 30
+      ///////////////////////////////////////////////////////////////////////////////////////
+      BlockTimestep(field_type* field, value_type eta = static_cast<value_type>(0.02),
+                    value_type length = static_cast<value_type>(1), int maxLevel = 10)
+      :  _field      (field),
+         _eta        (eta),
+         _length     (length),
+         _maxLevel   (maxLevel < 0 ? 0 : (maxLevel > 30 ? 30 : maxLevel)),
+         _evaluations(0)
+      {}
+      
+      /// Level of particle i in the last call, its step was dt / 2^level
+      int level(size_t i) const { return _level[i]; }
+      
+      /// Particle accelerations computed by the last call
+      size_t getEvaluations(void) const { return _evaluations; }
+      
+      ///////////////////////////////////////////////////////////////////////////////////////
+      /// Advance every particle by dt
+      ///////////////////////////////////////////////////////////////////////////////////////
+      void operator()(ParticleArray<vec_type>& particles, value_type t, value_type dt)
+      {
+         static const int dimension = vec_type::size;
+         const size_t n = particles.size();
+         const unsigned long ticks = 1ul << _maxLevel;  // Finest steps in dt
+         const value_type tick = dt / static_cast<value_type>(ticks);
+         ForEachParticle<field_type> forEach;
+         if(n == 0) return;
+         
+         // Everyone starts together: accelerations, levels, opening half kicks
+         particles.clearAcceleration();
+         forEach(particles, *_field);
+         _evaluations = n;
+         _level.resize(n);
+         for(size_t i = 0; i < n; ++i)
+         {
+            _level[i] = levelFor(particles.getAcceleration(i), dt);
+            kick(particles, i, dt);
+         }
+         
+         unsigned long now = 0;
+         while(now < ticks)
+         {
+            // The next time anyone is due is the end of the finest step in use
+            int finest = 0;
+            for(size_t i = 0; i < n; ++i) finest = _level[i] > finest ? _level[i] : finest;
+            const unsigned long next = now + (ticks >> finest);
+            
+            const value_type drift = tick * static_cast<value_type>(next - now);
+            for(int d = 0; d < dimension; ++d)
+            {
+               value_type* x = particles.position(d);
+               const value_type* v = particles.velocity(d);
+               for(size_t i = 0; i < n; ++i) x[i] += drift * v[i];
+            }
+            now = next;
+            
+            _due.clear();
+            for(size_t i = 0; i < n; ++i)
+            {
+               if(now % (ticks >> _level[i]) == 0) _due.push_back(static_cast<unsigned int>(i));
+            }
+            for(size_t k = 0; k < _due.size(); ++k) particles.setAcceleration(_due[k], vec_type(static_cast<value_type>(0)));
+            forEach(particles, *_field, _due);
+            _evaluations += _due.size();
+            
+            // Closing half kick, then unless dt is over a new level and its opening half kick
+            for(size_t k = 0; k < _due.size(); ++k)
+            {
+               const unsigned int i = _due[k];
+               kick(particles, i, dt);
+               if(now == ticks) continue;
+               int level = levelFor(particles.getAcceleration(i), dt);
+               while(level < _level[i] && now % (ticks >> level) != 0) ++level;
+               _level[i] = level;
+               kick(particles, i, dt);
+            }
+         }
+      }
+      
+   protected:
+      /// Half a step of particle i's acceleration into its velocity
+      void kick(ParticleArray<vec_type>& particles, size_t i, value_type dt)
+      {
+         const value_type half = dt / static_cast<value_type>(2ul << _level[i]);
+         particles.setVelocity(i, particles.getVelocity(i) + particles.getAcceleration(i) * half);
+      }
+      
+      /// Coarsest level whose step meets the criterion
+      int levelFor(const vec_type& acceleration, value_type dt) const
+      {
+         const double a = acceleration.norm();
+         if(a <= 0) return 0;
+         const double step = _eta * sqrt(_length / a);
+         int level = 0;
+         while(level < _maxLevel && dt / double(1ul << level) > step) ++level;
+         return level;
+      }
+      
+   private:
+      field_type*               _field;        //< Force field
+      value_type                _eta;
+      value_type                _length;
+      int                       _maxLevel;
+      size_t                    _evaluations;
+      std::vector<int>          _level;        //< By particle
+      std::vector<unsigned int> _due;          //< Scratch, the particles due now
+   };
+   
+}
+
+#endif
@@ -0,0 +1,351 @@
+/////////////////////////////////////////////////////////////////////////////////////////////
+//                                                                                           
+//                                          8MMNMM8                                          
+//                                     $MMMMMMMMMMMNMMNNNNN:                                 
+//                             7MMMMMMMMMMMMMNNNMNNNNNNNMNDDDDD7                             
+//                            MMMMMMMMMMMMMMNNNNNNNNNNNNNND8DD888                            
+//                          ZMMMMMMMMMMMMMMMMNNNNNNNNNNNNNNNNDDD8888:                        
+//                       8MMMMMMMMMMMMMMMMMMMNNNNNNNNNNNNNNNNDDD88888=                       
+//                     MMMMMMMMMMMMMMMMMMMMMMMNNNMNNNNNNNNNNNNNDD88888O8                     
+//                   MMMMMMMMMMMMMMMMNNNNNNNNNNNDDDDDDDDDDNNDNNNDD888888O8                   
+//                  MMMMMMMMMMMMMMMNNNNNNNNNNNNDDDDDDDDDDDDDDD888ND88888OO8                  
+//                 MMMMMMMMMMMMMMMNNNNNNNNNNNNNNDDDDDDDDDDDDDDD888OO8DDOOZZZ                 
+//                MMMMMMMMMMMMMMMNMMMMMMMMMMMMMMMMMMMMMMNDDDDDD8888OOOZZ$$$$Z                
+//               ,MMMMMMMMMMMMMMMMMNNNNNMMMMMMMMMMMMMMMDDDDDDMMMDN8OOOOZZZ++I7               
+//               MMMMMMMMMMMMMMMMMMMNNNNNNNNNNNNNNNNDDDDDDDDMMM88OMMD8OOZZZ$~I               
+//              MMMMMMMMMMMMMMMMMNND8Z7I+=~::::::::~~=?I$O88DDDDD8MMOO8M8OZZ$$$              
+//             MMMMMMMMMMMMMNDOI+:,                         ,~+78O888OMMZDMO$$$$             
+//            MMMMMMMMMMM87=,                                     ,+$8OOOMMZM8$$7            
+//           MMMMMMMMMO?:                                             :IOZO8M7MO77           
+//          MMMMMMMDI,                                                   :7ZZZM7MZ7          
+//         MMMMMMD?,                                                       ,7DZMDMZ7         
+//        :MMMMN?,                                                           ,$$$MMZ,        
+//        MMMM8~                                                               +N$MM7        
+//        MMMZ,                                                                 ~DZMM        
+//        MMD:                                           8""""8 8                1XD         
+//          #2IN                eeeee eeeee eeeeeee eeee 8    " 8               2YE          
+//            1HM               8   8 8  88 8  8  8 8    8e     8e             3ZF           
+//              0GL             8e  8 8   8 8e 8  8 8eee 88  ee 88            4AG            
+//                9FK           88  8 8   8 88 8  8 88   88   8 88           5BH             
+//                  8EJ         88ee8 8eee8 88 8  8 88ee 88eee8 88eee       6CJ              
+//                    7DI                                                7DI                 
+//                       OO?~                                        ,~78D                   
+//                         D8$+:,                             ,~?ZDN                         
+//                             ,NDO$?=::,             ,:~=?$8DM,                             
+//                                       ~7NNNNN8NNNNNZ:                                     
+//                                                                                           
+//                                                                                           
+//                                       Copyright 2011                                      
+//                      Art, Research, Technology and Science Laboratory                     
+//                                 The University of New Mexico                              
+//                                      Project Home Page                                    
+//                           <<<<http://artslab.unm.edu/domegl>>>>>                          
+//                                       Code Repository                                     
+//                           <<<https://svn.cs.unm.edu/domegl>>>>>>                          
+//                                                                                           
+/////////////////////////////////////////////////////////////////////////////////////////////
+
+#ifndef _CELL_LIST_H
+#define _CELL_LIST_H
+
+#include <vector>
+#include <iterator>
+#include <math.h>
+#include <vec.h>
+#include <Field.h>
+#include <ParticleArray.h>
+
+namespace gutz
+{
+   
+   //////////////////////////////////////////////////////////////////////////////////////////
+   /// Spatial hash of particle positions for short range neighbor search
+   ///
+   /// Space is cut into cubic cells of side cellSize, every cell hashes to one of a power of
+   /// two buckets and every bucket lists the particles in it. Nothing has to be known about
+   /// the extent of the particles up front. update() works out each particle's cell again
+   /// and only moves the ones that left their bucket, a small fraction per step when the
+   /// particles move less than a cell. Cells that share a bucket cost a few extra tests,
+   /// nothing more.
+   ///
+   /// The queries visit the particles within radius, cellSize >= radius looks at 3^dim
+   /// cells. They only read, so several threads can query at once.
+   ///
+   /// \code
+   /// struct Count
+   /// {
+   ///    std::vector<int>* count;
+   ///    void operator()(size_t i, size_t j) { ++(*count)[i]; }
+   /// };
+   ///
+   /// gutz::CellList<gutz::vec3f> cells(0.1f);
+   /// cells.update(particles);                      // each step
+   /// Count visit = { &neighbors };
+   /// cells.forEachNeighbor(i, 0.1f, visit);        // visit(i, j) for every j within 0.1
+   /// \endcode
+   //////////////////////////////////////////////////////////////////////////////////////////
+   template<typename VEC_TYPE = gutz::vec3f>
+   class CellList
+   {
+   public:
+      typedef VEC_TYPE vec_type;
+      typedef typename VEC_TYPE::value_type value_type;
+      static const int dimension = VEC_TYPE::size;
+      
+      ///////////////////////////////////////////////////////////////////////////////////////
+      /// Constructor
+      ///
+      /// @param cellSize  side of a cell in meters, about the largest query radius
+      ///////////////////////////////////////////////////////////////////////////////////////
+      CellList(value_type cellSize = static_cast<value_type>(1))
+      : _cellSize(cellSize),
+        _moved   (0)
+      {}
+      
+      ///////////////////////////////////////////////////////////////////////////////////////
+      /// A new cell size sorts everything again on the next update()
+      ///////////////////////////////////////////////////////////////////////////////////////
+      void setCellSize(value_type cellSize)
+      {
+         if(cellSize == _cellSize) return;
+         _cellSize = cellSize;
+         _buckets.clear();
+      }
+      
+      value_type getCellSize(void) const { return _cellSize; }
+      
+      const size_t size(void) const { return _position.size(); }
+      
+      /// Particles that changed bucket in the last update(), all of them after a full sort
+      size_t getMoved(void) const { return _moved; }
+      
+      const vec_type& getPosition(size_t i) const { return _position[i]; }
+      
+      ///////////////////////////////////////////////////////////////////////////////////////
+      /// Take the positions of the particles in [begin, end), particle i of the range is
+      /// index i in the queries. Incremental as long as the number of particles stays the
+      /// same.
+      ///////////////////////////////////////////////////////////////////////////////////////
+      template<typename p_iterator_type>
+      void update(const p_iterator_type& begin, const p_iterator_type& end)
+      {
+         const size_t n = std::distance(begin, end);
+         if(n != _position.size()) resize(n);
+         size_t i = 0;
+         for(p_iterator_type p = begin; p != end; ++p, ++i) _position[i] = (*p).getPosition();
+         sort();
+      }
+      
+      ///////////////////////////////////////////////////////////////////////////////////////
+      /// Same from the position columns of a ParticleArray
+      ///////////////////////////////////////////////////////////////////////////////////////
+      void update(const ParticleArray<vec_type>& particles)
+      {
+         if(particles.size() != _position.size()) resize(particles.size());
+         for(int d = 0; d < dimension; ++d)
+         {
+            const value_type* x = particles.position(d);
+            for(size_t i = 0; i < _position.size(); ++i) _position[i][d] = x[i];
+         }
+         sort();
+      }
+      
+      ///////////////////////////////////////////////////////////////////////////////////////
+      /// Call visit(i, j) for every other particle j closer than radius to particle i
+      ///////////////////////////////////////////////////////////////////////////////////////
+      template<class VISITOR>
+      void forEachNeighbor(size_t i, value_type radius, VISITOR& visit) const
+      {
+         neighbors(i, radius, visit, false);
+      }
+      
+      ///////////////////////////////////////////////////////////////////////////////////////
+      /// Call visit(i, j) once for every pair closer than radius, i < j
+      ///////////////////////////////////////////////////////////////////////////////////////
+      template<class VISITOR>
+      void forEachPair(value_type radius, VISITOR& visit) const
+      {
+         for(size_t i = 0; i < _position.size(); ++i) neighbors(i, radius, visit, true);
+      }
+      
+   private:
+      ///////////////////////////////////////////////////////////////////////////////////////
+      /// Walk the cells within reach of particle i's, each particle found belongs to just
+      /// one cell so checking its cell skips the others sharing the bucket
+      ///////////////////////////////////////////////////////////////////////////////////////
+      template<class VISITOR>
+      void neighbors(size_t i, value_type radius, VISITOR& visit, bool after) const
+      {
+         if(_buckets.empty()) return;
+         const long reach = radius > _cellSize ? static_cast<long>(ceil(radius / _cellSize)) : 1;
+         const value_type r2 = radius * radius;
+         const vec_type& x = _position[i];
+         const long* home = &_cell[i * dimension];
+         long offset[dimension];
+         long cell[dimension];
+         for(int d = 0; d < dimension; ++d) offset[d] = -reach;
+         
+         for(;;)
+         {
+            for(int d = 0; d < dimension; ++d) cell[d] = home[d] + offset[d];
+            const std::vector<unsigned int>& bucket = _buckets[hash(cell)];
+            for(size_t k = 0; k < bucket.size(); ++k)
+            {
+               const size_t j = bucket[k];
+               if(j == i || (after && j < i) || !inCell(j, cell)) continue;
+               value_type distance2 = static_cast<value_type>(0);
+               for(int d = 0; d < dimension; ++d)
+               {
+                  const value_type delta = _position[j][d] - x[d];
+                  distance2 += delta * delta;
+               }
+               if(distance2 < r2) visit(i, j);
+            }
+            
+            // Next offset, odometer style
+            int d = 0;
+            while(d < dimension && ++offset[d] > reach) offset[d++] = -reach;
+            if(d == dimension) break;
+         }
+      }
+      
+      void resize(size_t n)
+      {
+         _position.resize(n);
+         _cell.resize(n * dimension);
+         _bucket.resize(n);
+         _slot.resize(n);
+         _buckets.clear();
+      }
+      
+      ///////////////////////////////////////////////////////////////////////////////////////
+      /// New cells for everyone, into new buckets if there are none yet, else only the
+      /// particles whose bucket changed move
+      ///////////////////////////////////////////////////////////////////////////////////////
+      void sort(void)
+      {
+         const size_t n = _position.size();
+         const bool full = _buckets.empty();
+         if(full)
+         {
+            size_t buckets = 64;
+            while(buckets < 2 * n) buckets *= 2;
+            _buckets.resize(buckets);
+         }
+         
+         _moved = 0;
+         for(size_t i = 0; i < n; ++i)
+         {
+            long* cell = &_cell[i * dimension];
+            for(int d = 0; d < dimension; ++d)
+            {
+               cell[d] = static_cast<long>(floor(_position[i][d] / _cellSize));
+            }
+            const unsigned int b = hash(cell);
+            if(!full && b == _bucket[i]) continue;
+            if(!full) remove(i);
+            _bucket[i] = b;
+            _slot[i] = static_cast<unsigned int>(_buckets[b].size());
+            _buckets[b].push_back(static_cast<unsigned int>(i));
+            ++_moved;
+         }
+      }
+      
+      /// Take particle i out of its bucket, the last one in the bucket fills the hole
+      void remove(size_t i)
+      {
+         std::vector<unsigned int>& bucket = _buckets[_bucket[i]];
+         const unsigned int last = bucket.back();
+         bucket[_slot[i]] = last;
+         _slot[last] = _slot[i];
+         bucket.pop_back();
+      }
+      
+      bool inCell(size_t j, const long cell[]) const
+      {
+         for(int d = 0; d < dimension; ++d)
+         {
+            if(_cell[j * dimension + d] != cell[d]) return false;
+         }
+         return true;
+      }
+      
+      /// Teschner et al., Optimized Spatial Hashing for Collision Detection of Deformable
+      /// Objects, VMV 2003
+      unsigned int hash(const long cell[]) const
+      {
+         static const unsigned long primes[4] = { 73856093ul, 19349663ul, 83492791ul, 2654435761ul };
+         unsigned long h = 0;
+         for(int d = 0; d < dimension; ++d) h ^= static_cast<unsigned long>(cell[d]) * primes[d % 4];
+         return static_cast<unsigned int>(h & (_buckets.size() - 1));
+      }
+      
+      value_type                              _cellSize;
+      size_t                                  _moved;
+      std::vector<vec_type>                   _position;
+      std::vector<long>                       _cell;      //< dimension per particle
+      std::vector<unsigned int>               _bucket;    //< Bucket of each particle
+      std::vector<unsigned int>               _slot;      //< Where in its bucket
+      std::vector< std::vector<unsigned int> > _buckets;
+   };
+   
+   //////////////////////////////////////////////////////////////////////////////////////////
+   /// ForEachParticlePair for short range fields
+   ///
+   /// Visits only the particles within field.cutoff() of each particle, through a CellList
+   /// that prepare() updates every step. O(N) rather than O(N^2) while the number of
+   /// particles within the cutoff stays bounded. A field opts in by specializing
+   /// ForEachParticlePair to derive from this, see CollisionField. Keep the object between
+   /// steps, Simulation does, so the cell list gets updated rather than built.
+   //////////////////////////////////////////////////////////////////////////////////////////
+   template<class FIELD>
+   class ForEachNeighborPair
+   {
+   public:
+      typedef typename FIELD::vec_type vec_type;
+      typedef typename FIELD::particle_type particle_type;
+      
+      ///////////////////////////////////////////////////////////////////////////////////////
+      ///////////////////////////////////////////////////////////////////////////////////////
+      template<typename p_iterator_type>
+      void prepare(const p_iterator_type& begin, const p_iterator_type& end, FIELD& field)
+      {
+         _cells.setCellSize(field.cutoff());
+         _cells.update(begin, end);
+      }
+      
+      ///////////////////////////////////////////////////////////////////////////////////////
+      ///////////////////////////////////////////////////////////////////////////////////////
+      template<typename p_iterator_type>
+      void operator()(vec_type& acceleration, p_iterator_type& p0i, const p_iterator_type& begin,
+                      const p_iterator_type& end, FIELD& field)
+      {
+         Sum<p_iterator_type> sum = { &acceleration, &field, p0i, begin };
+         _cells.forEachNeighbor(std::distance(begin, p0i), field.cutoff(), sum);
+      }
+      
+      const CellList<vec_type>& cells(void) const { return _cells; }
+      
+   private:
+      template<typename p_iterator_type>
+      struct Sum
+      {
+         vec_type*       acceleration;
+         FIELD*          field;
+         p_iterator_type p0i;
+         p_iterator_type begin;
+         
+         void operator()(size_t i, size_t j)
+         {
+            p_iterator_type p1i = begin;
+            std::advance(p1i, j);
+            *acceleration += (*field)(*p0i, *p1i);
+         }
+      };
+      
+      CellList<vec_type> _cells;
+   };
+   
+}
+
+#endif
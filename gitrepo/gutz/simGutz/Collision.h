@@ -0,0 +1,203 @@
+/////////////////////////////////////////////////////////////////////////////////////////////
+//                                                                                           
+//                                          8MMNMM8                                          
+//                                     $MMMMMMMMMMMNMMNNNNN:                                 
+//                             7MMMMMMMMMMMMMNNNMNNNNNNNMNDDDDD7                             
+//                            MMMMMMMMMMMMMMNNNNNNNNNNNNNND8DD888                            
+//                          ZMMMMMMMMMMMMMMMMNNNNNNNNNNNNNNNNDDD8888:                        
+//                       8MMMMMMMMMMMMMMMMMMMNNNNNNNNNNNNNNNNDDD88888=                       
+//                     MMMMMMMMMMMMMMMMMMMMMMMNNNMNNNNNNNNNNNNNDD88888O8                     
+//                   MMMMMMMMMMMMMMMMNNNNNNNNNNNDDDDDDDDDDNNDNNNDD888888O8                   
+//                  MMMMMMMMMMMMMMMNNNNNNNNNNNNDDDDDDDDDDDDDDD888ND88888OO8                  
+//                 MMMMMMMMMMMMMMMNNNNNNNNNNNNNNDDDDDDDDDDDDDDD888OO8DDOOZZZ                 
+//                MMMMMMMMMMMMMMMNMMMMMMMMMMMMMMMMMMMMMMNDDDDDD8888OOOZZ$$$$Z                
+//               ,MMMMMMMMMMMMMMMMMNNNNNMMMMMMMMMMMMMMMDDDDDDMMMDN8OOOOZZZ++I7               
+//               MMMMMMMMMMMMMMMMMMMNNNNNNNNNNNNNNNNDDDDDDDDMMM88OMMD8OOZZZ$~I               
+//              MMMMMMMMMMMMMMMMMNND8Z7I+=~::::::::~~=?I$O88DDDDD8MMOO8M8OZZ$$$              
+//             MMMMMMMMMMMMMNDOI+:,                         ,~+78O888OMMZDMO$$$$             
+//            MMMMMMMMMMM87=,                                     ,+$8OOOMMZM8$$7            
+//           MMMMMMMMMO?:                                             :IOZO8M7MO77           
+//          MMMMMMMDI,                                                   :7ZZZM7MZ7          
+//         MMMMMMD?,                                                       ,7DZMDMZ7         
+//        :MMMMN?,                                                           ,$$$MMZ,        
+//        MMMM8~                                                               +N$MM7        
+//        MMMZ,                                                                 ~DZMM        
+//        MMD:                                           8""""8 8                1XD         
+//          #2IN                eeeee eeeee eeeeeee eeee 8    " 8               2YE          
+//            1HM               8   8 8  88 8  8  8 8    8e     8e             3ZF           
+//              0GL             8e  8 8   8 8e 8  8 8eee 88  ee 88            4AG            
+//                9FK           88  8 8   8 88 8  8 88   88   8 88           5BH             
+//                  8EJ         88ee8 8eee8 88 8  8 88ee 88eee8 88eee       6CJ              
+//                    7DI                                                7DI                 
+//                       OO?~                                        ,~78D                   
+//                         D8$+:,                             ,~?ZDN                         
+//                             ,NDO$?=::,             ,:~=?$8DM,                             
+//                                       ~7NNNNN8NNNNNZ:                                     
+//                                                                                           
+//                                                                                           
+//                                       Copyright 2011                                      
+//                      Art, Research, Technology and Science Laboratory                     
+//                                 The University of New Mexico                              
+//                                      Project Home Page                                    
+//                           <<<<http://artslab.unm.edu/domegl>>>>>                          
+//                                       Code Repository                                     
+//                           <<<https://svn.cs.unm.edu/domegl>>>>>>                          
+//                                                                                           
+/////////////////////////////////////////////////////////////////////////////////////////////
+
+#ifndef _COLLISION_H
+#define _COLLISION_H
+
+#include <vector>
+#include <Field.h>
+#include <CellList.h>
+#include <ParticleArray.h>
+
+namespace gutz
+{
+   
+   //////////////////////////////////////////////////////////////////////////////////////////
+   /// Soft sphere contact between particles, a short range field
+   ///
+   /// Two particles push apart once they overlap, a spring on the overlap plus a damper on
+   /// the closing speed along the line between them:
+   ///
+   ///    F = (k (r0 + r1 - |d|) - c (v0 - v1).n) n,   n = d / |d|,   d = x0 - x1
+   ///
+   /// Radii come from Particle::getRadius(), or the "radius" column of a ParticleArray.
+   /// Nothing beyond 2 maxRadius is ever touched: ForEachParticlePair visits only the
+   /// neighbors in a CellList, and so does accelerate(), so a step is O(N).
+   ///
+   /// \code
+   /// gutz::CollisionField<particle_type> contact(1e4f, 5.0f, 0.01f);   // k, c, largest radius
+   /// gutz::Simulation<gutz::RK4<Gravity>, gutz::CollisionField<particle_type> > sim(&integrator, &contact);
+   /// \endcode
+   //////////////////////////////////////////////////////////////////////////////////////////
+   template<class PARTICLE>
+   class CollisionField
+   {
+   public:
+      typedef PARTICLE particle_type;
+      typedef typename PARTICLE::vec_type vec_type;
+      typedef typename vec_type::value_type value_type;
+      
+      ///////////////////////////////////////////////////////////////////////////////////////
+      /// Constructor
+      ///
+      /// @param stiffness  spring constant k, N/m
+      /// @param damping    damping c, N s/m
+      /// @param maxRadius  no particle is bigger than this, meters
+      ///////////////////////////////////////////////////////////////////////////////////////
+      CollisionField(value_type stiffness, value_type damping = static_cast<value_type>(0),
+                     value_type maxRadius = static_cast<value_type>(1))
+      : _stiffness(stiffness),
+        _damping  (damping),
+        _maxRadius(maxRadius)
+      {}
+      
+      void setMaxRadius(value_type maxRadius) { _maxRadius = maxRadius; }
+      
+      ///////////////////////////////////////////////////////////////////////////////////////
+      /// @return the distance beyond which particles don't interact
+      ///////////////////////////////////////////////////////////////////////////////////////
+      value_type cutoff(void) const { return static_cast<value_type>(2) * _maxRadius; }
+      
+      ///////////////////////////////////////////////////////////////////////////////////////
+      /// @return the acceleration of p0 from its contact with p1, m/s^2
+      ///////////////////////////////////////////////////////////////////////////////////////
+      vec_type operator()(const particle_type& p0, const particle_type& p1)
+      {
+         const vec_type d = p0.getPosition() - p1.getPosition();
+         const value_type force = contact(d, p0.getVelocity() - p1.getVelocity(), p0.getRadius() + p1.getRadius());
+         if(force == static_cast<value_type>(0)) return vec_type(static_cast<value_type>(0));
+         return d * (force / (d.norm() * p0.getMass()));
+      }
+      
+      ///////////////////////////////////////////////////////////////////////////////////////
+      /// Add every particle's contact acceleration to its acceleration columns, each pair
+      /// once for both particles. No "radius" column, no contacts.
+      ///////////////////////////////////////////////////////////////////////////////////////
+      void accelerate(ParticleArray<vec_type>& particles)
+      {
+         if(!particles.hasColumn("radius")) return;
+         _cells.setCellSize(cutoff());
+         _cells.update(particles);
+         Contact contact = { this, &particles, particles.column("radius"), true };
+         _cells.forEachPair(cutoff(), contact);
+      }
+      
+      ///////////////////////////////////////////////////////////////////////////////////////
+      /// Same for just the particles listed in targets
+      ///////////////////////////////////////////////////////////////////////////////////////
+      void accelerate(ParticleArray<vec_type>& particles, const std::vector<unsigned int>& targets)
+      {
+         if(!particles.hasColumn("radius")) return;
+         _cells.setCellSize(cutoff());
+         _cells.update(particles);
+         Contact contact = { this, &particles, particles.column("radius"), false };
+         for(size_t t = 0; t < targets.size(); ++t) _cells.forEachNeighbor(targets[t], cutoff(), contact);
+      }
+      
+   private:
+      struct Contact;
+      friend struct Contact;
+      
+      ///////////////////////////////////////////////////////////////////////////////////////
+      /// Force along d, positive apart, zero if the spheres don't touch
+      ///////////////////////////////////////////////////////////////////////////////////////
+      value_type contact(const vec_type& d, const vec_type& v, value_type reach) const
+      {
+         const value_type distance = d.norm();
+         const value_type overlap = reach - distance;
+         if(overlap <= static_cast<value_type>(0) || distance <= static_cast<value_type>(0))
+         {
+            return static_cast<value_type>(0);
+         }
+         return _stiffness * overlap - _damping * v.dot(d) / distance;
+      }
+      
+      ///////////////////////////////////////////////////////////////////////////////////////
+      /// CellList visitor, i and j within the cutoff
+      ///////////////////////////////////////////////////////////////////////////////////////
+      struct Contact
+      {
+         CollisionField*          field;
+         ParticleArray<vec_type>* particles;
+         const value_type*        radius;
+         bool                     both;     //< Newton's third law, j gets the reaction
+         
+         void operator()(size_t i, size_t j)
+         {
+            const vec_type d = particles->getPosition(i) - particles->getPosition(j);
+            const value_type force = field->contact(d, particles->getVelocity(i) - particles->getVelocity(j), radius[i] + radius[j]);
+            if(force == static_cast<value_type>(0)) return;
+            const vec_type push = d * (force / d.norm());
+            const value_type* m = particles->mass();
+            particles->setAcceleration(i, particles->getAcceleration(i) + push / m[i]);
+            if(both) particles->setAcceleration(j, particles->getAcceleration(j) - push / m[j]);
+         }
+      };
+      
+      value_type         _stiffness;
+      value_type         _damping;
+      value_type         _maxRadius;
+      CellList<vec_type> _cells;      //< For accelerate(), kept so updates are incremental
+   };
+   
+   //////////////////////////////////////////////////////////////////////////////////////////
+   /// Contacts only happen within the cutoff, visit the neighbors alone
+   //////////////////////////////////////////////////////////////////////////////////////////
+   template<class PARTICLE>
+   class ForEachParticlePair< CollisionField<PARTICLE>, false >
+   : public ForEachNeighborPair< CollisionField<PARTICLE> >
+   {
+   };
+   
+   template<class PARTICLE>
+   struct IsBulkField< CollisionField<PARTICLE> >
+   {
+      enum { value = true };
+   };
+}
+
+#endif
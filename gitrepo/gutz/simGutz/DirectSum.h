@@ -0,0 +1,463 @@
+/////////////////////////////////////////////////////////////////////////////////////////////
+//                                                                                           
+//                                          8MMNMM8                                          
+//                                     $MMMMMMMMMMMNMMNNNNN:                                 
+//                             7MMMMMMMMMMMMMNNNMNNNNNNNMNDDDDD7                             
+//                            MMMMMMMMMMMMMMNNNNNNNNNNNNNND8DD888                            
+//                          ZMMMMMMMMMMMMMMMMNNNNNNNNNNNNNNNNDDD8888:                        
+//                       8MMMMMMMMMMMMMMMMMMMNNNNNNNNNNNNNNNNDDD88888=                       
+//                     MMMMMMMMMMMMMMMMMMMMMMMNNNMNNNNNNNNNNNNNDD88888O8                     
+//                   MMMMMMMMMMMMMMMMNNNNNNNNNNNDDDDDDDDDDNNDNNNDD888888O8                   
+//                  MMMMMMMMMMMMMMMNNNNNNNNNNNNDDDDDDDDDDDDDDD888ND88888OO8                  
+//                 MMMMMMMMMMMMMMMNNNNNNNNNNNNNNDDDDDDDDDDDDDDD888OO8DDOOZZZ                 
+//                MMMMMMMMMMMMMMMNMMMMMMMMMMMMMMMMMMMMMMNDDDDDD8888OOOZZ$$$$Z                
+//               ,MMMMMMMMMMMMMMMMMNNNNNMMMMMMMMMMMMMMMDDDDDDMMMDN8OOOOZZZ++I7               
+//               MMMMMMMMMMMMMMMMMMMNNNNNNNNNNNNNNNNDDDDDDDDMMM88OMMD8OOZZZ$~I               
+//              MMMMMMMMMMMMMMMMMNND8Z7I+=~::::::::~~=?I$O88DDDDD8MMOO8M8OZZ$$$              
+//             MMMMMMMMMMMMMNDOI+:,                         ,~+78O888OMMZDMO$$$$             
+//            MMMMMMMMMMM87=,                                     ,+$8OOOMMZM8$$7            
+//           MMMMMMMMMO?:                                             :IOZO8M7MO77           
+//          MMMMMMMDI,                                                   :7ZZZM7MZ7          
+//         MMMMMMD?,                                                       ,7DZMDMZ7         
+//        :MMMMN?,                                                           ,$$$MMZ,        
+//        MMMM8~                                                               +N$MM7        
+//        MMMZ,                                                                 ~DZMM        
+//        MMD:                                           8""""8 8                1XD         
+//          #2IN                eeeee eeeee eeeeeee eeee 8    " 8               2YE          
+//            1HM               8   8 8  88 8  8  8 8    8e     8e             3ZF           
+//              0GL             8e  8 8   8 8e 8  8 8eee 88  ee 88            4AG            
+//                9FK           88  8 8   8 88 8  8 88   88   8 88           5BH             
+//                  8EJ         88ee8 8eee8 88 8  8 88ee 88eee8 88eee       6CJ              
+//                    7DI                                                7DI                 
+//                       OO?~                                        ,~78D                   
+//                         D8$+:,                             ,~?ZDN                         
+//                             ,NDO$?=::,             ,:~=?$8DM,                             
+//                                       ~7NNNNN8NNNNNZ:                                     
+//                                                                                           
+//                                                                                           
+//                                       Copyright 2011                                      
+//                      Art, Research, Technology and Science Laboratory                     
+//                                 The University of New Mexico                              
+//                                      Project Home Page                                    
+//                           <<<<http://artslab.unm.edu/domegl>>>>>                          
+//                                       Code Repository                                     
+//                           <<<https://svn.cs.unm.edu/domegl>>>>>>                          
+//                                                                                           
+/////////////////////////////////////////////////////////////////////////////////////////////
+
+#ifndef _DIRECT_SUM_H
+#define _DIRECT_SUM_H
+
+#include <vector>
+#include <iterator>
+#include <math.h>
+#include <Field.h>
+#include <ParticleArray.h>
+
+#if defined(__AVX512F__) || defined(__AVX2__)
+#  include <immintrin.h>
+#endif
+
+namespace gutz
+{
+   
+   //////////////////////////////////////////////////////////////////////////////////////////
+   /// SIMD packs for the direct sum kernel
+   ///
+   /// Pack<T> holds as many T as the widest instruction set the compiler was told about:
+   /// AVX-512 (-mavx512f), then AVX2 with FMA (-mavx2 -mfma), else one T. rsqrt() is the
+   /// hardware estimate refined by Newton's method to about full precision, except for
+   /// double under AVX2 which has no estimate of its own. positive(x, y) is y where x > 0
+   /// and 0 elsewhere.
+   //////////////////////////////////////////////////////////////////////////////////////////
+   namespace simd
+   {
+      template<typename T>
+      struct Pack
+      {
+         typedef T type;
+         enum { width = 1 };
+         
+         static type load(const T* p)                            { return *p; }
+         static void store(T* p, type v)                         { *p = v; }
+         static type set1(T x)                                   { return x; }
+         static type add(type a, type b)                         { return a + b; }
+         static type sub(type a, type b)                         { return a - b; }
+         static type mul(type a, type b)                         { return a * b; }
+         static type fmadd(type a, type b, type c)               { return a * b + c; }
+         static type rsqrt(type x)                               { return static_cast<T>(1) / static_cast<T>(sqrt(x)); }
+         static type positive(type x, type y)                    { return x > static_cast<T>(0) ? y : static_cast<T>(0); }
+         static T    sum(type v)                                 { return v; }
+      };
+      
+#if defined(__AVX512F__)
+      template<>
+      struct Pack<float>
+      {
+         typedef __m512 type;
+         enum { width = 16 };
+         
+         static type load(const float* p)                        { return _mm512_loadu_ps(p); }
+         static void store(float* p, type v)                     { _mm512_storeu_ps(p, v); }
+         static type set1(float x)                               { return _mm512_set1_ps(x); }
+         static type add(type a, type b)                         { return _mm512_add_ps(a, b); }
+         static type sub(type a, type b)                         { return _mm512_sub_ps(a, b); }
+         static type mul(type a, type b)                         { return _mm512_mul_ps(a, b); }
+         static type fmadd(type a, type b, type c)               { return _mm512_fmadd_ps(a, b, c); }
+         static float sum(type v)                                { return _mm512_reduce_add_ps(v); }
+         
+         static type positive(type x, type y)
+         {
+            return _mm512_maskz_mov_ps(_mm512_cmp_ps_mask(x, _mm512_setzero_ps(), _CMP_GT_OQ), y);
+         }
+         
+         // 14 bit estimate, one Newton step
+         static type rsqrt(type x)
+         {
+            const type y = _mm512_maskz_rsqrt14_ps(0xFFFF, x);  // unmasked form warns on gcc 12
+            return newton(x, y);
+         }
+         
+         static type newton(type x, type y)
+         {
+            // y (1.5 - 0.5 x y^2)
+            const type hx = _mm512_mul_ps(x, _mm512_set1_ps(0.5f));
+            return _mm512_mul_ps(y, _mm512_fnmadd_ps(hx, _mm512_mul_ps(y, y), _mm512_set1_ps(1.5f)));
+         }
+      };
+      
+      template<>
+      struct Pack<double>
+      {
+         typedef __m512d type;
+         enum { width = 8 };
+         
+         static type load(const double* p)                       { return _mm512_loadu_pd(p); }
+         static void store(double* p, type v)                    { _mm512_storeu_pd(p, v); }
+         static type set1(double x)                              { return _mm512_set1_pd(x); }
+         static type add(type a, type b)                         { return _mm512_add_pd(a, b); }
+         static type sub(type a, type b)                         { return _mm512_sub_pd(a, b); }
+         static type mul(type a, type b)                         { return _mm512_mul_pd(a, b); }
+         static type fmadd(type a, type b, type c)               { return _mm512_fmadd_pd(a, b, c); }
+         static double sum(type v)                               { return _mm512_reduce_add_pd(v); }
+         
+         static type positive(type x, type y)
+         {
+            return _mm512_maskz_mov_pd(_mm512_cmp_pd_mask(x, _mm512_setzero_pd(), _CMP_GT_OQ), y);
+         }
+         
+         // 14 bit estimate, two Newton steps
+         static type rsqrt(type x)
+         {
+            type y = _mm512_maskz_rsqrt14_pd(0xFF, x);
+            y = newton(x, y);
+            return newton(x, y);
+         }
+         
+         static type newton(type x, type y)
+         {
+            const type hx = _mm512_mul_pd(x, _mm512_set1_pd(0.5));
+            return _mm512_mul_pd(y, _mm512_fnmadd_pd(hx, _mm512_mul_pd(y, y), _mm512_set1_pd(1.5)));
+         }
+      };
+#elif defined(__AVX2__) && defined(__FMA__)
+      template<>
+      struct Pack<float>
+      {
+         typedef __m256 type;
+         enum { width = 8 };
+         
+         static type load(const float* p)                        { return _mm256_loadu_ps(p); }
+         static void store(float* p, type v)                     { _mm256_storeu_ps(p, v); }
+         static type set1(float x)                               { return _mm256_set1_ps(x); }
+         static type add(type a, type b)                         { return _mm256_add_ps(a, b); }
+         static type sub(type a, type b)                         { return _mm256_sub_ps(a, b); }
+         static type mul(type a, type b)                         { return _mm256_mul_ps(a, b); }
+         static type fmadd(type a, type b, type c)               { return _mm256_fmadd_ps(a, b, c); }
+         
+         static float sum(type v)
+         {
+            __m128 s = _mm_add_ps(_mm256_castps256_ps128(v), _mm256_extractf128_ps(v, 1));
+            s = _mm_add_ps(s, _mm_movehl_ps(s, s));
+            s = _mm_add_ss(s, _mm_shuffle_ps(s, s, 1));
+            return _mm_cvtss_f32(s);
+         }
+         
+         static type positive(type x, type y)
+         {
+            return _mm256_and_ps(_mm256_cmp_ps(x, _mm256_setzero_ps(), _CMP_GT_OQ), y);
+         }
+         
+         // 12 bit estimate, one Newton step
+         static type rsqrt(type x)
+         {
+            const type y = _mm256_rsqrt_ps(x);
+            return newton(x, y);
+         }
+         
+         static type newton(type x, type y)
+         {
+            const type hx = _mm256_mul_ps(x, _mm256_set1_ps(0.5f));
+            return _mm256_mul_ps(y, _mm256_fnmadd_ps(hx, _mm256_mul_ps(y, y), _mm256_set1_ps(1.5f)));
+         }
+      };
+      
+      template<>
+      struct Pack<double>
+      {
+         typedef __m256d type;
+         enum { width = 4 };
+         
+         static type load(const double* p)                       { return _mm256_loadu_pd(p); }
+         static void store(double* p, type v)                    { _mm256_storeu_pd(p, v); }
+         static type set1(double x)                              { return _mm256_set1_pd(x); }
+         static type add(type a, type b)                         { return _mm256_add_pd(a, b); }
+         static type sub(type a, type b)                         { return _mm256_sub_pd(a, b); }
+         static type mul(type a, type b)                         { return _mm256_mul_pd(a, b); }
+         static type fmadd(type a, type b, type c)               { return _mm256_fmadd_pd(a, b, c); }
+         
+         static double sum(type v)
+         {
+            __m128d s = _mm_add_pd(_mm256_castpd256_pd128(v), _mm256_extractf128_pd(v, 1));
+            return _mm_cvtsd_f64(_mm_add_sd(s, _mm_unpackhi_pd(s, s)));
+         }
+         
+         static type positive(type x, type y)
+         {
+            return _mm256_and_pd(_mm256_cmp_pd(x, _mm256_setzero_pd(), _CMP_GT_OQ), y);
+         }
+         
+         // No double estimate in AVX2, and the float one overflows or underflows outside
+         // float's range: a real square root and a divide
+         static type rsqrt(type x)
+         {
+            return _mm256_div_pd(_mm256_set1_pd(1.0), _mm256_sqrt_pd(x));
+         }
+      };
+#endif
+   }
+   
+   //////////////////////////////////////////////////////////////////////////////////////////
+   /// Vectorized all-pairs Newtonian gravity
+   ///
+   /// For N where the direct sum is still the right tool. The particles are cut into
+   /// tiles of TILE that fit in L1, each pair of tiles is visited once and every
+   /// interaction updates both particles (Newton's third law), half the work of the
+   /// P2PField loop. The inner loop runs over simd::Pack lanes with a refined rsqrt.
+   ///
+   /// Plummer softening: a_i = G sum m_j d / (|d|^2 + eps^2)^(3/2). It keeps close
+   /// encounters finite. Without it (the default) particles on top of each other add
+   /// nothing to each other, as in P2PField. Works for vec3f and vec3d particles.
+   ///
+   /// \code
+   /// gutz::DirectSumField<particle_type> nbody(1e-3f);   // eps, meters
+   /// gutz::Simulation<gutz::RK4<MyField>, gutz::DirectSumField<particle_type> > sim(&integrator, &nbody);
+   /// \endcode
+   //////////////////////////////////////////////////////////////////////////////////////////
+   template<class PARTICLE>
+   class DirectSumField
+   {
+   public:
+      typedef PARTICLE particle_type;
+      typedef typename PARTICLE::vec_type vec_type;
+      typedef typename vec_type::value_type value_type;
+      typedef simd::Pack<value_type> pack;
+      typedef typename pack::type pack_type;
+      
+      enum { TILE = 512 };  //< Particles per tile, 7 columns: 14k in float, 28k in double
+      
+      ///////////////////////////////////////////////////////////////////////////////////////
+      /// Constructor
+      ///
+      /// @param softening
+      ///   Plummer softening length eps, meters
+      ///////////////////////////////////////////////////////////////////////////////////////
+      DirectSumField(value_type softening = static_cast<value_type>(0))
+      : _G       (static_cast<value_type>(6.67e-11)),
+        _eps2    (softening * softening)
+      {}
+      
+      void setSoftening(value_type softening) { _eps2 = softening * softening; }
+      
+      ///////////////////////////////////////////////////////////////////////////////////////
+      /// Add every particle's acceleration to its acceleration columns
+      ///////////////////////////////////////////////////////////////////////////////////////
+      void accelerate(ParticleArray<vec_type>& particles)
+      {
+         compute(particles.position(0), particles.position(1), particles.position(2), particles.mass(), particles.size());
+         for(int d = 0; d < 3; ++d)
+         {
+            value_type* a = particles.acceleration(d);
+            for(size_t i = 0; i < particles.size(); ++i) a[i] += _a[d][i];
+         }
+      }
+      
+      ///////////////////////////////////////////////////////////////////////////////////////
+      /// Same for just the particles listed in targets. The tiles pay off over the whole
+      /// array, so this does all of the pairs anyway.
+      ///////////////////////////////////////////////////////////////////////////////////////
+      void accelerate(ParticleArray<vec_type>& particles, const std::vector<unsigned int>& targets)
+      {
+         compute(particles.position(0), particles.position(1), particles.position(2), particles.mass(), particles.size());
+         for(size_t t = 0; t < targets.size(); ++t)
+         {
+            const size_t i = targets[t];
+            particles.setAcceleration(i, particles.getAcceleration(i) + acceleration(i));
+         }
+      }
+      
+      ///////////////////////////////////////////////////////////////////////////////////////
+      /// Compute the accelerations of the particles in [begin, end), acceleration() returns
+      /// them
+      ///////////////////////////////////////////////////////////////////////////////////////
+      template<typename p_iterator_type>
+      void build(const p_iterator_type& begin, const p_iterator_type& end)
+      {
+         for(int d = 0; d < 3; ++d) _x[d].clear();
+         _m.clear();
+         for(p_iterator_type i = begin; i != end; ++i)
+         {
+            const vec_type position = (*i).getPosition();
+            for(int d = 0; d < 3; ++d) _x[d].push_back(position[d]);
+            _m.push_back((*i).getMass());
+         }
+         if(_m.empty())
+         {
+            for(int d = 0; d < 3; ++d) _a[d].clear();
+            return;
+         }
+         compute(&_x[0][0], &_x[1][0], &_x[2][0], &_m[0], _m.size());
+      }
+      
+      ///////////////////////////////////////////////////////////////////////////////////////
+      /// Acceleration of the i'th particle given to build(). Units: m/s^2
+      ///////////////////////////////////////////////////////////////////////////////////////
+      vec_type acceleration(size_t i) const
+      {
+         return vec_type(_a[0][i], _a[1][i], _a[2][i]);
+      }
+      
+   private:
+      ///////////////////////////////////////////////////////////////////////////////////////
+      /// _a = G sum over pairs, from position and mass columns of n particles
+      ///////////////////////////////////////////////////////////////////////////////////////
+      void compute(const value_type* x, const value_type* y, const value_type* z, const value_type* m, size_t n)
+      {
+         for(int d = 0; d < 3; ++d) _a[d].assign(n, static_cast<value_type>(0));
+         if(n == 0) return;
+         value_type* ax = &_a[0][0];
+         value_type* ay = &_a[1][0];
+         value_type* az = &_a[2][0];
+         
+         for(size_t i0 = 0; i0 < n; i0 += TILE)
+         {
+            const size_t i1 = i0 + TILE < n ? i0 + TILE : n;
+            diagonal(x, y, z, m, ax, ay, az, i0, i1);
+            for(size_t j0 = i1; j0 < n; j0 += TILE)
+            {
+               const size_t j1 = j0 + TILE < n ? j0 + TILE : n;
+               tiles(x, y, z, m, ax, ay, az, i0, i1, j0, j1);
+            }
+         }
+         
+         for(int d = 0; d < 3; ++d)
+         {
+            for(size_t i = 0; i < n; ++i) _a[d][i] *= _G;
+         }
+      }
+      
+      ///////////////////////////////////////////////////////////////////////////////////////
+      /// Every i in [i0, i1) with every j in [j0, j1), both ways. The j's go through the
+      /// packs, what is left over at the end of the range one at a time.
+      ///////////////////////////////////////////////////////////////////////////////////////
+      void tiles(const value_type* x, const value_type* y, const value_type* z, const value_type* m,
+                 value_type* ax, value_type* ay, value_type* az,
+                 size_t i0, size_t i1, size_t j0, size_t j1) const
+      {
+         const size_t packed = j0 + (j1 - j0) / pack::width * pack::width;
+         const pack_type eps2 = pack::set1(_eps2);
+         for(size_t i = i0; i < i1; ++i)
+         {
+            const pack_type xi = pack::set1(x[i]), yi = pack::set1(y[i]), zi = pack::set1(z[i]);
+            const pack_type mi = pack::set1(m[i]);
+            pack_type sx = pack::set1(0), sy = pack::set1(0), sz = pack::set1(0);
+            for(size_t j = j0; j < packed; j += pack::width)
+            {
+               const pack_type dx = pack::sub(pack::load(x + j), xi);
+               const pack_type dy = pack::sub(pack::load(y + j), yi);
+               const pack_type dz = pack::sub(pack::load(z + j), zi);
+               const pack_type r2 = pack::fmadd(dx, dx, pack::fmadd(dy, dy, pack::fmadd(dz, dz, eps2)));
+               const pack_type inv = pack::positive(r2, pack::rsqrt(r2));
+               const pack_type inv3 = pack::mul(inv, pack::mul(inv, inv));
+               
+               // i pulled towards j by m_j, j towards i by m_i
+               const pack_type fi = pack::mul(pack::load(m + j), inv3);
+               sx = pack::fmadd(fi, dx, sx);
+               sy = pack::fmadd(fi, dy, sy);
+               sz = pack::fmadd(fi, dz, sz);
+               const pack_type fj = pack::mul(mi, inv3);
+               pack::store(ax + j, pack::sub(pack::load(ax + j), pack::mul(fj, dx)));
+               pack::store(ay + j, pack::sub(pack::load(ay + j), pack::mul(fj, dy)));
+               pack::store(az + j, pack::sub(pack::load(az + j), pack::mul(fj, dz)));
+            }
+            ax[i] += pack::sum(sx);
+            ay[i] += pack::sum(sy);
+            az[i] += pack::sum(sz);
+            for(size_t j = packed; j < j1; ++j) pair(x, y, z, m, ax, ay, az, i, j);
+         }
+      }
+      
+      ///////////////////////////////////////////////////////////////////////////////////////
+      /// The pairs inside one tile, j > i
+      ///////////////////////////////////////////////////////////////////////////////////////
+      void diagonal(const value_type* x, const value_type* y, const value_type* z, const value_type* m,
+                    value_type* ax, value_type* ay, value_type* az, size_t i0, size_t i1) const
+      {
+         for(size_t i = i0; i < i1; ++i)
+         {
+            // Same as a tile pair against the rest of the tile
+            if(i + 1 < i1) tiles(x, y, z, m, ax, ay, az, i, i + 1, i + 1, i1);
+         }
+      }
+      
+      void pair(const value_type* x, const value_type* y, const value_type* z, const value_type* m,
+                value_type* ax, value_type* ay, value_type* az, size_t i, size_t j) const
+      {
+         const value_type dx = x[j] - x[i], dy = y[j] - y[i], dz = z[j] - z[i];
+         const value_type r2 = dx * dx + dy * dy + dz * dz + _eps2;
+         if(!(r2 > static_cast<value_type>(0))) return;
+         const value_type inv = static_cast<value_type>(1) / static_cast<value_type>(sqrt(r2));
+         const value_type inv3 = inv * inv * inv;
+         ax[i] += m[j] * inv3 * dx;
+         ay[i] += m[j] * inv3 * dy;
+         az[i] += m[j] * inv3 * dz;
+         ax[j] -= m[i] * inv3 * dx;
+         ay[j] -= m[i] * inv3 * dy;
+         az[j] -= m[i] * inv3 * dz;
+      }
+      
+      /// Gravitational constant, m^3 / (kg s^2)
+      value_type              _G;
+      value_type              _eps2;   //< Softening length squared
+      std::vector<value_type> _x[3];   //< Positions given to build()
+      std::vector<value_type> _m;
+      std::vector<value_type> _a[3];   //< Results
+   };
+   
+   //////////////////////////////////////////////////////////////////////////////////////////
+   /// prepare() runs the kernel for the step, each particle then picks up its result
+   //////////////////////////////////////////////////////////////////////////////////////////
+   template<class PARTICLE>
+   struct IsPrebuiltField< DirectSumField<PARTICLE> >
+   {
+      enum { value = true };
+   };
+   
+   template<class PARTICLE>
+   struct IsBulkField< DirectSumField<PARTICLE> >
+   {
+      enum { value = true };
+   };
+}
+
+#endif
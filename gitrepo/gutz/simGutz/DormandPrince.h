@@ -0,0 +1,290 @@
+/////////////////////////////////////////////////////////////////////////////////////////////
+//                                                                                           
+//                                          8MMNMM8                                          
+//                                     $MMMMMMMMMMMNMMNNNNN:                                 
+//                             7MMMMMMMMMMMMMNNNMNNNNNNNMNDDDDD7                             
+//                            MMMMMMMMMMMMMMNNNNNNNNNNNNNND8DD888                            
+//                          ZMMMMMMMMMMMMMMMMNNNNNNNNNNNNNNNNDDD8888:                        
+//                       8MMMMMMMMMMMMMMMMMMMNNNNNNNNNNNNNNNNDDD88888=                       
+//                     MMMMMMMMMMMMMMMMMMMMMMMNNNMNNNNNNNNNNNNNDD88888O8                     
+//                   MMMMMMMMMMMMMMMMNNNNNNNNNNNDDDDDDDDDDNNDNNNDD888888O8                   
+//                  MMMMMMMMMMMMMMMNNNNNNNNNNNNDDDDDDDDDDDDDDD888ND88888OO8                  
+//                 MMMMMMMMMMMMMMMNNNNNNNNNNNNNNDDDDDDDDDDDDDDD888OO8DDOOZZZ                 
+//                MMMMMMMMMMMMMMMNMMMMMMMMMMMMMMMMMMMMMMNDDDDDD8888OOOZZ$$$$Z                
+//               ,MMMMMMMMMMMMMMMMMNNNNNMMMMMMMMMMMMMMMDDDDDDMMMDN8OOOOZZZ++I7               
+//               MMMMMMMMMMMMMMMMMMMNNNNNNNNNNNNNNNNDDDDDDDDMMM88OMMD8OOZZZ$~I               
+//              MMMMMMMMMMMMMMMMMNND8Z7I+=~::::::::~~=?I$O88DDDDD8MMOO8M8OZZ$$$              
+//             MMMMMMMMMMMMMNDOI+:,                         ,~+78O888OMMZDMO$$$$             
+//            MMMMMMMMMMM87=,                                     ,+$8OOOMMZM8$$7            
+//           MMMMMMMMMO?:                                             :IOZO8M7MO77           
+//          MMMMMMMDI,                                                   :7ZZZM7MZ7          
+//         MMMMMMD?,                                                       ,7DZMDMZ7         
+//        :MMMMN?,                                                           ,$$$MMZ,        
+//        MMMM8~                                                               +N$MM7        
+//        MMMZ,                                                                 ~DZMM        
+//        MMD:                                           8""""8 8                1XD         
+//          #2IN                eeeee eeeee eeeeeee eeee 8    " 8               2YE          
+//            1HM               8   8 8  88 8  8  8 8    8e     8e             3ZF           
+//              0GL             8e  8 8   8 8e 8  8 8eee 88  ee 88            4AG            
+//                9FK           88  8 8   8 88 8  8 88   88   8 88           5BH             
+//                  8EJ         88ee8 8eee8 88 8  8 88ee 88eee8 88eee       6CJ              
+//                    7DI                                                7DI                 
+//                       OO?~                                        ,~78D                   
+//                         D8$+:,                             ,~?ZDN                         
+//                             ,NDO$?=::,             ,:~=?$8DM,                             
+//                                       ~7NNNNN8NNNNNZ:                                     
+//                                                                                           
+//                                                                                           
+//                                       Copyright 2011                                      
+//                      Art, Research, Technology and Science Laboratory                     
+//                                 The University of New Mexico                              
+//                                      Project Home Page                                    
+//                           <<<<http://artslab.unm.edu/domegl>>>>>                          
+//                                       Code Repository                                     
+//                           <<<https://svn.cs.unm.edu/domegl>>>>>>                          
+//                                                                                           
+/////////////////////////////////////////////////////////////////////////////////////////////
+
+#ifndef _DORMAND_PRINCE_H
+#define _DORMAND_PRINCE_H
+
+#include <vector>
+#include <math.h>
+#include <vec.h>
+#include <ParticleArray.h>
+#include <Field.h>
+
+namespace gutz
+{
+   
+   //////////////////////////////////////////////////////////////////////////////////////////
+   /// Adaptive Runge-Kutta, Dormand-Prince 5(4)
+   ///
+   /// Each step carries a fifth order solution and a fourth order one along with it, their
+   /// difference is the error estimate. operator() covers the dt it is given with as many
+   /// substeps as the tolerance needs, growing or shrinking them as it goes, so the caller
+   /// keeps its fixed frame rate while the integrator takes small steps only through the
+   /// hard parts. Seven field evaluations per substep, six once the last one is reused.
+   ///
+   /// A component passes when its error is below absolute + relative * |value|, positions
+   /// and velocities alike. On a ParticleArray all particles share the substeps, the worst
+   /// one decides, and the last substep size is remembered for the next call; one particle
+   /// at a time each starts again from dt, with scratch of its own so several threads can
+   /// share the integrator. See BlockTimestep for per particle steps.
+   ///
+   /// J. R. Dormand, P. J. Prince, A family of embedded Runge-Kutta formulae, J. Comp. Appl.
+   /// Math. 6 (1980) 19.
+   ///
+   /// Same interface as RK4, see Integrator.h.
+   //////////////////////////////////////////////////////////////////////////////////////////
+   template <class FIELD>
+   class DormandPrince
+   {
+   public:
+      typedef FIELD field_type;
+      typedef typename FIELD::particle_type      particle_type;
+      typedef typename particle_type::value_type value_type;
+      typedef typename particle_type::vec_type   vec_type;
+      
+      enum { MAX_SUBSTEPS = 100000 };  //< Per call, past this the rest of dt is one step whatever the error
+      
+      /// Constructor
+      DormandPrince(field_type* field, value_type relative = static_cast<value_type>(1e-6),
+                    value_type absolute = static_cast<value_type>(1e-6))
+      :  _field      (field),
+         _relative   (relative),
+         _absolute   (absolute),
+         _h          (0)
+      {}
+      
+      void setTolerance(value_type relative, value_type absolute)
+      {
+         _relative = relative;
+         _absolute = absolute;
+      }
+      
+      /// Substeps taken by the last ParticleArray call, rejected ones included
+      int getSubsteps(void) const { return _scratch.substeps; }
+      
+      /////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+      /// Integration step
+      ///
+      /// @params state    the current state for a particle
+      ///         t        the current time
+      ///         dt       size of the time step
+      particle_type operator()(const particle_type& state, value_type t, value_type dt)
+      {
+         // Called from every thread of a Simulation at once, nothing here touches the members
+         Scratch scratch;
+         ParticleArray<vec_type> one;
+         one.push_back(state);
+         value_type h = dt;
+         integrate(one, dt, h, scratch);
+         particle_type p(state);
+         p.setPosition(one.getPosition(0));
+         p.setVelocity(one.getVelocity(0));
+         return p;
+      }
+      
+      /////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+      /// Integrate every particle of a ParticleArray in place. Only the position and velocity columns change.
+      ///
+      /// @params particles   the particles
+      ///         t           the current time
+      ///         dt          size of the time step
+      void operator()(ParticleArray<vec_type>& particles, value_type t, value_type dt)
+      {
+         if(_h <= static_cast<value_type>(0)) _h = dt;
+         integrate(particles, dt, _h, _scratch);
+      }
+      
+   protected:
+      static const int dimension = vec_type::size;
+      static const int columns = 2 * dimension;  // dx then dv
+      
+      /// What a call works in
+      struct Scratch
+      {
+         Scratch() : substeps(0) {}
+         
+         int                     substeps;
+         ParticleArray<vec_type> stage;       //< The state at the current stage
+         std::vector<value_type> k[7][2 * vec_type::size];  //< Derivative at each stage by column
+      };
+      
+      /////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+      /// Advance particles by dt in substeps starting from h, h is left at the next proposed size
+      void integrate(ParticleArray<vec_type>& particles, value_type dt, value_type& h, Scratch& scratch)
+      {
+         // The Butcher tableau, row s gives stage s from the earlier ones. Row 6 is the fifth
+         // order solution, e the fifth minus the fourth order weights.
+         static const double a[7][6] = {
+            { 0 },
+            { 1.0 / 5 },
+            { 3.0 / 40, 9.0 / 40 },
+            { 44.0 / 45, -56.0 / 15, 32.0 / 9 },
+            { 19372.0 / 6561, -25360.0 / 2187, 64448.0 / 6561, -212.0 / 729 },
+            { 9017.0 / 3168, -355.0 / 33, 46732.0 / 5247, 49.0 / 176, -5103.0 / 18656 },
+            { 35.0 / 384, 0, 500.0 / 1113, 125.0 / 192, -2187.0 / 6784, 11.0 / 84 } };
+         static const double e[7] = { 71.0 / 57600, 0, -71.0 / 16695, 71.0 / 1920, -17253.0 / 339200, 22.0 / 525, -1.0 / 40 };
+         
+         const size_t n = particles.size();
+         scratch.substeps = 0;
+         if(n == 0 || dt <= static_cast<value_type>(0)) return;
+         for(int s = 0; s < 7; ++s)
+         {
+            for(int c = 0; c < columns; ++c) scratch.k[s][c].resize(n);
+         }
+         ParticleArray<vec_type>& stage = scratch.stage;
+         
+         value_type remaining = dt;
+         bool haveFirst = false;  // First same as last: an accepted step's k[6] is the next k[0]
+         while(remaining > static_cast<value_type>(0))
+         {
+            const bool forced = ++scratch.substeps > MAX_SUBSTEPS;
+            const bool last = forced || h >= remaining;
+            const value_type step = last ? remaining : h;
+            
+            if(!haveFirst)
+            {
+               evaluate(particles, 0, scratch);
+               haveFirst = true;
+            }
+            for(int s = 1; s < 7; ++s)
+            {
+               // Stage s starts from the state at the beginning of the substep
+               for(int d = 0; d < dimension; ++d)
+               {
+                  stageColumn(particles.position(d), stage.position(d), a[s], s, d, step, n, scratch);
+                  stageColumn(particles.velocity(d), stage.velocity(d), a[s], s, dimension + d, step, n, scratch);
+               }
+               evaluate(stage, s, scratch);
+            }
+            
+            // Stage 6 is the fifth order solution, the error is step * sum e k
+            double error = 0;
+            for(int d = 0; d < dimension; ++d)
+            {
+               error = worst(error, particles.position(d), stage.position(d), d, step, e, n, scratch);
+               error = worst(error, particles.velocity(d), stage.velocity(d), dimension + d, step, e, n, scratch);
+            }
+            
+            if(error <= 1.0 || forced)
+            {
+               for(int d = 0; d < dimension; ++d)
+               {
+                  copy(stage.position(d), particles.position(d), n);
+                  copy(stage.velocity(d), particles.velocity(d), n);
+               }
+               for(int c = 0; c < columns; ++c) scratch.k[0][c].swap(scratch.k[6][c]);
+               remaining = last ? static_cast<value_type>(0) : remaining - step;
+               if(last && step < h) break;  // Cut short by the end of dt, h still fits
+            }
+            
+            // The usual controller, 0.9 (1 / error)^(1/5), kept within a factor of five
+            double scale = error > 0 ? 0.9 * pow(error, -0.2) : 5.0;
+            scale = scale < 0.2 ? 0.2 : (scale > 5.0 ? 5.0 : scale);
+            h = static_cast<value_type>(step * scale);
+         }
+      }
+      
+      /////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+      /// k[s] at state, which is the scratch stage itself or gets copied there
+      void evaluate(ParticleArray<vec_type>& state, int s, Scratch& scratch)
+      {
+         ParticleArray<vec_type>& stage = scratch.stage;
+         if(&state != &stage) stage = state;
+         stage.clearAcceleration();
+         ForEachParticle<field_type> forEach;
+         forEach(stage, *_field);
+         const size_t n = stage.size();
+         for(int d = 0; d < dimension; ++d)
+         {
+            copy(stage.velocity(d), &scratch.k[s][d][0], n);
+            copy(stage.acceleration(d), &scratch.k[s][dimension + d][0], n);
+         }
+      }
+      
+      /// out = y0 + step * sum of row[j] k[j] over the first s stages, for column c
+      static void stageColumn(const value_type* y0, value_type* out, const double row[], int s, int c, value_type step,
+                              size_t n, const Scratch& scratch)
+      {
+         for(size_t i = 0; i < n; ++i)
+         {
+            double sum = 0;
+            for(int j = 0; j < s; ++j) sum += row[j] * scratch.k[j][c][i];
+            out[i] = static_cast<value_type>(y0[i] + step * sum);
+         }
+      }
+      
+      /// Largest of error and the scaled error of column c
+      double worst(double error, const value_type* y0, const value_type* y1, int c, value_type step, const double e[],
+                   size_t n, const Scratch& scratch) const
+      {
+         for(size_t i = 0; i < n; ++i)
+         {
+            double sum = 0;
+            for(int j = 0; j < 7; ++j) sum += e[j] * scratch.k[j][c][i];
+            const double size = fabs(y0[i]) > fabs(y1[i]) ? fabs(y0[i]) : fabs(y1[i]);
+            const double scaled = fabs(step * sum) / (_absolute + _relative * size);
+            if(scaled > error) error = scaled;
+         }
+         return error;
+      }
+      
+      static void copy(const value_type* from, value_type* to, size_t n)
+      {
+         for(size_t i = 0; i < n; ++i) to[i] = from[i];
+      }
+      
+   private:
+      field_type*             _field;          //< Force field
+      value_type              _relative;
+      value_type              _absolute;
+      value_type              _h;              //< Next substep for the ParticleArray form
+      Scratch                 _scratch;        //< For the ParticleArray form only
+   };
+   
+}
+
+#endif
@@ -0,0 +1,769 @@
+/////////////////////////////////////////////////////////////////////////////////////////////
+//                                                                                           
+//                                          8MMNMM8                                          
+//                                     $MMMMMMMMMMMNMMNNNNN:                                 
+//                             7MMMMMMMMMMMMMNNNMNNNNNNNMNDDDDD7                             
+//                            MMMMMMMMMMMMMMNNNNNNNNNNNNNND8DD888                            
+//                          ZMMMMMMMMMMMMMMMMNNNNNNNNNNNNNNNNDDD8888:                        
+//                       8MMMMMMMMMMMMMMMMMMMNNNNNNNNNNNNNNNNDDD88888=                       
+//                     MMMMMMMMMMMMMMMMMMMMMMMNNNMNNNNNNNNNNNNNDD88888O8                     
+//                   MMMMMMMMMMMMMMMMNNNNNNNNNNNDDDDDDDDDDNNDNNNDD888888O8                   
+//                  MMMMMMMMMMMMMMMNNNNNNNNNNNNDDDDDDDDDDDDDDD888ND88888OO8                  
+//                 MMMMMMMMMMMMMMMNNNNNNNNNNNNNNDDDDDDDDDDDDDDD888OO8DDOOZZZ                 
+//                MMMMMMMMMMMMMMMNMMMMMMMMMMMMMMMMMMMMMMNDDDDDD8888OOOZZ$$$$Z                
+//               ,MMMMMMMMMMMMMMMMMNNNNNMMMMMMMMMMMMMMMDDDDDDMMMDN8OOOOZZZ++I7               
+//               MMMMMMMMMMMMMMMMMMMNNNNNNNNNNNNNNNNDDDDDDDDMMM88OMMD8OOZZZ$~I               
+//              MMMMMMMMMMMMMMMMMNND8Z7I+=~::::::::~~=?I$O88DDDDD8MMOO8M8OZZ$$$              
+//             MMMMMMMMMMMMMNDOI+:,                         ,~+78O888OMMZDMO$$$$             
+//            MMMMMMMMMMM87=,                                     ,+$8OOOMMZM8$$7            
+//           MMMMMMMMMO?:                                             :IOZO8M7MO77           
+//          MMMMMMMDI,                                                   :7ZZZM7MZ7          
+//         MMMMMMD?,                                                       ,7DZMDMZ7         
+//        :MMMMN?,                                                           ,$$$MMZ,        
+//        MMMM8~                                                               +N$MM7        
+//        MMMZ,                                                                 ~DZMM        
+//        MMD:                                           8""""8 8                1XD         
+//          #2IN                eeeee eeeee eeeeeee eeee 8    " 8               2YE          
+//            1HM               8   8 8  88 8  8  8 8    8e     8e             3ZF           
+//              0GL             8e  8 8   8 8e 8  8 8eee 88  ee 88            4AG            
+//                9FK           88  8 8   8 88 8  8 88   88   8 88           5BH             
+//                  8EJ         88ee8 8eee8 88 8  8 88ee 88eee8 88eee       6CJ              
+//                    7DI                                                7DI                 
+//                       OO?~                                        ,~78D                   
+//                         D8$+:,                             ,~?ZDN                         
+//                             ,NDO$?=::,             ,:~=?$8DM,                             
+//                                       ~7NNNNN8NNNNNZ:                                     
+//                                                                                           
+//                                                                                           
+//                                       Copyright 2011                                      
+//                      Art, Research, Technology and Science Laboratory                     
+//                                 The University of New Mexico                              
+//                                      Project Home Page                                    
+//                           <<<<http://artslab.unm.edu/domegl>>>>>                          
+//                                       Code Repository                                     
+//                           <<<https://svn.cs.unm.edu/domegl>>>>>>                          
+//                                                                                           
+/////////////////////////////////////////////////////////////////////////////////////////////
+
+#ifndef _FMM_H
+#define _FMM_H
+
+#include <iterator>
+#include <vector>
+#include <math.h>
+#include <Field.h>
+
+namespace gutz
+{
+   
+   //////////////////////////////////////////////////////////////////////////////////////////
+   /// Fast multipole method for Newtonian gravity
+   ///
+   /// Every cell of an octree gets a multipole expansion of its particles' potential
+   /// and a local expansion of everybody else's, both Cartesian Taylor series about the
+   /// cell's center of mass, so the dipole term vanishes. Multipoles go up to a
+   /// configurable order, locals one degree further so that the force, their gradient,
+   /// keeps the same order. Pairs of cells that are well separated, (r_a + r_b) < theta * R
+   /// for radii r and distance R between centers, talk through their expansions, near
+   /// cells through P2PField's direct sum. Both interactions are symmetric, each pair is
+   /// visited once and Newton's third law gives the other half. The cost is O(N) per step
+   /// for a fixed order and theta.
+   ///
+   /// The series of 1/r in the separation of two such cells converges like theta^n, and
+   /// the force one far cell puts on a particle is off by at most
+   /// bound() = (order + 2) theta^(order + 1) / (1 - theta)^2 of itself. That bounds a
+   /// particle's relative error where its far cells pull the same way; where they cancel
+   /// it can be more. It measures 25 times below the bound at the defaults (order 4,
+   /// theta 0.5) and over 10 times below at 1e-4. setTolerance() picks theta for the
+   /// current order from the bound, tight tolerances push it towards the direct sum.
+   /// Expansions are kept in double whatever the particles' precision.
+   ///
+   /// Plugs into gutz::Simulation as its NBODY_FIELD, same as BarnesHutField:
+   /// \code
+   /// typedef gutz::FMMField<particle_type> nbody_type;
+   /// 
+   /// nbody_type nbody;
+   /// nbody.setTolerance(1e-6f);
+   /// gutz::Simulation<gutz::RK4<MyField>, nbody_type> sim(&integrator, &nbody);
+   /// \endcode
+   //////////////////////////////////////////////////////////////////////////////////////////
+   template<class PARTICLE>
+   class FMMField
+   {
+   public:
+      typedef PARTICLE particle_type;
+      typedef typename PARTICLE::vec_type vec_type;
+      typedef typename vec_type::value_type value_type;
+      
+      enum {
+         LEAF_SIZE = 32,   //< Cells with this many particles or less are not split
+         MAX_DEPTH = 32,   //< Coincident particles share a leaf past this depth
+         MAX_ORDER = 16
+      };
+      
+      ///////////////////////////////////////////////////////////////////////////////////////
+      /// Constructor
+      ///
+      /// @param order
+      ///   Highest order term of the multipoles, 1 treats far cells as point masses
+      ///
+      /// @param theta
+      ///   Separation criterion, see above. Smaller is slower and more accurate.
+      ///////////////////////////////////////////////////////////////////////////////////////
+      FMMField(int order = 4, value_type theta = static_cast<value_type>(0.5))
+      : _G       (6.67e-11),
+        _theta   (theta)
+      {
+         setOrder(order);
+      }
+      
+      ///////////////////////////////////////////////////////////////////////////////////////
+      /// Set the expansion order, clamped to [1, MAX_ORDER]
+      ///////////////////////////////////////////////////////////////////////////////////////
+      void setOrder(int order)
+      {
+         if(order < 1) order = 1;
+         if(order > MAX_ORDER) order = MAX_ORDER;
+         _order = order;
+         makeTables();
+         _powers.resize(_terms.size());
+         _derivatives.resize(_terms.size());
+      }
+      
+      int getOrder(void) const { return _order; }
+      
+      void setTheta(value_type theta) { _theta = theta; }
+      
+      value_type getTheta(void) const { return _theta; }
+      
+      ///////////////////////////////////////////////////////////////////////////////////////
+      /// Pick the largest theta whose bound() at the current order is within tolerance
+      ///////////////////////////////////////////////////////////////////////////////////////
+      void setTolerance(value_type tolerance)
+      {
+         double lo = 0.0, hi = 1.0;
+         for(int i = 0; i < 60; ++i)
+         {
+            const double theta = 0.5 * (lo + hi);
+            if(bound(_order, theta) > tolerance) hi = theta;
+            else lo = theta;
+         }
+         _theta = static_cast<value_type>(lo);
+      }
+      
+      ///////////////////////////////////////////////////////////////////////////////////////
+      /// Relative error of the force of one far cell, see above
+      ///////////////////////////////////////////////////////////////////////////////////////
+      static double bound(int order, double theta)
+      {
+         return (order + 2) * pow(theta, order + 1) / ((1.0 - theta) * (1.0 - theta));
+      }
+      
+      ///////////////////////////////////////////////////////////////////////////////////////
+      /// Compute the acceleration of every particle in [begin, end) due to all the others.
+      /// Call it whenever they have moved, acceleration() returns the results.
+      ///////////////////////////////////////////////////////////////////////////////////////
+      template<typename p_iterator_type>
+      void build(const p_iterator_type& begin, const p_iterator_type& end)
+      {
+         _x.clear();
+         _m.clear();
+         _cells.clear();
+         for(p_iterator_type i = begin; i != end; ++i)
+         {
+            const vec_type position = (*i).getPosition();
+            for(int d = 0; d < 3; ++d) _x.push_back(static_cast<double>(position[d]));
+            _m.push_back(static_cast<double>((*i).getMass()));
+         }
+         run();
+      }
+      
+      ///////////////////////////////////////////////////////////////////////////////////////
+      /// Compute the acceleration of every particle of a ParticleArray
+      ///////////////////////////////////////////////////////////////////////////////////////
+      void build(const ParticleArray<vec_type>& particles)
+      {
+         const size_t n = particles.size();
+         _x.resize(3 * n);
+         _m.assign(particles.mass(), particles.mass() + n);
+         _cells.clear();
+         for(int d = 0; d < 3; ++d)
+         {
+            const value_type* x = particles.position(d);
+            for(size_t i = 0; i < n; ++i) _x[3 * i + d] = static_cast<double>(x[i]);
+         }
+         run();
+      }
+      
+      ///////////////////////////////////////////////////////////////////////////////////////
+      /// Add everyone's acceleration to their acceleration columns
+      ///////////////////////////////////////////////////////////////////////////////////////
+      void accelerate(ParticleArray<vec_type>& particles)
+      {
+         build(particles);
+         for(int d = 0; d < 3; ++d)
+         {
+            value_type* a = particles.acceleration(d);
+            for(size_t i = 0; i < particles.size(); ++i) a[i] += _acceleration[i][d];
+         }
+      }
+      
+      ///////////////////////////////////////////////////////////////////////////////////////
+      /// Same for just the particles listed in targets. The expansions are over everyone,
+      /// so this costs as much as accelerate() for all of them.
+      ///////////////////////////////////////////////////////////////////////////////////////
+      void accelerate(ParticleArray<vec_type>& particles, const std::vector<unsigned int>& targets)
+      {
+         build(particles);
+         for(size_t t = 0; t < targets.size(); ++t)
+         {
+            const size_t i = targets[t];
+            particles.setAcceleration(i, particles.getAcceleration(i) + _acceleration[i]);
+         }
+      }
+      
+      ///////////////////////////////////////////////////////////////////////////////////////
+      /// Acceleration of the i'th particle given to build(). Units: m/s^2
+      ///////////////////////////////////////////////////////////////////////////////////////
+      const vec_type& acceleration(size_t i) const { return _acceleration[i]; }
+      
+      ///////////////////////////////////////////////////////////////////////////////////////
+      /// Number of cells in the tree, for the curious
+      ///////////////////////////////////////////////////////////////////////////////////////
+      size_t size(void) const { return _cells.size(); }
+      
+   private:
+      ///////////////////////////////////////////////////////////////////////////////////////
+      /// The whole method over _x and _m
+      ///////////////////////////////////////////////////////////////////////////////////////
+      void run(void)
+      {
+         const unsigned int n = static_cast<unsigned int>(_m.size());
+         _acceleration.assign(n, vec_type(static_cast<value_type>(0)));
+         if(n == 0) return;
+         
+         makeTree();
+         
+         _multipole.assign(_cells.size() * _multipoleTerms, 0.0);
+         _local.assign(_cells.size() * _terms.size(), 0.0);
+         _a.assign(n * 3, 0.0);
+         
+         // Cells are stored parents first, children after, so upward goes backwards
+         for(size_t c = _cells.size(); c-- > 0; ) upward(static_cast<unsigned int>(c));
+         interact();
+         for(size_t c = 0; c < _cells.size(); ++c) downward(static_cast<unsigned int>(c));
+         
+         for(unsigned int i = 0; i < n; ++i)
+         {
+            vec_type a;
+            for(int d = 0; d < 3; ++d) a[d] = static_cast<value_type>(_G * _a[3 * i + d]);
+            _acceleration[_index[i]] = a;
+         }
+      }
+      
+      struct Cell
+      {
+         double       center[3];   //< Center of mass, expansions are about this
+         double       radius;      //< Every particle is this close to the center
+         double       mass;
+         unsigned int begin;       //< First particle, in tree order
+         unsigned int end;         //< One past the last particle
+         unsigned int firstChild;  //< Children are stored next to each other
+         unsigned int children;    //< Number of non-empty children, 0 for a leaf
+      };
+      
+      /// Exponents of one term x^k y^l z^m and the indices of its neighbours
+      struct Term
+      {
+         int power[3];
+         int degree;
+         int lower[3];             //< Index of this term with power[d] - 1, -1 if none
+         int axis;                 //< x^power = x^lower[axis] * x[axis], -1 for the constant
+      };
+      
+      /// One product of a translation, for M2L
+      ///   L[local] += factor * M[source] * a[derivative]
+      /// for M2M and L2L
+      ///   M[local] += factor * delta^derivative * Mchild[source]
+      ///   Lchild[source] += factor * delta^derivative * L[local]
+      struct Product
+      {
+         int    local;
+         int    source;
+         int    derivative;
+         double factor;
+      };
+      
+      //////////////////////////////////////////////////////////////////////////////////////
+      // Tables
+      //////////////////////////////////////////////////////////////////////////////////////
+      void makeTables(void)
+      {
+         // Multipoles go to _order, locals one further: the force is their gradient
+         const int top = _order + 1;
+         _terms.clear();
+         _indexOf.assign((top + 1) * (top + 1) * (top + 1), -1);
+         for(int degree = 0; degree <= top; ++degree)
+         {
+            if(degree == top) _multipoleTerms = _terms.size();
+            for(int i = degree; i >= 0; --i)
+            {
+               for(int j = degree - i; j >= 0; --j)
+               {
+                  Term t;
+                  t.power[0] = i;
+                  t.power[1] = j;
+                  t.power[2] = degree - i - j;
+                  t.degree   = degree;
+                  _indexOf[key(t.power)] = static_cast<int>(_terms.size());
+                  _terms.push_back(t);
+               }
+            }
+         }
+         for(size_t k = 0; k < _terms.size(); ++k)
+         {
+            Term& t = _terms[k];
+            t.axis = -1;
+            for(int d = 2; d >= 0; --d)
+            {
+               t.lower[d] = -1;
+               if(t.power[d] == 0) continue;
+               int p[3] = { t.power[0], t.power[1], t.power[2] };
+               --p[d];
+               t.lower[d] = _indexOf[key(p)];
+               t.axis = d;
+            }
+         }
+         
+         // M2M uses the first _multipoleShifts, L2L all of them
+         _shifts.clear();
+         for(size_t k = 0; k < _terms.size(); ++k)
+         {
+            if(k == _multipoleTerms) _multipoleShifts = _shifts.size();
+            for(size_t j = 0; j <= k; ++j)
+            {
+               int diff[3];
+               double factor = 1.0;
+               for(int d = 0; d < 3; ++d)
+               {
+                  diff[d] = _terms[k].power[d] - _terms[j].power[d];
+                  factor *= binomial(_terms[k].power[d], _terms[j].power[d]);
+               }
+               if(diff[0] < 0 || diff[1] < 0 || diff[2] < 0) continue;
+               Product p;
+               p.local      = static_cast<int>(k);
+               p.source     = static_cast<int>(j);
+               p.derivative = _indexOf[key(diff)];
+               p.factor     = factor;
+               _shifts.push_back(p);
+            }
+         }
+         
+         // The Taylor series of 1/|R + y - x| to degree _order + 1 in y - x, less the
+         // x^(_order + 1) terms, which only reach the potential
+         _products.clear();
+         for(size_t n = 0; n < _terms.size(); ++n)
+         {
+            for(size_t k = 0; k < _multipoleTerms; ++k)
+            {
+               if(_terms[n].degree + _terms[k].degree > top) continue;
+               int sum[3];
+               double factor = (_terms[k].degree % 2) ? -1.0 : 1.0;
+               for(int d = 0; d < 3; ++d)
+               {
+                  sum[d] = _terms[n].power[d] + _terms[k].power[d];
+                  factor *= binomial(sum[d], _terms[n].power[d]);
+               }
+               Product p;
+               p.local      = static_cast<int>(n);
+               p.source     = static_cast<int>(k);
+               p.derivative = _indexOf[key(sum)];
+               p.factor     = factor;
+               _products.push_back(p);
+            }
+         }
+      }
+      
+      int key(const int power[3]) const
+      {
+         return (power[0] * (_order + 2) + power[1]) * (_order + 2) + power[2];
+      }
+      
+      static double binomial(int n, int k)
+      {
+         double b = 1.0;
+         for(int i = 1; i <= k; ++i) b = b * (n - k + i) / i;
+         return b;
+      }
+      
+      /// out[k] = d^k for every term k
+      void powers(const double d[3], double* out) const
+      {
+         out[0] = 1.0;
+         for(size_t k = 1; k < _terms.size(); ++k)
+         {
+            const Term& t = _terms[k];
+            out[k] = out[t.lower[t.axis]] * d[t.axis];
+         }
+      }
+      
+      /// out[k] = (1/k!) d^k/dr^k 1/|r|, by the recurrence of Duan and Krasny (with r negated)
+      void derivatives(const double r[3], double* out) const
+      {
+         const double r2 = r[0] * r[0] + r[1] * r[1] + r[2] * r[2];
+         out[0] = 1.0 / sqrt(r2);
+         for(size_t k = 1; k < _terms.size(); ++k)
+         {
+            const Term& t = _terms[k];
+            double sum = 0.0;
+            for(int d = 0; d < 3; ++d)
+            {
+               if(t.power[d] == 0) continue;
+               sum -= (2 * t.degree - 1) * r[d] * out[t.lower[d]];
+               if(t.power[d] >= 2) sum -= (t.degree - 1) * out[_terms[t.lower[d]].lower[d]];
+            }
+            out[k] = sum / (t.degree * r2);
+         }
+      }
+      
+      //////////////////////////////////////////////////////////////////////////////////////
+      // Tree
+      //////////////////////////////////////////////////////////////////////////////////////
+      void makeTree(void)
+      {
+         const unsigned int n = static_cast<unsigned int>(_m.size());
+         double lo[3], hi[3];
+         for(int d = 0; d < 3; ++d) lo[d] = hi[d] = _x[d];
+         for(unsigned int i = 1; i < n; ++i)
+         {
+            for(int d = 0; d < 3; ++d)
+            {
+               if(_x[3 * i + d] < lo[d]) lo[d] = _x[3 * i + d];
+               if(_x[3 * i + d] > hi[d]) hi[d] = _x[3 * i + d];
+            }
+         }
+         double edge = 0.0, center[3];
+         for(int d = 0; d < 3; ++d)
+         {
+            if(hi[d] - lo[d] > edge) edge = hi[d] - lo[d];
+            center[d] = 0.5 * (lo[d] + hi[d]);
+         }
+         
+         _index.resize(n);
+         for(unsigned int i = 0; i < n; ++i) _index[i] = i;
+         _scratch.resize(n);
+         _cells.push_back(Cell());
+         split(0, 0, n, center, edge, 0);
+         
+         // Particles in tree order, _index takes them back
+         std::vector<double> x(3 * n), m(n);
+         for(unsigned int i = 0; i < n; ++i)
+         {
+            for(int d = 0; d < 3; ++d) x[3 * i + d] = _x[3 * _index[i] + d];
+            m[i] = _m[_index[i]];
+         }
+         _x.swap(x);
+         _m.swap(m);
+      }
+      
+      /// center is the middle of the cube, the cell's own center is its center of mass
+      void split(unsigned int c, unsigned int begin, unsigned int end, const double center[3], double edge, int depth)
+      {
+         Cell cell;
+         cell.radius     = 0.0;
+         cell.mass       = 0.0;
+         cell.begin      = begin;
+         cell.end        = end;
+         cell.firstChild = 0;
+         cell.children   = 0;
+         
+         if(end - begin <= LEAF_SIZE || depth >= MAX_DEPTH)
+         {
+            double moment[3] = { 0.0, 0.0, 0.0 };
+            for(unsigned int i = begin; i < end; ++i)
+            {
+               cell.mass += _m[_index[i]];
+               for(int d = 0; d < 3; ++d) moment[d] += _m[_index[i]] * _x[3 * _index[i] + d];
+            }
+            centerOfMass(cell, moment, center);
+            _cells[c] = cell;
+            return;
+         }
+         
+         // Counting sort of the range by octant
+         unsigned int count[9] = { 0 };
+         for(unsigned int i = begin; i < end; ++i) ++count[octant(_index[i], center) + 1];
+         for(int o = 0; o < 8; ++o) count[o + 1] += count[o];
+         unsigned int fill[8];
+         for(int o = 0; o < 8; ++o) fill[o] = begin + count[o];
+         for(unsigned int i = begin; i < end; ++i) _scratch[fill[octant(_index[i], center)]++] = _index[i];
+         for(unsigned int i = begin; i < end; ++i) _index[i] = _scratch[i];
+         
+         cell.firstChild = static_cast<unsigned int>(_cells.size());
+         for(int o = 0; o < 8; ++o)
+         {
+            if(count[o + 1] > count[o]) ++cell.children;
+         }
+         _cells.resize(_cells.size() + cell.children);
+         
+         unsigned int child = cell.firstChild;
+         double moment[3] = { 0.0, 0.0, 0.0 };
+         for(int o = 0; o < 8; ++o)
+         {
+            if(count[o + 1] == count[o]) continue;
+            double childCenter[3];
+            for(int d = 0; d < 3; ++d) childCenter[d] = center[d] + ((o & (1 << d)) ? 0.25 : -0.25) * edge;
+            split(child, begin + count[o], begin + count[o + 1], childCenter, 0.5 * edge, depth + 1);
+            cell.mass += _cells[child].mass;
+            for(int d = 0; d < 3; ++d) moment[d] += _cells[child].mass * _cells[child].center[d];
+            ++child;
+         }
+         centerOfMass(cell, moment, center);
+         _cells[c] = cell;
+      }
+      
+      /// About the center of mass the dipole term vanishes, the geometric center is the
+      /// fallback for massless cells. The radius is measured from there, particle by
+      /// particle, a bound built from the children's spheres opens far more pairs.
+      void centerOfMass(Cell& cell, const double moment[3], const double center[3]) const
+      {
+         for(int d = 0; d < 3; ++d) cell.center[d] = cell.mass > 0.0 ? moment[d] / cell.mass : center[d];
+         double r2max = 0.0;
+         for(unsigned int i = cell.begin; i < cell.end; ++i)
+         {
+            double r2 = 0.0;
+            for(int d = 0; d < 3; ++d)
+            {
+               const double dx = _x[3 * _index[i] + d] - cell.center[d];
+               r2 += dx * dx;
+            }
+            if(r2 > r2max) r2max = r2;
+         }
+         cell.radius = sqrt(r2max);
+      }
+      
+      int octant(unsigned int i, const double center[3]) const
+      {
+         int o = 0;
+         for(int d = 0; d < 3; ++d)
+         {
+            if(_x[3 * i + d] >= center[d]) o |= 1 << d;
+         }
+         return o;
+      }
+      
+      //////////////////////////////////////////////////////////////////////////////////////
+      // Passes
+      //////////////////////////////////////////////////////////////////////////////////////
+      
+      /// P2M for leaves, M2M from the children otherwise
+      void upward(unsigned int c)
+      {
+         const Cell& cell = _cells[c];
+         const size_t terms = _multipoleTerms;
+         double* M = &_multipole[c * terms];
+         double* p = &_powers[0];
+         if(cell.children == 0)
+         {
+            for(unsigned int i = cell.begin; i < cell.end; ++i)
+            {
+               double d[3];
+               for(int k = 0; k < 3; ++k) d[k] = _x[3 * i + k] - cell.center[k];
+               powers(d, p);
+               for(size_t k = 0; k < terms; ++k) M[k] += _m[i] * p[k];
+            }
+            return;
+         }
+         for(unsigned int ch = cell.firstChild; ch < cell.firstChild + cell.children; ++ch)
+         {
+            // M[k] += sum over j <= k of  C(k, j) delta^(k - j) Mchild[j]
+            double delta[3];
+            for(int k = 0; k < 3; ++k) delta[k] = _cells[ch].center[k] - cell.center[k];
+            powers(delta, p);
+            const double* Mc = &_multipole[ch * terms];
+            for(size_t i = 0; i < _multipoleShifts; ++i)
+            {
+               const Product& s = _shifts[i];
+               M[s.local] += s.factor * p[s.derivative] * Mc[s.source];
+            }
+         }
+      }
+      
+      /// L2L into the children, L2P for leaves
+      void downward(unsigned int c)
+      {
+         const Cell& cell = _cells[c];
+         const size_t terms = _terms.size();
+         const double* L = &_local[c * terms];
+         double* p = &_powers[0];
+         if(cell.children == 0)
+         {
+            // acceleration / G = grad of sum over n of L[n] y^n
+            for(unsigned int i = cell.begin; i < cell.end; ++i)
+            {
+               double y[3];
+               for(int d = 0; d < 3; ++d) y[d] = _x[3 * i + d] - cell.center[d];
+               powers(y, p);
+               for(size_t n = 1; n < terms; ++n)
+               {
+                  const Term& t = _terms[n];
+                  for(int d = 0; d < 3; ++d)
+                  {
+                     if(t.power[d] > 0) _a[3 * i + d] += t.power[d] * L[n] * p[t.lower[d]];
+                  }
+               }
+            }
+            return;
+         }
+         for(unsigned int ch = cell.firstChild; ch < cell.firstChild + cell.children; ++ch)
+         {
+            // Lchild[j] += sum over n >= j of  C(n, j) delta^(n - j) L[n]
+            double delta[3];
+            for(int d = 0; d < 3; ++d) delta[d] = _cells[ch].center[d] - cell.center[d];
+            powers(delta, p);
+            double* Lc = &_local[ch * terms];
+            for(size_t i = 0; i < _shifts.size(); ++i)
+            {
+               const Product& s = _shifts[i];
+               Lc[s.source] += s.factor * p[s.derivative] * L[s.local];
+            }
+         }
+      }
+      
+      /// Dual tree walk, every pair of cells once
+      void interact(void)
+      {
+         std::vector< std::pair<unsigned int, unsigned int> > stack;
+         stack.push_back(std::make_pair(0u, 0u));
+         while(!stack.empty())
+         {
+            const unsigned int a = stack.back().first, b = stack.back().second;
+            stack.pop_back();
+            const Cell& A = _cells[a];
+            const Cell& B = _cells[b];
+            
+            if(a == b)
+            {
+               if(A.children == 0)
+               {
+                  p2p(A, A);
+                  continue;
+               }
+               for(unsigned int i = A.firstChild; i < A.firstChild + A.children; ++i)
+               {
+                  for(unsigned int j = i; j < A.firstChild + A.children; ++j) stack.push_back(std::make_pair(i, j));
+               }
+               continue;
+            }
+            
+            double R[3];
+            for(int d = 0; d < 3; ++d) R[d] = B.center[d] - A.center[d];
+            const double R2 = R[0] * R[0] + R[1] * R[1] + R[2] * R[2];
+            const double reach = A.radius + B.radius;
+            if(reach * reach < _theta * _theta * R2)
+            {
+               m2l(a, b, R);
+               continue;
+            }
+            if(A.children == 0 && B.children == 0)
+            {
+               p2p(A, B);
+               continue;
+            }
+            
+            // Split the bigger one
+            if(B.children == 0 || (A.children != 0 && A.radius >= B.radius))
+            {
+               for(unsigned int i = A.firstChild; i < A.firstChild + A.children; ++i) stack.push_back(std::make_pair(i, b));
+            }
+            else
+            {
+               for(unsigned int j = B.firstChild; j < B.firstChild + B.children; ++j) stack.push_back(std::make_pair(a, j));
+            }
+         }
+      }
+      
+      /// Both ways: a's multipole into b's local and b's into a's. R = b - a.
+      void m2l(unsigned int a, unsigned int b, const double R[3])
+      {
+         double* D = &_derivatives[0];
+         derivatives(R, D);
+         const double* Ma = &_multipole[a * _multipoleTerms];
+         const double* Mb = &_multipole[b * _multipoleTerms];
+         double* La = &_local[a * _terms.size()];
+         double* Lb = &_local[b * _terms.size()];
+         for(size_t i = 0; i < _products.size(); ++i)
+         {
+            const Product& p = _products[i];
+            const double f = p.factor * D[p.derivative];
+            Lb[p.local] += f * Ma[p.source];
+            // a_m(-R) = (-1)^|m| a_m(R)
+            La[p.local] += ((_terms[p.derivative].degree % 2) ? -f : f) * Mb[p.source];
+         }
+      }
+      
+      /// Direct sum between two leaves, or within one. Skips r = 0 like P2PField.
+      void p2p(const Cell& A, const Cell& B)
+      {
+         const bool same = &A == &B;
+         for(unsigned int i = A.begin; i < A.end; ++i)
+         {
+            for(unsigned int j = same ? i + 1 : B.begin; j < B.end; ++j)
+            {
+               double d[3], r2 = 0.0;
+               for(int k = 0; k < 3; ++k)
+               {
+                  d[k] = _x[3 * j + k] - _x[3 * i + k];
+                  r2 += d[k] * d[k];
+               }
+               if(r2 <= 0.0) continue;
+               const double inv3 = 1.0 / (r2 * sqrt(r2));
+               for(int k = 0; k < 3; ++k)
+               {
+                  _a[3 * i + k] += _m[j] * inv3 * d[k];
+                  _a[3 * j + k] -= _m[i] * inv3 * d[k];
+               }
+            }
+         }
+      }
+      
+      /// Gravitational constant, m^3 / (kg s^2)
+      double                    _G;
+      value_type                _theta;
+      int                       _order;
+      std::vector<Term>         _terms;         //< By degree up to _order + 1, the constant first
+      size_t                    _multipoleTerms;  //< Those of degree _order or less
+      size_t                    _multipoleShifts; //< Leading _shifts for M2M
+      std::vector<int>          _indexOf;       //< Term index by key()
+      std::vector<Product>      _products;      //< The M2L sum
+      std::vector<Product>      _shifts;        //< The M2M and L2L sums
+      std::vector<double>       _powers;        //< Scratch, one per term
+      std::vector<double>       _derivatives;   //< Scratch, one per term
+      std::vector<Cell>         _cells;         //< The root is cell 0
+      std::vector<double>       _multipole;     //< _multipoleTerms per cell
+      std::vector<double>       _local;         //< _terms.size() per cell
+      std::vector<double>       _x;             //< x, y, z per particle, tree order
+      std::vector<double>       _m;
+      std::vector<double>       _a;             //< Acceleration / G, tree order
+      std::vector<unsigned int> _index;         //< Tree order to the order given to build()
+      std::vector<unsigned int> _scratch;
+      std::vector<vec_type>     _acceleration;  //< Results, in the order given to build()
+   };
+   
+   //////////////////////////////////////////////////////////////////////////////////////////
+   /// prepare() runs the whole method for the step, each particle then picks up its result
+   //////////////////////////////////////////////////////////////////////////////////////////
+   template<class PARTICLE>
+   struct IsPrebuiltField< FMMField<PARTICLE> >
+   {
+      enum { value = true };
+   };
+   
+   template<class PARTICLE>
+   struct IsBulkField< FMMField<PARTICLE> >
+   {
+      enum { value = true };
+   };
+}
+
+#endif
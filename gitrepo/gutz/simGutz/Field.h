@@ -48,7 +48,10 @@
 #ifndef _FIELD_H
 #define _FIELD_H
 
+#include <iterator>
+#include <vector>
 #include <typelistGutz.h>
+#include <ParticleArray.h>
 
 namespace gutz
 {
@@ -111,6 +114,24 @@ namespace gutz
       }
       
       
+      ///////////////////////////////////////////////////////////////////////////////////////
+      /// Add the acceleration of every particle due to all the others to its acceleration
+      /// columns. Same physics as operator(), O(N^2), straight off the position and mass
+      /// columns.
+      ///////////////////////////////////////////////////////////////////////////////////////
+      void accelerate(ParticleArray<vec_type>& particles)
+      {
+         for(size_t i = 0; i < particles.size(); ++i) accelerate(particles, i);
+      }
+      
+      ///////////////////////////////////////////////////////////////////////////////////////
+      /// Same for just the particles listed in targets, every particle still pulls on them
+      ///////////////////////////////////////////////////////////////////////////////////////
+      void accelerate(ParticleArray<vec_type>& particles, const std::vector<unsigned int>& targets)
+      {
+         for(size_t t = 0; t < targets.size(); ++t) accelerate(particles, targets[t]);
+      }
+      
       ///////////////////////////////////////////////////////////////////////////////////////
       /// Newton's 2nd Law of Gravitation.
       ///
@@ -127,19 +148,79 @@ namespace gutz
       
       
    private:
+      ///////////////////////////////////////////////////////////////////////////////////////
+      /// Add the acceleration of particle i due to all the others
+      ///////////////////////////////////////////////////////////////////////////////////////
+      void accelerate(ParticleArray<vec_type>& particles, size_t i)
+      {
+         static const int dimension = vec_type::size;
+         const size_t n = particles.size();
+         const value_type* x[dimension];
+         for(int d = 0; d < dimension; ++d) x[d] = particles.position(d);
+         const value_type* m = particles.mass();
+         
+         value_type sum[dimension] = { 0 };
+         for(size_t j = 0; j < n; ++j)
+         {
+            value_type delta[dimension];
+            value_type r2 = static_cast<value_type>(0);
+            for(int d = 0; d < dimension; ++d)
+            {
+               delta[d] = x[d][j] - x[d][i];
+               r2 += delta[d] * delta[d];
+            }
+            // i itself and anything else at distance zero adds nothing. A select rather
+            // than a branch so the loop vectorizes.
+            const bool apart = r2 > static_cast<value_type>(0);
+            const value_type safe = apart ? r2 : static_cast<value_type>(1);
+            const value_type g = apart ? _G * m[j] / (safe * static_cast<value_type>(sqrt(safe))) : static_cast<value_type>(0);
+            for(int d = 0; d < dimension; ++d) sum[d] += g * delta[d];
+         }
+         for(int d = 0; d < dimension; ++d) particles.acceleration(d)[i] += sum[d];
+      }
+      
       // Keepin it real with Newton's 2nd Law of Gravitation
       value_type _G;
    };
    
    //////////////////////////////////////////////////////////////////////////////////////////
+   /// value is true for fields that do the whole step at once: build(begin, end) over every
+   /// particle, then acceleration(i) of the i'th one. ForEachParticlePair forwards to them.
    //////////////////////////////////////////////////////////////////////////////////////////
-   template<class P2PField>
+   template<class FIELD>
+   struct IsPrebuiltField
+   {
+      enum { value = false };
+   };
+   
+   //////////////////////////////////////////////////////////////////////////////////////////
+   /// value is true for fields with accelerate(ParticleArray&) and accelerate(ParticleArray&,
+   /// targets) adding to the acceleration columns. ForEachParticle forwards to them.
+   //////////////////////////////////////////////////////////////////////////////////////////
+   template<class FIELD>
+   struct IsBulkField
+   {
+      enum { value = false };
+   };
+   
+   //////////////////////////////////////////////////////////////////////////////////////////
+   //////////////////////////////////////////////////////////////////////////////////////////
+   template<class P2PField, bool PREBUILT = IsPrebuiltField<P2PField>::value>
    class ForEachParticlePair
    {
    public:
       typedef typename P2PField::vec_type vec_type;
       typedef typename P2PField::particle_type particle_type;
       
+      ///////////////////////////////////////////////////////////////////////////////////////
+      /// Called once per step before the particles are visited. Fields that need a view
+      /// of all the particles (a tree, a grid) set it up here, see IsPrebuiltField.
+      ///////////////////////////////////////////////////////////////////////////////////////
+      template<typename p_iterator_type>
+      void prepare(const p_iterator_type& /*begin*/, const p_iterator_type& /*end*/, P2PField& /*field*/)
+      {
+      }
+      
       ///////////////////////////////////////////////////////////////////////////////////////
       ///////////////////////////////////////////////////////////////////////////////////////
       template<typename p_iterator_type>
@@ -159,17 +240,134 @@ namespace gutz
       }
    };
 
+   //////////////////////////////////////////////////////////////////////////////////////////
+   /// prepare() runs the field over every particle, each one then picks up its result
+   //////////////////////////////////////////////////////////////////////////////////////////
+   template<class FIELD>
+   class ForEachParticlePair<FIELD, true>
+   {
+   public:
+      typedef typename FIELD::vec_type vec_type;
+      typedef typename FIELD::particle_type particle_type;
+      
+      template<typename p_iterator_type>
+      void prepare(const p_iterator_type& begin, const p_iterator_type& end, FIELD& field)
+      {
+         field.build(begin, end);
+      }
+      
+      template<typename p_iterator_type>
+      void operator()(vec_type& acceleration, p_iterator_type& p0i, const p_iterator_type& begin,
+                      const p_iterator_type& /*end*/, FIELD& field)
+      {
+         acceleration += field.acceleration(std::distance(begin, p0i));
+      }
+   };
+   
+   //////////////////////////////////////////////////////////////////////////////////////////
+   /// value is false for NullType, the "no pairwise field" of Simulation, which then skips
+   /// the pairwise phase at compile time
+   //////////////////////////////////////////////////////////////////////////////////////////
+   template<class P2PField>
+   struct IsPairwiseField
+   {
+      enum { value = true };
+   };
+   
+   template<>
+   struct IsPairwiseField<NullType>
+   {
+      enum { value = false };
+   };
+   
    // No-op. This should get compiled out.
    template<>
    class ForEachParticlePair<NullType>
    {
    public:
+      template<typename p_iterator_type, typename P2PField>
+      void prepare(const p_iterator_type& /*begin*/, const p_iterator_type& /*end*/, const P2PField& /*field*/)
+      {
+      }
+      
       template<typename p_iterator_type, typename vec_type, typename P2PField>
       void operator()(vec_type& force, p_iterator_type& p0i, const p_iterator_type& begin, const p_iterator_type& end,
                       const P2PField& field)
       {
       }
    };
+   
+   //////////////////////////////////////////////////////////////////////////////////////////
+   /// Evaluate a field for every particle of a ParticleArray at once, adding to the
+   /// acceleration columns. Integrators that work on whole arrays go through this.
+   ///
+   /// The default calls the field's operator() one particle at a time, IsBulkField fields
+   /// get a single accelerate() call instead and bulk = true. The targets form is for
+   /// integrators that only need some of the particles this time.
+   //////////////////////////////////////////////////////////////////////////////////////////
+   template<class FIELD, bool BULK = IsBulkField<FIELD>::value>
+   class ForEachParticle
+   {
+   public:
+      typedef typename FIELD::particle_type particle_type;
+      typedef typename particle_type::vec_type vec_type;
+      enum { bulk = false };
+      
+      void operator()(ParticleArray<vec_type>& particles, FIELD& field)
+      {
+         particle_type p;  // One particle reloaded each time, not one made per call
+         for(size_t i = 0; i < particles.size(); ++i)
+         {
+            p.setPosition(particles.getPosition(i));
+            p.setVelocity(particles.getVelocity(i));
+            p.setMass(particles.mass()[i]);
+            p.setID(particles.id()[i]);
+            particles.setAcceleration(i, particles.getAcceleration(i) + field(p));
+         }
+      }
+      
+      ///////////////////////////////////////////////////////////////////////////////////////
+      /// Only the particles listed in targets. The others are still there for fields that
+      /// sum over them.
+      ///////////////////////////////////////////////////////////////////////////////////////
+      void operator()(ParticleArray<vec_type>& particles, FIELD& field, const std::vector<unsigned int>& targets)
+      {
+         particle_type p;
+         for(size_t t = 0; t < targets.size(); ++t)
+         {
+            const size_t i = targets[t];
+            p.setPosition(particles.getPosition(i));
+            p.setVelocity(particles.getVelocity(i));
+            p.setMass(particles.mass()[i]);
+            p.setID(particles.id()[i]);
+            particles.setAcceleration(i, particles.getAcceleration(i) + field(p));
+         }
+      }
+   };
+   
+   template<class FIELD>
+   class ForEachParticle<FIELD, true>
+   {
+   public:
+      typedef typename FIELD::particle_type::vec_type vec_type;
+      enum { bulk = true };
+      
+      void operator()(ParticleArray<vec_type>& particles, FIELD& field)
+      {
+         field.accelerate(particles);
+      }
+      
+      void operator()(ParticleArray<vec_type>& particles, FIELD& field, const std::vector<unsigned int>& targets)
+      {
+         field.accelerate(particles, targets);
+      }
+   };
+   
+   template<class PARTICLE>
+   struct IsBulkField< P2PField<PARTICLE> >
+   {
+      enum { value = true };
+   };
 }
 
 #endif
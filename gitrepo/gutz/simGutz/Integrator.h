@@ -45,4 +45,53 @@
 //                                                                                           
 /////////////////////////////////////////////////////////////////////////////////////////////
 
-#pragma once
\ No newline at end of file
+#pragma once
+
+/////////////////////////////////////////////////////////////////////////////////////////////
+/// Integrators for gutz::Simulation
+///
+/// An integrator is built on a field and advances particles through it:
+///
+/// \code
+/// template <class FIELD>
+/// class AnIntegrator
+/// {
+/// public:
+///    typedef FIELD field_type;
+///    typedef typename FIELD::particle_type      particle_type;
+///    typedef typename particle_type::value_type value_type;
+///    typedef typename particle_type::vec_type   vec_type;
+///    
+///    AnIntegrator(field_type* field);
+///    
+///    // One particle from t to t + dt
+///    particle_type operator()(const particle_type& state, value_type t, value_type dt);
+///    
+///    // Every particle of a ParticleArray from t to t + dt, in place
+///    void operator()(ParticleArray<vec_type>& particles, value_type t, value_type dt);
+/// };
+/// \endcode
+///
+/// A field gives the acceleration of a particle, operator()(const particle_type&), or
+/// of a whole ParticleArray through ForEachParticle (Field.h).
+///
+/// Simulation::setThreads() calls the one particle operator() from several threads at
+/// once on the same integrator, so it must not write to the integrator's members: any
+/// scratch it needs is local to the call. The ParticleArray form is called from one
+/// thread and may keep scratch and state between calls.
+///
+/// RK4            classic fourth order Runge-Kutta, four evaluations per step
+/// Leapfrog       kick-drift-kick, second order, symplectic, two evaluations per step
+/// Yoshida4       fourth order, symplectic, four evaluations per step
+/// DormandPrince  adaptive 5(4), substeps to meet a tolerance
+/// BlockTimestep  leapfrog with a power of two step for every particle, ParticleArray
+///                only: one particle alone has no block to share, use Leapfrog
+///
+/// The symplectic ones keep the energy of a bound orbit from drifting and are the choice
+/// for long orbital runs; they need fields that do not depend on velocity.
+/////////////////////////////////////////////////////////////////////////////////////////////
+
+#include <RK4.h>
+#include <Leapfrog.h>
+#include <DormandPrince.h>
+#include <BlockTimestep.h>
@@ -0,0 +1,216 @@
+/////////////////////////////////////////////////////////////////////////////////////////////
+//                                                                                           
+//                                          8MMNMM8                                          
+//                                     $MMMMMMMMMMMNMMNNNNN:                                 
+//                             7MMMMMMMMMMMMMNNNMNNNNNNNMNDDDDD7                             
+//                            MMMMMMMMMMMMMMNNNNNNNNNNNNNND8DD888                            
+//                          ZMMMMMMMMMMMMMMMMNNNNNNNNNNNNNNNNDDD8888:                        
+//                       8MMMMMMMMMMMMMMMMMMMNNNNNNNNNNNNNNNNDDD88888=                       
+//                     MMMMMMMMMMMMMMMMMMMMMMMNNNMNNNNNNNNNNNNNDD88888O8                     
+//                   MMMMMMMMMMMMMMMMNNNNNNNNNNNDDDDDDDDDDNNDNNNDD888888O8                   
+//                  MMMMMMMMMMMMMMMNNNNNNNNNNNNDDDDDDDDDDDDDDD888ND88888OO8                  
+//                 MMMMMMMMMMMMMMMNNNNNNNNNNNNNNDDDDDDDDDDDDDDD888OO8DDOOZZZ                 
+//                MMMMMMMMMMMMMMMNMMMMMMMMMMMMMMMMMMMMMMNDDDDDD8888OOOZZ$$$$Z                
+//               ,MMMMMMMMMMMMMMMMMNNNNNMMMMMMMMMMMMMMMDDDDDDMMMDN8OOOOZZZ++I7               
+//               MMMMMMMMMMMMMMMMMMMNNNNNNNNNNNNNNNNDDDDDDDDMMM88OMMD8OOZZZ$~I               
+//              MMMMMMMMMMMMMMMMMNND8Z7I+=~::::::::~~=?I$O88DDDDD8MMOO8M8OZZ$$$              
+//             MMMMMMMMMMMMMNDOI+:,                         ,~+78O888OMMZDMO$$$$             
+//            MMMMMMMMMMM87=,                                     ,+$8OOOMMZM8$$7            
+//           MMMMMMMMMO?:                                             :IOZO8M7MO77           
+//          MMMMMMMDI,                                                   :7ZZZM7MZ7          
+//         MMMMMMD?,                                                       ,7DZMDMZ7         
+//        :MMMMN?,                                                           ,$$$MMZ,        
+//        MMMM8~                                                               +N$MM7        
+//        MMMZ,                                                                 ~DZMM        
+//        MMD:                                           8""""8 8                1XD         
+//          #2IN                eeeee eeeee eeeeeee eeee 8    " 8               2YE          
+//            1HM               8   8 8  88 8  8  8 8    8e     8e             3ZF           
+//              0GL             8e  8 8   8 8e 8  8 8eee 88  ee 88            4AG            
+//                9FK           88  8 8   8 88 8  8 88   88   8 88           5BH             
+//                  8EJ         88ee8 8eee8 88 8  8 88ee 88eee8 88eee       6CJ              
+//                    7DI                                                7DI                 
+//                       OO?~                                        ,~78D                   
+//                         D8$+:,                             ,~?ZDN                         
+//                             ,NDO$?=::,             ,:~=?$8DM,                             
+//                                       ~7NNNNN8NNNNNZ:                                     
+//                                                                                           
+//                                                                                           
+//                                       Copyright 2011                                      
+//                      Art, Research, Technology and Science Laboratory                     
+//                                 The University of New Mexico                              
+//                                      Project Home Page                                    
+//                           <<<<http://artslab.unm.edu/domegl>>>>>                          
+//                                       Code Repository                                     
+//                           <<<https://svn.cs.unm.edu/domegl>>>>>>                          
+//                                                                                           
+/////////////////////////////////////////////////////////////////////////////////////////////
+
+#ifndef _LEAPFROG_H
+#define _LEAPFROG_H
+
+#include <math.h>
+#include <vec.h>
+#include <ParticleArray.h>
+#include <Field.h>
+
+namespace gutz
+{
+   
+   //////////////////////////////////////////////////////////////////////////////////////////
+   /// Kick-drift-kick leapfrog, a.k.a. velocity Verlet
+   ///
+   /// Second order and symplectic: the energy error of a bound orbit stays bounded instead
+   /// of drifting, so long orbital runs can take much larger steps than with RK4. Two field
+   /// evaluations per step. The field must not depend on velocity.
+   ///
+   /// Same interface as RK4, see Integrator.h.
+   //////////////////////////////////////////////////////////////////////////////////////////
+   template <class FIELD>
+   class Leapfrog
+   {
+   public:
+      typedef FIELD field_type;
+      typedef typename FIELD::particle_type      particle_type;
+      typedef typename particle_type::value_type value_type;
+      typedef typename particle_type::vec_type   vec_type;
+      
+      /// Constructor
+      Leapfrog(field_type* field)
+      :  _field   (field)
+      {}
+      
+      /////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+      /// Integration step
+      ///
+      /// @params state    the current state for a particle
+      ///         t        the current time
+      ///         dt       size of the time step
+      particle_type operator()(const particle_type& state, value_type t, value_type dt)
+      {
+         static const value_type kick[2] = { 0.5, 0.5 };
+         static const value_type drift[1] = { 1 };
+         return compose(state, dt, kick, drift, 1);
+      }
+      
+      /////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+      /// Integrate every particle of a ParticleArray in place. The acceleration columns are left holding the
+      /// accelerations at the end of the step.
+      ///
+      /// @params particles   the particles
+      ///         t           the current time
+      ///         dt          size of the time step
+      void operator()(ParticleArray<vec_type>& particles, value_type t, value_type dt)
+      {
+         static const value_type kick[2] = { 0.5, 0.5 };
+         static const value_type drift[1] = { 1 };
+         compose(particles, dt, kick, drift, 1);
+      }
+      
+   protected:
+      /////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+      /// kick[0] drift[0] kick[1] ... drift[drifts-1] kick[drifts], each coefficient a fraction of dt. A kick adds
+      /// the acceleration at the current position, a drift the velocity.
+      particle_type compose(const particle_type& state, value_type dt, const value_type kick[], const value_type drift[],
+                            int drifts)
+      {
+         particle_type p(state);
+         for(int s = 0; s <= drifts; ++s)
+         {
+            const vec_type acceleration = (*_field)(p);
+            p.setVelocity(p.getVelocity() + acceleration * (kick[s] * dt));
+            p.setAcceleration(acceleration);
+            if(s < drifts) p.setPosition(p.getPosition() + p.getVelocity() * (drift[s] * dt));
+         }
+         return p;
+      }
+      
+      void compose(ParticleArray<vec_type>& particles, value_type dt, const value_type kick[], const value_type drift[],
+                   int drifts)
+      {
+         static const int dimension = vec_type::size;
+         const size_t n = particles.size();
+         ForEachParticle<field_type> forEach;
+         for(int s = 0; s <= drifts; ++s)
+         {
+            particles.clearAcceleration();
+            forEach(particles, *_field);
+            for(int d = 0; d < dimension; ++d)
+            {
+               value_type* x = particles.position(d);
+               value_type* v = particles.velocity(d);
+               const value_type* a = particles.acceleration(d);
+               const value_type k = kick[s] * dt;
+               for(size_t i = 0; i < n; ++i) v[i] += k * a[i];
+               if(s == drifts) continue;
+               const value_type c = drift[s] * dt;
+               for(size_t i = 0; i < n; ++i) x[i] += c * v[i];
+            }
+         }
+      }
+      
+   private:
+      field_type* _field; //< Force field
+   };
+   
+   //////////////////////////////////////////////////////////////////////////////////////////
+   /// Yoshida's fourth order symplectic integrator
+   ///
+   /// Three leapfrog steps of w1 dt, w0 dt and w1 dt, w0 negative, chosen so the second
+   /// and third order errors cancel. Neighbouring kicks are merged, four field evaluations
+   /// per step. Worth it over Leapfrog when accuracy rather than just stability is the goal.
+   ///
+   /// H. Yoshida, Construction of higher order symplectic integrators, Phys. Lett. A 150
+   /// (1990) 262.
+   //////////////////////////////////////////////////////////////////////////////////////////
+   template <class FIELD>
+   class Yoshida4 : public Leapfrog<FIELD>
+   {
+   public:
+      typedef Leapfrog<FIELD> base_type;
+      typedef typename base_type::field_type    field_type;
+      typedef typename base_type::particle_type particle_type;
+      typedef typename base_type::value_type    value_type;
+      typedef typename base_type::vec_type      vec_type;
+      
+      /// Constructor
+      Yoshida4(field_type* field)
+      : base_type(field)
+      {
+         const double cubeRoot2 = pow(2.0, 1.0 / 3.0);
+         const double w1 = 1.0 / (2.0 - cubeRoot2);
+         const double w0 = -cubeRoot2 * w1;
+         _drift[0] = static_cast<value_type>(w1);
+         _drift[1] = static_cast<value_type>(w0);
+         _drift[2] = static_cast<value_type>(w1);
+         _kick[0]  = static_cast<value_type>(w1 / 2);
+         _kick[1]  = static_cast<value_type>((w1 + w0) / 2);
+         _kick[2]  = static_cast<value_type>((w0 + w1) / 2);
+         _kick[3]  = static_cast<value_type>(w1 / 2);
+      }
+      
+      /////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+      /// Integration step
+      ///
+      /// @params state    the current state for a particle
+      ///         t        the current time
+      ///         dt       size of the time step
+      particle_type operator()(const particle_type& state, value_type t, value_type dt)
+      {
+         return base_type::compose(state, dt, _kick, _drift, 3);
+      }
+      
+      /////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+      /// Integrate every particle of a ParticleArray in place, see Leapfrog
+      void operator()(ParticleArray<vec_type>& particles, value_type t, value_type dt)
+      {
+         base_type::compose(particles, dt, _kick, _drift, 3);
+      }
+      
+   private:
+      value_type _kick[4];
+      value_type _drift[3];
+   };
+   
+}
+
+#endif
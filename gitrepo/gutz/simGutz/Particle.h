@@ -64,10 +64,12 @@ namespace gutz
       /// Default constructor
       ///////////////////////////////////////////////////////////////////////////////////////
       Particle() 
-      :  _id         (-1),
-         _position   (vec_type(static_cast<value_type>(0))),
-         _velocity   (vec_type(static_cast<value_type>(0))),
-         _mass       (static_cast<value_type>(0))
+      :  _id            (-1),
+         _position      (vec_type(static_cast<value_type>(0))),
+         _velocity      (vec_type(static_cast<value_type>(0))),
+         _acceleration  (vec_type(static_cast<value_type>(0))),
+         _mass          (static_cast<value_type>(0)),
+         _radius        (static_cast<value_type>(0))
       {
       }
       
@@ -76,10 +78,12 @@ namespace gutz
       ///////////////////////////////////////////////////////////////////////////////////////
       Particle(const vec_type& position, const vec_type& velocity, const value_type& mass,
                const int id = -1)
-      :  _id         (id),
-         _position   (position),
-         _velocity   (velocity),
-         _mass       (mass)
+      :  _id            (id),
+         _position      (position),
+         _velocity      (velocity),
+         _acceleration  (vec_type(static_cast<value_type>(0))),
+         _mass          (mass),
+         _radius        (static_cast<value_type>(0))
       {}
       
 
@@ -108,6 +112,7 @@ namespace gutz
       {
          if(&p0 != this)
          {
+            _id            = p0._id;
             _position      = p0._position;
             _velocity      = p0._velocity;
             _acceleration	= p0._acceleration;
@@ -192,6 +197,22 @@ namespace gutz
          return _mass;
       }   
       
+      ///////////////////////////////////////////////////////////////////////////////////////
+      /// Set the radius of a particle in meters, for contact between particles
+      ///////////////////////////////////////////////////////////////////////////////////////
+      void setRadius(const value_type& radius)
+      {
+         _radius = radius;
+      }
+      
+      ///////////////////////////////////////////////////////////////////////////////////////
+      /// @return the radius of a particle in meters
+      ///////////////////////////////////////////////////////////////////////////////////////
+      const value_type getRadius(void) const
+      {
+         return _radius;
+      }
+      
       
       ///////////////////////////////////////////////////////////////////////////////////////
       /// Get the id for this particle
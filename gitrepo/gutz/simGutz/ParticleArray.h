@@ -0,0 +1,286 @@
+/////////////////////////////////////////////////////////////////////////////////////////////
+//                                                                                           
+//                                          8MMNMM8                                          
+//                                     $MMMMMMMMMMMNMMNNNNN:                                 
+//                             7MMMMMMMMMMMMMNNNMNNNNNNNMNDDDDD7                             
+//                            MMMMMMMMMMMMMMNNNNNNNNNNNNNND8DD888                            
+//                          ZMMMMMMMMMMMMMMMMNNNNNNNNNNNNNNNNDDD8888:                        
+//                       8MMMMMMMMMMMMMMMMMMMNNNNNNNNNNNNNNNNDDD88888=                       
+//                     MMMMMMMMMMMMMMMMMMMMMMMNNNMNNNNNNNNNNNNNDD88888O8                     
+//                   MMMMMMMMMMMMMMMMNNNNNNNNNNNDDDDDDDDDDNNDNNNDD888888O8                   
+//                  MMMMMMMMMMMMMMMNNNNNNNNNNNNDDDDDDDDDDDDDDD888ND88888OO8                  
+//                 MMMMMMMMMMMMMMMNNNNNNNNNNNNNNDDDDDDDDDDDDDDD888OO8DDOOZZZ                 
+//                MMMMMMMMMMMMMMMNMMMMMMMMMMMMMMMMMMMMMMNDDDDDD8888OOOZZ$$$$Z                
+//               ,MMMMMMMMMMMMMMMMMNNNNNMMMMMMMMMMMMMMMDDDDDDMMMDN8OOOOZZZ++I7               
+//               MMMMMMMMMMMMMMMMMMMNNNNNNNNNNNNNNNNDDDDDDDDMMM88OMMD8OOZZZ$~I               
+//              MMMMMMMMMMMMMMMMMNND8Z7I+=~::::::::~~=?I$O88DDDDD8MMOO8M8OZZ$$$              
+//             MMMMMMMMMMMMMNDOI+:,                         ,~+78O888OMMZDMO$$$$             
+//            MMMMMMMMMMM87=,                                     ,+$8OOOMMZM8$$7            
+//           MMMMMMMMMO?:                                             :IOZO8M7MO77           
+//          MMMMMMMDI,                                                   :7ZZZM7MZ7          
+//         MMMMMMD?,                                                       ,7DZMDMZ7         
+//        :MMMMN?,                                                           ,$$$MMZ,        
+//        MMMM8~                                                               +N$MM7        
+//        MMMZ,                                                                 ~DZMM        
+//        MMD:                                           8""""8 8                1XD         
+//          #2IN                eeeee eeeee eeeeeee eeee 8    " 8               2YE          
+//            1HM               8   8 8  88 8  8  8 8    8e     8e             3ZF           
+//              0GL             8e  8 8   8 8e 8  8 8eee 88  ee 88            4AG            
+//                9FK           88  8 8   8 88 8  8 88   88   8 88           5BH             
+//                  8EJ         88ee8 8eee8 88 8  8 88ee 88eee8 88eee       6CJ              
+//                    7DI                                                7DI                 
+//                       OO?~                                        ,~78D                   
+//                         D8$+:,                             ,~?ZDN                         
+//                             ,NDO$?=::,             ,:~=?$8DM,                             
+//                                       ~7NNNNN8NNNNNZ:                                     
+//                                                                                           
+//                                                                                           
+//                                       Copyright 2011                                      
+//                      Art, Research, Technology and Science Laboratory                     
+//                                 The University of New Mexico                              
+//                                      Project Home Page                                    
+//                           <<<<http://artslab.unm.edu/domegl>>>>>                          
+//                                       Code Repository                                     
+//                           <<<https://svn.cs.unm.edu/domegl>>>>>>                          
+//                                                                                           
+/////////////////////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include <map>
+#include <string>
+#include <vector>
+#include <vec.h>
+#include <Particle.h>
+
+namespace gutz
+{
+   
+   //////////////////////////////////////////////////////////////////////////////////////////
+   /// Structure of arrays particle store
+   ///
+   /// Every component of position, velocity and acceleration, the mass and the id live in
+   /// their own contiguous column, so a force loop that only reads positions and masses
+   /// streams exactly those through the cache, and the loops vectorize. Particles go in
+   /// and out as gutz::Particle; fields and integrators work on the columns.
+   ///
+   /// Anything else a particle carries (charge, radius, age, ...) is an optional named
+   /// column, created on first use and kept the same length as the rest.
+   ///
+   /// \code
+   /// gutz::ParticleArray<gutz::vec3f> particles;
+   /// particles.push_back(gutz::Particle<gutz::vec3f>(x, v, m));
+   /// float* radius = particles.column("radius");
+   /// 
+   /// const float* x = particles.position(0);   // all x coordinates
+   /// const float* m = particles.mass();
+   /// \endcode
+   //////////////////////////////////////////////////////////////////////////////////////////
+   template<typename VEC_TYPE = gutz::vec3f>
+   class ParticleArray
+   {
+   public:
+      typedef VEC_TYPE vec_type;
+      typedef typename VEC_TYPE::value_type value_type;
+      static const int dimension = VEC_TYPE::size;
+      typedef Particle<VEC_TYPE> particle_type;
+      typedef std::vector<value_type> column_type;
+      
+      ///////////////////////////////////////////////////////////////////////////////////////
+      /// Constructor
+      ///////////////////////////////////////////////////////////////////////////////////////
+      ParticleArray() {}
+      
+      ///////////////////////////////////////////////////////////////////////////////////////
+      /// Copy particles in from a container of particle_type
+      ///////////////////////////////////////////////////////////////////////////////////////
+      template<typename p_iterator_type>
+      ParticleArray(const p_iterator_type& begin, const p_iterator_type& end)
+      {
+         for(p_iterator_type i = begin; i != end; ++i) push_back(*i);
+      }
+      
+      ///////////////////////////////////////////////////////////////////////////////////////
+      /// @return the number of particles
+      ///////////////////////////////////////////////////////////////////////////////////////
+      size_t size(void) const { return _mass.size(); }
+      
+      bool empty(void) const { return _mass.empty(); }
+      
+      ///////////////////////////////////////////////////////////////////////////////////////
+      /// Change the number of particles. New ones are zero with id -1.
+      ///////////////////////////////////////////////////////////////////////////////////////
+      void resize(size_t n)
+      {
+         for(int d = 0; d < dimension; ++d)
+         {
+            _position[d].resize(n, static_cast<value_type>(0));
+            _velocity[d].resize(n, static_cast<value_type>(0));
+            _acceleration[d].resize(n, static_cast<value_type>(0));
+         }
+         _mass.resize(n, static_cast<value_type>(0));
+         _id.resize(n, -1);
+         for(typename column_map::iterator c = _columns.begin(); c != _columns.end(); ++c)
+         {
+            c->second.resize(n, static_cast<value_type>(0));
+         }
+      }
+      
+      void reserve(size_t n)
+      {
+         for(int d = 0; d < dimension; ++d)
+         {
+            _position[d].reserve(n);
+            _velocity[d].reserve(n);
+            _acceleration[d].reserve(n);
+         }
+         _mass.reserve(n);
+         _id.reserve(n);
+      }
+      
+      void clear(void) { resize(0); }
+      
+      ///////////////////////////////////////////////////////////////////////////////////////
+      /// Add a particle at the end
+      ///////////////////////////////////////////////////////////////////////////////////////
+      void push_back(const particle_type& particle)
+      {
+         const size_t i = size();
+         resize(i + 1);
+         set(i, particle);
+      }
+      
+      ///////////////////////////////////////////////////////////////////////////////////////
+      /// Overwrite particle i's id, position, velocity, acceleration and mass. A radius goes
+      /// to the "radius" column, made on the first particle that has one.
+      ///////////////////////////////////////////////////////////////////////////////////////
+      void set(size_t i, const particle_type& particle)
+      {
+         setPosition(i, particle.getPosition());
+         setVelocity(i, particle.getVelocity());
+         setAcceleration(i, particle.getAcceleration());
+         _mass[i] = particle.getMass();
+         _id[i]   = particle.getID();
+         if(particle.getRadius() != static_cast<value_type>(0) || hasColumn("radius"))
+         {
+            column("radius")[i] = particle.getRadius();
+         }
+      }
+      
+      ///////////////////////////////////////////////////////////////////////////////////////
+      /// @return particle i as a gutz::Particle. Named columns other than "radius" are not
+      /// part of it.
+      ///////////////////////////////////////////////////////////////////////////////////////
+      particle_type particle(size_t i) const
+      {
+         particle_type p(getPosition(i), getVelocity(i), _mass[i], _id[i]);
+         p.setAcceleration(getAcceleration(i));
+         const value_type* radius = column("radius");
+         if(radius) p.setRadius(radius[i]);
+         return p;
+      }
+      
+      ///////////////////////////////////////////////////////////////////////////////////////
+      /// Gather and scatter one particle's vectors
+      ///////////////////////////////////////////////////////////////////////////////////////
+      vec_type getPosition(size_t i) const     { return gather(_position, i); }
+      vec_type getVelocity(size_t i) const     { return gather(_velocity, i); }
+      vec_type getAcceleration(size_t i) const { return gather(_acceleration, i); }
+      
+      void setPosition(size_t i, const vec_type& position)         { scatter(_position, i, position); }
+      void setVelocity(size_t i, const vec_type& velocity)         { scatter(_velocity, i, velocity); }
+      void setAcceleration(size_t i, const vec_type& acceleration) { scatter(_acceleration, i, acceleration); }
+      
+      ///////////////////////////////////////////////////////////////////////////////////////
+      /// The columns. Component d of every particle's position, velocity or acceleration,
+      /// contiguous. The pointers stay valid until the array is resized.
+      ///////////////////////////////////////////////////////////////////////////////////////
+      value_type*       position(int d)           { return data(_position[d]); }
+      const value_type* position(int d) const     { return data(_position[d]); }
+      value_type*       velocity(int d)           { return data(_velocity[d]); }
+      const value_type* velocity(int d) const     { return data(_velocity[d]); }
+      value_type*       acceleration(int d)       { return data(_acceleration[d]); }
+      const value_type* acceleration(int d) const { return data(_acceleration[d]); }
+      value_type*       mass(void)                { return data(_mass); }
+      const value_type* mass(void) const          { return data(_mass); }
+      int*              id(void)                  { return _id.empty() ? 0 : &_id[0]; }
+      const int*        id(void) const            { return _id.empty() ? 0 : &_id[0]; }
+      
+      ///////////////////////////////////////////////////////////////////////////////////////
+      /// Zero every acceleration. Fields add to the acceleration columns, clear them
+      /// before summing up a new step.
+      ///////////////////////////////////////////////////////////////////////////////////////
+      void clearAcceleration(void)
+      {
+         for(int d = 0; d < dimension; ++d)
+         {
+            _acceleration[d].assign(size(), static_cast<value_type>(0));
+         }
+      }
+      
+      ///////////////////////////////////////////////////////////////////////////////////////
+      /// Named attribute column, created full of zeros if there is none by that name
+      ///////////////////////////////////////////////////////////////////////////////////////
+      value_type* column(const std::string& name)
+      {
+         typename column_map::iterator c = _columns.find(name);
+         if(c == _columns.end())
+         {
+            c = _columns.insert(std::make_pair(name, column_type(size(), static_cast<value_type>(0)))).first;
+         }
+         return data(c->second);
+      }
+      
+      ///////////////////////////////////////////////////////////////////////////////////////
+      /// Named attribute column, 0 if there is none by that name
+      ///////////////////////////////////////////////////////////////////////////////////////
+      const value_type* column(const std::string& name) const
+      {
+         typename column_map::const_iterator c = _columns.find(name);
+         return c == _columns.end() ? 0 : data(c->second);
+      }
+      
+      bool hasColumn(const std::string& name) const { return _columns.count(name) != 0; }
+      
+      void removeColumn(const std::string& name) { _columns.erase(name); }
+      
+      ///////////////////////////////////////////////////////////////////////////////////////
+      /// Names of the attribute columns, in order
+      ///////////////////////////////////////////////////////////////////////////////////////
+      std::vector<std::string> columnNames(void) const
+      {
+         std::vector<std::string> names;
+         for(typename column_map::const_iterator c = _columns.begin(); c != _columns.end(); ++c)
+         {
+            names.push_back(c->first);
+         }
+         return names;
+      }
+      
+   private:
+      typedef std::map<std::string, column_type> column_map;
+      
+      static vec_type gather(const column_type columns[], size_t i)
+      {
+         vec_type v;
+         for(int d = 0; d < dimension; ++d) v[d] = columns[d][i];
+         return v;
+      }
+      
+      static void scatter(column_type columns[], size_t i, const vec_type& v)
+      {
+         for(int d = 0; d < dimension; ++d) columns[d][i] = v[d];
+      }
+      
+      static value_type*       data(column_type& c)       { return c.empty() ? 0 : &c[0]; }
+      static const value_type* data(const column_type& c) { return c.empty() ? 0 : &c[0]; }
+      
+      column_type      _position[dimension];      //< Meters
+      column_type      _velocity[dimension];      //< Meters per second
+      column_type      _acceleration[dimension];  //< Meters per second squared
+      column_type      _mass;                     //< Kilograms
+      std::vector<int> _id;
+      column_map       _columns;                  //< Optional attributes by name
+   };
+   
+}
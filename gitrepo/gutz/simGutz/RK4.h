@@ -48,7 +48,10 @@
 #ifndef _RK4_h
 #define _RK4_h
 
+#include <vector>
 #include <vec.h>
+#include <ParticleArray.h>
+#include <Field.h>
 
 /////////////////////////////////////////////////////////////////////////////////////////////
 /// Runge-Kutta 4th Order Solver
@@ -148,7 +151,7 @@ namespace gutz
          Derivative b = evaluate(state, t, dt*0.5f, a);
          Derivative c = evaluate(state, t, dt*0.5f, b);
          Derivative d = evaluate(state, t, dt, c);
-         static value_type one_sixth = 1.0f/6.0f; // What if we're using complex numbers? Will this work?
+         static const value_type one_sixth = static_cast<value_type>(1) / static_cast<value_type>(6); // Not 1.0f/6.0f, a float sixth stalls doubles near 1e-7
          const vec_type dxdt = (a.dx + (b.dx + c.dx) * 2.0f + d.dx) * one_sixth;
          const vec_type dvdt = (a.dv + (b.dv + c.dv) * 2.0f + d.dv) * one_sixth;
          
@@ -162,7 +165,94 @@ namespace gutz
                               state.getMass());
       }
       
+      /////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+      /// Integrate every particle of a ParticleArray in place. Only the position and velocity columns change.
+      ///
+      /// For a field with a bulk accelerate() (IsBulkField<FIELD>: P2PField, BarnesHutField, FMMField,
+      /// DirectSumField, CollisionField) it goes stage by stage rather than particle by particle. Each of the four stages moves
+      /// a scratch copy of the whole array and evaluates the field for all of it at once, the update loops run
+      /// down the columns and no particle_type is made. The scratch columns are kept between calls.
+      ///
+      /// A field that only works one particle at a time is integrated one particle at a time, which streams
+      /// the columns once instead of four times and is about twice as fast for a cheap field.
+      ///
+      /// @params particles   the particles
+      ///         t           the current time
+      ///         dt          size of the time step
+      void operator()(ParticleArray<vec_type>& particles, value_type t, value_type dt)
+      {
+         integrate(particles, t, dt, Batch<ForEachParticle<field_type>::bulk>());
+      }
+      
    protected:
+      template<int BULK> struct Batch {};
+      
+      void integrate(ParticleArray<vec_type>& particles, value_type t, value_type dt, Batch<false>)
+      {
+         for(size_t i = 0; i < particles.size(); ++i)
+         {
+            const particle_type next = (*this)(particles.particle(i), t, dt);
+            particles.setPosition(i, next.getPosition());
+            particles.setVelocity(i, next.getVelocity());
+         }
+      }
+      
+      void integrate(ParticleArray<vec_type>& particles, value_type t, value_type dt, Batch<true>)
+      {
+         static const int dimension = vec_type::size;
+         static const value_type weight[4] = { 1, 2, 2, 1 };        // Of each stage's derivative
+         const value_type offset[4] = { dt / 2, dt / 2, dt, 0 };    // Of the next stage from the start
+         const size_t n = particles.size();
+         if(n == 0) return;
+         
+         _stage = particles;  // Positions, velocities, masses and named columns for the field
+         for(int d = 0; d < dimension; ++d)
+         {
+            _dx[d].assign(n, static_cast<value_type>(0));
+            _dv[d].assign(n, static_cast<value_type>(0));
+         }
+         
+         ForEachParticle<field_type> forEach;
+         for(int stage = 0; stage < 4; ++stage)
+         {
+            _stage.clearAcceleration();
+            forEach(_stage, *_field);
+            for(int d = 0; d < dimension; ++d)
+            {
+               const value_type* x0 = particles.position(d);
+               const value_type* v0 = particles.velocity(d);
+               value_type* x = _stage.position(d);
+               value_type* v = _stage.velocity(d);
+               const value_type* a = _stage.acceleration(d);
+               value_type* dx = &_dx[d][0];
+               value_type* dv = &_dv[d][0];
+               for(size_t i = 0; i < n; ++i)
+               {
+                  // Derivative at this stage is (v, a), the next stage starts from the initial state
+                  const value_type vi = v[i];
+                  dx[i] += weight[stage] * vi;
+                  dv[i] += weight[stage] * a[i];
+                  x[i] = x0[i] + offset[stage] * vi;
+                  v[i] = v0[i] + offset[stage] * a[i];
+               }
+            }
+         }
+         
+         const value_type sixth = dt / static_cast<value_type>(6);
+         for(int d = 0; d < dimension; ++d)
+         {
+            value_type* x = particles.position(d);
+            value_type* v = particles.velocity(d);
+            const value_type* dx = &_dx[d][0];
+            const value_type* dv = &_dv[d][0];
+            for(size_t i = 0; i < n; ++i)
+            {
+               x[i] += sixth * dx[i];
+               v[i] += sixth * dv[i];
+            }
+         }
+      }
+      
       Derivative evaluate(const particle_type& initial, value_type t)
       {
          Derivative output;
@@ -186,7 +276,10 @@ namespace gutz
       }
       
    private:
-      field_type* _field; //< Force field
+      field_type*             _field;                //< Force field
+      ParticleArray<vec_type> _stage;                //< Batch scratch, the state at the current stage
+      std::vector<value_type> _dx[vec_type::size];   //< Batch scratch, weighted sums of the derivatives
+      std::vector<value_type> _dv[vec_type::size];
    };
 
    namespace deprecated
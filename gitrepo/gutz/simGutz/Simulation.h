@@ -49,6 +49,7 @@
 
 #include <vector>
 #include <Field.h>
+#include <threadPool.h>
 
 namespace gutz
 {
@@ -71,9 +72,16 @@ namespace gutz
       
       ///////////////////////////////////////////////////////////////////////////////////////
       /// Constructor
+      ///
+      /// @param integrator
+      ///   Integrates each particle in its field
+      ///
+      /// @param p2pField
+      ///   The pairwise field, required unless NBODY_FIELD is NullType. With NullType there
+      ///   is no pairwise phase at all and the pointer is never looked at.
       ///////////////////////////////////////////////////////////////////////////////////////
       Simulation(integrator_type* integrator, p2p_field_type* p2pField=0)
-      : _integrator(integrator), _p2pField(0)
+      : _integrator(integrator), _p2pField(p2pField), _threads(1)
       {}
       
       
@@ -85,6 +93,8 @@ namespace gutz
          if(this != &sim)
          {
             _integrator = sim._integrator;
+            _p2pField   = sim._p2pField;
+            _threads    = sim._threads;
             for(unsigned int i = 0; i < sim._particles.size(); ++i)
             {
                _particles.push_back(sim._particles[i]);
@@ -129,37 +139,51 @@ namespace gutz
       ///////////////////////////////////////////////////////////////////////////////////////
       const size_t size(void) const { return _particles.size(); }
       
+      ///////////////////////////////////////////////////////////////////////////////////////
+      /// Copy every particle into state, replacing what it held. With Snapshot.h this
+      /// saves a simulation, see gutz::writeSnapshot and gutz::TrajectoryWriter.
+      ///////////////////////////////////////////////////////////////////////////////////////
+      void getState(ParticleArray<vec_type>& state) const
+      {
+         state.resize(_particles.size());
+         for(size_t i = 0; i < _particles.size(); ++i) state.set(i, _particles[i]);
+      }
+      
+      ///////////////////////////////////////////////////////////////////////////////////////
+      /// Replace every particle with the ones in state
+      ///////////////////////////////////////////////////////////////////////////////////////
+      void setState(const ParticleArray<vec_type>& state)
+      {
+         _particles.resize(state.size());
+         for(size_t i = 0; i < state.size(); ++i) _particles[i] = state.particle(i);
+      }
+      
+      ///////////////////////////////////////////////////////////////////////////////////////
+      /// Number of threads advanceState() uses, the calling thread included. With more than
+      /// one, the integrator and both fields are called from several threads at once.
+      ///////////////////////////////////////////////////////////////////////////////////////
+      void setThreads(unsigned int threads)
+      {
+         _threads = threads > 0 ? threads : 1;
+      }
+      
+      unsigned int getThreads(void) const { return _threads; }
+      
       ///////////////////////////////////////////////////////////////////////////////////////
       /// Advance the state
+      ///
+      /// Two phases. The accelerations from the pairwise field are computed for every particle
+      /// from the positions at time, then every particle's velocity is kicked by its pairwise
+      /// acceleration times deltaTime and the integrator moves it through its own field on
+      /// the kicked velocity. For the pairwise force that is symplectic Euler, first order
+      /// but bound orbits stay bound. Each particle's sum runs in the same order whichever
+      /// thread does it, so the result does not depend on the number of threads. Without a
+      /// pairwise field (NullType) only the second phase exists, chosen at compile time.
       ///////////////////////////////////////////////////////////////////////////////////////
       void advanceState(value_type time, value_type deltaTime)
       {
-#if 0
-         // Update each particle
-         for(unsigned int i = 0; i < _particles.size(); ++i)
-         {
-            _particles[i] = (*_integrator)(_particles[i], time, deltaTime);
-         }
-#else
-         ForEachParticlePair<p2p_field_type> fepp;
-         //p2p_field_type p2p_field;
-         vec_type acceleration;
-         for(particle_iterator i = _particles.begin(); i != _particles.end(); ++i)
-         {
-//            ForEachParticlePair fepp;
-            acceleration = vec_type(static_cast<value_type>(0));
-            fepp(acceleration, i, _particles.begin(), _particles.end(), (*_p2pField));
-//            std::cout << "acceleration: " << acceleration << std::endl;
-            
-            vec_type move(acceleration * (deltaTime * deltaTime));
-            (*i) = (*_integrator)(*i, time, deltaTime);
-            (*i).setPosition((*i).getPosition() + move);
-//            (*i).setPosition((*i).getPosition() + move * 0.0);
-//            std::cout << "move: " << move << std::endl;
-         }
-         
-#endif
-         
+         if(!_pool || _pool->size() != _threads) _pool = new ThreadPool(_threads);
+         advanceState(time, deltaTime, Pairwise<IsPairwiseField<p2p_field_type>::value>());
       }
 
    protected:
@@ -169,7 +193,7 @@ namespace gutz
       /// Copy constructor
       ///////////////////////////////////////////////////////////////////////////////////////
       Simulation(const Simulation& sim)
-      : _integrator(sim._integrator)
+      : _integrator(sim._integrator), _p2pField(sim._p2pField), _threads(sim._threads)
       {
          for(unsigned int i = 0; i < sim._particles.size(); ++i)
          {
@@ -179,9 +203,77 @@ namespace gutz
       
       
    private:
-      particle_vector_type _particles;
+      template<int PAIRWISE> struct Pairwise {};
+      
+      void advanceState(value_type time, value_type deltaTime, Pairwise<true>)
+      {
+         _accelerations.resize(_particles.size());
+         _fepp.prepare(_particles.begin(), _particles.end(), (*_p2pField));
+         Accelerate accelerate = { this, &_fepp };
+         _pool->run(accelerate, _particles.size());
+         
+         Integrate<true> integrate = { this, time, deltaTime };
+         _pool->run(integrate, _particles.size());
+      }
+      
+      void advanceState(value_type time, value_type deltaTime, Pairwise<false>)
+      {
+         Integrate<false> integrate = { this, time, deltaTime };
+         _pool->run(integrate, _particles.size());
+      }
+      
+      ///////////////////////////////////////////////////////////////////////////////////////
+      /// Phase one, pairwise accelerations of a range of particles. Reads only.
+      ///////////////////////////////////////////////////////////////////////////////////////
+      struct Accelerate
+      {
+         Simulation*                          sim;
+         ForEachParticlePair<p2p_field_type>* fepp;
+         
+         void operator()(size_t begin, size_t end)
+         {
+            particle_iterator first = sim->_particles.begin();
+            for(size_t i = begin; i < end; ++i)
+            {
+               particle_iterator p = first + i;
+               vec_type acceleration(static_cast<value_type>(0));
+               (*fepp)(acceleration, p, sim->_particles.begin(), sim->_particles.end(), (*sim->_p2pField));
+               sim->_accelerations[i] = acceleration;
+            }
+         }
+      };
+      
+      ///////////////////////////////////////////////////////////////////////////////////////
+      /// Phase two, integrate a range of particles. Each one only touches itself. PAIRWISE
+      /// first kicks the velocity with phase one's acceleration.
+      ///////////////////////////////////////////////////////////////////////////////////////
+      template<bool PAIRWISE>
+      struct Integrate
+      {
+         Simulation* sim;
+         value_type  time;
+         value_type  deltaTime;
+         
+         void operator()(size_t begin, size_t end)
+         {
+            for(size_t i = begin; i < end; ++i)
+            {
+               particle_type& p = sim->_particles[i];
+               if(PAIRWISE) p.setVelocity(p.getVelocity() + sim->_accelerations[i] * deltaTime);
+               p = (*sim->_integrator)(p, time, deltaTime);
+            }
+         }
+      };
+      
+      particle_vector_type  _particles;
       integrator_type*      _integrator;
       p2p_field_type*       _p2pField;
+      unsigned int          _threads;
+      ThreadPool::pointer   _pool;           //< Made by advanceState(), each copy its own
+      std::vector<vec_type> _accelerations;  //< Phase one results
+      
+      /// Kept between steps, a neighbor search updates its cells rather than starting over
+      ForEachParticlePair<p2p_field_type> _fepp;
    };
    
 }
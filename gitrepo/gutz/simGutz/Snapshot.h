@@ -0,0 +1,673 @@
+/////////////////////////////////////////////////////////////////////////////////////////////
+//                                                                                           
+//                                          8MMNMM8                                          
+//                                     $MMMMMMMMMMMNMMNNNNN:                                 
+//                             7MMMMMMMMMMMMMNNNMNNNNNNNMNDDDDD7                             
+//                            MMMMMMMMMMMMMMNNNNNNNNNNNNNND8DD888                            
+//                          ZMMMMMMMMMMMMMMMMNNNNNNNNNNNNNNNNDDD8888:                        
+//                       8MMMMMMMMMMMMMMMMMMMNNNNNNNNNNNNNNNNDDD88888=                       
+//                     MMMMMMMMMMMMMMMMMMMMMMMNNNMNNNNNNNNNNNNNDD88888O8                     
+//                   MMMMMMMMMMMMMMMMNNNNNNNNNNNDDDDDDDDDDNNDNNNDD888888O8                   
+//                  MMMMMMMMMMMMMMMNNNNNNNNNNNNDDDDDDDDDDDDDDD888ND88888OO8                  
+//                 MMMMMMMMMMMMMMMNNNNNNNNNNNNNNDDDDDDDDDDDDDDD888OO8DDOOZZZ                 
+//                MMMMMMMMMMMMMMMNMMMMMMMMMMMMMMMMMMMMMMNDDDDDD8888OOOZZ$$$$Z                
+//               ,MMMMMMMMMMMMMMMMMNNNNNMMMMMMMMMMMMMMMDDDDDDMMMDN8OOOOZZZ++I7               
+//               MMMMMMMMMMMMMMMMMMMNNNNNNNNNNNNNNNNDDDDDDDDMMM88OMMD8OOZZZ$~I               
+//              MMMMMMMMMMMMMMMMMNND8Z7I+=~::::::::~~=?I$O88DDDDD8MMOO8M8OZZ$$$              
+//             MMMMMMMMMMMMMNDOI+:,                         ,~+78O888OMMZDMO$$$$             
+//            MMMMMMMMMMM87=,                                     ,+$8OOOMMZM8$$7            
+//           MMMMMMMMMO?:                                             :IOZO8M7MO77           
+//          MMMMMMMDI,                                                   :7ZZZM7MZ7          
+//         MMMMMMD?,                                                       ,7DZMDMZ7         
+//        :MMMMN?,                                                           ,$$$MMZ,        
+//        MMMM8~                                                               +N$MM7        
+//        MMMZ,                                                                 ~DZMM        
+//        MMD:                                           8""""8 8                1XD         
+//          #2IN                eeeee eeeee eeeeeee eeee 8    " 8               2YE          
+//            1HM               8   8 8  88 8  8  8 8    8e     8e             3ZF           
+//              0GL             8e  8 8   8 8e 8  8 8eee 88  ee 88            4AG            
+//                9FK           88  8 8   8 88 8  8 88   88   8 88           5BH             
+//                  8EJ         88ee8 8eee8 88 8  8 88ee 88eee8 88eee       6CJ              
+//                    7DI                                                7DI                 
+//                       OO?~                                        ,~78D                   
+//                         D8$+:,                             ,~?ZDN                         
+//                             ,NDO$?=::,             ,:~=?$8DM,                             
+//                                       ~7NNNNN8NNNNNZ:                                     
+//                                                                                           
+//                                                                                           
+//                                       Copyright 2011                                      
+//                      Art, Research, Technology and Science Laboratory                     
+//                                 The University of New Mexico                              
+//                                      Project Home Page                                    
+//                           <<<<http://artslab.unm.edu/domegl>>>>>                          
+//                                       Code Repository                                     
+//                           <<<https://svn.cs.unm.edu/domegl>>>>>>                          
+//                                                                                           
+/////////////////////////////////////////////////////////////////////////////////////////////
+
+#ifndef _SNAPSHOT_H
+#define _SNAPSHOT_H
+
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <stdint.h>
+#include <exception.h>
+#include <thread.h>
+#include <ParticleArray.h>
+
+namespace gutz
+{
+   //////////////////////////////////////////////////////////////////////////////////////////
+   /// The snapshot file format
+   ///
+   /// A snapshot is a 64 byte Header, a directory of Column entries, then one block per
+   /// column. Every block starts on a multiple of ALIGN bytes from the start of the
+   /// snapshot, so a snapshot read through mmap hands out aligned column pointers. The
+   /// columns are, in order: "id" (int32), "mass", "position.d", "velocity.d",
+   /// "acceleration.d" for each dimension d, then the named columns of the ParticleArray.
+   /// Numbers are in the writer's byte order, Header::endian tells.
+   ///
+   /// A trajectory is snapshots back to back, each a multiple of ALIGN long, followed by
+   /// the file offset of every snapshot and a Trailer. A trajectory whose writer died
+   /// without a trailer can still be read by walking the headers, and so can a single
+   /// snapshot.
+   //////////////////////////////////////////////////////////////////////////////////////////
+   namespace snapshot
+   {
+      enum
+      {
+         ALIGN   = 64,  //< Bytes, blocks and snapshots start on multiples of this
+         NAME    = 24,  //< Bytes of a column name, the terminating 0 included
+         VERSION = 1
+      };
+      
+      static const uint32_t ENDIAN = 0x01020304;
+      
+      struct Header
+      {
+         char     magic[8];     //< "GUTZSNAP"
+         uint32_t version;
+         uint32_t endian;       //< ENDIAN as written
+         uint32_t valueSize;    //< 4 for float, 8 for double
+         uint32_t dimension;
+         uint32_t columns;      //< Entries in the directory
+         uint32_t reserved;
+         uint64_t particles;
+         uint64_t size;         //< Bytes from the start of the header to the end of the last block
+         double   time;
+         uint64_t unused;
+      };
+      
+      struct Column
+      {
+         char     name[NAME];
+         uint64_t offset;       //< From the start of the header
+      };
+      
+      struct Trailer
+      {
+         char     magic[8];     //< "GUTZTRAJ"
+         uint64_t frames;
+         uint64_t index;        //< File offset of the frames uint64_t offsets
+         uint64_t unused;
+      };
+      
+      typedef char header_is_64_bytes[sizeof(Header) == 64 ? 1 : -1];
+      typedef char column_is_32_bytes[sizeof(Column) == 32 ? 1 : -1];
+      typedef char int_is_32_bits[sizeof(int) == 4 ? 1 : -1];
+      
+      inline uint64_t align(uint64_t bytes) { return (bytes + ALIGN - 1) / ALIGN * ALIGN; }
+      
+      inline std::string name(const char* vector, int d)
+      {
+         return std::string(vector) + "." + static_cast<char>('0' + d);
+      }
+      
+      ///////////////////////////////////////////////////////////////////////////////////////
+      /// Plain file access, 64 bit offsets, throwing gutz::Exception on failure
+      ///////////////////////////////////////////////////////////////////////////////////////
+      inline void seek(std::FILE* file, uint64_t offset)
+      {
+#if defined(_WIN32)
+         const int failed = _fseeki64(file, static_cast<__int64>(offset), SEEK_SET);
+#else
+         const int failed = fseeko(file, static_cast<off_t>(offset), SEEK_SET);
+#endif
+         if(failed) throw gutz::Exception("snapshot: seek failed");
+      }
+      
+      inline uint64_t length(std::FILE* file)
+      {
+#if defined(_WIN32)
+         _fseeki64(file, 0, SEEK_END);
+         return static_cast<uint64_t>(_ftelli64(file));
+#else
+         fseeko(file, 0, SEEK_END);
+         return static_cast<uint64_t>(ftello(file));
+#endif
+      }
+      
+      inline void write(std::FILE* file, const void* data, size_t bytes)
+      {
+         if(bytes > 0 && std::fwrite(data, 1, bytes, file) != bytes)
+         {
+            throw gutz::Exception("snapshot: write failed");
+         }
+      }
+      
+      inline void read(std::FILE* file, void* data, size_t bytes)
+      {
+         if(bytes > 0 && std::fread(data, 1, bytes, file) != bytes)
+         {
+            throw gutz::Exception("snapshot: read failed, file cut short");
+         }
+      }
+      
+      /// Zeros from at up to to
+      inline void pad(std::FILE* file, uint64_t at, uint64_t to)
+      {
+         static const char zeros[ALIGN] = { 0 };
+         write(file, zeros, static_cast<size_t>(to - at));
+      }
+      
+      ///////////////////////////////////////////////////////////////////////////////////////
+      /// Write particles as one snapshot at the current position of file
+      ///
+      /// @return the bytes written, a multiple of ALIGN
+      ///////////////////////////////////////////////////////////////////////////////////////
+      template<typename VEC_TYPE>
+      uint64_t writeFrame(std::FILE* file, const ParticleArray<VEC_TYPE>& particles, double time)
+      {
+         typedef typename VEC_TYPE::value_type value_type;
+         const int dimension = VEC_TYPE::size;
+         
+         std::vector<std::string> names;
+         std::vector<const void*> data;
+         names.push_back("id");
+         data.push_back(particles.id());
+         names.push_back("mass");
+         data.push_back(particles.mass());
+         for(int d = 0; d < dimension; ++d) { names.push_back(name("position", d));     data.push_back(particles.position(d)); }
+         for(int d = 0; d < dimension; ++d) { names.push_back(name("velocity", d));     data.push_back(particles.velocity(d)); }
+         for(int d = 0; d < dimension; ++d) { names.push_back(name("acceleration", d)); data.push_back(particles.acceleration(d)); }
+         const std::vector<std::string> named = particles.columnNames();
+         for(size_t c = 0; c < named.size(); ++c)
+         {
+            names.push_back(named[c]);
+            data.push_back(particles.column(named[c]));
+         }
+         
+         Header header;
+         std::memset(&header, 0, sizeof(header));
+         std::memcpy(header.magic, "GUTZSNAP", 8);
+         header.version   = VERSION;
+         header.endian    = ENDIAN;
+         header.valueSize = sizeof(value_type);
+         header.dimension = dimension;
+         header.columns   = static_cast<uint32_t>(names.size());
+         header.particles = particles.size();
+         header.time      = time;
+         
+         std::vector<Column> directory(names.size());
+         std::memset(&directory[0], 0, directory.size() * sizeof(Column));
+         std::vector<uint64_t> bytes(names.size());
+         uint64_t offset = align(sizeof(Header) + directory.size() * sizeof(Column));
+         for(size_t c = 0; c < names.size(); ++c)
+         {
+            if(names[c].size() >= NAME) throw gutz::Exception("snapshot: column name too long: " + names[c]);
+            std::strncpy(directory[c].name, names[c].c_str(), NAME);
+            directory[c].offset = offset;
+            bytes[c] = particles.size() * (c == 0 ? sizeof(int) : sizeof(value_type));
+            offset = align(offset + bytes[c]);
+         }
+         header.size = offset;
+         
+         write(file, &header, sizeof(header));
+         write(file, &directory[0], directory.size() * sizeof(Column));
+         uint64_t at = sizeof(Header) + directory.size() * sizeof(Column);
+         for(size_t c = 0; c < names.size(); ++c)
+         {
+            pad(file, at, directory[c].offset);
+            write(file, data[c], static_cast<size_t>(bytes[c]));
+            at = directory[c].offset + bytes[c];
+         }
+         pad(file, at, header.size);
+         return header.size;
+      }
+      
+      /// Read n numbers stored as FROM into to
+      template<typename FROM, typename TO>
+      void convert(std::FILE* file, TO* to, size_t n)
+      {
+         std::vector<FROM> from(n);
+         if(n > 0) read(file, &from[0], n * sizeof(FROM));
+         for(size_t i = 0; i < n; ++i) to[i] = static_cast<TO>(from[i]);
+      }
+      
+      ///////////////////////////////////////////////////////////////////////////////////////
+      /// Read the snapshot starting at offset start of file into particles. Float and
+      /// double files both read into either; named columns the snapshot doesn't have are
+      /// dropped.
+      ///
+      /// @return the snapshot's time
+      ///////////////////////////////////////////////////////////////////////////////////////
+      template<typename VEC_TYPE>
+      double readFrame(std::FILE* file, uint64_t start, ParticleArray<VEC_TYPE>& particles)
+      {
+         typedef typename VEC_TYPE::value_type value_type;
+         const int dimension = VEC_TYPE::size;
+         
+         Header header;
+         seek(file, start);
+         read(file, &header, sizeof(header));
+         if(std::memcmp(header.magic, "GUTZSNAP", 8) != 0) throw gutz::Exception("snapshot: not a snapshot");
+         if(header.endian != ENDIAN) throw gutz::Exception("snapshot: written with the other byte order");
+         if(header.version > VERSION) throw gutz::Exception("snapshot: written by a newer version");
+         if(header.dimension != static_cast<uint32_t>(dimension)) throw gutz::Exception("snapshot: wrong dimension");
+         if(header.valueSize != sizeof(float) && header.valueSize != sizeof(double))
+         {
+            throw gutz::Exception("snapshot: neither float nor double");
+         }
+         
+         std::vector<Column> directory(header.columns);
+         if(header.columns > 0) read(file, &directory[0], directory.size() * sizeof(Column));
+         
+         const size_t n = static_cast<size_t>(header.particles);
+         const std::vector<std::string> named = particles.columnNames();
+         for(size_t c = 0; c < named.size(); ++c) particles.removeColumn(named[c]);
+         particles.resize(n);
+         
+         for(size_t c = 0; c < directory.size(); ++c)
+         {
+            directory[c].name[NAME - 1] = 0;
+            const std::string column(directory[c].name);
+            seek(file, start + directory[c].offset);
+            if(column == "id")
+            {
+               if(n > 0) read(file, particles.id(), n * sizeof(int));
+               continue;
+            }
+            
+            value_type* to = 0;
+            if(column == "mass") to = particles.mass();
+            for(int d = 0; d < dimension && !to; ++d)
+            {
+               if(column == name("position", d))          to = particles.position(d);
+               else if(column == name("velocity", d))     to = particles.velocity(d);
+               else if(column == name("acceleration", d)) to = particles.acceleration(d);
+            }
+            if(!to) to = particles.column(column);
+            
+            if(header.valueSize == sizeof(value_type)) { if(n > 0) read(file, to, n * sizeof(value_type)); }
+            else if(header.valueSize == sizeof(float)) convert<float>(file, to, n);
+            else                                       convert<double>(file, to, n);
+         }
+         return header.time;
+      }
+   }
+   
+   //////////////////////////////////////////////////////////////////////////////////////////
+   /// Save particles to file as a single snapshot, see gutz::snapshot for the format
+   ///
+   /// \code
+   /// gutz::ParticleArray<gutz::vec3f> state;
+   /// sim.getState(state);
+   /// gutz::writeSnapshot("run.snap", state, time);
+   /// ...
+   /// time = gutz::readSnapshot("run.snap", state);
+   /// sim.setState(state);
+   /// \endcode
+   //////////////////////////////////////////////////////////////////////////////////////////
+   template<typename VEC_TYPE>
+   void writeSnapshot(const std::string& fileName, const ParticleArray<VEC_TYPE>& particles, double time = 0.0)
+   {
+      std::FILE* file = std::fopen(fileName.c_str(), "wb");
+      if(!file) throw gutz::Exception("snapshot: cannot open " + fileName);
+      try
+      {
+         snapshot::writeFrame(file, particles, time);
+      }
+      catch(...)
+      {
+         std::fclose(file);
+         throw;
+      }
+      if(std::fclose(file) != 0) throw gutz::Exception("snapshot: write failed on " + fileName);
+   }
+   
+   //////////////////////////////////////////////////////////////////////////////////////////
+   /// Load a snapshot into particles, the first one if fileName is a trajectory
+   ///
+   /// @return the time it was taken at
+   //////////////////////////////////////////////////////////////////////////////////////////
+   template<typename VEC_TYPE>
+   double readSnapshot(const std::string& fileName, ParticleArray<VEC_TYPE>& particles)
+   {
+      std::FILE* file = std::fopen(fileName.c_str(), "rb");
+      if(!file) throw gutz::Exception("snapshot: cannot open " + fileName);
+      double time;
+      try
+      {
+         time = snapshot::readFrame(file, 0, particles);
+      }
+      catch(...)
+      {
+         std::fclose(file);
+         throw;
+      }
+      std::fclose(file);
+      return time;
+   }
+   
+   //////////////////////////////////////////////////////////////////////////////////////////
+   /// Streams snapshots to a trajectory file from a background thread
+   ///
+   /// Two ParticleArray buffers. The caller fills frame() and calls append(), which hands
+   /// the buffer to the writer thread and gives the caller the other one back. append()
+   /// only waits when the disk is slower than the simulation, a whole frame behind.
+   /// Errors on the writer thread are thrown from the next append(), flush() or close().
+   ///
+   /// \code
+   /// gutz::TrajectoryWriter<gutz::vec3f> trajectory("run.traj");
+   /// for(int step = 0; step < steps; ++step)
+   /// {
+   ///    sim.advanceState(step * dt, dt);
+   ///    sim.getState(trajectory.frame());
+   ///    trajectory.append(step * dt);
+   /// }
+   /// trajectory.close();
+   /// \endcode
+   //////////////////////////////////////////////////////////////////////////////////////////
+   template<typename VEC_TYPE>
+   class TrajectoryWriter
+   {
+   public:
+      typedef ParticleArray<VEC_TYPE> particle_array;
+      
+      ///////////////////////////////////////////////////////////////////////////////////////
+      /// Constructor, starts a new trajectory in fileName
+      ///////////////////////////////////////////////////////////////////////////////////////
+      TrajectoryWriter(const std::string& fileName)
+      : _file    (std::fopen(fileName.c_str(), "wb")),
+        _front   (0),
+        _frames  (0),
+        _time    (0.0),
+        _pending (false),
+        _closing (false),
+        _at      (0)
+      {
+         if(!_file) throw gutz::Exception("snapshot: cannot open " + fileName);
+         try
+         {
+            _thread = new gutz::Thread(Worker(this));
+         }
+         catch(...)
+         {
+            std::fclose(_file);
+            throw;
+         }
+      }
+      
+      ///////////////////////////////////////////////////////////////////////////////////////
+      /// Destructor, closes the file if close() wasn't called. Errors are lost, call close().
+      ///////////////////////////////////////////////////////////////////////////////////////
+      ~TrajectoryWriter()
+      {
+         try
+         {
+            close();
+         }
+         catch(...)
+         {
+         }
+      }
+      
+      ///////////////////////////////////////////////////////////////////////////////////////
+      /// The buffer the next append() writes. It holds an old frame, overwrite all of it.
+      ///////////////////////////////////////////////////////////////////////////////////////
+      particle_array& frame(void) { return _buffers[_front]; }
+      
+      ///////////////////////////////////////////////////////////////////////////////////////
+      /// Queue frame() as the next snapshot, taken at time
+      ///////////////////////////////////////////////////////////////////////////////////////
+      void append(double time)
+      {
+         Lock lock(_mutex);
+         while(_pending) _written.wait(lock);
+         check();
+         if(_closing) throw gutz::Exception("snapshot: append after close");
+         _time = time;
+         _front = 1 - _front;
+         _pending = true;
+         ++_frames;
+         _ready.wakeAll();
+      }
+      
+      ///////////////////////////////////////////////////////////////////////////////////////
+      /// Copy particles in and append them
+      ///////////////////////////////////////////////////////////////////////////////////////
+      void append(const particle_array& particles, double time)
+      {
+         frame() = particles;
+         append(time);
+      }
+      
+      ///////////////////////////////////////////////////////////////////////////////////////
+      /// Wait until every frame appended so far is in the file
+      ///////////////////////////////////////////////////////////////////////////////////////
+      void flush(void)
+      {
+         Lock lock(_mutex);
+         while(_pending) _written.wait(lock);
+         check();
+         if(_file && std::fflush(_file) != 0) throw gutz::Exception("snapshot: write failed");
+      }
+      
+      ///////////////////////////////////////////////////////////////////////////////////////
+      /// Write out the last frame and the index, stop the thread and close the file
+      ///////////////////////////////////////////////////////////////////////////////////////
+      void close(void)
+      {
+         {
+            Lock lock(_mutex);
+            if(_closing) return;
+            while(_pending) _written.wait(lock);
+            _closing = true;
+            _ready.wakeAll();
+         }
+         _thread->join();
+         
+         std::FILE* file = _file;
+         _file = 0;
+         try
+         {
+            check();
+            snapshot::Trailer trailer;
+            std::memset(&trailer, 0, sizeof(trailer));
+            std::memcpy(trailer.magic, "GUTZTRAJ", 8);
+            trailer.frames = _offsets.size();
+            trailer.index  = _at;
+            if(!_offsets.empty()) snapshot::write(file, &_offsets[0], _offsets.size() * sizeof(uint64_t));
+            snapshot::write(file, &trailer, sizeof(trailer));
+         }
+         catch(...)
+         {
+            std::fclose(file);
+            throw;
+         }
+         if(std::fclose(file) != 0) throw gutz::Exception("snapshot: write failed");
+      }
+      
+      /// Frames appended so far
+      size_t frames(void) const { return _frames; }
+      
+   private:
+      ///////////////////////////////////////////////////////////////////////////////////////
+      /// Thread entry point
+      ///////////////////////////////////////////////////////////////////////////////////////
+      class Worker
+      {
+      public:
+         Worker(TrajectoryWriter* writer) : _writer(writer) {}
+         void operator()(void) { _writer->work(); }
+         
+      private:
+         TrajectoryWriter* _writer;
+      };
+      
+      void work(void)
+      {
+         for(;;)
+         {
+            {
+               Lock lock(_mutex);
+               while(!_pending && !_closing) _ready.wait(lock);
+               if(!_pending) return;
+            }
+            
+            // The caller only touches the other buffer while _pending is set
+            const particle_array& back = _buffers[1 - _front];
+            if(_error.empty())
+            {
+               try
+               {
+                  const uint64_t bytes = snapshot::writeFrame(_file, back, _time);
+                  _offsets.push_back(_at);
+                  _at += bytes;
+               }
+               catch(const std::exception& e)
+               {
+                  _error = e.what();
+               }
+            }
+            
+            Lock lock(_mutex);
+            _pending = false;
+            _written.wakeAll();
+         }
+      }
+      
+      /// Throws the writer thread's error, call with _mutex held
+      void check(void)
+      {
+         if(!_error.empty()) throw gutz::Exception(_error);
+      }
+      
+      TrajectoryWriter(const TrajectoryWriter&);
+      TrajectoryWriter& operator=(const TrajectoryWriter&);
+      
+      std::FILE*            _file;
+      particle_array        _buffers[2];
+      int                   _front;      //< Buffer the caller fills
+      size_t                _frames;
+      gutz::Thread::pointer _thread;
+      Mutex                 _mutex;      //< Guards the handover, _pending to _closing
+      Condition             _ready;      //< A frame to write, or _closing
+      Condition             _written;    //< _pending went false
+      double                _time;       //< Of the frame being written
+      bool                  _pending;    //< The back buffer holds a frame not written yet
+      bool                  _closing;
+      std::string           _error;      //< First failure on the writer thread
+      uint64_t              _at;         //< File offset of the next frame
+      std::vector<uint64_t> _offsets;    //< Of every frame written
+   };
+   
+   //////////////////////////////////////////////////////////////////////////////////////////
+   /// Reads any frame of a trajectory, or a snapshot file as a trajectory of one
+   ///
+   /// The index at the end of the file gives every frame's offset, so read(i) is a seek
+   /// and the frame's own bytes whatever i is. Files with no index (a writer that never
+   /// got to close()) are indexed once by hopping from header to header.
+   ///
+   /// \code
+   /// gutz::TrajectoryReader<gutz::vec3f> trajectory("run.traj");
+   /// gutz::ParticleArray<gutz::vec3f> state;
+   /// double time = trajectory.read(trajectory.frames() / 2, state);
+   /// \endcode
+   //////////////////////////////////////////////////////////////////////////////////////////
+   template<typename VEC_TYPE>
+   class TrajectoryReader
+   {
+   public:
+      typedef ParticleArray<VEC_TYPE> particle_array;
+      
+      ///////////////////////////////////////////////////////////////////////////////////////
+      ///////////////////////////////////////////////////////////////////////////////////////
+      TrajectoryReader(const std::string& fileName)
+      : _file(std::fopen(fileName.c_str(), "rb"))
+      {
+         if(!_file) throw gutz::Exception("snapshot: cannot open " + fileName);
+         try
+         {
+            index();
+         }
+         catch(...)
+         {
+            std::fclose(_file);
+            throw;
+         }
+      }
+      
+      ~TrajectoryReader() { std::fclose(_file); }
+      
+      size_t frames(void) const { return _offsets.size(); }
+      
+      ///////////////////////////////////////////////////////////////////////////////////////
+      /// @return the file offset of a frame, where its Header starts, for mmap
+      ///////////////////////////////////////////////////////////////////////////////////////
+      uint64_t offset(size_t frame) const { return _offsets[frame]; }
+      
+      ///////////////////////////////////////////////////////////////////////////////////////
+      /// Load a frame into particles
+      ///
+      /// @return the time of the frame
+      ///////////////////////////////////////////////////////////////////////////////////////
+      double read(size_t frame, particle_array& particles)
+      {
+         if(frame >= _offsets.size()) throw gutz::Exception("snapshot: no such frame");
+         return snapshot::readFrame(_file, _offsets[frame], particles);
+      }
+      
+   private:
+      void index(void)
+      {
+         const uint64_t size = snapshot::length(_file);
+         if(size >= sizeof(snapshot::Trailer))
+         {
+            snapshot::Trailer trailer;
+            snapshot::seek(_file, size - sizeof(trailer));
+            snapshot::read(_file, &trailer, sizeof(trailer));
+            if(std::memcmp(trailer.magic, "GUTZTRAJ", 8) == 0 &&
+               trailer.index + trailer.frames * sizeof(uint64_t) + sizeof(trailer) == size)
+            {
+               _offsets.resize(static_cast<size_t>(trailer.frames));
+               snapshot::seek(_file, trailer.index);
+               if(!_offsets.empty()) snapshot::read(_file, &_offsets[0], _offsets.size() * sizeof(uint64_t));
+               return;
+            }
+         }
+         
+         // No index, every complete frame from the start
+         uint64_t at = 0;
+         while(at + sizeof(snapshot::Header) <= size)
+         {
+            snapshot::Header header;
+            snapshot::seek(_file, at);
+            snapshot::read(_file, &header, sizeof(header));
+            if(std::memcmp(header.magic, "GUTZSNAP", 8) != 0 || header.size == 0 || at + header.size > size) break;
+            _offsets.push_back(at);
+            at += header.size;
+         }
+      }
+      
+      TrajectoryReader(const TrajectoryReader&);
+      TrajectoryReader& operator=(const TrajectoryReader&);
+      
+      std::FILE*            _file;
+      std::vector<uint64_t> _offsets;   //< Of every frame
+   };
+}
+
+#endif
@@ -0,0 +1,281 @@
+///////////////////////////////////////////////////////////////////////////
+//              _____________  ______________________    ^    ----  _
+//             /  ________  |  |   ___   ________   /   / \  /    \ |
+//            |  |       |  |_ |  |_ |  |       /  /   /   \|       |
+//            |  |  ___  |  || |  || |  |      /  /   / --- \   --- |
+//            |  | |   \ |  || |  || |  |     /  /   /       \____/ |_____|
+//            |  | |_@  ||  || |  || |  |    /  /          
+//            |  |___/  ||  ||_|  || |  |   /  /_____________________
+//             \_______/  \______/ | |__|  /___________________________
+//                        |  |__|  |
+//                         \______/
+//                 University of New Mexico       
+//                           2010
+///////////////////////////////////////////////////////////////////////////
+
+///////////////////////////////////////////////////////////////////////////
+/// CellList and the short range fields built on it
+///
+/// - forEachPair and forEachNeighbor find exactly the pairs a brute force
+///   search does, for radii up to several cells and negative coordinates
+/// - after a small move update() only touches the particles that left
+///   their bucket and still finds the same pairs
+/// - CollisionField through ForEachNeighborPair, through accelerate() on
+///   a ParticleArray and through a Simulation agrees with all pairs
+///////////////////////////////////////////////////////////////////////////
+
+#include <Particle.h>
+#include <ParticleArray.h>
+#include <CellList.h>
+#include <Collision.h>
+#include <RK4.h>
+#include <Simulation.h>
+#include <iostream>
+#include <vector>
+#include <set>
+#include <utility>
+#include <cstdlib>
+#include <math.h>
+
+typedef gutz::Particle<gutz::vec3d>         particle_type;
+typedef particle_type::vec_type              vec_type;
+typedef gutz::ParticleArray<vec_type>        particle_array;
+typedef gutz::CollisionField<particle_type>  collision_type;
+typedef std::set< std::pair<size_t, size_t> > pair_set;
+
+int failedTests = 0;
+
+void testTrue(bool condition, const std::string& message)
+{
+   if(!condition)
+   {
+      std::cout << "Fail: " << message << std::endl;
+      failedTests++;
+   }
+}
+
+double uniform(void)
+{
+   return 2.0 * rand() / RAND_MAX - 1.0;
+}
+
+// Collects the pairs it is shown, counts repeats
+struct Collect
+{
+   pair_set* pairs;
+   size_t    visits;
+   
+   void operator()(size_t i, size_t j)
+   {
+      pairs->insert(std::make_pair(std::min(i, j), std::max(i, j)));
+      ++visits;
+   }
+};
+
+template<class VEC>
+pair_set bruteForce(const std::vector<VEC>& x, double radius)
+{
+   pair_set pairs;
+   for(size_t i = 0; i < x.size(); ++i)
+   {
+      for(size_t j = i + 1; j < x.size(); ++j)
+      {
+         if((x[i] - x[j]).norm2() < radius * radius) pairs.insert(std::make_pair(i, j));
+      }
+   }
+   return pairs;
+}
+
+// A particle with just a position for CellList::update()
+template<class VEC>
+struct Point
+{
+   VEC x;
+   const VEC& getPosition(void) const { return x; }
+};
+
+template<class VEC>
+void testPairs(const std::vector<VEC>& x, gutz::CellList<VEC>& cells, double radius, const std::string& name)
+{
+   const pair_set expected = bruteForce(x, radius);
+   
+   pair_set pairs;
+   Collect collect = { &pairs, 0 };
+   cells.forEachPair(radius, collect);
+   testTrue(pairs == expected, name + " forEachPair misses or adds pairs");
+   testTrue(collect.visits == expected.size(), name + " forEachPair visits a pair twice");
+   
+   pair_set neighbors;
+   Collect each = { &neighbors, 0 };
+   for(size_t i = 0; i < x.size(); ++i) cells.forEachNeighbor(i, radius, each);
+   testTrue(neighbors == expected, name + " forEachNeighbor misses or adds pairs");
+   testTrue(each.visits == 2 * expected.size(), name + " forEachNeighbor visit count");
+}
+
+template<class VEC>
+void testCellList(int n, const std::string& name)
+{
+   srand(11);
+   std::vector< Point<VEC> > points(n);
+   std::vector<VEC> x(n);
+   for(int i = 0; i < n; ++i)
+   {
+      for(int d = 0; d < VEC::size; ++d) x[i][d] = 5.0 * uniform();
+      points[i].x = x[i];
+   }
+   
+   gutz::CellList<VEC> cells(0.5);
+   cells.update(points.begin(), points.end());
+   testTrue(cells.getMoved() == size_t(n), name + " first update sorts everyone");
+   testPairs(x, cells, 0.5, name + " radius = cell");
+   testPairs(x, cells, 0.3, name + " radius < cell");
+   testPairs(x, cells, 1.2, name + " radius > cell");
+   
+   // Small moves, most particles keep their bucket
+   for(int step = 0; step < 3; ++step)
+   {
+      for(int i = 0; i < n; ++i)
+      {
+         for(int d = 0; d < VEC::size; ++d) x[i][d] += 0.02 * uniform();
+         points[i].x = x[i];
+      }
+      cells.update(points.begin(), points.end());
+      testTrue(cells.getMoved() < size_t(n / 4), name + " update moves too many");
+      testPairs(x, cells, 0.5, name + " after update");
+   }
+   
+   // Different size starts over
+   points.resize(n / 2);
+   x.resize(n / 2);
+   cells.update(points.begin(), points.end());
+   testPairs(x, cells, 0.5, name + " after resize");
+}
+
+// Overlapping balls in a box, each with a radius
+std::vector<particle_type> balls(int n)
+{
+   srand(5);
+   std::vector<particle_type> particles;
+   for(int i = 0; i < n; ++i)
+   {
+      particle_type p(vec_type(2.0 * uniform(), 2.0 * uniform(), 2.0 * uniform()),
+                      vec_type(uniform(), uniform(), uniform()), 1.0 + 0.5 * uniform(), i);
+      p.setRadius(0.1 + 0.05 * uniform());
+      particles.push_back(p);
+   }
+   return particles;
+}
+
+bool close(const vec_type& a, const vec_type& b)
+{
+   return (a - b).norm() <= 1e-9 * (1.0 + b.norm());
+}
+
+void testCollision(void)
+{
+   std::vector<particle_type> particles = balls(1500);
+   collision_type contact(1e3, 2.0, 0.15);
+   
+   // Every pair, the field's operator() straight
+   std::vector<vec_type> expected;
+   int touching = 0;
+   for(size_t i = 0; i < particles.size(); ++i)
+   {
+      vec_type a(0.0);
+      for(size_t j = 0; j < particles.size(); ++j)
+      {
+         if(i != j) a += contact(particles[i], particles[j]);
+      }
+      if(a.norm() > 0) ++touching;
+      expected.push_back(a);
+   }
+   testTrue(touching > 100, "Collision too few contacts to test");
+   
+   gutz::ForEachParticlePair<collision_type> fepp;
+   fepp.prepare(particles.begin(), particles.end(), contact);
+   bool same = true;
+   for(std::vector<particle_type>::iterator p = particles.begin(); p != particles.end(); ++p)
+   {
+      vec_type a(0.0);
+      fepp(a, p, particles.begin(), particles.end(), contact);
+      same = same && close(a, expected[p - particles.begin()]);
+   }
+   testTrue(same, "Collision ForEachNeighborPair differs from all pairs");
+   
+   particle_array array(particles.begin(), particles.end());
+   testTrue(array.hasColumn("radius"), "ParticleArray drops the radius");
+   testTrue(array.particle(7).getRadius() == particles[7].getRadius(), "ParticleArray radius round trip");
+   gutz::ForEachParticle<collision_type> fep;
+   fep(array, contact);
+   same = true;
+   for(size_t i = 0; i < array.size(); ++i) same = same && close(array.getAcceleration(i), expected[i]);
+   testTrue(same, "Collision accelerate differs from all pairs");
+   
+   std::vector<unsigned int> targets;
+   for(unsigned int i = 0; i < array.size(); i += 3) targets.push_back(i);
+   array.clearAcceleration();
+   fep(array, contact, targets);
+   same = true;
+   for(size_t i = 0; i < array.size(); ++i)
+   {
+      same = same && close(array.getAcceleration(i), i % 3 == 0 ? expected[i] : vec_type(0.0));
+   }
+   testTrue(same, "Collision accelerate targets differs from all pairs");
+}
+
+// No outside force
+class Free
+{
+public:
+   typedef gutz::Particle<gutz::vec3d> particle_type;
+   vec_type operator()(const particle_type& p) { return vec_type(0.0); }
+};
+
+void testSimulation(void)
+{
+   typedef gutz::RK4<Free> integrator_type;
+   Free free;
+   integrator_type integrator(&free);
+   collision_type contact(1e3, 2.0, 0.15);
+   gutz::Simulation<integrator_type, collision_type> sim(&integrator, &contact);
+   
+   std::vector<particle_type> particles = balls(400);
+   for(size_t i = 0; i < particles.size(); ++i) sim.addParticle(particles[i]);
+   sim.setThreads(2);
+   for(int step = 0; step < 5; ++step)
+   {
+      // The same step by hand, every pair
+      std::vector<particle_type> expected = particles;
+      for(size_t i = 0; i < particles.size(); ++i)
+      {
+         vec_type a(0.0);
+         for(size_t j = 0; j < particles.size(); ++j)
+         {
+            if(i != j) a += contact(particles[i], particles[j]);
+         }
+         expected[i].setVelocity(particles[i].getVelocity() + a * 0.01);
+         expected[i] = integrator(expected[i], step * 0.01, 0.01);
+      }
+      particles = expected;
+      sim.advanceState(step * 0.01, 0.01);
+   }
+   bool same = true;
+   for(size_t i = 0; i < particles.size(); ++i) same = same && close(sim[i].getPosition(), particles[i].getPosition());
+   testTrue(same, "Collision Simulation differs from all pairs");
+}
+
+int main(int argc, char **argv)
+{
+   testCellList<gutz::vec3d>(3000, "3D");
+   testCellList<gutz::vec2d>(2000, "2D");
+   testCollision();
+   testSimulation();
+   
+   if(failedTests > 0)
+   {
+      std::cout << "Failed test: " << failedTests << std::endl;
+      return 1;
+   }
+   
+   return 0;
+}
@@ -0,0 +1,116 @@
+///////////////////////////////////////////////////////////////////////////
+//              _____________  ______________________    ^    ----  _
+//             /  ________  |  |   ___   ________   /   / \  /    \ |
+//            |  |       |  |_ |  |_ |  |       /  /   /   \|       |
+//            |  |  ___  |  || |  || |  |      /  /   / --- \   --- |
+//            |  | |   \ |  || |  || |  |     /  /   /       \____/ |_____|
+//            |  | |_@  ||  || |  || |  |    /  /          
+//            |  |___/  ||  ||_|  || |  |   /  /_____________________
+//             \_______/  \______/ | |__|  /___________________________
+//                        |  |__|  |
+//                         \______/
+//                 University of New Mexico       
+//                           2010
+///////////////////////////////////////////////////////////////////////////
+/// DirectSumField against P2PField::accelerate, in float and double
+///
+/// - a cluster over several tiles, not a multiple of the pack width
+/// - two particles on the same spot with no softening add nothing to each
+///   other, and nobody's acceleration turns into NaN
+/// - in double, separations far beyond float's range (|d|^2 > FLT_MAX and
+///   |d|^2 < FLT_MIN) still give the right force
+///
+/// Build with -mavx2 -mfma or -mavx512f to check the SIMD packs.
+///////////////////////////////////////////////////////////////////////////
+
+#include <Particle.h>
+#include <ParticleArray.h>
+#include <Field.h>
+#include <DirectSum.h>
+#include <iostream>
+#include <string>
+#include <cstdlib>
+#include <math.h>
+
+int failedTests = 0;
+
+void testTrue(bool condition, const std::string& message)
+{
+   if(!condition)
+   {
+      std::cout << "Fail: " << message << std::endl;
+      failedTests++;
+   }
+}
+
+double uniform(void)
+{
+   return 2.0 * rand() / RAND_MAX - 1.0;
+}
+
+// Largest relative difference of DirectSumField from P2PField over the particles
+template<class VEC>
+double compare(size_t n, double scale, size_t coincident, double* worst)
+{
+   typedef gutz::Particle<VEC>               particle_type;
+   typedef typename VEC::value_type          value_type;
+   typedef gutz::ParticleArray<VEC>          particle_array;
+   
+   particle_array particles;
+   for(size_t i = 0; i < n; ++i)
+   {
+      const VEC x(value_type(scale * uniform()), value_type(scale * uniform()), value_type(scale * uniform()));
+      particles.push_back(particle_type(x, VEC(value_type(0)), value_type(1e6 * (1.5 + uniform())), int(i)));
+   }
+   // Put particle i on top of particle i + 1
+   for(size_t i = 0; i + 1 < n && i < 2 * coincident; i += 2) particles.setPosition(i, particles.getPosition(i + 1));
+   
+   particle_array direct(particles);
+   gutz::P2PField<particle_type> p2p;
+   p2p.accelerate(direct);
+   gutz::DirectSumField<particle_type> field;
+   field.accelerate(particles);
+   
+   double error = 0.0;
+   bool finite = true;
+   for(size_t i = 0; i < n; ++i)
+   {
+      const VEC a = particles.getAcceleration(i), b = direct.getAcceleration(i);
+      for(int d = 0; d < 3; ++d) finite = finite && a[d] == a[d] && fabs(double(a[d])) <= HUGE_VAL * 0.5;
+      const double e = double((a - b).norm()) / double(b.norm());
+      if(e > error) error = e;
+   }
+   *worst = error;
+   return finite ? error : HUGE_VAL;
+}
+
+template<class VEC>
+void testField(const std::string& name, double tolerance)
+{
+   double worst = 0.0;
+   testTrue(compare<VEC>(1237, 1.0, 0, &worst) < tolerance, name + " cluster differs from P2PField");
+   std::cout << name << " cluster " << worst << std::endl;
+   testTrue(compare<VEC>(1237, 1.0, 20, &worst) < tolerance, name + " coincident particles differ from P2PField");
+   std::cout << name << " coincident " << worst << std::endl;
+}
+
+int main(int argc, char **argv)
+{
+   testField<gutz::vec3f>("vec3f", 1e-3);
+   testField<gutz::vec3d>("vec3d", 1e-10);
+   
+   // Out of float's range, the AVX2 double path used to go through float
+   double worst = 0.0;
+   testTrue(compare<gutz::vec3d>(257, 1e22, 0, &worst) < 1e-10, "vec3d |d|^2 > FLT_MAX differs from P2PField");
+   std::cout << "vec3d 1e22 apart " << worst << std::endl;
+   testTrue(compare<gutz::vec3d>(257, 1e-22, 0, &worst) < 1e-10, "vec3d |d|^2 < FLT_MIN differs from P2PField");
+   std::cout << "vec3d 1e-22 apart " << worst << std::endl;
+   
+   if(failedTests > 0)
+   {
+      std::cout << "Failed test: " << failedTests << std::endl;
+      return 1;
+   }
+   
+   return 0;
+}
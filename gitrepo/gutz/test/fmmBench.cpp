@@ -0,0 +1,157 @@
+///////////////////////////////////////////////////////////////////////////
+//              _____________  ______________________    ^    ----  _
+//             /  ________  |  |   ___   ________   /   / \  /    \ |
+//            |  |       |  |_ |  |_ |  |       /  /   /   \|       |
+//            |  |  ___  |  || |  || |  |      /  /   / --- \   --- |
+//            |  | |   \ |  || |  || |  |     /  /   /       \____/ |_____|
+//            |  | |_@  ||  || |  || |  |    /  /          
+//            |  |___/  ||  ||_|  || |  |   /  /_____________________
+//             \_______/  \______/ | |__|  /___________________________
+//                        |  |__|  |
+//                         \______/
+//                 University of New Mexico       
+//                           2010
+///////////////////////////////////////////////////////////////////////////
+///////////////////////////////////////////////////////////////////////////
+/// Fast multipole and Barnes-Hut against the direct sum
+///
+/// For each N: time one step of P2PField through ForEachParticlePair (the
+/// all-pairs loop Simulation uses), of BarnesHutField and of FMMField, and
+/// the mean and largest per-particle relative force error of the
+/// approximations. The direct sum is timed up to DIRECT_MAX particles and
+/// sampled beyond that. FMMField is given a tolerance with setTolerance(),
+/// the test fails when any checked particle's force is further than that
+/// from the direct sum.
+///
+/// usage: benchFMM [largest N] [tolerance] [order]
+///////////////////////////////////////////////////////////////////////////
+
+#include <Particle.h>
+#include <Field.h>
+#include <BarnesHut.h>
+#include <FMM.h>
+#include <iostream>
+#include <iomanip>
+#include <vector>
+#include <cstdlib>
+#include <math.h>
+#include <time.h>
+
+typedef gutz::Particle<gutz::vec3d>    particle_type;
+typedef particle_type::vec_type         vec_type;
+typedef std::vector<particle_type>      particle_vector;
+
+static const size_t DIRECT_MAX = 16000;  // Slower than this takes minutes
+static const size_t SAMPLES    = 500;    // Particles checked beyond DIRECT_MAX
+
+int failedTests = 0;
+
+double seconds(clock_t start)
+{
+   return double(clock() - start) / CLOCKS_PER_SEC;
+}
+
+double uniform(void)
+{
+   return 2.0 * rand() / RAND_MAX - 1.0;
+}
+
+// A Plummer-like sphere with a dense core, the hard case for the expansions
+particle_vector makeCluster(size_t n)
+{
+   particle_vector particles;
+   for(size_t i = 0; i < n; ++i)
+   {
+      vec_type x(uniform(), uniform(), uniform());
+      const double r = double(rand()) / RAND_MAX;
+      x.normalize();
+      particles.push_back(particle_type(x * (r * r), vec_type(0.0), 1e6 * (1.5 + uniform()), int(i)));
+   }
+   return particles;
+}
+
+// Direct sum for particle i, the way Simulation::advanceState does it
+vec_type direct(particle_vector& particles, size_t i)
+{
+   gutz::P2PField<particle_type> field;
+   gutz::ForEachParticlePair< gutz::P2PField<particle_type> > fepp;
+   vec_type acceleration(0.0);
+   particle_vector::iterator p0i = particles.begin() + i;
+   fepp(acceleration, p0i, particles.begin(), particles.end(), field);
+   return acceleration;
+}
+
+int main(int argc, char **argv)
+{
+   const size_t largest   = argc > 1 ? size_t(atol(argv[1])) : 256000;
+   const double tolerance = argc > 2 ? atof(argv[2]) : 1e-4;
+   const int    order     = argc > 3 ? atoi(argv[3]) : 4;
+   
+   gutz::FMMField<particle_type>       fmm(order);
+   gutz::BarnesHutField<particle_type> bh;
+   fmm.setTolerance(tolerance);
+   
+   std::cout << "FMM tolerance " << tolerance << ": order " << fmm.getOrder() << ", theta "
+             << fmm.getTheta() << std::endl;
+   std::cout << std::setw(8) << "N" << std::setw(12) << "direct s" << std::setw(12) << "BH s"
+             << std::setw(12) << "BH mean" << std::setw(12) << "BH max" << std::setw(12) << "FMM s"
+             << std::setw(12) << "FMM mean" << std::setw(12) << "FMM max" << std::endl;
+   
+   for(size_t n = 1000; n <= largest; n *= 4)
+   {
+      particle_vector particles = makeCluster(n);
+      
+      // Reference forces for every particle, or for a sample
+      const size_t stride = n <= DIRECT_MAX ? 1 : n / SAMPLES;
+      std::vector<vec_type> reference;
+      clock_t start = clock();
+      for(size_t i = 0; i < n; i += stride) reference.push_back(direct(particles, i));
+      double directTime = seconds(start) * stride;  // Extrapolated when sampled
+      
+      start = clock();
+      fmm.build(particles.begin(), particles.end());
+      const double fmmTime = seconds(start);
+      
+      start = clock();
+      bh.build(particles.begin(), particles.end());
+      std::vector<vec_type> bhAcceleration(n);
+      for(size_t i = 0; i < n; ++i) bhAcceleration[i] = bh(particles[i]);
+      const double bhTime = seconds(start);
+      
+      // Relative error of each particle's force, not of the total
+      double fmmMean = 0.0, fmmMax = 0.0, bhMean = 0.0, bhMax = 0.0;
+      size_t worst = 0, checked = 0;
+      for(size_t i = 0, k = 0; i < n; i += stride, ++k, ++checked)
+      {
+         const double norm = reference[k].norm();
+         const double fmmError = (fmm.acceleration(i) - reference[k]).norm() / norm;
+         const double bhError  = (bhAcceleration[i] - reference[k]).norm() / norm;
+         fmmMean += fmmError;
+         bhMean  += bhError;
+         if(fmmError > fmmMax) { fmmMax = fmmError; worst = i; }
+         if(bhError > bhMax) bhMax = bhError;
+      }
+      fmmMean /= checked;
+      bhMean  /= checked;
+      
+      std::cout << std::setw(8) << n << std::setw(12) << directTime << std::setw(12) << bhTime
+                << std::setw(12) << bhMean << std::setw(12) << bhMax << std::setw(12) << fmmTime
+                << std::setw(12) << fmmMean << std::setw(12) << fmmMax
+                << (stride > 1 ? "  (direct sampled)" : "") << std::endl;
+      
+      if(fmmMax > tolerance)
+      {
+         std::cout << "Fail: FMM error " << fmmMax << " on particle " << worst << " above the tolerance "
+                   << tolerance << " for N = " << n << std::endl;
+         failedTests++;
+      }
+   }
+   
+   if(failedTests > 0)
+   {
+      std::cout << "Failed test: " << failedTests << std::endl;
+      return 1;
+   }
+   
+   return 0;
+}
@@ -0,0 +1,252 @@
+///////////////////////////////////////////////////////////////////////////
+//              _____________  ______________________    ^    ----  _
+//             /  ________  |  |   ___   ________   /   / \  /    \ |
+//            |  |       |  |_ |  |_ |  |       /  /   /   \|       |
+//            |  |  ___  |  || |  || |  |      /  /   / --- \   --- |
+//            |  | |   \ |  || |  || |  |     /  /   /       \____/ |_____|
+//            |  | |_@  ||  || |  || |  |    /  /          
+//            |  |___/  ||  ||_|  || |  |   /  /_____________________
+//             \_______/  \______/ | |__|  /___________________________
+//                        |  |__|  |
+//                         \______/
+//                 University of New Mexico       
+//                           2010
+///////////////////////////////////////////////////////////////////////////
+
+///////////////////////////////////////////////////////////////////////////
+/// The integrators on Kepler orbits, GM = 1
+///
+/// - Leapfrog and Yoshida4 converge at second and fourth order, RK4 at
+///   fourth, one particle at a time and on a ParticleArray alike
+/// - RK4's stage-by-stage path for bulk fields matches its particle by
+///   particle one and converges at fourth order too
+/// - Leapfrog's energy error stays bounded over many orbits
+/// - DormandPrince meets its tolerance in far fewer substeps than a
+///   fixed step needs
+/// - BlockTimestep on a mix of tight and wide orbits matches a leapfrog
+///   run at the finest step while evaluating the field far less often
+///////////////////////////////////////////////////////////////////////////
+
+#include <Particle.h>
+#include <Integrator.h>
+#include <iostream>
+#include <vector>
+#include <math.h>
+
+typedef gutz::Particle<gutz::vec3d>     particle_type;
+typedef particle_type::vec_type          vec_type;
+typedef gutz::ParticleArray<vec_type>    particle_array;
+
+// Unit mass at the origin
+class Kepler
+{
+public:
+   typedef gutz::Particle<gutz::vec3d> particle_type;
+   
+   vec_type operator()(const particle_type& p)
+   {
+      const vec_type x = p.getPosition();
+      const double r = x.norm();
+      return x * (-1.0 / (r * r * r));
+   }
+};
+
+// The same with a bulk accelerate(), RK4 integrates it stage by stage
+class BulkKepler : public Kepler
+{
+public:
+   void accelerate(particle_array& particles)
+   {
+      for(size_t i = 0; i < particles.size(); ++i) add(particles, i);
+   }
+   
+   void accelerate(particle_array& particles, const std::vector<unsigned int>& targets)
+   {
+      for(size_t t = 0; t < targets.size(); ++t) add(particles, targets[t]);
+   }
+   
+private:
+   void add(particle_array& particles, size_t i)
+   {
+      particles.setAcceleration(i, particles.getAcceleration(i) + (*this)(particles.particle(i)));
+   }
+};
+
+namespace gutz
+{
+   template<>
+   struct IsBulkField<BulkKepler>
+   {
+      enum { value = true };
+   };
+}
+
+static const double PI = 3.14159265358979323846;
+
+int failedTests = 0;
+
+void testTrue(bool condition, const std::string& message)
+{
+   if(!condition)
+   {
+      std::cout << "Fail: " << message << std::endl;
+      failedTests++;
+   }
+}
+
+// Orbit with semi-major axis a and eccentricity e, at pericenter
+particle_type orbit(double e, double a = 1.0)
+{
+   const double r = a * (1.0 - e);
+   return particle_type(vec_type(r, 0.0, 0.0), vec_type(0.0, sqrt((1.0 + e) / r), 0.0), 1.0);
+}
+
+double energy(const vec_type& x, const vec_type& v)
+{
+   return 0.5 * v.norm2() - 1.0 / x.norm();
+}
+
+// Position error after one period, one particle at a time
+template<class INTEGRATOR>
+double periodError(int steps)
+{
+   typename INTEGRATOR::field_type kepler;
+   INTEGRATOR integrator(&kepler);
+   particle_type p = orbit(0.5);
+   const vec_type start = p.getPosition();
+   const double dt = 2.0 * PI / steps;
+   for(int s = 0; s < steps; ++s) p = integrator(p, s * dt, dt);
+   return (p.getPosition() - start).norm();
+}
+
+// Same on a ParticleArray of one
+template<class INTEGRATOR>
+double periodErrorArray(int steps)
+{
+   typename INTEGRATOR::field_type kepler;
+   INTEGRATOR integrator(&kepler);
+   particle_array particles;
+   particles.push_back(orbit(0.5));
+   const vec_type start = particles.getPosition(0);
+   const double dt = 2.0 * PI / steps;
+   for(int s = 0; s < steps; ++s) integrator(particles, s * dt, dt);
+   return (particles.getPosition(0) - start).norm();
+}
+
+template<class INTEGRATOR>
+void testOrder(int order, const std::string& name)
+{
+   const double ratio = periodError<INTEGRATOR>(400) / periodError<INTEGRATOR>(800);
+   const double arrayRatio = periodErrorArray<INTEGRATOR>(400) / periodErrorArray<INTEGRATOR>(800);
+   const double expected = pow(2.0, order);
+   testTrue(ratio > 0.8 * expected && ratio < 1.25 * expected, name + " order, one particle");
+   testTrue(arrayRatio > 0.8 * expected && arrayRatio < 1.25 * expected, name + " order, ParticleArray");
+}
+
+int main(int argc, char **argv)
+{
+   testOrder< gutz::Leapfrog<Kepler> >(2, "Leapfrog");
+   testOrder< gutz::Yoshida4<Kepler> >(4, "Yoshida4");
+   testOrder< gutz::RK4<Kepler> >(4, "RK4");
+   testOrder< gutz::RK4<BulkKepler> >(4, "RK4 bulk");
+   
+   // A few orbits at once: the stage-by-stage path agrees with the particle by particle one
+   {
+      Kepler kepler;
+      BulkKepler bulkKepler;
+      gutz::RK4<Kepler> single(&kepler);
+      gutz::RK4<BulkKepler> batch(&bulkKepler);
+      particle_array particles;
+      for(int i = 0; i < 5; ++i) particles.push_back(orbit(0.2 * i, 1.0 + i));
+      particle_array batched = particles;
+      const double dt = 2.0 * PI / 200;
+      for(int s = 0; s < 200; ++s)
+      {
+         single(particles, s * dt, dt);
+         batch(batched, s * dt, dt);
+      }
+      double worst = 0;
+      for(size_t i = 0; i < particles.size(); ++i)
+      {
+         worst = std::max(worst, (particles.getPosition(i) - batched.getPosition(i)).norm());
+         worst = std::max(worst, (particles.getVelocity(i) - batched.getVelocity(i)).norm());
+      }
+      testTrue(worst < 1e-12, "RK4 bulk and per-particle paths differ");
+   }
+   
+   // 100 orbits, 100 steps each: leapfrog's energy error oscillates, it doesn't grow
+   {
+      Kepler kepler;
+      gutz::Leapfrog<Kepler> integrator(&kepler);
+      particle_type p = orbit(0.5);
+      const double e0 = energy(p.getPosition(), p.getVelocity());
+      const double dt = 2.0 * PI / 100;
+      double firstOrbit = 0, lastOrbit = 0;
+      for(int s = 0; s < 100 * 100; ++s)
+      {
+         p = integrator(p, s * dt, dt);
+         const double error = fabs(energy(p.getPosition(), p.getVelocity()) - e0);
+         if(s < 100) firstOrbit = std::max(firstOrbit, error);
+         if(s >= 99 * 100) lastOrbit = std::max(lastOrbit, error);
+      }
+      testTrue(lastOrbit < 1.1 * firstOrbit, "Leapfrog energy error grows");
+   }
+   
+   // One period of an e = 0.9 orbit in a single call
+   {
+      Kepler kepler;
+      gutz::DormandPrince<Kepler> integrator(&kepler, 1e-9, 1e-9);
+      particle_array particles;
+      particles.push_back(orbit(0.9));
+      const vec_type start = particles.getPosition(0);
+      integrator(particles, 0.0, 2.0 * PI);
+      testTrue((particles.getPosition(0) - start).norm() < 1e-5, "DormandPrince misses its tolerance");
+      testTrue(integrator.getSubsteps() < 2000, "DormandPrince takes too many substeps");
+      
+      const particle_type p = integrator(orbit(0.9), 0.0, 2.0 * PI);
+      testTrue((p.getPosition() - start).norm() < 1e-5, "DormandPrince one particle misses its tolerance");
+   }
+   
+   // Tight eccentric orbits among wide ones
+   {
+      Kepler kepler;
+      particle_array particles;
+      for(int i = 0; i < 20; ++i)
+      {
+         const double a = i < 2 ? 0.1 : 4.0 + i;
+         particles.push_back(orbit(i < 2 ? 0.8 : 0.1, a));
+      }
+      particle_array reference = particles;
+      
+      const int maxLevel = 10;
+      gutz::BlockTimestep<Kepler> block(&kepler, 0.01, 1.0, maxLevel);
+      gutz::Leapfrog<Kepler> leapfrog(&kepler);
+      const double dt = 0.5;
+      size_t evaluations = 0;
+      for(int s = 0; s < 8; ++s)
+      {
+         block(particles, s * dt, dt);
+         evaluations += block.getEvaluations();
+         for(int k = 0; k < (1 << maxLevel); ++k) leapfrog(reference, 0.0, dt / (1 << maxLevel));
+      }
+      
+      testTrue(block.level(0) > block.level(10), "BlockTimestep tight orbit not on a finer level");
+      testTrue(evaluations < 8 * particles.size() * (1 << maxLevel) / 4, "BlockTimestep saves too few evaluations");
+      double worst = 0;
+      for(size_t i = 0; i < particles.size(); ++i)
+      {
+         const double e = fabs(energy(particles.getPosition(i), particles.getVelocity(i)) -
+                               energy(reference.getPosition(i), reference.getVelocity(i)));
+         worst = std::max(worst, e / fabs(energy(reference.getPosition(i), reference.getVelocity(i))));
+      }
+      testTrue(worst < 1e-3, "BlockTimestep energy off");
+   }
+   
+   if(failedTests > 0)
+   {
+      std::cout << "Failed test: " << failedTests << std::endl;
+      return 1;
+   }
+   
+   return 0;
+}
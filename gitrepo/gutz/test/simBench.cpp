@@ -0,0 +1,159 @@
+///////////////////////////////////////////////////////////////////////////
+//              _____________  ______________________    ^    ----  _
+//             /  ________  |  |   ___   ________   /   / \  /    \ |
+//            |  |       |  |_ |  |_ |  |       /  /   /   \|       |
+//            |  |  ___  |  || |  || |  |      /  /   / --- \   --- |
+//            |  | |   \ |  || |  || |  |     /  /   /       \____/ |_____|
+//            |  | |_@  ||  || |  || |  |    /  /          
+//            |  |___/  ||  ||_|  || |  |   /  /_____________________
+//             \_______/  \______/ | |__|  /___________________________
+//                        |  |__|  |
+//                         \______/
+//                 University of New Mexico       
+//                           2010
+///////////////////////////////////////////////////////////////////////////
+
+///////////////////////////////////////////////////////////////////////////
+/// Per-step cost of Simulation with and without pairwise forces
+///
+/// For each N: the time of one step of
+///  - a bare loop calling the integrator on every particle,
+///  - Simulation<RK4> with no pairwise field (NullType),
+///  - Simulation<RK4, BarnesHutField>,
+///  - Simulation<RK4, P2PField>, up to DIRECT_MAX particles.
+/// The NullType simulation has to land on exactly the bare loop's
+/// particles, and should cost the same: the pairwise phase is compiled out.
+///
+/// usage: benchSim [largest N] [steps]
+///////////////////////////////////////////////////////////////////////////
+
+#include <Particle.h>
+#include <Field.h>
+#include <BarnesHut.h>
+#include <RK4.h>
+#include <Simulation.h>
+#include <iostream>
+#include <iomanip>
+#include <vector>
+#include <cstdlib>
+#include <math.h>
+#include <time.h>
+
+typedef gutz::Particle<gutz::vec3d>    particle_type;
+typedef particle_type::vec_type         vec_type;
+typedef std::vector<particle_type>      particle_vector;
+
+static const size_t DIRECT_MAX = 16000;  // Slower than this takes minutes a step
+
+// Pull towards a heavy mass at the origin
+class Central
+{
+public:
+   typedef gutz::Particle<gutz::vec3d> particle_type;
+   
+   vec_type operator()(const particle_type& p)
+   {
+      const vec_type x = p.getPosition();
+      const double r = x.norm();
+      return x * (-6.67e-11 * 1e12 / (r * r * r));
+   }
+};
+
+typedef gutz::RK4<Central>                         integrator_type;
+typedef gutz::P2PField<particle_type>              p2p_type;
+typedef gutz::BarnesHutField<particle_type>        bh_type;
+
+int failedTests = 0;
+
+double seconds(clock_t start)
+{
+   return double(clock() - start) / CLOCKS_PER_SEC;
+}
+
+double uniform(void)
+{
+   return 2.0 * rand() / RAND_MAX - 1.0;
+}
+
+particle_vector makeParticles(size_t n)
+{
+   srand(3);
+   particle_vector particles;
+   for(size_t i = 0; i < n; ++i)
+   {
+      const vec_type x(uniform() + 3.0, uniform(), uniform());
+      particles.push_back(particle_type(x, vec_type(0.0, 1.0, 0.0), 1e6 * (1.5 + uniform()), int(i)));
+   }
+   return particles;
+}
+
+// Seconds per step of sim over steps steps
+template<class SIMULATION>
+double perStep(SIMULATION& sim, const particle_vector& particles, int steps)
+{
+   for(size_t i = 0; i < particles.size(); ++i) sim.addParticle(particles[i]);
+   const clock_t start = clock();
+   for(int step = 0; step < steps; ++step) sim.advanceState(step * 0.01, 0.01);
+   return seconds(start) / steps;
+}
+
+int main(int argc, char **argv)
+{
+   const size_t largest = argc > 1 ? size_t(atol(argv[1])) : 1024000;
+   const int    steps   = argc > 2 ? atoi(argv[2]) : 3;
+   
+   Central central;
+   integrator_type integrator(&central);
+   
+   std::cout << "seconds per step" << std::endl;
+   std::cout << std::setw(8) << "N" << std::setw(12) << "bare" << std::setw(12) << "NullType"
+             << std::setw(12) << "Barnes-Hut" << std::setw(12) << "P2P" << std::endl;
+   
+   for(size_t n = 1000; n <= largest; n *= 4)
+   {
+      const particle_vector particles = makeParticles(n);
+      
+      particle_vector bare = particles;
+      const clock_t start = clock();
+      for(int step = 0; step < steps; ++step)
+      {
+         for(size_t i = 0; i < n; ++i) bare[i] = integrator(bare[i], step * 0.01, 0.01);
+      }
+      const double bareTime = seconds(start) / steps;
+      
+      gutz::Simulation<integrator_type> none(&integrator);
+      const double noneTime = perStep(none, particles, steps);
+      for(size_t i = 0; i < n; ++i)
+      {
+         if(none[i].getPosition() != bare[i].getPosition() || none[i].getVelocity() != bare[i].getVelocity())
+         {
+            std::cout << "Fail: NullType simulation differs from the bare loop at particle " << i
+                      << " for N = " << n << std::endl;
+            failedTests++;
+            break;
+         }
+      }
+      
+      bh_type bh(0.5);
+      gutz::Simulation<integrator_type, bh_type> tree(&integrator, &bh);
+      const double bhTime = perStep(tree, particles, steps);
+      
+      std::cout << std::setw(8) << n << std::setw(12) << bareTime << std::setw(12) << noneTime
+                << std::setw(12) << bhTime;
+      if(n <= DIRECT_MAX)
+      {
+         p2p_type p2p;
+         gutz::Simulation<integrator_type, p2p_type> direct(&integrator, &p2p);
+         std::cout << std::setw(12) << perStep(direct, particles, steps);
+      }
+      std::cout << std::endl;
+   }
+   
+   if(failedTests > 0)
+   {
+      std::cout << "Failed test: " << failedTests << std::endl;
+      return 1;
+   }
+   
+   return 0;
+}
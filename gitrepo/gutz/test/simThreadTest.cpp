@@ -0,0 +1,218 @@
+///////////////////////////////////////////////////////////////////////////
+//              _____________  ______________________    ^    ----  _
+//             /  ________  |  |   ___   ________   /   / \  /    \ |
+//            |  |       |  |_ |  |_ |  |       /  /   /   \|       |
+//            |  |  ___  |  || |  || |  |      /  /   / --- \   --- |
+//            |  | |   \ |  || |  || |  |     /  /   /       \____/ |_____|
+//            |  | |_@  ||  || |  || |  |    /  /          
+//            |  |___/  ||  ||_|  || |  |   /  /_____________________
+//             \_______/  \______/ | |__|  /___________________________
+//                        |  |__|  |
+//                         \______/
+//                 University of New Mexico       
+//                           2010
+///////////////////////////////////////////////////////////////////////////
+
+///////////////////////////////////////////////////////////////////////////
+/// Simulation::advanceState on several threads
+///
+/// The same cluster is stepped with 1, 2, 3 and 8 threads. The particles
+/// must come out bit for bit the same, and the same as a serial two phase
+/// step written out by hand. DormandPrince, which keeps scratch for its
+/// ParticleArray form, must give the same on 4 threads as on 1.
+///
+/// Two equal masses on a circular orbit, held by nothing but P2PField
+/// through the Simulation, must stay on it for ten periods.
+///////////////////////////////////////////////////////////////////////////
+
+#include <Particle.h>
+#include <Field.h>
+#include <RK4.h>
+#include <DormandPrince.h>
+#include <Simulation.h>
+#include <iostream>
+#include <vector>
+#include <string>
+#include <algorithm>
+#include <cstdlib>
+#include <math.h>
+
+typedef gutz::Particle<gutz::vec3d>         particle_type;
+typedef particle_type::vec_type              vec_type;
+typedef gutz::P2PField<particle_type>        p2p_type;
+
+// Pull towards a heavy mass at the origin
+class Central
+{
+public:
+   typedef gutz::Particle<gutz::vec3d> particle_type;
+   
+   vec_type operator()(const particle_type& p)
+   {
+      const vec_type x = p.getPosition();
+      const double r = x.norm();
+      return x * (-6.67e-11 * 1e12 / (r * r * r));
+   }
+};
+
+// No field of its own, the pairwise one does everything
+class Free
+{
+public:
+   typedef gutz::Particle<gutz::vec3d> particle_type;
+   
+   vec_type operator()(const particle_type& p)
+   {
+      return vec_type(0.0);
+   }
+};
+
+typedef gutz::RK4<Central>                     integrator_type;
+typedef gutz::DormandPrince<Central>           adaptive_type;
+
+static const int PARTICLES = 700;
+static const int STEPS     = 5;
+
+int failedTests = 0;
+
+void testTrue(bool condition, const std::string& message)
+{
+   if(!condition)
+   {
+      std::cout << "Fail: " << message << std::endl;
+      failedTests++;
+   }
+}
+
+double uniform(void)
+{
+   return 2.0 * rand() / RAND_MAX - 1.0;
+}
+
+template<class INTEGRATOR>
+std::vector<particle_type> run(unsigned int threads)
+{
+   Central central;
+   INTEGRATOR integrator(&central);
+   p2p_type p2p;
+   gutz::Simulation<INTEGRATOR, p2p_type> sim(&integrator, &p2p);
+   sim.setThreads(threads);
+   
+   srand(7);
+   for(int i = 0; i < PARTICLES; ++i)
+   {
+      const vec_type x(uniform() + 3.0, uniform(), uniform());
+      sim.addParticle(particle_type(x, vec_type(0.0, 1.0, 0.0), 1e6 * (1.5 + uniform()), i));
+   }
+   for(int step = 0; step < STEPS; ++step)
+   {
+      sim.advanceState(step * 0.1, 0.1);
+   }
+   
+   std::vector<particle_type> particles;
+   for(size_t i = 0; i < sim.size(); ++i) particles.push_back(sim[i]);
+   return particles;
+}
+
+// The two phases one after the other, no threads
+std::vector<particle_type> reference(void)
+{
+   Central central;
+   integrator_type integrator(&central);
+   p2p_type p2p;
+   gutz::ForEachParticlePair<p2p_type> fepp;
+   
+   srand(7);
+   std::vector<particle_type> particles;
+   for(int i = 0; i < PARTICLES; ++i)
+   {
+      const vec_type x(uniform() + 3.0, uniform(), uniform());
+      particles.push_back(particle_type(x, vec_type(0.0, 1.0, 0.0), 1e6 * (1.5 + uniform()), i));
+   }
+   for(int step = 0; step < STEPS; ++step)
+   {
+      std::vector<vec_type> accelerations;
+      for(std::vector<particle_type>::iterator p = particles.begin(); p != particles.end(); ++p)
+      {
+         vec_type acceleration(0.0);
+         fepp(acceleration, p, particles.begin(), particles.end(), p2p);
+         accelerations.push_back(acceleration);
+      }
+      for(size_t i = 0; i < particles.size(); ++i)
+      {
+         particles[i].setVelocity(particles[i].getVelocity() + accelerations[i] * 0.1);
+         particles[i] = integrator(particles[i], step * 0.1, 0.1);
+      }
+   }
+   return particles;
+}
+
+void testSame(const std::vector<particle_type>& actual, const std::vector<particle_type>& expected,
+              const std::string& message)
+{
+   for(size_t i = 0; i < expected.size(); ++i)
+   {
+      if(actual[i].getPosition() != expected[i].getPosition() ||
+         actual[i].getVelocity() != expected[i].getVelocity())
+      {
+         std::cout << "Fail: " << message << " particle " << i << " expected: " << expected[i].getPosition()
+                   << ", actual: " << actual[i].getPosition() << std::endl;
+         failedTests++;
+         return;
+      }
+   }
+}
+
+// Largest relative change of the separation and of the energy over ten periods
+void orbit(double* distance, double* energy)
+{
+   const double G = 6.67e-11, m = 1e10, d = 1.0;
+   const double v = sqrt(G * m / (2.0 * d));
+   const double period = 2.0 * M_PI * (0.5 * d) / v;
+   const int    steps  = 1000;  // Per period
+   const double dt     = period / steps;
+   
+   Free free;
+   gutz::RK4<Free> integrator(&free);
+   p2p_type p2p;
+   gutz::Simulation<gutz::RK4<Free>, p2p_type> sim(&integrator, &p2p);
+   sim.setThreads(2);
+   sim.addParticle(particle_type(vec_type(0.5 * d, 0.0, 0.0), vec_type(0.0, v, 0.0), m, 0));
+   sim.addParticle(particle_type(vec_type(-0.5 * d, 0.0, 0.0), vec_type(0.0, -v, 0.0), m, 1));
+   
+   const double e0 = m * v * v - G * m * m / d;
+   *distance = 0.0;
+   *energy = 0.0;
+   for(int s = 0; s < 10 * steps; ++s)
+   {
+      sim.advanceState(s * dt, dt);
+      const double r = (sim[0].getPosition() - sim[1].getPosition()).norm();
+      const double e = 0.5 * m * (sim[0].getVelocity().norm2() + sim[1].getVelocity().norm2()) - G * m * m / r;
+      *distance = std::max(*distance, fabs(r - d) / d);
+      *energy = std::max(*energy, fabs((e - e0) / e0));
+   }
+}
+
+int main(int argc, char **argv)
+{
+   const std::vector<particle_type> expected = reference();
+   const unsigned int threads[] = { 1, 2, 3, 8 };
+   for(int t = 0; t < 4; ++t)
+   {
+      testSame(run<integrator_type>(threads[t]), expected, "threads changed the result");
+   }
+   testSame(run<adaptive_type>(4), run<adaptive_type>(1), "threads changed the DormandPrince result");
+   
+   double distance = 0.0, energy = 0.0;
+   orbit(&distance, &energy);
+   testTrue(distance < 0.01, "two body orbit drifts off its circle");
+   testTrue(energy < 0.01, "two body orbit loses its energy");
+   
+   if(failedTests > 0)
+   {
+      std::cout << "Failed test: " << failedTests << std::endl;
+      return 1;
+   }
+   
+   return 0;
+}
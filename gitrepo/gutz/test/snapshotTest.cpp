@@ -0,0 +1,237 @@
+///////////////////////////////////////////////////////////////////////////
+//              _____________  ______________________    ^    ----  _
+//             /  ________  |  |   ___   ________   /   / \  /    \ |
+//            |  |       |  |_ |  |_ |  |       /  /   /   \|       |
+//            |  |  ___  |  || |  || |  |      /  /   / --- \   --- |
+//            |  | |   \ |  || |  || |  |     /  /   /       \____/ |_____|
+//            |  | |_@  ||  || |  || |  |    /  /          
+//            |  |___/  ||  ||_|  || |  |   /  /_____________________
+//             \_______/  \______/ | |__|  /___________________________
+//                        |  |__|  |
+//                         \______/
+//                 University of New Mexico       
+//                           2010
+///////////////////////////////////////////////////////////////////////////
+
+///////////////////////////////////////////////////////////////////////////
+/// Snapshots and trajectories
+///
+/// - a snapshot reads back bit for bit, named columns included, and a
+///   float file reads into double particles
+/// - a Simulation saved and restored through a snapshot carries on as if
+///   nothing happened
+/// - every frame of a trajectory, read in any order, is the one appended,
+///   with or without the index at the end
+///////////////////////////////////////////////////////////////////////////
+
+#include <Particle.h>
+#include <ParticleArray.h>
+#include <Snapshot.h>
+#include <RK4.h>
+#include <Simulation.h>
+#include <iostream>
+#include <vector>
+#include <cstdio>
+#include <cstdlib>
+
+typedef gutz::Particle<gutz::vec3f>    particle_type;
+typedef particle_type::vec_type         vec_type;
+typedef gutz::ParticleArray<vec_type>   particle_array;
+
+static const char* SNAPSHOT   = "snapshotTest.snap";
+static const char* TRAJECTORY = "snapshotTest.traj";
+static const char* TRUNCATED  = "snapshotTest.cut";
+
+int failedTests = 0;
+
+void testTrue(bool condition, const std::string& message)
+{
+   if(!condition)
+   {
+      std::cout << "Fail: " << message << std::endl;
+      failedTests++;
+   }
+}
+
+float uniform(void)
+{
+   return 2.0f * rand() / RAND_MAX - 1.0f;
+}
+
+particle_array makeParticles(size_t n)
+{
+   particle_array particles;
+   for(size_t i = 0; i < n; ++i)
+   {
+      particle_type p(vec_type(uniform(), uniform(), uniform()), vec_type(uniform(), uniform(), uniform()),
+                      1.0f + uniform(), int(i));
+      p.setAcceleration(vec_type(uniform(), uniform(), uniform()));
+      p.setRadius(0.1f + 0.01f * uniform());
+      particles.push_back(p);
+   }
+   float* charge = particles.column("charge");
+   for(size_t i = 0; i < n; ++i) charge[i] = uniform();
+   return particles;
+}
+
+template<class A, class B>
+bool same(const A& a, const B& b)
+{
+   if(a.size() != b.size() || a.columnNames() != b.columnNames()) return false;
+   for(size_t i = 0; i < a.size(); ++i)
+   {
+      if(a.id()[i] != b.id()[i] || a.mass()[i] != b.mass()[i]) return false;
+      for(int d = 0; d < 3; ++d)
+      {
+         if(a.position(d)[i] != b.position(d)[i] || a.velocity(d)[i] != b.velocity(d)[i] ||
+            a.acceleration(d)[i] != b.acceleration(d)[i]) return false;
+      }
+      const std::vector<std::string> names = a.columnNames();
+      for(size_t c = 0; c < names.size(); ++c)
+      {
+         if(a.column(names[c])[i] != b.column(names[c])[i]) return false;
+      }
+   }
+   return true;
+}
+
+void testSnapshot(void)
+{
+   const particle_array particles = makeParticles(1000);
+   gutz::writeSnapshot(SNAPSHOT, particles, 2.5);
+   
+   particle_array back;
+   back.column("stale");
+   const double time = gutz::readSnapshot(SNAPSHOT, back);
+   testTrue(time == 2.5, "Snapshot time");
+   testTrue(same(back, particles), "Snapshot does not read back the same");
+   
+   gutz::ParticleArray<gutz::vec3d> wide;
+   gutz::readSnapshot(SNAPSHOT, wide);
+   testTrue(same(wide, particles), "Snapshot float into double");
+   
+   particle_array empty;
+   gutz::writeSnapshot(SNAPSHOT, empty);
+   gutz::readSnapshot(SNAPSHOT, back);
+   testTrue(back.size() == 0, "Empty snapshot");
+   
+   std::FILE* junk = std::fopen(SNAPSHOT, "wb");
+   std::fputs("not a snapshot, not at all, just some text long enough to look at", junk);
+   std::fclose(junk);
+   bool threw = false;
+   try
+   {
+      gutz::readSnapshot(SNAPSHOT, back);
+   }
+   catch(const gutz::Exception&)
+   {
+      threw = true;
+   }
+   testTrue(threw, "Snapshot reads junk");
+   std::remove(SNAPSHOT);
+}
+
+// Pull towards the origin
+class Central
+{
+public:
+   typedef gutz::Particle<gutz::vec3f> particle_type;
+   vec_type operator()(const particle_type& p) { return p.getPosition() * -1.0f; }
+};
+
+void testSimulation(void)
+{
+   typedef gutz::RK4<Central> integrator_type;
+   Central central;
+   integrator_type integrator(&central);
+   gutz::Simulation<integrator_type> sim(&integrator);
+   const particle_array particles = makeParticles(200);
+   for(size_t i = 0; i < particles.size(); ++i) sim.addParticle(particles.particle(i));
+   for(int step = 0; step < 3; ++step) sim.advanceState(step * 0.01f, 0.01f);
+   
+   particle_array state;
+   sim.getState(state);
+   gutz::writeSnapshot(SNAPSHOT, state, 0.03);
+   
+   gutz::Simulation<integrator_type> restored(&integrator);
+   particle_array loaded;
+   const float time = static_cast<float>(gutz::readSnapshot(SNAPSHOT, loaded));
+   restored.setState(loaded);
+   for(int step = 0; step < 3; ++step)
+   {
+      sim.advanceState(time + step * 0.01f, 0.01f);
+      restored.advanceState(time + step * 0.01f, 0.01f);
+   }
+   bool equal = restored.size() == sim.size();
+   for(size_t i = 0; equal && i < sim.size(); ++i)
+   {
+      equal = restored[i].getPosition() == sim[i].getPosition() && restored[i].getVelocity() == sim[i].getVelocity() &&
+              restored[i].getRadius() == sim[i].getRadius() && restored[i].getID() == sim[i].getID();
+   }
+   testTrue(equal, "Simulation restored from a snapshot differs");
+   std::remove(SNAPSHOT);
+}
+
+void testTrajectory(void)
+{
+   static const int FRAMES = 40;
+   std::vector<particle_array> frames;
+   {
+      gutz::TrajectoryWriter<vec_type> writer(TRAJECTORY);
+      for(int f = 0; f < FRAMES; ++f)
+      {
+         frames.push_back(makeParticles(100 + 37 * f));
+         if(f % 2) writer.append(frames.back(), f * 0.5);
+         else
+         {
+            writer.frame() = frames.back();
+            writer.append(f * 0.5);
+         }
+      }
+      testTrue(writer.frames() == FRAMES, "TrajectoryWriter frame count");
+      writer.close();
+   }
+   
+   gutz::TrajectoryReader<vec_type> reader(TRAJECTORY);
+   testTrue(reader.frames() == FRAMES, "TrajectoryReader frame count");
+   bool aligned = true, equal = true;
+   particle_array frame;
+   for(int k = 0; k < FRAMES; ++k)
+   {
+      const int f = (k * 17) % FRAMES;
+      aligned = aligned && reader.offset(f) % gutz::snapshot::ALIGN == 0;
+      equal = equal && reader.read(f, frame) == f * 0.5 && same(frame, frames[f]);
+   }
+   testTrue(aligned, "Trajectory frames not aligned");
+   testTrue(equal, "Trajectory frames differ");
+   
+   // No index and half a frame at the end, as after a crash
+   std::FILE* in = std::fopen(TRAJECTORY, "rb");
+   std::FILE* out = std::fopen(TRUNCATED, "wb");
+   const uint64_t keep = reader.offset(FRAMES - 1) + 100;
+   for(uint64_t i = 0; i < keep; ++i) std::fputc(std::fgetc(in), out);
+   std::fclose(in);
+   std::fclose(out);
+   gutz::TrajectoryReader<vec_type> cut(TRUNCATED);
+   testTrue(cut.frames() == FRAMES - 1, "Trajectory without an index");
+   testTrue(cut.read(FRAMES - 2, frame) == (FRAMES - 2) * 0.5 && same(frame, frames[FRAMES - 2]), "Trajectory without an index differs");
+   
+   std::remove(TRAJECTORY);
+   std::remove(TRUNCATED);
+}
+
+int main(int argc, char **argv)
+{
+   srand(17);
+   testSnapshot();
+   testSimulation();
+   testTrajectory();
+   
+   if(failedTests > 0)
+   {
+      std::cout << "Failed test: " << failedTests << std::endl;
+      return 1;
+   }
+   
+   return 0;
+}
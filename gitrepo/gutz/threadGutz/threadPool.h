@@ -0,0 +1,201 @@
+///////////////////////////////////////////////////////////////////////////
+//              _____________  ______________________    ^    ----  _
+//             /  ________  |  |   ___   ________   /   / \  /    \ |
+//            |  |       |  |_ |  |_ |  |       /  /   /   \|       |
+//            |  |  ___  |  || |  || |  |      /  /   / --- \   --- |
+//            |  | |   \ |  || |  || |  |     /  /   /       \____/ |_____|
+//            |  | |_@  ||  || |  || |  |    /  /          
+//            |  |___/  ||  ||_|  || |  |   /  /_____________________
+//             \_______/  \______/ | |__|  /___________________________
+//                        |  |__|  |
+//                         \______/
+//                 University of New Mexico       
+//                           2010
+///////////////////////////////////////////////////////////////////////////
+
+#ifndef _THREAD_POOL_H
+#define _THREAD_POOL_H
+
+#include <thread.h>
+#include <cstddef>
+
+namespace gutz
+{
+   ///////////////////////////////////////////////////////////////////////////
+   /// A fixed crew of threads for data parallel loops
+   ///
+   /// run(f, n) cuts [0, n) into size() contiguous chunks, the same chunks
+   /// for the same n every time, and calls f(begin, end) once per chunk. The
+   /// calling thread does the first chunk itself and run() returns once all
+   /// of them are done. The threads sleep on a condition in between, so a
+   /// pool can be kept around and used every time step.
+   ///
+   /// f is called from several threads at once and must not throw.
+   ///
+   /// \code
+   /// struct Scale
+   /// {
+   ///    std::vector<float>* v;
+   ///    void operator()(size_t begin, size_t end)
+   ///    {
+   ///       for(size_t i = begin; i < end; ++i) (*v)[i] *= 2.0f;
+   ///    }
+   /// };
+   ///
+   /// gutz::ThreadPool pool(4);
+   /// Scale scale = { &values };
+   /// pool.run(scale, values.size());
+   /// \endcode
+   ///////////////////////////////////////////////////////////////////////////
+   class ThreadPool : public gutz::Counted
+   {
+   public:
+      typedef gutz::SmartPtr<ThreadPool> pointer;
+      
+      ///////////////////////////////////////////////////////////////////////////
+      /// Constructor
+      ///
+      /// @param threads number of threads working on a run(), the caller
+      ///                included. 0 is taken as 1.
+      ThreadPool(unsigned int threads = 1)
+      : _size(threads > 0 ? threads : 1),
+        _job(0),
+        _n(0),
+        _pending(0),
+        _generation(0),
+        _die(false)
+      {
+         for(unsigned int i = 1; i < _size; ++i)
+         {
+            _threads.push_back(new gutz::Thread(Worker(this, i)));
+         }
+      }
+      
+      ///////////////////////////////////////////////////////////////////////////
+      /// Destructor, stops and joins the threads
+      virtual ~ThreadPool()
+      {
+         {
+            Lock lock(_mutex);
+            _die = true;
+            _start.wakeAll();
+         }
+         for(gutz::Thread::iterator thread = _threads.begin(); thread != _threads.end(); ++thread)
+         {
+            (*thread)->join();
+         }
+      }
+      
+      ///////////////////////////////////////////////////////////////////////////
+      /// Number of threads working on a run(), the caller included
+      unsigned int size(void) const { return _size; }
+      
+      ///////////////////////////////////////////////////////////////////////////
+      /// First index of chunk c out of chunks for a range of n
+      static size_t chunkBegin(size_t n, unsigned int c, unsigned int chunks)
+      {
+         return static_cast<size_t>(static_cast<double>(n) * c / chunks);
+      }
+      
+      ///////////////////////////////////////////////////////////////////////////
+      /// Call f(begin, end) for every chunk of [0, n), wait for all of them
+      template<class F>
+      void run(F& f, size_t n)
+      {
+         if(_size == 1 || n < _size)
+         {
+            f(0, n);
+            return;
+         }
+         
+         Job<F> job(f);
+         {
+            Lock lock(_mutex);
+            _job = &job;
+            _n = n;
+            _pending = _size - 1;
+            ++_generation;
+            _start.wakeAll();
+         }
+         
+         job(0, chunkBegin(n, 1, _size));
+         
+         Lock lock(_mutex);
+         while(_pending > 0) _done.wait(lock);
+         _job = 0;
+      }
+      
+   private:
+      ///////////////////////////////////////////////////////////////////////////
+      /// Type erased f
+      class Task
+      {
+      public:
+         virtual ~Task() {}
+         virtual void operator()(size_t begin, size_t end) = 0;
+      };
+      
+      template<class F>
+      class Job : public Task
+      {
+      public:
+         Job(F& f) : _f(f) {}
+         void operator()(size_t begin, size_t end) { _f(begin, end); }
+         
+      private:
+         F& _f;
+      };
+      
+      ///////////////////////////////////////////////////////////////////////////
+      /// Thread entry point, runs chunk |index| of every job
+      class Worker
+      {
+      public:
+         Worker(ThreadPool* pool, unsigned int index) : _pool(pool), _index(index) {}
+         void operator()(void) { _pool->work(_index); }
+         
+      private:
+         ThreadPool*  _pool;
+         unsigned int _index;
+      };
+      
+      void work(unsigned int index)
+      {
+         unsigned long seen = 0;
+         for(;;)
+         {
+            Task* job;
+            size_t n;
+            {
+               Lock lock(_mutex);
+               while(!_die && _generation == seen) _start.wait(lock);
+               if(_die) return;
+               seen = _generation;
+               job = _job;
+               n = _n;
+            }
+            
+            (*job)(chunkBegin(n, index, _size), chunkBegin(n, index + 1, _size));
+            
+            Lock lock(_mutex);
+            if(--_pending == 0) _done.wakeAll();
+         }
+      }
+      
+      ThreadPool(const ThreadPool&);
+      ThreadPool& operator=(const ThreadPool&);
+      
+      unsigned int            _size;
+      gutz::Thread::container _threads;
+      Mutex                   _mutex;      //< Guards everything below
+      Condition               _start;      //< A new job or _die
+      Condition               _done;       //< _pending reached zero
+      Task*                   _job;
+      size_t                  _n;
+      unsigned int            _pending;    //< Chunks still running on the threads
+      unsigned long           _generation; //< Bumped for every job
+      bool                    _die;
+   };
+}
+
+#endif